@@ -31,11 +31,6 @@
 #include <chrono>
 #include <thread>
 
-// SIMD Headers
-#ifdef __SSE2__
-#include <emmintrin.h>
-#endif
-
 using namespace visiontransfer;
 
 namespace GenTL {
@@ -474,17 +469,11 @@ int PhysicalDevice::copy3dDataToBufferMemory(const ImageSet& receivedSet, unsign
         // Buffer is too small, no disparity image, or pixel format doesn't match
         return -1;
     } else {
-        // GenTL does not support padding between pixels. Let's only
-        // copy the non-padding bytes
-
-        float* inputPtr = reconstruct.createPointMap(receivedSet, 0, maxDisparity);
-
-        float* outputPtr = reinterpret_cast<float*>(dst);
-#ifdef __SSE2__
-        copyPointsSSE(outputPtr, inputPtr, pixels);
-#else
-        copyPointsFallback(outputPtr, inputPtr, pixels);
-#endif
+        // GenTL does not support padding between pixels. Reconstruct
+        // the points directly into the buffer without padding.
+        reconstruct.createPointMap(receivedSet, Reconstruct3D::LAYOUT_XYZ_FLOAT, 0, maxDisparity,
+            dst, 0);
+        markInvalidPoints(reinterpret_cast<float*>(dst), pixels);
         return totalSize;
     }
 }
@@ -554,68 +543,17 @@ void PhysicalDevice::copyMultipartDataToBuffer(const ImageSet& receivedSet) {
     }
 }
 
-void PhysicalDevice::copyPointsFallback(float* dst, float* src, int numPoints) {
-    float* endPtr = src + 4*numPoints;
-    while(src < endPtr) {
-        // replace with 0.0 for inf and nan Z values (-> marked invalid)
-        if (std::isfinite(src[2])) {
-            dst[0] = src[0];
-            dst[1] = src[1];
-            dst[2] = src[2];
-        } else {
-            dst[0] = getInvalidDepthValue(); // is inlined
-            dst[1] = getInvalidDepthValue();
-            dst[2] = getInvalidDepthValue();
-        }
-        dst+=3;
-        src+=4;
-    }
-}
-
-#ifdef __SSE2__
-void PhysicalDevice::copyPointsSSE(float* dst, float* src, int numPoints) {
-    float* endPtr = src + 4*numPoints;
-
-    __m128 point;
-    // replace with special value for inf and nan Z values (-> marked invalid)
-    const __m128 invalidPoint = _mm_setr_ps(getInvalidDepthValue(), getInvalidDepthValue(), getInvalidDepthValue(), getInvalidDepthValue());
-    while(src < endPtr) {
-        // 1x aligned copy
-        if (std::isfinite(src[2])) {
-            point  = _mm_load_ps(src);
-            _mm_store_ps(dst, point);
-        } else {
-            _mm_store_ps(dst, invalidPoint);
-        }
-        dst+=3; src+=4;
-
-        // 3x unaligned copy
-        if (std::isfinite(src[2])) {
-            point  = _mm_load_ps(src);
-            _mm_storeu_ps(dst, point);
-        } else {
-            _mm_storeu_ps(dst, invalidPoint);
+void PhysicalDevice::markInvalidPoints(float* points, int numPoints) {
+    float* endPtr = points + 3*numPoints;
+    for(; points < endPtr; points += 3) {
+        // replace with special value for inf and nan Z values (-> marked invalid)
+        if (!std::isfinite(points[2])) {
+            points[0] = getInvalidDepthValue(); // is inlined
+            points[1] = getInvalidDepthValue();
+            points[2] = getInvalidDepthValue();
         }
-        dst+=3; src+=4;
-
-        if (std::isfinite(src[2])) {
-            point  = _mm_load_ps(src);
-            _mm_storeu_ps(dst, point);
-        } else {
-            _mm_storeu_ps(dst, invalidPoint);
-        }
-        dst+=3; src+=4;
-
-        if (std::isfinite(src[2])) {
-            point  = _mm_load_ps(src);
-            _mm_storeu_ps(dst, point);
-        } else {
-            _mm_storeu_ps(dst, invalidPoint);
-        }
-        dst+=3; src+=4;
     }
 }
-#endif
 
 bool PhysicalDevice::inUse() {
     for(int i=0; i<NUM_LOGICAL_DEVICES; i++) {
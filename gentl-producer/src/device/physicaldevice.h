@@ -159,8 +159,7 @@ private:
     void copyRawDataToBuffer(const visiontransfer::ImageSet& receivedSet);
     void copy3dDataToBuffer(const visiontransfer::ImageSet& receivedSet);
     void copyMultipartDataToBuffer(const visiontransfer::ImageSet& receivedSet);
-    void copyPointsFallback(float* dst, float* src, int numPoints);
-    void copyPointsSSE(float* dst, float* src, int numPoints);
+    void markInvalidPoints(float* points, int numPoints);
     void setTestData(visiontransfer::ImageSet& receivedSet);
     int copyImageToBufferMemory(const visiontransfer::ImageSet& receivedSet, int id, unsigned char* dst, int dstSize);
     int copy3dDataToBufferMemory(const visiontransfer::ImageSet& receivedSet, unsigned char* dst, int dstSize);
@@ -0,0 +1,66 @@
+/*******************************************************************************
+ * Copyright (c) 2023 Allied Vision Technologies GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *******************************************************************************/
+
+
+#include <visiontransfer/deviceenumeration.h>
+#include <visiontransfer/multidevicetransfer.h>
+#include <visiontransfer/imageset.h>
+#include <iostream>
+#include <exception>
+#include <vector>
+
+using namespace visiontransfer;
+
+int main() {
+    try {
+        // Search for Nerian stereo devices
+        DeviceEnumeration deviceEnum;
+        DeviceEnumeration::DeviceList devices =
+            deviceEnum.discoverDevices();
+        if(devices.size() < 2) {
+            std::cout << "At least two devices are required!" << std::endl;
+            return -1;
+        }
+
+        // Receive from all discovered devices. The devices need to be
+        // triggered synchronously, or their clocks need to be synchronized.
+        MultiDeviceTransfer transfer;
+        for(unsigned int i=0; i<devices.size(); i++) {
+            std::cout << "Device " << transfer.addDevice(devices[i]) << ": "
+                << devices[i].toString() << std::endl;
+        }
+        transfer.setSyncTolerance(2000);
+
+        std::vector<ImageSet> bundle;
+        for(int n=0; n<100; n++) {
+            if(!transfer.collectBundle(bundle, 1.0)) {
+                std::cout << "No bundle received!" << std::endl;
+                continue;
+            }
+
+            int sec = 0, usec = 0;
+            bundle[0].getTimestamp(sec, usec);
+            std::cout << "Bundle at " << sec << "." << usec << " s:";
+            for(int i=0; i<transfer.getNumDevices(); i++) {
+                std::cout << " [skew " << transfer.getSkew(i) << " us, dropped "
+                    << transfer.getNumDroppedFrames(i) << "]";
+            }
+            std::cout << std::endl;
+        }
+    } catch(const std::exception& ex) {
+        std::cerr << "Exception occurred: " << ex.what() << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,72 @@
+/*******************************************************************************
+ * Copyright (c) 2024 Allied Vision Technologies GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *******************************************************************************/
+
+
+#include <visiontransfer/recordingplayer.h>
+#include <iostream>
+#include <exception>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+#   include <windows.h>
+#else
+#   include <unistd.h>
+#endif
+
+using namespace std;
+using namespace visiontransfer;
+
+int main(int argc, char** argv) {
+    if(argc < 2) {
+        cerr << "Usage: " << argv[0] << " RECORDING [SPEED] [tcp]" << endl << endl
+            << "Serves a recording like a live device. A speed of 0 sends" << endl
+            << "all frames as fast as possible." << endl;
+        return 1;
+    }
+
+    try {
+        ImageProtocol::ProtocolType protType = ImageProtocol::PROTOCOL_UDP;
+        if(argc > 3 && strcmp(argv[3], "tcp") == 0) {
+            protType = ImageProtocol::PROTOCOL_TCP;
+        }
+
+        // Create a player that acts as server on the default port
+        RecordingPlayer player(argv[1], "0.0.0.0", "7681", protType);
+        if(argc > 2) {
+            player.setPlaybackSpeed(atof(argv[2]));
+        }
+        player.setLooping(true);
+
+        cout << "Serving " << player.getNumFrames() << " frames. Waiting for client..." << endl;
+        player.start();
+
+        while(player.isPlaying()) {
+#ifdef _WIN32
+            Sleep(1000);
+#else
+            sleep(1);
+#endif
+            // Report the throughput of the playback
+            cout << "Sent: " << player.getNumFramesSent() << " frames, "
+                << player.getFrameRate() << " fps, "
+                << player.getDataRate() / 1048576.0 << " MB/s, late: "
+                << player.getNumLateFrames() << endl;
+        }
+    } catch(const std::exception& ex) {
+        std::cerr << "Exception occurred: " << ex.what() << std::endl;
+    }
+
+    return 0;
+}
@@ -207,6 +207,10 @@ if __name__=='__main__':
             'visiontransfer/sensordata.h',
             'visiontransfer/datachannelservice.h',
             'visiontransfer/reconstruct3d.h',
+            'visiontransfer/temporalfilter.h',
+            'visiontransfer/recording.h',
+            'visiontransfer/recordingplayer.h',
+            'visiontransfer/multidevicetransfer.h',
             ]:
             d.generate(basedir, filename)
 
@@ -0,0 +1,118 @@
+#include <visiontransfer/asynctransfer.h>
+#include <visiontransfer/framepool.h>
+#include <gtest/gtest.h>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include "test-common.h"
+
+using namespace std;
+using namespace visiontransfer;
+
+/*
+ * Transfers image sets through a local TCP connection
+ */
+
+class AsyncTransferFixture: public ::testing::Test {
+public:
+    void connect(const char* port, int queueDepth, AsyncTransfer::ReceiveQueuePolicy policy) {
+        server.reset(new AsyncTransfer(NULL, port, ImageProtocol::PROTOCOL_TCP, true));
+        client.reset(new AsyncTransfer("127.0.0.1", port, ImageProtocol::PROTOCOL_TCP));
+        client->setReceiveQueueDepth(queueDepth, policy);
+        EXPECT_EQ(queueDepth, client->getReceiveQueueDepth());
+        EXPECT_EQ(policy, client->getReceiveQueuePolicy());
+
+        for(int i=0; i<1000 && !server->tryAccept(); i++) {
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+        ASSERT_TRUE(server->isConnected());
+    }
+
+    virtual void TearDown() {
+        client.reset();
+        server.reset();
+    }
+
+protected:
+    unique_ptr<AsyncTransfer> server;
+    unique_ptr<AsyncTransfer> client;
+    FramePool pool;
+
+    void send(int seqNum) {
+        server->sendImageSetAsync(createMonoSet(pool, 320, 240, seqNum));
+    }
+
+    // Returns the sequence number of the next received image set, or -1 on timeout
+    int collect(double timeout = 2.0) {
+        ImageSet imageSet;
+        if(!client->collectReceivedImageSet(imageSet, timeout)) {
+            return -1;
+        }
+        EXPECT_TRUE(hasMonoPattern(imageSet, imageSet.getSequenceNumber()));
+        return static_cast<int>(imageSet.getSequenceNumber());
+    }
+
+    // Waits until the client has dropped the given number of frames
+    void waitForDroppedFrames(int numDropped) {
+        for(int i=0; i<2000 && client->getNumDroppedFrames() < numDropped; i++) {
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+        // Give the receive thread a chance to exceed the expected value
+        this_thread::sleep_for(chrono::milliseconds(50));
+        EXPECT_EQ(numDropped, client->getNumDroppedFrames());
+    }
+};
+
+TEST_F(AsyncTransferFixture, KeepNewestDropsOldestQueued) {
+    connect("17781", 3, AsyncTransfer::QUEUE_KEEP_NEWEST);
+
+    send(0);
+    ASSERT_EQ(0, collect());
+    EXPECT_EQ(0, client->getNumDroppedFrames());
+
+    // Ten image sets arrive while only three fit into the queue
+    for(int i=1; i<=10; i++) {
+        send(i);
+    }
+    waitForDroppedFrames(7);
+
+    for(int i=8; i<=10; i++) {
+        EXPECT_EQ(i, collect());
+    }
+    EXPECT_EQ(-1, collect(0.1));
+    EXPECT_EQ(7, client->getNumDroppedFrames());
+}
+
+TEST_F(AsyncTransferFixture, KeepOldestDropsNewImageSets) {
+    connect("17782", 4, AsyncTransfer::QUEUE_KEEP_OLDEST);
+
+    send(0);
+    ASSERT_EQ(0, collect());
+
+    for(int i=1; i<=8; i++) {
+        send(i);
+    }
+    waitForDroppedFrames(4);
+
+    for(int i=1; i<=4; i++) {
+        EXPECT_EQ(i, collect());
+    }
+    EXPECT_EQ(-1, collect(0.1));
+}
+
+TEST_F(AsyncTransferFixture, BlockingQueueDropsNothing) {
+    connect("17783", 2, AsyncTransfer::QUEUE_BLOCK);
+
+    thread sender([this]{
+        for(int i=0; i<20; i++) {
+            send(i);
+        }
+    });
+
+    this_thread::sleep_for(chrono::milliseconds(100));
+    for(int i=0; i<20; i++) {
+        EXPECT_EQ(i, collect());
+    }
+    sender.join();
+    EXPECT_EQ(0, client->getNumDroppedFrames());
+}
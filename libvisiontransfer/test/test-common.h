@@ -0,0 +1,83 @@
+#ifndef TEST_COMMON_H
+#define TEST_COMMON_H
+
+#include <visiontransfer/imageset.h>
+#include <visiontransfer/framepool.h>
+#include <vector>
+#include <cstdlib>
+
+/*
+ * Helpers for creating image sets with synthetic data
+ */
+
+// Creates an image set that references the given 12-bit disparity map
+static inline visiontransfer::ImageSet createDisparitySet(std::vector<unsigned short>& disp,
+        int width, int height, const float* q) {
+    using visiontransfer::ImageSet;
+
+    ImageSet imageSet;
+    imageSet.setNumberOfImages(1);
+    imageSet.setIndexOf(ImageSet::IMAGE_LEFT, -1);
+    imageSet.setIndexOf(ImageSet::IMAGE_RIGHT, -1);
+    imageSet.setIndexOf(ImageSet::IMAGE_DISPARITY, 0);
+    imageSet.setWidth(width);
+    imageSet.setHeight(height);
+    imageSet.setPixelFormat(0, ImageSet::FORMAT_12_BIT_MONO);
+    imageSet.setRowStride(0, 2*width);
+    imageSet.setPixelData(0, reinterpret_cast<unsigned char*>(&disp[0]));
+    imageSet.setQMatrix(q);
+    imageSet.setSubpixelFactor(16);
+    return imageSet;
+}
+
+// Fills a disparity map with random values, including 0 and invalid (0xFFF) pixels
+static inline std::vector<unsigned short> createRandomDisparities(int width, int height, unsigned int seed) {
+    std::vector<unsigned short> disp(width*height);
+    srand(seed);
+    for(int i=0; i<width*height; i++) {
+        int r = rand();
+        disp[i] = (r % 5 == 0) ? 0xFFF : (r % 7 == 0 ? 0 : static_cast<unsigned short>(rand() % 0xFFF));
+    }
+    return disp;
+}
+
+// Creates an image set with one 8-bit image in pooled memory, which holds a test pattern
+static inline visiontransfer::ImageSet createMonoSet(visiontransfer::FramePool& pool,
+        int width, int height, int seqNum) {
+    using visiontransfer::ImageSet;
+
+    ImageSet layout;
+    layout.setNumberOfImages(1);
+    layout.setIndexOf(ImageSet::IMAGE_LEFT, 0);
+    layout.setIndexOf(ImageSet::IMAGE_RIGHT, -1);
+    layout.setWidth(width);
+    layout.setHeight(height);
+    layout.setPixelFormat(0, ImageSet::FORMAT_8_BIT_MONO);
+    layout.setRowStride(0, width);
+    layout.setSequenceNumber(seqNum);
+
+    ImageSet imageSet;
+    pool.allocate(layout, imageSet);
+    for(int y=0; y<height; y++) {
+        unsigned char* row = imageSet.getPixelData(0) + y*imageSet.getRowStride(0);
+        for(int x=0; x<width; x++) {
+            row[x] = static_cast<unsigned char>(y*width + x + seqNum);
+        }
+    }
+    return imageSet;
+}
+
+// Checks whether an image set contains the test pattern of createMonoSet()
+static inline bool hasMonoPattern(const visiontransfer::ImageSet& imageSet, int seqNum) {
+    for(int y=0; y<imageSet.getHeight(); y++) {
+        const unsigned char* row = imageSet.getPixelData(0) + y*imageSet.getRowStride(0);
+        for(int x=0; x<imageSet.getWidth(); x++) {
+            if(row[x] != static_cast<unsigned char>(y*imageSet.getWidth() + x + seqNum)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+#endif
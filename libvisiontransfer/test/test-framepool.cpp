@@ -0,0 +1,80 @@
+#include <visiontransfer/framepool.h>
+#include <gtest/gtest.h>
+#include <vector>
+#include <cstring>
+#include <stdint.h>
+#include "test-common.h"
+
+using namespace std;
+using namespace visiontransfer;
+
+TEST(FramePool, CopiesAreRecycled) {
+    FramePool pool;
+    ImageSet src = createMonoSet(pool, 64, 8, 3);
+    float q[16];
+    for(int i=0; i<16; i++) {
+        q[i] = static_cast<float>(i);
+    }
+    src.setQMatrix(q);
+    EXPECT_EQ(1, pool.getNumAllocatedFrames());
+
+    ImageSet copy;
+    src.copyTo(copy, pool);
+    src.copyTo(copy, pool);
+    int numAllocated = pool.getNumAllocatedFrames();
+
+    for(int i=0; i<100; i++) {
+        src.copyTo(copy, pool);
+        ASSERT_NE(src.getPixelData(0), copy.getPixelData(0));
+        ASSERT_TRUE(hasMonoPattern(copy, 3));
+        ASSERT_EQ(15.0f, copy.getQMatrix()[15]);
+    }
+
+    // The previous copy is only released once the new one has been
+    // allocated, hence no more than three buffers are required
+    EXPECT_EQ(numAllocated, pool.getNumAllocatedFrames());
+    EXPECT_LE(numAllocated, 3);
+}
+
+TEST(FramePool, BuffersAreAligned) {
+    FramePool pool;
+    ImageSet imageSet = createMonoSet(pool, 33, 5, 0);
+    EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(imageSet.getPixelData(0)) % 32);
+    EXPECT_EQ(33, imageSet.getRowStride(0));
+}
+
+TEST(FramePool, FreeFramesAreLimited) {
+    FramePool pool(2);
+    {
+        vector<ImageSet> frames;
+        for(int i=0; i<5; i++) {
+            frames.push_back(createMonoSet(pool, 16, 16, i));
+        }
+        EXPECT_EQ(5, pool.getNumAllocatedFrames());
+        EXPECT_EQ(0, pool.getNumFreeFrames());
+    }
+
+    // Only two of the released buffers are kept
+    EXPECT_EQ(2, pool.getNumFreeFrames());
+
+    // A different geometry requires new buffers
+    ImageSet other = createMonoSet(pool, 8, 8, 0);
+    EXPECT_EQ(6, pool.getNumAllocatedFrames());
+    EXPECT_EQ(2, pool.getNumFreeFrames());
+
+    ImageSet reused = createMonoSet(pool, 16, 16, 0);
+    EXPECT_EQ(6, pool.getNumAllocatedFrames());
+    EXPECT_EQ(1, pool.getNumFreeFrames());
+
+    pool.clear();
+    EXPECT_EQ(0, pool.getNumFreeFrames());
+}
+
+TEST(FramePool, ImageSetsOutlivePool) {
+    ImageSet imageSet;
+    {
+        FramePool pool;
+        imageSet = createMonoSet(pool, 16, 16, 7);
+    }
+    EXPECT_TRUE(hasMonoPattern(imageSet, 7));
+}
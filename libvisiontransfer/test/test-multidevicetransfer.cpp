@@ -0,0 +1,160 @@
+#include <visiontransfer/multidevicetransfer.h>
+#include <visiontransfer/asynctransfer.h>
+#include <visiontransfer/framepool.h>
+#include <visiontransfer/exceptions.h>
+#include <gtest/gtest.h>
+#include <memory>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include "test-common.h"
+
+using namespace std;
+using namespace visiontransfer;
+
+/*
+ * Three local TCP servers act as devices, whose clocks are offset
+ * against each other
+ */
+
+const int NUM_DEVICES = 3;
+
+class MultiDeviceFixture: public ::testing::Test {
+public:
+    virtual void SetUp() {
+        const char* ports[NUM_DEVICES] = {"17791", "17792", "17793"};
+
+        transfer.reset(new MultiDeviceTransfer(16*1048576, 1472, 0));
+        transfer->setSyncTolerance(2000);
+        transfer->setBundleQueueDepth(64);
+
+        for(int i=0; i<NUM_DEVICES; i++) {
+            servers[i].reset(new AsyncTransfer(NULL, ports[i], ImageProtocol::PROTOCOL_TCP, true));
+            ASSERT_EQ(i, transfer->addDevice("127.0.0.1", ports[i], ImageProtocol::PROTOCOL_TCP));
+        }
+        EXPECT_EQ(NUM_DEVICES, transfer->getNumDevices());
+
+        for(int i=0; i<NUM_DEVICES; i++) {
+            for(int j=0; j<1000 && !servers[i]->tryAccept(); j++) {
+                this_thread::sleep_for(chrono::milliseconds(1));
+            }
+            ASSERT_TRUE(servers[i]->isConnected());
+        }
+
+        // Starts reception
+        vector<ImageSet> bundle;
+        EXPECT_FALSE(transfer->collectBundle(bundle, 0.1));
+    }
+
+    virtual void TearDown() {
+        transfer.reset();
+        for(int i=0; i<NUM_DEVICES; i++) {
+            servers[i].reset();
+        }
+    }
+
+protected:
+    unique_ptr<AsyncTransfer> servers[NUM_DEVICES];
+    unique_ptr<MultiDeviceTransfer> transfer;
+    FramePool pool;
+
+    void send(int device, int frame, int skewMicrosec) {
+        ImageSet imageSet = createMonoSet(pool, 160, 120, frame + device);
+        imageSet.setSequenceNumber(frame);
+        int time = frame*33333 + skewMicrosec;
+        imageSet.setTimestamp(100 + time / 1000000, time % 1000000);
+        servers[device]->sendImageSetAsync(imageSet);
+    }
+};
+
+TEST_F(MultiDeviceFixture, BundlesMatchSkewedDevices) {
+    const int numFrames = 30;
+    const int skews[NUM_DEVICES] = {0, 1200, -700};
+
+    thread sender([&]{
+        for(int f=1; f<=numFrames; f++) {
+            for(int d=0; d<NUM_DEVICES; d++) {
+                if(d == 2 && f == 10) {
+                    // Frame lost by device 2
+                    continue;
+                }
+                // Frame 20 of device 1 exceeds the sync tolerance
+                send(d, f, (d == 1 && f == 20) ? 8000 : skews[d]);
+            }
+            this_thread::sleep_for(chrono::milliseconds(20));
+        }
+    });
+
+    vector<ImageSet> bundle;
+    vector<int> received;
+    while(transfer->collectBundle(bundle, 1.0)) {
+        ASSERT_EQ(NUM_DEVICES, static_cast<int>(bundle.size()));
+        int frame = static_cast<int>(bundle[0].getSequenceNumber());
+        for(int d=0; d<NUM_DEVICES; d++) {
+            EXPECT_EQ(frame, static_cast<int>(bundle[d].getSequenceNumber()));
+            EXPECT_TRUE(hasMonoPattern(bundle[d], frame + d));
+        }
+        received.push_back(frame);
+    }
+    sender.join();
+
+    vector<int> expected;
+    for(int f=1; f<=numFrames; f++) {
+        if(f != 10 && f != 20) {
+            expected.push_back(f);
+        }
+    }
+    EXPECT_EQ(expected, received);
+
+    EXPECT_EQ(0, transfer->getSkew(0));
+    EXPECT_EQ(1200, transfer->getSkew(1));
+    EXPECT_EQ(-700, transfer->getSkew(2));
+    EXPECT_EQ(1200, transfer->getMaxSkew(1));
+    EXPECT_EQ(700, transfer->getMaxSkew(2));
+
+    // Each device drops its frames of the two incomplete bundles, except
+    // for device 2, which has not received frame 10
+    EXPECT_EQ(2, transfer->getNumDroppedFrames(0));
+    EXPECT_EQ(2, transfer->getNumDroppedFrames(1));
+    EXPECT_EQ(1, transfer->getNumDroppedFrames(2));
+
+    for(int d=0; d<NUM_DEVICES; d++) {
+        EXPECT_TRUE(transfer->isConnected(d));
+    }
+}
+
+TEST_F(MultiDeviceFixture, BundlesNeverMixFrames) {
+    // Device 0 has an unmatched older frame and is already one frame ahead
+    send(0, 9, 0);
+    send(0, 11, 0);
+    this_thread::sleep_for(chrono::milliseconds(100));
+    send(1, 10, 0);
+    send(2, 10, 0);
+    this_thread::sleep_for(chrono::milliseconds(100));
+
+    for(int d=0; d<NUM_DEVICES; d++) {
+        send(d, 12, 0);
+    }
+
+    vector<ImageSet> bundle;
+    ASSERT_TRUE(transfer->collectBundle(bundle, 2.0));
+    for(int d=0; d<NUM_DEVICES; d++) {
+        EXPECT_EQ(12u, bundle[d].getSequenceNumber());
+    }
+    EXPECT_FALSE(transfer->collectBundle(bundle, 0.1));
+
+    EXPECT_EQ(2, transfer->getNumDroppedFrames(0));
+    EXPECT_EQ(1, transfer->getNumDroppedFrames(1));
+    EXPECT_EQ(1, transfer->getNumDroppedFrames(2));
+}
+
+TEST_F(MultiDeviceFixture, ClosedConnectionThrowsWithoutReconnect) {
+    for(int d=0; d<NUM_DEVICES; d++) {
+        send(d, 1, 0);
+    }
+    vector<ImageSet> bundle;
+    ASSERT_TRUE(transfer->collectBundle(bundle, 2.0));
+
+    servers[1].reset();
+    EXPECT_THROW(transfer->collectBundle(bundle, 2.0), TransferException);
+}
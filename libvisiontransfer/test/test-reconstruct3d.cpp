@@ -0,0 +1,272 @@
+#include <visiontransfer/reconstruct3d.h>
+#include <gtest/gtest.h>
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include "test-common.h"
+
+using namespace std;
+using namespace visiontransfer;
+
+/*
+ * The vectorized reconstruction kernels are compared against a scalar
+ * reference implementation. Odd image widths ensure that the scalar
+ * remainder loops are covered as well.
+ */
+
+class Reconstruct3DFixture: public ::testing::TestWithParam<int> {
+public:
+    virtual void SetUp() {
+        width = GetParam();
+        height = 13;
+        disp = createRandomDisparities(width, height, width);
+
+        const float defaultQ[16] = {1, 0, 0, -width/2.0f, 0, 1, 0, -height/2.0f,
+            0, 0, 0, 800, 0, 0, 8, 0.1f};
+        memcpy(q, defaultQ, sizeof(q));
+        imageSet = createDisparitySet(disp, width, height, q);
+        recon.setNumThreads(3);
+    }
+
+protected:
+    int width, height;
+    float q[16];
+    vector<unsigned short> disp;
+    ImageSet imageSet;
+    Reconstruct3D recon;
+
+    // Scalar reference for the 3D location of one pixel
+    void referencePoint(int x, int y, unsigned short d, unsigned short minDisparity,
+            unsigned short maxDisparity, float* point) {
+        if(d >= maxDisparity) {
+            d = 0;
+        }
+        d = max(d, minDisparity);
+        if(d == 0) {
+            point[0] = point[1] = point[2] = numeric_limits<float>::infinity();
+            return;
+        }
+
+        double dd = d / 16.0;
+        double w = q[12]*x + q[13]*y + q[14]*dd + q[15];
+        point[0] = static_cast<float>((q[0]*x + q[1]*y + q[2]*dd + q[3]) / w);
+        point[1] = static_cast<float>((q[4]*x + q[5]*y + q[6]*dd + q[7]) / w);
+        point[2] = static_cast<float>((q[8]*x + q[9]*y + q[10]*dd + q[11]) / w);
+    }
+
+    vector<float> referencePointMap(unsigned short minDisparity, unsigned short maxDisparity) {
+        vector<float> ref(3*width*height);
+        for(int y=0; y<height; y++) {
+            for(int x=0; x<width; x++) {
+                referencePoint(x, y, disp[y*width + x], minDisparity, maxDisparity, &ref[3*(y*width + x)]);
+            }
+        }
+        return ref;
+    }
+
+    // Scalar reference for createPointMap(const ImageSet&, ...) and the float
+    // createZMap(), returning false for points that are set to NaN
+    bool referenceLegacyPoint(int x, int y, unsigned short d, unsigned short minDisparity,
+            unsigned short maxDisparity, float* point) {
+        if(d >= maxDisparity) {
+            if(minDisparity == 0) {
+                return false;
+            }
+            d = minDisparity;
+        }
+        d = max(d, minDisparity);
+
+        double dd = d / 16.0;
+        double w = q[12]*x + q[13]*y + q[14]*dd + q[15];
+        point[0] = static_cast<float>((q[0]*x + q[1]*y + q[2]*dd + q[3]) / w);
+        point[1] = static_cast<float>((q[4]*x + q[5]*y + q[6]*dd + q[7]) / w);
+        point[2] = static_cast<float>((q[8]*x + q[9]*y + q[10]*dd + q[11]) / w);
+        return true;
+    }
+
+    static float halfToFloat(unsigned short h) {
+        int exponent = (h >> 10) & 0x1F;
+        int mantissa = h & 0x3FF;
+        float value;
+        if(exponent == 0) {
+            value = ldexp(static_cast<float>(mantissa), -24);
+        } else if(exponent == 31) {
+            value = mantissa != 0 ? numeric_limits<float>::quiet_NaN() : numeric_limits<float>::infinity();
+        } else {
+            value = ldexp(static_cast<float>(mantissa | 0x400), exponent - 25);
+        }
+        return (h & 0x8000) ? -value : value;
+    }
+
+    static void expectNear(float expected, float actual, float relTolerance) {
+        if(isinf(expected)) {
+            EXPECT_TRUE(isinf(actual)) << "expected " << expected << ", got " << actual;
+        } else {
+            EXPECT_NEAR(expected, actual, relTolerance * max(1.0f, fabs(expected)));
+        }
+    }
+};
+
+TEST_P(Reconstruct3DFixture, PointMapLayoutsMatchScalarReference) {
+    for(unsigned short minDisparity = 0; minDisparity <= 5; minDisparity += 5) {
+        vector<float> ref = referencePointMap(minDisparity, 0xFFF);
+        int numPoints = width*height;
+
+        vector<float> xyz(3*numPoints);
+        memcpy(&xyz[0], recon.createPointMap(imageSet, Reconstruct3D::LAYOUT_XYZ_FLOAT, minDisparity),
+            xyz.size()*sizeof(float));
+        for(int i=0; i<3*numPoints; i++) {
+            expectNear(ref[i], xyz[i], 1e-5f);
+        }
+
+        // The original XYZW layout keeps its own handling of invalid
+        // disparities, which are replaced by the minimum disparity
+        const float* xyzw = recon.createPointMap(imageSet, minDisparity);
+        for(int y=0; y<height; y++) {
+            for(int x=0; x<width; x++) {
+                int i = y*width + x;
+                float expected[3];
+                if(!referenceLegacyPoint(x, y, disp[i], minDisparity, 0xFFF, expected)) {
+                    EXPECT_TRUE(isnan(xyzw[4*i + 2])) << "pixel " << i;
+                    continue;
+                }
+                for(int c=0; c<3; c++) {
+                    expectNear(expected[c], xyzw[4*i + c], 1e-5f);
+                }
+            }
+        }
+
+        // The other float layouts must be exact rearrangements of the same values
+        const float* planar = reinterpret_cast<const float*>(
+            recon.createPointMap(imageSet, Reconstruct3D::LAYOUT_PLANAR_FLOAT, minDisparity));
+        for(int i=0; i<numPoints; i++) {
+            for(int c=0; c<3; c++) {
+                ASSERT_EQ(0, memcmp(&xyz[3*i + c], &planar[c*numPoints + i], sizeof(float))) << "pixel " << i;
+            }
+        }
+
+        const unsigned short* half = reinterpret_cast<const unsigned short*>(
+            recon.createPointMap(imageSet, Reconstruct3D::LAYOUT_XYZ_HALF_FLOAT, minDisparity));
+        for(int i=0; i<3*numPoints; i++) {
+            if(fabs(xyz[i]) > 65504.0f) {
+                EXPECT_TRUE(isinf(halfToFloat(half[i])));
+            } else {
+                EXPECT_NEAR(xyz[i], halfToFloat(half[i]), fabs(xyz[i]) / 1024.0f + 1e-7f) << "element " << i;
+            }
+        }
+
+        const short* mm = reinterpret_cast<const short*>(
+            recon.createPointMap(imageSet, Reconstruct3D::LAYOUT_XYZ_INT16_MM, minDisparity));
+        for(int i=0; i<numPoints; i++) {
+            bool inRange = true;
+            for(int c=0; c<3; c++) {
+                inRange = inRange && fabs(ref[3*i + c] * 1000.0) <= 32767.0;
+            }
+            for(int c=0; c<3; c++) {
+                double expected = inRange ? round(ref[3*i + c] * 1000.0) : 0.0;
+                EXPECT_NEAR(expected, mm[3*i + c], 1.0) << "pixel " << i;
+            }
+        }
+    }
+}
+
+TEST_P(Reconstruct3DFixture, CallerBufferMatchesInternalPointMap) {
+    int bytesPerPoint = Reconstruct3D::getBytesPerPoint(Reconstruct3D::LAYOUT_XYZ_FLOAT);
+    int stride = width*bytesPerPoint + 40;
+    vector<unsigned char> dst(height*stride, 0xAB);
+    recon.createPointMap(imageSet, Reconstruct3D::LAYOUT_XYZ_FLOAT, 0, 0xFFF, &dst[0], stride);
+
+    const unsigned char* internal = recon.createPointMap(imageSet, Reconstruct3D::LAYOUT_XYZ_FLOAT, 0);
+    for(int y=0; y<height; y++) {
+        ASSERT_EQ(0, memcmp(&dst[y*stride], &internal[y*width*bytesPerPoint], width*bytesPerPoint)) << "row " << y;
+        // The row padding must not be touched
+        for(int i=width*bytesPerPoint; i<stride; i++) {
+            ASSERT_EQ(0xAB, dst[y*stride + i]);
+        }
+    }
+}
+
+TEST_P(Reconstruct3DFixture, ZMapMatchesScalarReference) {
+    // A Q-matrix with perspective terms that depend on the x-coordinate
+    q[8] = 0.01f;
+    q[12] = 0.0001f;
+    imageSet.setQMatrix(q);
+
+    for(unsigned short minDisparity = 0; minDisparity <= 16; minDisparity += 16) {
+        const float* z = recon.createZMap(imageSet, minDisparity, 0xFFF);
+        for(int y=0; y<height; y++) {
+            for(int x=0; x<width; x++) {
+                float expected[3];
+                float actual = z[y*width + x];
+                if(referenceLegacyPoint(x, y, disp[y*width + x], minDisparity, 0xFFF, expected)) {
+                    expectNear(expected[2], actual, 1e-5f);
+                } else {
+                    EXPECT_TRUE(isnan(actual)) << "pixel " << x << ", " << y;
+                }
+            }
+        }
+    }
+
+    vector<float> zFloat(width*height);
+    memcpy(&zFloat[0], recon.createZMap(imageSet, Reconstruct3D::ZMAP_FLOAT, -1.0f), zFloat.size()*sizeof(float));
+    vector<unsigned short> zMm(width*height);
+    memcpy(&zMm[0], recon.createZMap(imageSet, Reconstruct3D::ZMAP_UINT16_MM, 0), zMm.size()*sizeof(unsigned short));
+
+    // Half-float map with padded rows in a caller-provided buffer
+    int halfStride = width + 8;
+    vector<unsigned short> zHalf(height*halfStride);
+    recon.createZMap(imageSet, Reconstruct3D::ZMAP_HALF_FLOAT, 0, 1, 0xFFF,
+        reinterpret_cast<unsigned char*>(&zHalf[0]), halfStride*sizeof(unsigned short));
+
+    for(int y=0; y<height; y++) {
+        for(int x=0; x<width; x++) {
+            int i = y*width + x;
+            unsigned short d = disp[i];
+            bool valid = d >= 1 && d < 0xFFF;
+            float expected[3];
+            referencePoint(x, y, d, 1, 0xFFF, expected);
+
+            if(valid) {
+                expectNear(expected[2], zFloat[i], 1e-5f);
+                EXPECT_NEAR(expected[2], halfToFloat(zHalf[y*halfStride + x]), fabs(expected[2]) / 1024.0f);
+            } else {
+                EXPECT_EQ(-1.0f, zFloat[i]);
+                EXPECT_EQ(0, zHalf[y*halfStride + x]);
+            }
+
+            double mm = expected[2] * 1000.0;
+            if(valid && mm >= 0 && mm <= 65535.0) {
+                EXPECT_NEAR(round(mm), zMm[i], 1.0) << "pixel " << x << ", " << y;
+            } else {
+                EXPECT_EQ(0, zMm[i]) << "pixel " << x << ", " << y;
+            }
+        }
+    }
+}
+
+TEST_P(Reconstruct3DFixture, CompactCloudContainsAllValidPoints) {
+    const float maxZ = 50.0f;
+    vector<float> full(3*width*height);
+    memcpy(&full[0], recon.createPointMap(imageSet, Reconstruct3D::LAYOUT_XYZ_FLOAT, 0),
+        full.size()*sizeof(float));
+
+    int numPoints = 0;
+    const int* indices = NULL;
+    const float* points = recon.createCompactPointCloud(imageSet, numPoints, 32, 0xFFF, maxZ, &indices);
+
+    int k = 0;
+    for(int i=0; i<width*height; i++) {
+        float z = full[3*i + 2];
+        if(disp[i] < 32 || disp[i] >= 0xFFF || !(z > 0 && z <= maxZ)) {
+            continue;
+        }
+        ASSERT_LT(k, numPoints);
+        ASSERT_EQ(i, indices[k]);
+        ASSERT_EQ(0, memcmp(&points[3*k], &full[3*i], 3*sizeof(float))) << "pixel " << i;
+        k++;
+    }
+    EXPECT_EQ(k, numPoints);
+}
+
+INSTANTIATE_TEST_SUITE_P(Widths, Reconstruct3DFixture, ::testing::Values(1, 7, 16, 1021, 1024));
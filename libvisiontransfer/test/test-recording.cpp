@@ -0,0 +1,167 @@
+#include <visiontransfer/recording.h>
+#include <gtest/gtest.h>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+#include <unistd.h>
+#include "test-common.h"
+
+using namespace std;
+using namespace visiontransfer;
+
+class RecordingFixture: public ::testing::Test {
+public:
+    RecordingFixture(): width(64), height(24), numFrames(10) {
+    }
+
+    virtual void SetUp() {
+        char name[] = "/tmp/test-recording-XXXXXX";
+        int fd = mkstemp(name);
+        ASSERT_GE(fd, 0);
+        close(fd);
+        fileName = name;
+
+        disp = createRandomDisparities(width, height, 1);
+    }
+
+    virtual void TearDown() {
+        unlink(fileName.c_str());
+    }
+
+protected:
+    int width, height, numFrames;
+    string fileName;
+    vector<unsigned char> left;
+    vector<unsigned short> disp;
+    float q[16];
+
+    // Image set with an 8-bit left image and a 12-bit disparity map
+    ImageSet createFrame(int index) {
+        left.resize(width*height);
+        for(int i=0; i<width*height; i++) {
+            left[i] = static_cast<unsigned char>(i + index);
+        }
+
+        ImageSet imageSet;
+        imageSet.setNumberOfImages(2);
+        imageSet.setWidth(width);
+        imageSet.setHeight(height);
+        imageSet.setIndexOf(ImageSet::IMAGE_LEFT, 0);
+        imageSet.setIndexOf(ImageSet::IMAGE_RIGHT, -1);
+        imageSet.setIndexOf(ImageSet::IMAGE_DISPARITY, 1);
+        imageSet.setPixelFormat(0, ImageSet::FORMAT_8_BIT_MONO);
+        imageSet.setPixelFormat(1, ImageSet::FORMAT_12_BIT_MONO);
+        imageSet.setRowStride(0, width);
+        imageSet.setRowStride(1, 2*width);
+        imageSet.setPixelData(0, &left[0]);
+        imageSet.setPixelData(1, reinterpret_cast<unsigned char*>(&disp[0]));
+        imageSet.setSequenceNumber(100 + index);
+        imageSet.setTimestamp(1000 + index/4, (index % 4) * 250000);
+
+        // The image set only references the Q-matrix
+        for(int i=0; i<16; i++) {
+            q[i] = static_cast<float>(i + index);
+        }
+        imageSet.setQMatrix(q);
+        return imageSet;
+    }
+
+    void writeRecording(int frames) {
+        RecordingWriter writer(fileName.c_str());
+        for(int i=0; i<frames; i++) {
+            // The writer copies the data, such that the buffers can be reused
+            writer.writeImageSet(createFrame(i));
+        }
+        EXPECT_EQ(frames, writer.getNumFrames());
+        writer.close();
+    }
+
+    void checkFrame(RecordingReader& reader, int index) {
+        ImageSet imageSet;
+        reader.getImageSet(index, imageSet);
+
+        ASSERT_EQ(2, imageSet.getNumberOfImages());
+        EXPECT_EQ(width, imageSet.getWidth());
+        EXPECT_EQ(height, imageSet.getHeight());
+        EXPECT_EQ(static_cast<unsigned int>(100 + index), imageSet.getSequenceNumber());
+        EXPECT_EQ(1, imageSet.getIndexOf(ImageSet::IMAGE_DISPARITY));
+        EXPECT_EQ(ImageSet::FORMAT_12_BIT_MONO, imageSet.getPixelFormat(1));
+
+        int sec = 0, usec = 0;
+        imageSet.getTimestamp(sec, usec);
+        EXPECT_EQ(1000 + index/4, sec);
+        EXPECT_EQ((index % 4) * 250000, usec);
+        ASSERT_TRUE(imageSet.getQMatrix() != NULL);
+        EXPECT_EQ(static_cast<float>(15 + index), imageSet.getQMatrix()[15]);
+
+        EXPECT_TRUE(hasMonoPattern(imageSet, index));
+        for(int y=0; y<height; y++) {
+            ASSERT_EQ(0, memcmp(imageSet.getPixelData(1) + y*imageSet.getRowStride(1),
+                &disp[y*width], width*sizeof(unsigned short))) << "row " << y;
+        }
+    }
+};
+
+TEST_F(RecordingFixture, WriteAndRead) {
+    writeRecording(numFrames);
+
+    RecordingReader reader(fileName.c_str());
+    ASSERT_EQ(numFrames, reader.getNumFrames());
+
+    // Read in reverse order to ensure random access
+    for(int i=numFrames-1; i>=0; i--) {
+        checkFrame(reader, i);
+    }
+
+    EXPECT_EQ(3, reader.findSequenceNumber(103));
+    EXPECT_EQ(-1, reader.findSequenceNumber(99));
+    EXPECT_EQ(4, reader.findTimestamp(1001, 100000));
+    EXPECT_EQ(-1, reader.findTimestamp(999, 0));
+
+    int sec = 0, usec = 0;
+    reader.getTimestamp(numFrames-1, sec, usec);
+    EXPECT_EQ(1002, sec);
+    EXPECT_EQ(250000, usec);
+}
+
+TEST_F(RecordingFixture, ImageSetsOutliveReader) {
+    writeRecording(2);
+
+    ImageSet imageSet;
+    {
+        RecordingReader reader(fileName.c_str());
+        reader.getImageSet(1, imageSet);
+    }
+    EXPECT_TRUE(hasMonoPattern(imageSet, 1));
+}
+
+TEST_F(RecordingFixture, RecoverUnclosedRecording) {
+    writeRecording(numFrames);
+
+    // Turn the file into a recording that has not been closed properly:
+    // the header does not reference an index, and the last frame has only
+    // been written partially
+    FILE* file = fopen(fileName.c_str(), "r+b");
+    ASSERT_TRUE(file != NULL);
+    const long indexOffsetPos = 16;
+    uint64_t indexOffset = 0;
+    ASSERT_EQ(0, fseek(file, indexOffsetPos, SEEK_SET));
+    ASSERT_EQ(1u, fread(&indexOffset, sizeof(indexOffset), 1, file));
+    ASSERT_GT(indexOffset, 0u);
+
+    uint64_t zero = 0;
+    ASSERT_EQ(0, fseek(file, indexOffsetPos, SEEK_SET));
+    ASSERT_EQ(1u, fwrite(&zero, sizeof(zero), 1, file));
+    fclose(file);
+    ASSERT_EQ(0, truncate(fileName.c_str(), static_cast<off_t>(indexOffset - 100)));
+
+    RecordingReader reader(fileName.c_str());
+    ASSERT_EQ(numFrames - 1, reader.getNumFrames());
+    for(int i=0; i<numFrames-1; i++) {
+        checkFrame(reader, i);
+    }
+    EXPECT_EQ(numFrames - 2, reader.findSequenceNumber(100 + numFrames - 2));
+    EXPECT_EQ(-1, reader.findSequenceNumber(100 + numFrames - 1));
+}
@@ -26,11 +26,15 @@
 #include <condition_variable>
 #include <chrono>
 #include <mutex>
+#include <atomic>
 #include <vector>
+#include <deque>
 #include <cstring>
 #include <algorithm>
+#include <utility>
 #include "visiontransfer/asynctransfer.h"
-#include "visiontransfer/internal/alignedallocator.h"
+#include "visiontransfer/internal/lockfreequeue.h"
+#include "visiontransfer/internal/receivebuffers.h"
 
 using namespace std;
 using namespace visiontransfer;
@@ -57,49 +61,76 @@ public:
     bool tryAccept();
     void setConnectionStateChangeCallback(std::function<void(visiontransfer::ConnectionState)> callback);
     void setAutoReconnect(int secondsBetweenRetries);
+    void setImageSetCallback(const std::function<void(const ImageSet&)>& callback);
+    void setSendQueueDepth(int depth);
+    int getSendQueueDepth();
+    void setReceiveQueueDepth(int depth, ReceiveQueuePolicy policy);
+    int getReceiveQueueDepth() const {return receiveQueueDepth;}
+    ReceiveQueuePolicy getReceiveQueuePolicy() const {return receiveQueuePolicy;}
 
 private:
-    static constexpr int NUM_BUFFERS = ImageSet::MAX_SUPPORTED_IMAGES * 3;
     static constexpr int SEND_THREAD_SHORT_WAIT_MS = 1;
-    static constexpr int SEND_THREAD_LONG_WAIT_MS = 10;
+    static constexpr int SEND_THREAD_IDLE_WAIT_MS = 100;
 
     // The encapsulated image transfer object
     ImageTransfer imgTrans;
+    ImageProtocol::ProtocolType protType;
 
     // Variable for controlling thread termination
     volatile bool terminate;
 
-    // There are two threads, one for sending and one for receiving.
-    // Each has a mutex and condition variable for synchronization.
+    // There are two threads, one for sending and one for receiving. The
+    // send thread waits for network events and is woken up through
+    // ImageTransfer::interruptWait() when a new image set is queued.
     std::thread sendThread;
     std::mutex sendMutex;
-    std::condition_variable sendCond;
     std::condition_variable sendWaitCond;
 
+    // Received image sets are handed over without locking. The mutex and
+    // condition variables are only used for waiting on an empty or full
+    // queue.
     std::thread receiveThread;
-    std::timed_mutex receiveMutex;
-    std::condition_variable_any receiveCond;
-
-    // Objects for exchanging images with the send and receive threads
-    ImageSet receivedSet;
-    std::vector<unsigned char, AlignedAllocator<unsigned char> > receivedData[NUM_BUFFERS];
-    volatile int receiveBufferIndex;
-    volatile bool newDataReceived;
-
-    ImageSet sendImageSet;
-    bool sendSetValid;
-    bool deleteSendData;
+    std::mutex receiveWaitMutex;
+    std::condition_variable receiveCond;
+    std::condition_variable receiveSpaceCond;
+    std::atomic<bool> consumerWaiting;
+    std::atomic<bool> producerWaiting;
+
+    // Buffers for received image sets, which are lent to the caller of
+    // collectReceivedImageSet(). All allocated slots are only accessed by
+    // the receive thread and the destructor.
+    std::vector<ReceiveSlot*> receiveSlots;
+    LockFreeQueue<ReceiveSlot*> receivedQueue;
+    int receiveQueueDepth;
+    ReceiveQueuePolicy receiveQueuePolicy;
+
+    // Image sets waiting for transmission
+    struct PendingSet {
+        ImageSet imageSet;
+        bool deleteData;
+    };
+    std::deque<PendingSet> sendQueue;
+    int sendQueueDepth;
+
+    // Optional thread that delivers received image sets to a callback
+    std::thread dispatchThread;
+    std::function<void(const ImageSet&)> imageSetCallback;
+    bool callbackInstalled;
+    std::atomic<bool> stopDispatch;
 
     // Exception occurred in one of the threads
     std::exception_ptr receiveException;
+    std::atomic<bool> receiveFailed;
     std::exception_ptr sendException;
+    std::exception_ptr dispatchException;
+    std::atomic<bool> dispatchFailed;
 
     bool sendThreadCreated;
-    bool receiveThreadCreated;
+    std::atomic<bool> receiveThreadCreated;
 
     // Count of additional locally dropped frames (due to not being collected in time)
     // Only starts counting with the first call of collectReceivedImagePair()
-    int uncollectedDroppedFrames;
+    std::atomic<int> uncollectedDroppedFrames;
 
     // Main loop for sending thread
     void sendLoop();
@@ -107,7 +138,22 @@ private:
     // Main loop for receiving;
     void receiveLoop();
 
+    // Main loop for delivering image sets to the callback
+    void dispatchLoop();
+
     void createSendThread();
+    void createReceiveThread();
+    void releasePendingSet(PendingSet& pendingSet);
+
+    // Methods for exchanging slots between the receive thread and the caller
+    bool acquireReceiveSlot(ReceiveSlot*& slot);
+    ReceiveSlot* findFreeReceiveSlot();
+    void queueReceivedSlot(ReceiveSlot* slot);
+    bool waitForReceivedSlot(ReceiveSlot*& slot, double timeout);
+    void lendReceivedSlot(ReceiveSlot* slot, ImageSet& imageSet);
+    void stopDispatchThread();
+    void rethrowReceiveErrors();
+    void countUncollectedDrop();
 };
 
 /******************** Stubs for all public members ********************/
@@ -137,6 +183,18 @@ bool AsyncTransfer::collectReceivedImageSet(ImageSet& imageSet, double timeout)
     return pimpl->collectReceivedImageSet(imageSet, timeout);
 }
 
+void AsyncTransfer::setReceiveQueueDepth(int depth, ReceiveQueuePolicy policy) {
+    pimpl->setReceiveQueueDepth(depth, policy);
+}
+
+int AsyncTransfer::getReceiveQueueDepth() const {
+    return pimpl->getReceiveQueueDepth();
+}
+
+AsyncTransfer::ReceiveQueuePolicy AsyncTransfer::getReceiveQueuePolicy() const {
+    return pimpl->getReceiveQueuePolicy();
+}
+
 int AsyncTransfer::getNumDroppedFrames() const {
     return pimpl->getNumDroppedFrames();
 }
@@ -167,14 +225,28 @@ void AsyncTransfer::setAutoReconnect(int secondsBetweenRetries) {
     pimpl->setAutoReconnect(secondsBetweenRetries);
 }
 
+void AsyncTransfer::setSendQueueDepth(int depth) {
+    pimpl->setSendQueueDepth(depth);
+}
+
+int AsyncTransfer::getSendQueueDepth() const {
+    return pimpl->getSendQueueDepth();
+}
+
+void AsyncTransfer::setImageSetCallback(std::function<void(const ImageSet&)> callback) {
+    pimpl->setImageSetCallback(callback);
+}
+
 /******************** Implementation in pimpl class *******************/
 
 AsyncTransfer::Pimpl::Pimpl(const char* address, const char* service,
         ImageProtocol::ProtocolType protType, bool server,
         int bufferSize, int maxUdpPacketSize, int autoReconnectDelay)
     : imgTrans(address, service, protType, server, bufferSize, maxUdpPacketSize, autoReconnectDelay),
-    terminate(false), receiveBufferIndex(0), newDataReceived(false), sendSetValid(false),
-    deleteSendData(false), sendThreadCreated(false),
+    protType(protType), terminate(false), consumerWaiting(false), producerWaiting(false),
+    receiveQueueDepth(1), receiveQueuePolicy(QUEUE_KEEP_NEWEST), sendQueueDepth(1),
+    callbackInstalled(false), stopDispatch(false),
+    receiveFailed(false), dispatchFailed(false), sendThreadCreated(false),
     receiveThreadCreated(false), uncollectedDroppedFrames(-1) {
 
     if(server) {
@@ -185,9 +257,16 @@ AsyncTransfer::Pimpl::Pimpl(const char* address, const char* service,
 AsyncTransfer::Pimpl::~Pimpl() {
     terminate = true;
 
-    sendCond.notify_all();
-    receiveCond.notify_all();
-    sendWaitCond.notify_all();
+    imgTrans.interruptWait();
+    {
+        unique_lock<mutex> lock(sendMutex);
+        sendWaitCond.notify_all();
+    }
+    {
+        unique_lock<mutex> lock(receiveWaitMutex);
+        receiveCond.notify_all();
+        receiveSpaceCond.notify_all();
+    }
 
     if(sendThreadCreated && sendThread.joinable()) {
         sendThread.join();
@@ -197,9 +276,21 @@ AsyncTransfer::Pimpl::~Pimpl() {
         receiveThread.join();
     }
 
-    if(sendSetValid && deleteSendData) {
-        delete[] sendImageSet.getPixelData(0);
-        delete[] sendImageSet.getPixelData(1);
+    if(dispatchThread.joinable()) {
+        dispatchThread.join();
+    }
+
+    while(!sendQueue.empty()) {
+        releasePendingSet(sendQueue.front());
+        sendQueue.pop_front();
+    }
+
+    // Slots that are still lent are deleted once they are released
+    for(unsigned int i=0; i<receiveSlots.size(); i++) {
+        if(receiveSlots[i]->state.exchange(ReceiveSlot::SLOT_ORPHANED,
+                std::memory_order_acq_rel) != ReceiveSlot::SLOT_LENT) {
+            delete receiveSlots[i];
+        }
     }
 }
 
@@ -215,98 +306,216 @@ void AsyncTransfer::Pimpl::createSendThread() {
 void AsyncTransfer::Pimpl::sendImageSetAsync(const ImageSet& imageSet, bool deleteData) {
     createSendThread();
 
-    while(true) {
+    {
         unique_lock<mutex> lock(sendMutex);
+        while(true) {
+            // Test for errors
+            if(sendException) {
+                std::rethrow_exception(sendException);
+            }
 
-        // Test for errors
-        if(sendException) {
-            std::rethrow_exception(sendException);
+            if(static_cast<int>(sendQueue.size()) < sendQueueDepth) {
+                PendingSet pendingSet;
+                pendingSet.imageSet = imageSet;
+                pendingSet.deleteData = deleteData;
+                sendQueue.push_back(pendingSet);
+                break;
+            } else {
+                // Wait for old data to be processed first
+                sendWaitCond.wait(lock);
+            }
         }
+    }
 
-        if(!sendSetValid) {
-            sendImageSet = imageSet;
-            sendSetValid = true;
-            deleteSendData = deleteData;
+    // Wake up the sender thread
+    imgTrans.interruptWait();
+}
+
+void AsyncTransfer::Pimpl::setSendQueueDepth(int depth) {
+    if(depth < 1) {
+        throw std::runtime_error("Send queue depth must be at least 1!");
+    }
+    unique_lock<mutex> lock(sendMutex);
+    sendQueueDepth = depth;
+    sendWaitCond.notify_all();
+}
 
-            // Wake up the sender thread
-            sendCond.notify_one();
+int AsyncTransfer::Pimpl::getSendQueueDepth() {
+    unique_lock<mutex> lock(sendMutex);
+    return sendQueueDepth;
+}
 
-            return;
-        } else {
-            // Wait for old data to be processed first
-            sendWaitCond.wait(lock);
+void AsyncTransfer::Pimpl::releasePendingSet(PendingSet& pendingSet) {
+    if(pendingSet.deleteData) {
+        for (int i=0; i<pendingSet.imageSet.getNumberOfImages(); ++i) {
+            delete[] pendingSet.imageSet.getPixelData(i);
         }
+        pendingSet.deleteData = false;
+    }
+
+    // Also drops the reference to owned pixel data
+    pendingSet.imageSet = ImageSet();
+}
+
+void AsyncTransfer::Pimpl::setReceiveQueueDepth(int depth, ReceiveQueuePolicy policy) {
+    if(depth < 1) {
+        throw std::runtime_error("Receive queue depth must be at least 1!");
+    }
+    if(receiveThreadCreated) {
+        throw std::runtime_error("Receive queue cannot be changed after the first image set has been collected!");
     }
+    receiveQueueDepth = depth;
+    receiveQueuePolicy = policy;
+}
+
+void AsyncTransfer::Pimpl::createReceiveThread() {
+    // Slots are allocated on demand by the receive thread
+    receivedQueue.reset(receiveQueueDepth);
+
+    // Lazy initialization of receive thread
+    unique_lock<mutex> lock(receiveWaitMutex);
+    receiveThreadCreated = true;
+    receiveThread = thread(bind(&AsyncTransfer::Pimpl::receiveLoop, this));
 }
 
 bool AsyncTransfer::Pimpl::collectReceivedImageSet(ImageSet& imageSet, double timeout) {
     if(!receiveThreadCreated) {
-        // Lazy initialization of receive thread
-        unique_lock<timed_mutex> lock(receiveMutex);
-        receiveThreadCreated = true;
-        receiveThread = thread(bind(&AsyncTransfer::Pimpl::receiveLoop, this));
-    }
-
-    // Acquire mutex
-    unique_lock<timed_mutex> lock(receiveMutex, std::defer_lock);
-    if(timeout < 0) {
-        lock.lock();
-    } else {
-        std::chrono::steady_clock::time_point lockStart =
-            std::chrono::steady_clock::now();
-        if(!lock.try_lock_for(std::chrono::microseconds(static_cast<unsigned int>(timeout*1e6)))) {
-            // Timed out
-            return false;
-        }
-
-        // Update timeout
-        unsigned int lockDuration = static_cast<unsigned int>(std::chrono::duration_cast<std::chrono::microseconds>(
-            std::chrono::steady_clock::now() - lockStart).count());
-        timeout = std::max(0.0, timeout - lockDuration*1e-6);
+        createReceiveThread();
     }
 
     // Test for errors
-    if(receiveException) {
-        std::rethrow_exception(receiveException);
+    rethrowReceiveErrors();
+    if(callbackInstalled) {
+        throw std::runtime_error("Image sets cannot be collected while an image set callback is installed!");
     }
 
-    if(timeout == 0 && !newDataReceived) {
-        // No image has been received and we are not blocking
+    ReceiveSlot* slot = nullptr;
+    if(!receivedQueue.pop(slot) && (timeout == 0 || !waitForReceivedSlot(slot, timeout))) {
+        // Test for errors again
+        if(receiveFailed.load(std::memory_order_acquire)) {
+            std::rethrow_exception(receiveException);
+        }
         return false;
     }
 
-    // If there is no data yet then keep on waiting
-    if(!newDataReceived) {
-        if(timeout < 0) {
-            while(!terminate && !receiveException && !newDataReceived) {
-                receiveCond.wait(lock);
-            }
-        } else {
-            receiveCond.wait_for(lock, std::chrono::microseconds(static_cast<unsigned int>(timeout*1e6)));
-        }
+    lendReceivedSlot(slot, imageSet);
+    return true;
+}
+
+void AsyncTransfer::Pimpl::lendReceivedSlot(ReceiveSlot* slot, ImageSet& imageSet) {
+    // Wake up the receive thread if it waits for space in the queue
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(producerWaiting.load(std::memory_order_relaxed)) {
+        unique_lock<mutex> lock(receiveWaitMutex);
+        receiveSpaceCond.notify_one();
     }
 
-    // Test for errors again
-    if(receiveException) {
+    // Lend the slot to the caller. This also releases the image set that
+    // has previously been collected into the same object.
+    slot->state.store(ReceiveSlot::SLOT_LENT, std::memory_order_relaxed);
+    imageSet = slot->imageSet;
+    imageSet.setDataOwner(slot);
+
+    // Start counting uncollected frames at the time of first collection
+    int notCounting = -1;
+    uncollectedDroppedFrames.compare_exchange_strong(notCounting, 0);
+}
+
+void AsyncTransfer::Pimpl::rethrowReceiveErrors() {
+    if(receiveFailed.load(std::memory_order_acquire)) {
         std::rethrow_exception(receiveException);
     }
+    if(dispatchFailed.load(std::memory_order_acquire)) {
+        // Reported only once, such that a new callback can be installed
+        std::exception_ptr ex = dispatchException;
+        dispatchException = nullptr;
+        dispatchFailed.store(false, std::memory_order_relaxed);
+        std::rethrow_exception(ex);
+    }
+}
 
-    if(newDataReceived) {
-        // Get the received image
-        imageSet = receivedSet;
+void AsyncTransfer::Pimpl::setImageSetCallback(const std::function<void(const ImageSet&)>& callback) {
+    stopDispatchThread();
+    rethrowReceiveErrors();
 
-        newDataReceived = false;
+    if(callback) {
+        if(!receiveThreadCreated) {
+            createReceiveThread();
+        }
+        imageSetCallback = callback;
+        callbackInstalled = true;
+        dispatchThread = thread(bind(&AsyncTransfer::Pimpl::dispatchLoop, this));
+    }
+}
 
-        // Increment index for data buffers
-        receiveBufferIndex = (receiveBufferIndex + receivedSet.getNumberOfImages()) % NUM_BUFFERS;
-        
-        // Start counting uncollected frames at the time of first collection
-        if (uncollectedDroppedFrames < 0) uncollectedDroppedFrames = 0;
+void AsyncTransfer::Pimpl::stopDispatchThread() {
+    if(dispatchThread.joinable()) {
+        if(std::this_thread::get_id() == dispatchThread.get_id()) {
+            throw std::runtime_error("The image set callback cannot be changed from within the callback!");
+        }
+        {
+            unique_lock<mutex> lock(receiveWaitMutex);
+            stopDispatch = true;
+            receiveCond.notify_all();
+        }
+        dispatchThread.join();
+        stopDispatch = false;
+    }
+    imageSetCallback = nullptr;
+    callbackInstalled = false;
+}
 
-        return true;
-    } else {
-        return false;
+void AsyncTransfer::Pimpl::dispatchLoop() {
+    try {
+        ImageSet imageSet;
+        while(!terminate && !stopDispatch) {
+            ReceiveSlot* slot = nullptr;
+            if(!receivedQueue.pop(slot) && !waitForReceivedSlot(slot, -1)) {
+                if(receiveFailed.load(std::memory_order_acquire)) {
+                    // Reported to the caller through rethrowReceiveErrors()
+                    break;
+                }
+                continue;
+            }
+
+            lendReceivedSlot(slot, imageSet);
+            imageSetCallback(imageSet);
+
+            // Return the buffers right away, unless the callback kept a copy
+            imageSet = ImageSet();
+        }
+    } catch(...) {
+        dispatchException = std::current_exception();
+        dispatchFailed.store(true, std::memory_order_release);
+    }
+}
+
+bool AsyncTransfer::Pimpl::waitForReceivedSlot(ReceiveSlot*& slot, double timeout) {
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now()
+        + std::chrono::microseconds(static_cast<long long>(std::max(0.0, timeout)*1e6));
+
+    unique_lock<mutex> lock(receiveWaitMutex);
+    consumerWaiting.store(true, std::memory_order_relaxed);
+    // Pairs with the fence in queueReceivedSlot(): either we see the new
+    // entry, or the receive thread sees that we are waiting
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    bool received = false;
+    while(!terminate && !stopDispatch && !receiveFailed.load(std::memory_order_acquire)) {
+        if(receivedQueue.pop(slot)) {
+            received = true;
+            break;
+        }
+        if(timeout < 0) {
+            receiveCond.wait(lock);
+        } else if(receiveCond.wait_until(lock, deadline) == std::cv_status::timeout) {
+            received = receivedQueue.pop(slot);
+            break;
+        }
     }
+
+    consumerWaiting.store(false, std::memory_order_relaxed);
+    return received;
 }
 
 void AsyncTransfer::Pimpl::sendLoop() {
@@ -315,70 +524,90 @@ void AsyncTransfer::Pimpl::sendLoop() {
         unique_lock<mutex> lock(sendMutex);
     }
 
-    ImageSet imgSet;
-    bool deleteSet = false;
+    PendingSet pendingSet;
+    pendingSet.deleteData = false;
+
+    // For UDP, the remote host might request the retransmission of lost
+    // packets. The data of the last set thus has to be kept until it is
+    // replaced by the next set.
+    PendingSet transmittedSet;
+    transmittedSet.deleteData = false;
 
     try {
         while(!terminate) {
-            // Wait for next image
+            // Get next image set
+            bool haveSet = false;
             {
                 unique_lock<mutex> lock(sendMutex);
-                // Wait for next frame to be queued
-                bool firstWait = true;
-                while(!terminate && !sendSetValid) {
-                    imgTrans.transferData();
-                    sendCond.wait_for(lock, std::chrono::milliseconds(
-                        firstWait ? SEND_THREAD_SHORT_WAIT_MS : SEND_THREAD_LONG_WAIT_MS));
-                    firstWait = false;
-                }
-                if(!sendSetValid) {
-                    continue;
+                if(!sendQueue.empty()) {
+                    pendingSet = sendQueue.front();
+                    sendQueue.pop_front();
+                    haveSet = true;
+                    sendWaitCond.notify_one();
                 }
+            }
 
-                imgSet = sendImageSet;
-                deleteSet = deleteSendData;
-                sendSetValid = false;
-
-                sendWaitCond.notify_one();
+            if(!haveSet) {
+                // Keep the connection serviced while idle. Incoming UDP control
+                // messages are handled here unless the receive thread handles
+                // them, and a TCP disconnect is detected within the timeout.
+                imgTrans.transferData();
+                bool waitForControlMessages = protType == ImageProtocol::PROTOCOL_UDP
+                    && !receiveThreadCreated;
+                imgTrans.waitForSocket(false, waitForControlMessages, SEND_THREAD_IDLE_WAIT_MS);
+                continue;
             }
 
-            imgTrans.setTransferImageSet(imgSet);
+            imgTrans.setTransferImageSet(pendingSet.imageSet);
+            releasePendingSet(transmittedSet);
+
+            bool stalled = false;
             while(!terminate) {
                 ImageTransfer::TransferStatus status = imgTrans.transferData();
-                if(status != ImageTransfer::PARTIAL_TRANSFER && status != ImageTransfer::WOULD_BLOCK) {
+                if(status == ImageTransfer::WOULD_BLOCK) {
+                    // Wait until the send buffers have drained
+                    imgTrans.waitForSocket(true, false, SEND_THREAD_IDLE_WAIT_MS);
+                    stalled = false;
+                } else if(status == ImageTransfer::PARTIAL_TRANSFER) {
+                    // Retry at once, but wait for messages from the remote
+                    // host if this did not complete the transfer
+                    if(stalled) {
+                        imgTrans.waitForSocket(false, true, SEND_THREAD_SHORT_WAIT_MS);
+                    }
+                    stalled = true;
+                } else {
                     break;
                 }
-                std::this_thread::sleep_for(std::chrono::milliseconds(SEND_THREAD_LONG_WAIT_MS));
             }
 
-            if(deleteSet) {
-                for (int i=0; i<imgSet.getNumberOfImages(); ++i) {
-                    delete[] imgSet.getPixelData(i);
-                }
-                deleteSet = false;
+            if(protType == ImageProtocol::PROTOCOL_UDP) {
+                std::swap(transmittedSet, pendingSet);
+            } else {
+                releasePendingSet(pendingSet);
             }
         }
+
+        releasePendingSet(transmittedSet);
     } catch(...) {
         // Store the exception for later
-        if(!sendException) {
-            sendException = std::current_exception();
+        {
+            unique_lock<mutex> lock(sendMutex);
+            if(!sendException) {
+                sendException = std::current_exception();
+            }
+            sendWaitCond.notify_all();
         }
-        sendWaitCond.notify_all();
 
         // Don't forget to free the memory
-        if(deleteSet) {
-            for (int i=0; i<imgSet.getNumberOfImages(); ++i) {
-                delete[] imgSet.getPixelData(i);
-            }
-            deleteSet = false;
-        }
+        releasePendingSet(pendingSet);
+        releasePendingSet(transmittedSet);
     }
 }
 
 void AsyncTransfer::Pimpl::receiveLoop() {
     {
         // Delay the thread start
-        unique_lock<timed_mutex> lock(receiveMutex);
+        unique_lock<mutex> lock(receiveWaitMutex);
     }
 
     try {
@@ -387,53 +616,106 @@ void AsyncTransfer::Pimpl::receiveLoop() {
         while(!terminate) {
             // Receive new image (blocks internally)
             bool newImageSetArrived = imgTrans.receiveImageSet(currentSet);
-            
-            if (newImageSetArrived) {
-                unique_lock<timed_mutex> lock(receiveMutex);
-                if (newDataReceived) {
-                    // collectReceivedImageSet() frequency was too low; previous frame lost
-                    if (uncollectedDroppedFrames > -1) uncollectedDroppedFrames++;
-                }
-                // Copy the pixel data
-                for(int i=0;i<currentSet.getNumberOfImages();i++) {
-                    int bytesPerPixel = currentSet.getBytesPerPixel(i);
-                    int newStride = currentSet.getWidth() * bytesPerPixel;
-                    int totalSize = currentSet.getHeight() * newStride;
-                    int bufIdxHere = (i + receiveBufferIndex) % NUM_BUFFERS;
-                    if(static_cast<int>(receivedData[bufIdxHere].size()) < totalSize) {
-                        receivedData[bufIdxHere].resize(totalSize);
-                    }
-                    if(newStride == currentSet.getRowStride(i)) {
-                        memcpy(&receivedData[bufIdxHere][0], currentSet.getPixelData(i),
-                            newStride*currentSet.getHeight());
-                    } else {
-                        for(int y = 0; y<currentSet.getHeight(); y++) {
-                            memcpy(&receivedData[bufIdxHere][y*newStride],
-                                &currentSet.getPixelData(i)[y*currentSet.getRowStride(i)],
-                                newStride);
-                        }
-                        currentSet.setRowStride(i, newStride);
-                    }
-                    currentSet.setPixelData(i, &receivedData[bufIdxHere][0]);
-                }
-                // N.B. receiveBufferIndex is only increased at collection time
+            if(!newImageSetArrived) {
+                continue;
+            }
 
-                // Notify that a new image set has been received
-                newDataReceived = true;
-                receivedSet = currentSet;
-                receiveCond.notify_one();
+            ReceiveSlot* slot = nullptr;
+            if(!acquireReceiveSlot(slot)) {
+                continue;
             }
 
+            // Take over the pixel data by exchanging buffers with the
+            // protocol, which receives the next image set into the
+            // previous buffers of this slot
+            imgTrans.exchangeReceiveBuffers(slot->buffers);
+            slot->imageSet = currentSet;
+
+            // Notify that a new image set has been received
+            queueReceivedSlot(slot);
         }
     } catch(...) {
         // Store the exception for later
-        if(!receiveException) {
+        if(!receiveFailed) {
             receiveException = std::current_exception();
+            receiveFailed.store(true, std::memory_order_release);
         }
+        unique_lock<mutex> lock(receiveWaitMutex);
         receiveCond.notify_all();
     }
 }
 
+bool AsyncTransfer::Pimpl::acquireReceiveSlot(ReceiveSlot*& slot) {
+    if(receivedQueue.size() >= receiveQueueDepth) {
+        if(receiveQueuePolicy == QUEUE_KEEP_OLDEST) {
+            countUncollectedDrop();
+            return false;
+        } else if(receiveQueuePolicy == QUEUE_KEEP_NEWEST) {
+            // Take over the oldest queued slot, unless it is being collected
+            // at the same time
+            if(receivedQueue.pop(slot)) {
+                countUncollectedDrop();
+                return true;
+            }
+        } else {
+            unique_lock<mutex> lock(receiveWaitMutex);
+            producerWaiting.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            while(!terminate && receivedQueue.size() >= receiveQueueDepth) {
+                receiveSpaceCond.wait(lock);
+            }
+            producerWaiting.store(false, std::memory_order_relaxed);
+            if(terminate) {
+                return false;
+            }
+        }
+    }
+
+    slot = findFreeReceiveSlot();
+    return true;
+}
+
+ReceiveSlot* AsyncTransfer::Pimpl::findFreeReceiveSlot() {
+    for(unsigned int i=0; i<receiveSlots.size(); i++) {
+        // Only this thread turns free slots into busy ones
+        if(receiveSlots[i]->state.load(std::memory_order_acquire) == ReceiveSlot::SLOT_FREE) {
+            receiveSlots[i]->state.store(ReceiveSlot::SLOT_BUSY, std::memory_order_relaxed);
+            return receiveSlots[i];
+        }
+    }
+
+    // All slots are queued or still held by the caller
+    ReceiveSlot* slot = new ReceiveSlot;
+    slot->state.store(ReceiveSlot::SLOT_BUSY, std::memory_order_relaxed);
+    receiveSlots.push_back(slot);
+    return slot;
+}
+
+void AsyncTransfer::Pimpl::queueReceivedSlot(ReceiveSlot* slot) {
+    if(!receivedQueue.push(slot)) {
+        // The queue capacity covers the queue depth, so this should not
+        // happen. The slot is still returned and the frame counted as dropped.
+        slot->imageSet = ImageSet();
+        slot->state.store(ReceiveSlot::SLOT_FREE, std::memory_order_release);
+        countUncollectedDrop();
+        return;
+    }
+
+    // Pairs with the fence in waitForReceivedSlot()
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(consumerWaiting.load(std::memory_order_relaxed)) {
+        unique_lock<mutex> lock(receiveWaitMutex);
+        receiveCond.notify_one();
+    }
+}
+
+void AsyncTransfer::Pimpl::countUncollectedDrop() {
+    // Only counted after the first image set has been collected
+    int count = uncollectedDroppedFrames.load(std::memory_order_relaxed);
+    while(count > -1 && !uncollectedDroppedFrames.compare_exchange_weak(count, count + 1)) {
+    }
+}
+
 bool AsyncTransfer::Pimpl::isConnected() const {
     return imgTrans.isConnected();
 }
@@ -462,9 +744,8 @@ void AsyncTransfer::Pimpl::setAutoReconnect(int secondsBetweenRetries) {
     imgTrans.setAutoReconnect(secondsBetweenRetries);
 }
 
-constexpr int AsyncTransfer::Pimpl::NUM_BUFFERS;
 constexpr int AsyncTransfer::Pimpl::SEND_THREAD_SHORT_WAIT_MS;
-constexpr int AsyncTransfer::Pimpl::SEND_THREAD_LONG_WAIT_MS;
+constexpr int AsyncTransfer::Pimpl::SEND_THREAD_IDLE_WAIT_MS;
 
 } // namespace
 
@@ -37,6 +37,18 @@ namespace visiontransfer {
  */
 class VT_EXPORT AsyncTransfer {
 public:
+    /// Handling of newly received image sets if the receive queue is full
+    enum ReceiveQueuePolicy {
+        /// The oldest queued image set is dropped in favor of the new one
+        QUEUE_KEEP_NEWEST,
+
+        /// The newly received image set is dropped
+        QUEUE_KEEP_OLDEST,
+
+        /// Reception pauses until an image set has been collected
+        QUEUE_BLOCK
+    };
+
     /**
      * \brief Creates a new transfer object.
      *
@@ -85,10 +97,34 @@ public:
      * If deleteData is set to false, the pixel data contained in \c imageSet
      * must not be freed before the data has been transmitted. As transmission
      * happens asynchronously, it is recommended to let AsyncTransfer delete
-     * the data pointers.
+     * the data pointers, or to pass an image set that owns its data (see
+     * ImageSet::setReleaseCallback() and FramePool). AsyncTransfer keeps a
+     * reference to such data until the transmission has completed. For UDP,
+     * the data is kept until the next image set is transmitted, such that
+     * lost packets can still be resent.
+     *
+     * The method only blocks if the send queue is full (see
+     * setSendQueueDepth()).
      */
     void sendImageSetAsync(const ImageSet& imageSet, bool deleteData = false);
 
+    /**
+     * \brief Sets the number of image sets that can be queued for
+     * transmission.
+     *
+     * \param depth Maximum number of image sets that have been passed to
+     *        sendImageSetAsync() and whose transmission has not yet started.
+     *        The default is 1.
+     *
+     * A deeper queue allows for passing bursts of image sets without
+     * waiting for the transmission of the previous ones. Image sets are
+     * transmitted in the order in which they have been queued.
+     */
+    void setSendQueueDepth(int depth);
+
+    /// Returns the number of image sets that can be queued for transmission
+    int getSendQueueDepth() const;
+
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
     DEPRECATED("Use sendImageSetAsync() instead")
     inline void sendImagePairAsync(const ImageSet& imageSet, bool deleteData = false) {
@@ -105,12 +141,18 @@ public:
      * \return True if an image set has been received before the timeout.
      *
      * If no image set has been received, this method might block or return false.
-     * Otherwise the returned image set is valid until the next call.
      *
      * If timeout is set to a value < 0, the function will block indefinitely.
      * If timeout = 0, the function will return immediately, and if timeout is > 0 then
-     * the function will block for the given amount of time in seconds. The received
-     * image set is only valid until the next call of collectReceivedImageSet().
+     * the function will block for the given amount of time in seconds.
+     *
+     * The pixel data is received directly into buffers that are lent to the
+     * caller without copying. The returned image set owns these buffers, and
+     * they are only reused once the image set and all of its copies have been
+     * destroyed or overwritten, e.g. by passing the same object to the next
+     * call. Image sets can thus be kept or handed to other threads without
+     * copying their pixel data, in which case additional buffers are
+     * allocated for receiving further image sets.
      */
     bool collectReceivedImageSet(ImageSet& imageSet, double timeout = -1);
 
@@ -121,12 +163,71 @@ public:
     }
 #endif
 
+#if VISIONTRANSFER_CPLUSPLUS_VERSION >= 201103L
+    /**
+     * \brief Installs a handler that is called for each received image
+     * set. *[C++11]*
+     *
+     * \param callback The handler, or an empty function for removing the
+     *        current handler.
+     *
+     * The handler is invoked from a dedicated thread as soon as an image set
+     * has been received completely, such that no polling through
+     * collectReceivedImageSet() is required. The latter cannot be used while
+     * a handler is installed. The image set passed to the handler owns its
+     * pixel data, and can be copied for further use without copying the
+     * pixel data (see collectReceivedImageSet()).
+     *
+     * Image sets that are received while the handler is still busy are
+     * queued. If the handler is too slow, the receive queue fills up and
+     * further image sets are handled according to the queue policy (see
+     * setReceiveQueueDepth()). With QUEUE_KEEP_NEWEST, the handler always
+     * receives the most recent image sets and skips outdated ones, while
+     * with QUEUE_BLOCK reception pauses until the handler catches up.
+     *
+     * If the handler throws an exception, no further image sets are
+     * delivered and the exception is rethrown by the next call of
+     * setImageSetCallback() or collectReceivedImageSet(). This method must
+     * not be called from within the handler.
+     */
+    void setImageSetCallback(std::function<void(const ImageSet&)> callback);
+#endif
+
+    /**
+     * \brief Sets the number of received image sets that can be queued
+     * for collection.
+     *
+     * \param depth Maximum number of received image sets that have not yet
+     *        been collected. The default is 1.
+     * \param policy Handling of newly received image sets while the queue
+     *        is full. The default is QUEUE_KEEP_NEWEST.
+     *
+     * A deeper queue allows for bursty processing, as image sets that
+     * arrive while the previous one is still being processed can be
+     * collected later.
+     *
+     * With QUEUE_BLOCK, no further data is read from the network while the
+     * queue is full. For UDP, this causes packets to be lost if image sets
+     * are not collected in time.
+     *
+     * This method has to be called before the first call of
+     * collectReceivedImageSet().
+     */
+    void setReceiveQueueDepth(int depth, ReceiveQueuePolicy policy = QUEUE_KEEP_NEWEST);
+
+    /// Returns the number of received image sets that can be queued for collection
+    int getReceiveQueueDepth() const;
+
+    /// Returns the handling of newly received image sets if the receive queue is full
+    ReceiveQueuePolicy getReceiveQueuePolicy() const;
+
     /**
      * \brief Returns the number of frames that have been dropped since
      * connecting to the current remote host.
      *
      * Dropped frames are caused by dropped packets due to a poor network
-     * connection
+     * connection, and by received image sets that have been discarded
+     * because the receive queue was full.
      */
     int getNumDroppedFrames() const;
 
@@ -0,0 +1,351 @@
+/*******************************************************************************
+ * Copyright (c) 2024 Allied Vision Technologies GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *******************************************************************************/
+
+
+#include "visiontransfer/framepool.h"
+#include "visiontransfer/internal/alignedallocator.h"
+#include "visiontransfer/internal/dataowner.h"
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+using namespace visiontransfer;
+using namespace visiontransfer::internal;
+
+namespace visiontransfer {
+
+namespace {
+
+// Alignment of each image within a buffer
+const int IMAGE_ALIGNMENT = 32;
+// Extra bytes behind each image for vectorized reads past the last pixel
+const int IMAGE_PADDING = 16;
+
+// Geometry and pixel formats of an image set
+struct FrameGeometry {
+    int width;
+    int height;
+    int numberOfImages;
+    ImageSet::ImageFormat formats[ImageSet::MAX_SUPPORTED_IMAGES];
+
+    FrameGeometry(const ImageSet& imageSet)
+        : width(imageSet.getWidth()), height(imageSet.getHeight()),
+        numberOfImages(imageSet.getNumberOfImages()) {
+        if(width <= 0 || height <= 0) {
+            throw std::runtime_error("Invalid image size for frame pool!");
+        }
+        for(int i=0; i<ImageSet::MAX_SUPPORTED_IMAGES; i++) {
+            formats[i] = i < numberOfImages ? imageSet.getPixelFormat(i) : ImageSet::FORMAT_8_BIT_MONO;
+        }
+    }
+
+    int getRowStride(int imageNumber) const {
+        return width * ImageSet::getBytesPerPixel(formats[imageNumber]);
+    }
+
+    bool operator<(const FrameGeometry& other) const {
+        if(width != other.width) return width < other.width;
+        if(height != other.height) return height < other.height;
+        if(numberOfImages != other.numberOfImages) return numberOfImages < other.numberOfImages;
+        for(int i=0; i<numberOfImages; i++) {
+            if(formats[i] != other.formats[i]) return formats[i] < other.formats[i];
+        }
+        return false;
+    }
+};
+
+class PooledFrame;
+
+// Pool state that is shared with all frames, such that frames can outlive
+// the pool object
+struct PoolState {
+    std::mutex mutex;
+    std::map<FrameGeometry, std::vector<PooledFrame*> > freeFrames;
+    int maxFreeFrames;
+    int numAllocatedFrames;
+    bool closed;
+
+    PoolState(int maxFree): maxFreeFrames(maxFree), numAllocatedFrames(0), closed(false) {}
+};
+
+// A single buffer holding all images and the Q-matrix of one image set
+class PooledFrame: public DataOwner {
+public:
+    FrameGeometry geometry;
+    unsigned char* images[ImageSet::MAX_SUPPORTED_IMAGES];
+    float* qMatrix;
+
+    PooledFrame(const std::shared_ptr<PoolState>& state, const FrameGeometry& geometry)
+            : geometry(geometry), state(state) {
+        int offsets[ImageSet::MAX_SUPPORTED_IMAGES];
+        int totalSize = 0;
+        for(int i=0; i<geometry.numberOfImages; i++) {
+            offsets[i] = totalSize;
+            int imageSize = geometry.height * geometry.getRowStride(i) + IMAGE_PADDING;
+            totalSize += (imageSize + IMAGE_ALIGNMENT - 1) / IMAGE_ALIGNMENT * IMAGE_ALIGNMENT;
+        }
+
+        buffer.resize(totalSize + 16*sizeof(float));
+        for(int i=0; i<ImageSet::MAX_SUPPORTED_IMAGES; i++) {
+            images[i] = i < geometry.numberOfImages ? &buffer[offsets[i]] : NULL;
+        }
+        qMatrix = reinterpret_cast<float*>(&buffer[totalSize]);
+    }
+
+protected:
+    virtual void release() {
+        // Keep the state alive, as deleting this frame might otherwise
+        // delete the state while its mutex is locked
+        std::shared_ptr<PoolState> poolState = state;
+        bool recycled = false;
+        {
+            std::unique_lock<std::mutex> lock(poolState->mutex);
+            if(!poolState->closed) {
+                std::vector<PooledFrame*>& frames = poolState->freeFrames[geometry];
+                if(static_cast<int>(frames.size()) < poolState->maxFreeFrames) {
+                    frames.push_back(this);
+                    recycled = true;
+                }
+            }
+        }
+        if(!recycled) {
+            delete this;
+        }
+    }
+
+private:
+    std::shared_ptr<PoolState> state;
+    std::vector<unsigned char, AlignedAllocator<unsigned char, IMAGE_ALIGNMENT> > buffer;
+};
+
+}
+
+/*************** Pimpl class containing all private members ***********/
+
+class FramePool::Pimpl {
+public:
+    Pimpl(int maxFreeFrames);
+    ~Pimpl();
+
+    void setMaxFreeFrames(int maxFreeFrames);
+    int getMaxFreeFrames() const;
+    void reserve(const ImageSet& layout, int numFrames);
+    PooledFrame* acquireFrame(const ImageSet& layout);
+    void clear();
+    int getNumFreeFrames() const;
+    int getNumAllocatedFrames() const;
+
+private:
+    std::shared_ptr<PoolState> state;
+
+    // Removes all free frames from the pool, which are then deleted by the caller
+    void takeFreeFrames(std::vector<PooledFrame*>& frames);
+};
+
+/******************** Stubs for all public members ********************/
+
+FramePool::FramePool(int maxFreeFrames)
+    : pimpl(new Pimpl(maxFreeFrames)) {
+}
+
+FramePool::~FramePool() {
+    delete pimpl;
+}
+
+void FramePool::setMaxFreeFrames(int maxFreeFrames) {
+    pimpl->setMaxFreeFrames(maxFreeFrames);
+}
+
+int FramePool::getMaxFreeFrames() const {
+    return pimpl->getMaxFreeFrames();
+}
+
+void FramePool::reserve(const ImageSet& layout, int numFrames) {
+    pimpl->reserve(layout, numFrames);
+}
+
+void FramePool::allocate(const ImageSet& layout, ImageSet& dest) {
+    PooledFrame* frame = pimpl->acquireFrame(layout);
+
+    // Copy the Q-matrix first, as dest might be identical to layout
+    const float* q = layout.getQMatrix();
+    if(q != NULL) {
+        memcpy(frame->qMatrix, q, 16*sizeof(float));
+    }
+
+    if(&dest != &layout) {
+        dest = layout;
+    }
+    dest.setDataOwner(frame);
+
+    for(int i=0; i<frame->geometry.numberOfImages; i++) {
+        dest.setRowStride(i, frame->geometry.getRowStride(i));
+        dest.setPixelData(i, frame->images[i]);
+    }
+    dest.setQMatrix(q != NULL ? frame->qMatrix : NULL);
+}
+
+void FramePool::copy(const ImageSet& src, ImageSet& dest) {
+    if(&src == &dest) {
+        // Keep the source data alive while copying
+        ImageSet srcCopy(src);
+        copy(srcCopy, dest);
+        return;
+    }
+
+    allocate(src, dest);
+
+    for(int i=0; i<src.getNumberOfImages(); i++) {
+        int srcStride = src.getRowStride(i);
+        int destStride = dest.getRowStride(i);
+        const unsigned char* srcData = src.getPixelData(i);
+        unsigned char* destData = dest.getPixelData(i);
+
+        if(srcStride == destStride) {
+            memcpy(destData, srcData, destStride * src.getHeight());
+        } else {
+            for(int y = 0; y < src.getHeight(); y++) {
+                memcpy(&destData[y*destStride], &srcData[y*srcStride], destStride);
+            }
+        }
+    }
+}
+
+void FramePool::clear() {
+    pimpl->clear();
+}
+
+int FramePool::getNumFreeFrames() const {
+    return pimpl->getNumFreeFrames();
+}
+
+int FramePool::getNumAllocatedFrames() const {
+    return pimpl->getNumAllocatedFrames();
+}
+
+/******************** Implementation in pimpl class *******************/
+
+FramePool::Pimpl::Pimpl(int maxFreeFrames)
+    : state(new PoolState(0)) {
+    setMaxFreeFrames(maxFreeFrames);
+}
+
+FramePool::Pimpl::~Pimpl() {
+    // Frames that are still in use will be deleted on release
+    std::vector<PooledFrame*> frames;
+    {
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->closed = true;
+        takeFreeFrames(frames);
+    }
+    for(unsigned int i=0; i<frames.size(); i++) {
+        delete frames[i];
+    }
+}
+
+void FramePool::Pimpl::setMaxFreeFrames(int maxFreeFrames) {
+    if(maxFreeFrames < 0) {
+        throw std::runtime_error("Illegal maximum number of free frames!");
+    }
+
+    std::vector<PooledFrame*> excessFrames;
+    {
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->maxFreeFrames = maxFreeFrames;
+        for(std::map<FrameGeometry, std::vector<PooledFrame*> >::iterator it = state->freeFrames.begin();
+                it != state->freeFrames.end(); it++) {
+            while(static_cast<int>(it->second.size()) > maxFreeFrames) {
+                excessFrames.push_back(it->second.back());
+                it->second.pop_back();
+            }
+        }
+    }
+    for(unsigned int i=0; i<excessFrames.size(); i++) {
+        delete excessFrames[i];
+    }
+}
+
+int FramePool::Pimpl::getMaxFreeFrames() const {
+    std::unique_lock<std::mutex> lock(state->mutex);
+    return state->maxFreeFrames;
+}
+
+void FramePool::Pimpl::reserve(const ImageSet& layout, int numFrames) {
+    FrameGeometry geometry(layout);
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    std::vector<PooledFrame*>& frames = state->freeFrames[geometry];
+    while(static_cast<int>(frames.size()) < numFrames) {
+        frames.push_back(new PooledFrame(state, geometry));
+        state->numAllocatedFrames++;
+    }
+}
+
+PooledFrame* FramePool::Pimpl::acquireFrame(const ImageSet& layout) {
+    FrameGeometry geometry(layout);
+
+    {
+        std::unique_lock<std::mutex> lock(state->mutex);
+        std::vector<PooledFrame*>& frames = state->freeFrames[geometry];
+        if(frames.size() > 0) {
+            PooledFrame* frame = frames.back();
+            frames.pop_back();
+            return frame;
+        }
+        state->numAllocatedFrames++;
+    }
+
+    // Allocate outside of the lock
+    return new PooledFrame(state, geometry);
+}
+
+void FramePool::Pimpl::clear() {
+    std::vector<PooledFrame*> frames;
+    {
+        std::unique_lock<std::mutex> lock(state->mutex);
+        takeFreeFrames(frames);
+    }
+    for(unsigned int i=0; i<frames.size(); i++) {
+        delete frames[i];
+    }
+}
+
+int FramePool::Pimpl::getNumFreeFrames() const {
+    std::unique_lock<std::mutex> lock(state->mutex);
+    int count = 0;
+    for(std::map<FrameGeometry, std::vector<PooledFrame*> >::const_iterator it = state->freeFrames.begin();
+            it != state->freeFrames.end(); it++) {
+        count += static_cast<int>(it->second.size());
+    }
+    return count;
+}
+
+int FramePool::Pimpl::getNumAllocatedFrames() const {
+    std::unique_lock<std::mutex> lock(state->mutex);
+    return state->numAllocatedFrames;
+}
+
+void FramePool::Pimpl::takeFreeFrames(std::vector<PooledFrame*>& frames) {
+    for(std::map<FrameGeometry, std::vector<PooledFrame*> >::iterator it = state->freeFrames.begin();
+            it != state->freeFrames.end(); it++) {
+        frames.insert(frames.end(), it->second.begin(), it->second.end());
+        it->second.clear();
+    }
+}
+
+} // namespace
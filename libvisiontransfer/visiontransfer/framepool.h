@@ -0,0 +1,134 @@
+/*******************************************************************************
+ * Copyright (c) 2024 Allied Vision Technologies GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *******************************************************************************/
+
+
+#ifndef VISIONTRANSFER_FRAMEPOOL_H
+#define VISIONTRANSFER_FRAMEPOOL_H
+
+#include "visiontransfer/common.h"
+#include "visiontransfer/imageset.h"
+
+namespace visiontransfer {
+
+/**
+ * \brief A pool of recyclable pixel buffers for image sets.
+ *
+ * The pool hands out image sets that own their pixel data, just like image
+ * sets created with ImageSet::copyTo(). Once the last copy of such an image
+ * set is destroyed or overwritten, its buffer is returned to the pool and is
+ * reused for the next image set of the same geometry, i.e. with the same
+ * width, height, number of images and pixel formats. Continuously copying
+ * or creating frames thus does not require any heap allocations once the
+ * pool has warmed up:
+ *
+ * \code
+ * FramePool pool;
+ * ImageSet imageSet, copy;
+ * while(imageTransfer.receiveImageSet(imageSet)) {
+ *     pool.copy(imageSet, copy);
+ *     // Hand the copy to another thread ...
+ * }
+ * \endcode
+ *
+ * Each image of a pooled buffer starts at a 32-byte aligned address and is
+ * stored without row padding. The pool is thread-safe, and image sets may be
+ * released by any thread. Image sets may also outlive the pool, in which
+ * case their buffers are freed instead of being returned.
+ */
+class VT_EXPORT FramePool {
+public:
+    /**
+     * \brief Creates a new, empty frame pool.
+     *
+     * \param maxFreeFrames The maximum number of unused buffers that are kept
+     *        for each geometry. See setMaxFreeFrames().
+     */
+    FramePool(int maxFreeFrames = 8);
+
+    ~FramePool();
+
+    /**
+     * \brief Sets the maximum number of unused buffers that are kept for
+     * each geometry.
+     *
+     * Buffers that are returned while this many buffers of the same
+     * geometry are already unused are freed. The limit does not restrict
+     * the number of buffers that can be in use at the same time.
+     */
+    void setMaxFreeFrames(int maxFreeFrames);
+
+    /// Returns the maximum number of unused buffers kept for each geometry
+    int getMaxFreeFrames() const;
+
+    /**
+     * \brief Allocates buffers in advance.
+     *
+     * \param layout Image set with the geometry for which to allocate.
+     * \param numFrames Number of unused buffers that shall be available for
+     *        this geometry.
+     */
+    void reserve(const ImageSet& layout, int numFrames);
+
+    /**
+     * \brief Provides an image set with pooled pixel buffers.
+     *
+     * \param layout Image set whose geometry and metadata, including the
+     *        values of its Q-matrix, are assigned to \c dest.
+     * \param dest Image set that receives the pooled buffers. Its previous
+     *        data is released.
+     *
+     * The content of the pixel buffers is undefined. This method is meant for
+     * producers that fill in the pixel data themselves.
+     */
+    void allocate(const ImageSet& layout, ImageSet& dest);
+
+    /**
+     * \brief Makes a deep copy of an image set into pooled pixel buffers.
+     *
+     * \param src The image set that shall be copied.
+     * \param dest Image set that receives the copy. Its previous data is
+     *        released.
+     *
+     * This is equivalent to ImageSet::copyTo(), except for the origin of
+     * the memory.
+     */
+    void copy(const ImageSet& src, ImageSet& dest);
+
+    /// Frees all buffers that are currently unused
+    void clear();
+
+    /// Returns the number of unused buffers across all geometries
+    int getNumFreeFrames() const;
+
+    /**
+     * \brief Returns the total number of buffers that have been allocated
+     * by this pool.
+     *
+     * Once all required buffers are available, this number stays constant.
+     */
+    int getNumAllocatedFrames() const;
+
+private:
+    // We follow the pimpl idiom
+    class Pimpl;
+    Pimpl* pimpl;
+
+    // This class cannot be copied
+    FramePool(const FramePool& other);
+    FramePool& operator=(const FramePool&);
+};
+
+} // namespace
+
+#endif
@@ -22,6 +22,7 @@
 #include "visiontransfer/exceptions.h"
 #include "visiontransfer/internal/alignedallocator.h"
 #include "visiontransfer/internal/datablockprotocol.h"
+#include "visiontransfer/internal/receivebuffers.h"
 #include "visiontransfer/internal/bitconversions.h"
 #include "visiontransfer/internal/internalinformation.h"
 
@@ -77,6 +78,7 @@ public:
     bool newClientConnected();
 
     std::string statusReport();
+    void exchangeReceiveBuffers(ReceiveBuffers& buffers);
 
     bool supportsExtendedConnectionStateProtocol() const;
 
@@ -156,6 +158,7 @@ private:
 
     // Transfer related variables
     std::vector<unsigned char> headerBuffer;
+    std::vector<unsigned char> encodingBuffer[ImageSet::MAX_SUPPORTED_IMAGES];
 
     // Reception related variables
     std::vector<unsigned char, AlignedAllocator<unsigned char> >decodeBuffer[ImageSet::MAX_SUPPORTED_IMAGES];
@@ -319,8 +322,8 @@ void ImageProtocol::Pimpl::setTransferImageSet(const ImageSet& imageSet) {
         if(imageSet.getPixelFormat(i) != ImageSet::FORMAT_12_BIT_MONO) {
             pixelData[i] = imageSet.getPixelData(i);
         } else {
-            static std::vector<unsigned char> encodingBuffer[ImageSet::MAX_SUPPORTED_IMAGES];
-            encodingBuffer[i].resize(rowSize[i] * imageSet.getHeight());
+            // The UDP segment header temporarily overwrites 4 bytes after the data
+            encodingBuffer[i].resize(rowSize[i] * imageSet.getHeight() + 4);
             BitConversions::encode12BitPacked(0, imageSet.getHeight(), imageSet.getPixelData(i),
                 &encodingBuffer[i][0], imageSet.getRowStride(i), rowSize[i], imageSet.getWidth());
             pixelData[i] = &encodingBuffer[i][0];
@@ -996,6 +999,21 @@ std::string ImageProtocol::Pimpl::statusReport() {
     return dataProt.statusReport();
 }
 
+void ImageProtocol::exchangeReceiveBuffers(ReceiveBuffers& buffers) {
+    pimpl->exchangeReceiveBuffers(buffers);
+}
+
+void ImageProtocol::Pimpl::exchangeReceiveBuffers(ReceiveBuffers& buffers) {
+    // Swapping the vectors keeps all pixel data pointers valid, which now
+    // point into the given buffers
+    for(int i=0; i<DataBlockProtocol::MAX_DATA_BLOCKS; i++) {
+        dataProt.swapBlockReceiveBuffer(i, buffers.blockData[i]);
+    }
+    for(int i=0; i<ImageSet::MAX_SUPPORTED_IMAGES; i++) {
+        decodeBuffer[i].swap(buffers.decodedData[i]);
+    }
+}
+
 bool ImageProtocol::Pimpl::supportsExtendedConnectionStateProtocol() const {
     return dataProt.supportsExtendedConnectionStateProtocol();
 }
@@ -22,6 +22,10 @@
 
 namespace visiontransfer {
 
+namespace internal {
+    struct ReceiveBuffers;
+}
+
 /**
  * \brief A lightweight protocol for transferring image sets.
  *
@@ -251,6 +255,17 @@ public:
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
     /// Prints status information to the console
     std::string statusReport();
+
+    /**
+     * \brief Exchanges the buffers holding the last received image set
+     * with the given buffers.
+     *
+     * The pixel data of the last image set returned by getReceivedImageSet()
+     * is handed over without copying, and the given buffers are used for
+     * subsequent receptions instead. This method may only be called after
+     * a complete image set has been received.
+     */
+    void exchangeReceiveBuffers(internal::ReceiveBuffers& buffers);
 #endif
 
 private:
@@ -16,7 +16,14 @@
 #include <fstream>
 #include <stdexcept>
 #include <cstring>
+#include <utility>
+#include <functional>
+#include <algorithm>
+#include <vector>
 #include "visiontransfer/imageset.h"
+#include "visiontransfer/framepool.h"
+#include "visiontransfer/internal/dataowner.h"
+#include "visiontransfer/internal/threadpool.h"
 
 #ifdef _WIN32
 #include <winsock2.h>
@@ -24,10 +31,94 @@
 #include <arpa/inet.h>
 #endif
 
+// SIMD Headers
+#ifdef __AVX2__
+#include <immintrin.h>
+#elif __SSE2__
+#include <emmintrin.h>
+#endif
+
 using namespace visiontransfer;
+using namespace visiontransfer::internal;
 
 namespace visiontransfer {
 
+namespace {
+
+// Owner of the data of image sets created with copyTo()
+class HeapDataOwner: public DataOwner {
+public:
+    unsigned char* data[ImageSet::MAX_SUPPORTED_IMAGES];
+    float* qMatrix;
+
+    HeapDataOwner(): qMatrix(NULL) {
+        for(int i=0; i<ImageSet::MAX_SUPPORTED_IMAGES; i++) {
+            data[i] = NULL;
+        }
+    }
+
+protected:
+    virtual void release() {
+        for(int i=0; i<ImageSet::MAX_SUPPORTED_IMAGES; i++) {
+            delete []data[i];
+        }
+        delete []qMatrix;
+        delete this;
+    }
+};
+
+// Size of the staging buffer for converting pixel data before writing
+const int WRITE_CHUNK_SIZE = 256*1024;
+
+// Converts 16-bit values from little to big endian, as required by PGM
+void swapBytes16(const unsigned char* src, unsigned char* dst, int count) {
+    int i = 0;
+#if defined(__AVX2__)
+    for(; i + 16 <= count; i += 16) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&src[2*i]));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(&dst[2*i]),
+            _mm256_or_si256(_mm256_slli_epi16(v, 8), _mm256_srli_epi16(v, 8)));
+    }
+#endif
+#if defined(__SSE2__) || defined(__AVX2__)
+    for(; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src[2*i]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&dst[2*i]),
+            _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
+    }
+#endif
+    for(; i < count; i++) {
+        dst[2*i] = src[2*i + 1];
+        dst[2*i + 1] = src[2*i];
+    }
+}
+
+// Owner of external data that is released through a user callback
+class CallbackDataOwner: public DataOwner {
+public:
+    CallbackDataOwner(const std::function<void()>& callback, DataOwner* previousOwner)
+        : callback(callback), previousOwner(previousOwner) {
+    }
+
+protected:
+    virtual void release() {
+        if(callback) {
+            callback();
+        }
+        if(previousOwner != NULL) {
+            previousOwner->removeReference();
+        }
+        delete this;
+    }
+
+private:
+    std::function<void()> callback;
+    // Owned data that was referenced before the callback has been set
+    DataOwner* previousOwner;
+};
+
+}
+
 // Pimpl (implementation) class
 
 class ImageSet::Pimpl {
@@ -42,6 +133,14 @@ public:
     ~Pimpl();
     Pimpl& operator= (Pimpl const& other);
 
+    // Releases the referenced data and restores the default state
+    void reset();
+
+    // Makes this set a reference of the given data owner
+    void setDataOwner(DataOwner* owner);
+
+    void setReleaseCallback(const std::function<void()>& callback);
+
     void setWidth(int w) {width = w;}
 
     void setHeight(int h) {height = h;}
@@ -141,6 +240,8 @@ public:
 
     void writePgmFile(int imageNumber, const char* fileName) const;
 
+    void writePgmFiles(const char* const* fileNames) const;
+
     void copyTo(ImageSet::Pimpl& dest);
 
     int getBytesPerPixel(int imageNumber) const {
@@ -240,7 +341,9 @@ private:
     int minDisparity;
     int maxDisparity;
     int subpixelFactor;
-    int* referenceCounter;
+    // Shared by all copies of a set that owns its data (see copyTo()). Copies
+    // may be released concurrently from different threads.
+    DataOwner* dataOwner;
     int numberOfImages;
 
     int indexLeftImage;
@@ -261,7 +364,7 @@ private:
 ImageSet::Pimpl::Pimpl()
     : width(0), height(0), qMatrix(NULL), timeSec(0), timeMicrosec(0),
         seqNum(0), minDisparity(0), maxDisparity(0), subpixelFactor(16),
-        referenceCounter(NULL), numberOfImages(2), indexLeftImage(0), indexRightImage(1), indexDisparityImage(-1),
+        dataOwner(NULL), numberOfImages(2), indexLeftImage(0), indexRightImage(1), indexDisparityImage(-1),
         indexColorImage(-1), exposureTime(0), lastSyncPulseSec(0), lastSyncPulseMicrosec(0), triggerPulseSequenceIndex{0} {
     for (int i=0; i<ImageSet::MAX_SUPPORTED_IMAGES; ++i) {
         formats[i] = ImageSet::FORMAT_8_BIT_MONO;
@@ -286,6 +389,26 @@ ImageSet::Pimpl::~Pimpl() {
     decrementReference();
 }
 
+void ImageSet::Pimpl::reset() {
+    decrementReference();
+    Pimpl empty;
+    copyData(*this, empty, false);
+}
+
+void ImageSet::Pimpl::setReleaseCallback(const std::function<void()>& callback) {
+    // Our reference to a previous owner is passed on to the new owner
+    dataOwner = new CallbackDataOwner(callback, dataOwner);
+    dataOwner->addReference();
+}
+
+void ImageSet::Pimpl::setDataOwner(DataOwner* owner) {
+    if(owner != NULL) {
+        owner->addReference();
+    }
+    decrementReference();
+    dataOwner = owner;
+}
+
 void ImageSet::Pimpl::copyData(ImageSet::Pimpl& dest, const ImageSet::Pimpl& src, bool countRef) {
     dest.width = src.width;
     dest.height = src.height;
@@ -304,7 +427,7 @@ void ImageSet::Pimpl::copyData(ImageSet::Pimpl& dest, const ImageSet::Pimpl& src
     dest.minDisparity = src.minDisparity;
     dest.maxDisparity = src.maxDisparity;
     dest.subpixelFactor = src.subpixelFactor;
-    dest.referenceCounter = src.referenceCounter;
+    dest.dataOwner = src.dataOwner;
     dest.numberOfImages = src.numberOfImages;
     dest.indexLeftImage = src.indexLeftImage;
     dest.indexRightImage = src.indexRightImage;
@@ -318,22 +441,15 @@ void ImageSet::Pimpl::copyData(ImageSet::Pimpl& dest, const ImageSet::Pimpl& src
         dest.triggerPulseSequenceIndex[i] = src.triggerPulseSequenceIndex[i];
     }
 
-    if(dest.referenceCounter != nullptr && countRef) {
-        (*dest.referenceCounter)++;
+    if(dest.dataOwner != nullptr && countRef) {
+        dest.dataOwner->addReference();
     }
 }
 
 void ImageSet::Pimpl::decrementReference() {
-    if(referenceCounter != nullptr && --(*referenceCounter) == 0) {
-        for (int i=0; i<getNumberOfImages(); ++i) {
-            delete []data[i];
-            data[i] = nullptr;
-        }
-        delete []qMatrix;
-        delete referenceCounter;
-
-        qMatrix = nullptr;
-        referenceCounter = nullptr;
+    if(dataOwner != nullptr) {
+        dataOwner->removeReference();
+        dataOwner = nullptr;
     }
 }
 
@@ -371,43 +487,75 @@ void ImageSet::Pimpl::writePgmFile(int imageNumber, const char* fileName) const
 
     strm << "P" << type << " " << width << " " << height << " " << maxVal << std::endl;
 
-    // Write image data
-    for(int y = 0; y < height; y++) {
-        for(int x = 0; x < width*channels; x++) {
-            unsigned char* pixel = &data[imageNumber][y*rowStride[imageNumber] + x*bytesPerChannel];
-            if(bytesPerChannel == 2) {
-                // Swap endianess
-                unsigned short swapped = htons(*reinterpret_cast<unsigned short*>(pixel));
-                strm.write(reinterpret_cast<char*>(&swapped), sizeof(swapped));
-            } else {
-                strm.write(reinterpret_cast<char*>(pixel), 1);
+    const unsigned char* imageData = data[imageNumber];
+    int stride = rowStride[imageNumber];
+    int rowSize = width*channels*bytesPerChannel;
+
+    // Write image data with as few write calls as possible
+    if(bytesPerChannel == 1 && stride == rowSize) {
+        strm.write(reinterpret_cast<const char*>(imageData), static_cast<std::streamsize>(rowSize)*height);
+    } else if(bytesPerChannel == 1) {
+        for(int y = 0; y < height; y++) {
+            strm.write(reinterpret_cast<const char*>(&imageData[y*stride]), rowSize);
+        }
+    } else {
+        // Swap endianess of multiple rows at once in a staging buffer
+        int rowsPerChunk = std::max(1, WRITE_CHUNK_SIZE / rowSize);
+        std::vector<unsigned char> buffer(static_cast<size_t>(std::min(rowsPerChunk, height))*rowSize);
+        for(int y = 0; y < height; y += rowsPerChunk) {
+            int rows = std::min(rowsPerChunk, height - y);
+            for(int i = 0; i < rows; i++) {
+                swapBytes16(&imageData[(y + i)*stride], &buffer[i*rowSize], width*channels);
             }
+            strm.write(reinterpret_cast<const char*>(&buffer[0]), rows*rowSize);
         }
     }
+
+    if(!strm) {
+        throw std::runtime_error("Error writing file!");
+    }
 }
 
-void ImageSet::Pimpl::copyTo(ImageSet::Pimpl& dest) {
-    dest.decrementReference();
-    copyData(dest, *this, false);
+void ImageSet::Pimpl::writePgmFiles(const char* const* fileNames) const {
+    // One thread per image, with the first image written by the calling thread
+    ThreadPool threadPool;
+    threadPool.setNumThreads(getNumberOfImages());
 
-    dest.qMatrix = new float[16];
-    memcpy(const_cast<float*>(dest.qMatrix), qMatrix, sizeof(float)*16);
+    // Each band receives at most one image
+    threadPool.parallelFor(getNumberOfImages(), [this, fileNames](int, int start, int end) {
+        for(int i = start; i < end; i++) {
+            writePgmFile(i, fileNames[i]);
+        }
+    });
+}
 
-    for(int i=0; i<getNumberOfImages(); i++) {
-        int bytesPixel = getBytesPerPixel(i);
+void ImageSet::Pimpl::copyTo(ImageSet::Pimpl& dest) {
+    HeapDataOwner* owner = new HeapDataOwner;
+    owner->qMatrix = new float[16];
+    memcpy(owner->qMatrix, qMatrix, sizeof(float)*16);
 
-        dest.rowStride[i] = width*bytesPixel;
-        dest.data[i] = new unsigned char[height*dest.rowStride[i]];
+    for(int i=0; i<getNumberOfImages(); i++) {
+        int newStride = width*getBytesPerPixel(i);
+        owner->data[i] = new unsigned char[height*newStride];
 
         // Convert possibly different row strides
         for(int y = 0; y < height; y++) {
-            memcpy(&dest.data[i][y*dest.rowStride[i]], &data[i][y*rowStride[i]],
-                dest.rowStride[i]);
+            memcpy(&owner->data[i][y*newStride], &data[i][y*rowStride[i]], newStride);
         }
     }
 
-    dest.referenceCounter = new int;
-    (*dest.referenceCounter) = 1;
+    // The destination might reference the same data as this set. Its
+    // reference may hence only be released after copying.
+    dest.decrementReference();
+    copyData(dest, *this, false);
+    dest.dataOwner = NULL;
+    dest.setDataOwner(owner);
+
+    dest.qMatrix = owner->qMatrix;
+    for(int i=0; i<getNumberOfImages(); i++) {
+        dest.rowStride[i] = width*getBytesPerPixel(i);
+        dest.data[i] = owner->data[i];
+    }
 }
 
 ImageSet::ImageType ImageSet::Pimpl::getImageType(int imageNumber) const {
@@ -488,7 +636,7 @@ ImageSet::ImageSet()
 }
 
 ImageSet::ImageSet(const ImageSet& other)
-: pimpl(new Pimpl(*(other.pimpl))) {
+: pimpl(new Pimpl(*(other.readablePimpl()))) {
 
 }
 
@@ -497,178 +645,229 @@ ImageSet::~ImageSet() {
 }
 
 ImageSet& ImageSet::operator= (ImageSet const& other) {
-    (*pimpl) = *(other.pimpl);
+    (*writablePimpl()) = *(other.readablePimpl());
+    return *this;
+}
+
+ImageSet::ImageSet(ImageSet&& other) noexcept
+: pimpl(other.pimpl) {
+    // The other set is left without a pimpl, which is only allocated again
+    // once it is modified
+    other.pimpl = nullptr;
+}
+
+ImageSet& ImageSet::operator= (ImageSet&& other) noexcept {
+    if(&other != this) {
+        // Take over the other set's state without touching the reference
+        // counter, and release our previous data
+        delete pimpl;
+        pimpl = other.pimpl;
+        other.pimpl = nullptr;
+    }
     return *this;
 }
 
+void ImageSet::swap(ImageSet& other) {
+    std::swap(pimpl, other.pimpl);
+}
+
+ImageSet::Pimpl* ImageSet::writablePimpl() {
+    if(pimpl == nullptr) {
+        pimpl = new Pimpl();
+    }
+    return pimpl;
+}
+
+const ImageSet::Pimpl* ImageSet::readablePimpl() const {
+    // Moved-from image sets read as default constructed ones
+    static const Pimpl emptyPimpl;
+    return pimpl != nullptr ? pimpl : &emptyPimpl;
+}
+
+void ImageSet::setDataOwner(DataOwner* owner) {
+    writablePimpl()->setDataOwner(owner);
+}
+
 void ImageSet::setWidth(int w) {
-    pimpl->setWidth(w);
+    writablePimpl()->setWidth(w);
 }
 
 void ImageSet::setHeight(int h) {
-    pimpl->setHeight(h);
+    writablePimpl()->setHeight(h);
 }
 
 void ImageSet::setRowStride(int imageNumber, int stride) {
-    pimpl->setRowStride(imageNumber, stride);
+    writablePimpl()->setRowStride(imageNumber, stride);
 }
 
 void ImageSet::setPixelFormat(int imageNumber, ImageSet::ImageFormat format) {
-    pimpl->setPixelFormat(imageNumber, format);
+    writablePimpl()->setPixelFormat(imageNumber, format);
 }
 
 void ImageSet::setPixelData(int imageNumber, unsigned char* pixelData) {
-    pimpl->setPixelData(imageNumber, pixelData);
+    writablePimpl()->setPixelData(imageNumber, pixelData);
+}
+
+void ImageSet::setReleaseCallback(const std::function<void()>& callback) {
+    writablePimpl()->setReleaseCallback(callback);
 }
 
 void ImageSet::setQMatrix(const float* q) {
-    pimpl->setQMatrix(q);
+    writablePimpl()->setQMatrix(q);
 }
 
 void ImageSet::setSequenceNumber(unsigned int num) {
-    pimpl->setSequenceNumber(num);
+    writablePimpl()->setSequenceNumber(num);
 }
 
 void ImageSet::setTimestamp(int seconds, int microsec) {
-    pimpl->setTimestamp(seconds, microsec);
+    writablePimpl()->setTimestamp(seconds, microsec);
 }
 
 void ImageSet::setDisparityRange(int minimum, int maximum) {
-    pimpl->setDisparityRange(minimum, maximum);
+    writablePimpl()->setDisparityRange(minimum, maximum);
 }
 
 void ImageSet::setSubpixelFactor(int subpixFact) {
-    pimpl->setSubpixelFactor(subpixFact);
+    writablePimpl()->setSubpixelFactor(subpixFact);
 }
 
 void ImageSet::setImageDisparityPair(bool dispPair) {
-    pimpl->setImageDisparityPair(dispPair);
+    writablePimpl()->setImageDisparityPair(dispPair);
 }
 
 int ImageSet::getWidth() const {
-    return pimpl->getWidth();
+    return readablePimpl()->getWidth();
 }
 
 int ImageSet::getHeight() const {
-    return pimpl->getHeight();
+    return readablePimpl()->getHeight();
 }
 
 int ImageSet::getRowStride(int imageNumber) const {
-    return pimpl->getRowStride(imageNumber);
+    return readablePimpl()->getRowStride(imageNumber);
 }
 
 int ImageSet::getRowStride(ImageSet::ImageType what) const {
-    return pimpl->getRowStride(what);
+    return readablePimpl()->getRowStride(what);
 }
 
 ImageSet::ImageFormat ImageSet::getPixelFormat(int imageNumber) const {
-    return pimpl->getPixelFormat(imageNumber);
+    return readablePimpl()->getPixelFormat(imageNumber);
 }
 
 ImageSet::ImageFormat ImageSet::getPixelFormat(ImageSet::ImageType what) const {
-    return pimpl->getPixelFormat(what);
+    return readablePimpl()->getPixelFormat(what);
 }
 
 unsigned char* ImageSet::getPixelData(int imageNumber) const {
-    return pimpl->getPixelData(imageNumber);
+    return readablePimpl()->getPixelData(imageNumber);
 }
 
 unsigned char* ImageSet::getPixelData(ImageSet::ImageType what) const {
-    return pimpl->getPixelData(what);
+    return readablePimpl()->getPixelData(what);
 }
 
 const float* ImageSet::getQMatrix() const {
-    return pimpl->getQMatrix();
+    return readablePimpl()->getQMatrix();
 }
 
 unsigned int ImageSet::getSequenceNumber() const {
-    return pimpl->getSequenceNumber();
+    return readablePimpl()->getSequenceNumber();
 }
 
 void ImageSet::getTimestamp(int& seconds, int& microsec) const {
-    pimpl->getTimestamp(seconds, microsec);
+    readablePimpl()->getTimestamp(seconds, microsec);
 }
 
 void ImageSet::getDisparityRange(int& minimum, int& maximum) const {
-    pimpl->getDisparityRange(minimum, maximum);
+    readablePimpl()->getDisparityRange(minimum, maximum);
 }
 
 int ImageSet::getSubpixelFactor() const {
-    return pimpl->getSubpixelFactor();
+    return readablePimpl()->getSubpixelFactor();
 }
 
 void ImageSet::writePgmFile(int imageNumber, const char* fileName) const {
-    pimpl->writePgmFile(imageNumber, fileName);
+    readablePimpl()->writePgmFile(imageNumber, fileName);
+}
+
+void ImageSet::writePgmFiles(const char* const* fileNames) const {
+    readablePimpl()->writePgmFiles(fileNames);
 }
 
 void ImageSet::copyTo(ImageSet& dest) {
-    pimpl->copyTo(*(dest.pimpl));
+    writablePimpl()->copyTo(*(dest.writablePimpl()));
+}
+
+void ImageSet::copyTo(ImageSet& dest, FramePool& pool) {
+    pool.copy(*this, dest);
 }
 
 int ImageSet::getBytesPerPixel(int imageNumber) const {
-    return pimpl->getBytesPerPixel(imageNumber);
+    return readablePimpl()->getBytesPerPixel(imageNumber);
 }
 
 int ImageSet::getBitsPerPixel(int imageNumber) const {
-    return pimpl->getBitsPerPixel(imageNumber);
+    return readablePimpl()->getBitsPerPixel(imageNumber);
 }
 
 int ImageSet::getBitsPerPixel(ImageSet::ImageType what) const {
-    return pimpl->getBitsPerPixel(what);
+    return readablePimpl()->getBitsPerPixel(what);
 }
 
 int ImageSet::getNumberOfImages() const {
-    return pimpl->getNumberOfImages();
+    return readablePimpl()->getNumberOfImages();
 }
 
 void ImageSet::setNumberOfImages(int number) {
-    pimpl->setNumberOfImages(number);
+    writablePimpl()->setNumberOfImages(number);
 }
 
 ImageSet::ImageType ImageSet::getImageType(int imageNumber) const {
-    return pimpl->getImageType(imageNumber);
+    return readablePimpl()->getImageType(imageNumber);
 }
 
 int ImageSet::getIndexOf(ImageSet::ImageType what, bool throwIfNotFound) const {
-    return pimpl->getIndexOf(what, throwIfNotFound);
+    return readablePimpl()->getIndexOf(what, throwIfNotFound);
 }
 
 bool ImageSet::hasImageType(ImageSet::ImageType what) const {
-    return pimpl->hasImageType(what);
+    return readablePimpl()->hasImageType(what);
 }
 
 void ImageSet::setIndexOf(ImageSet::ImageType what, int idx) {
-    pimpl->setIndexOf(what, idx);
+    writablePimpl()->setIndexOf(what, idx);
 }
 
 #ifdef CV_MAJOR_VERSION
 inline void ImageSet::toOpenCVImage(int imageNumber, cv::Mat& dest, bool convertRgbToBgr) {
-    pimpl->toOpenCVImage(imageNumber, dest, convertRgbToBgr);
+    writablePimpl()->toOpenCVImage(imageNumber, dest, convertRgbToBgr);
 }
 #endif
 
 void ImageSet::setExposureTime(int timeMicrosec) {
-    pimpl->setExposureTime(timeMicrosec);
+    writablePimpl()->setExposureTime(timeMicrosec);
 }
 
 int ImageSet::getExposureTime() const {
-    return pimpl->getExposureTime();
+    return readablePimpl()->getExposureTime();
 }
 
 void ImageSet::setLastSyncPulse(int seconds, int microsec) {
-    pimpl->setLastSyncPulse(seconds, microsec);
+    writablePimpl()->setLastSyncPulse(seconds, microsec);
 }
 
 void ImageSet::getLastSyncPulse(int& seconds, int& microsec) const {
-    pimpl->getLastSyncPulse(seconds, microsec);
+    readablePimpl()->getLastSyncPulse(seconds, microsec);
 }
 
 void ImageSet::setTriggerPulseSequenceIndex(int triggerChannel, int idx) {
-    pimpl->setTriggerPulseSequenceIndex(triggerChannel, idx);
+    writablePimpl()->setTriggerPulseSequenceIndex(triggerChannel, idx);
 }
 
 int ImageSet::getTriggerPulseSequenceIndex(int triggerChannel_RESERVED) const {
-    return pimpl->getTriggerPulseSequenceIndex(triggerChannel_RESERVED);
+    return readablePimpl()->getTriggerPulseSequenceIndex(triggerChannel_RESERVED);
 }
 
 // static
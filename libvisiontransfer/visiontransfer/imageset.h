@@ -19,8 +19,21 @@
 #include <cstddef>
 #include "visiontransfer/common.h"
 
+#if VISIONTRANSFER_CPLUSPLUS_VERSION >= 201103L
+#include <memory>
+#include <functional>
+#endif
+
 namespace visiontransfer {
 
+class AsyncTransfer;
+class FramePool;
+class MultiDeviceTransfer;
+class RecordingReader;
+namespace internal {
+    class DataOwner;
+}
+
 /**
  * \brief A set of one to three images, but usually two (the left camera image
  *  and the disparity map). One- and three-image modes can be enabled
@@ -34,6 +47,15 @@ namespace visiontransfer {
  * different pixel formats. Please note that the class does not manage the
  * pixel data but only keeps pointers. You thus need to ensure that the pixel
  * data remains valid for as long as this object persists.
+ *
+ * The only exception are image sets created through copyTo() or through a
+ * FramePool, image sets collected from AsyncTransfer, and image sets for
+ * which a release callback has been set with setReleaseCallback(). Such a
+ * set owns its pixel data, which is shared by all of its copies and
+ * released once the last copy is destroyed. The reference
+ * counting is thread-safe, such that copies can be handed to and released
+ * by different threads. The pixel data itself is not protected from
+ * concurrent modification.
  */
 class VT_EXPORT ImageSet {
 
@@ -42,6 +64,18 @@ private:
     class Pimpl;
     Pimpl* pimpl;
 
+    // A moved-from image set has no pimpl until it is modified again
+    Pimpl* writablePimpl();
+    const Pimpl* readablePimpl() const;
+
+    // Frame pools, recordings and received image sets attach their buffers
+    // as owned data
+    friend class AsyncTransfer;
+    friend class FramePool;
+    friend class MultiDeviceTransfer;
+    friend class RecordingReader;
+    void setDataOwner(internal::DataOwner* owner);
+
 public:
     static const int MAX_SUPPORTED_IMAGES = 4;
     static const int MAX_SUPPORTED_TRIGGER_CHANNELS = 5;
@@ -94,6 +128,43 @@ public:
     ~ImageSet();
     ImageSet& operator= (ImageSet const& other);
 
+#if VISIONTRANSFER_CPLUSPLUS_VERSION >= 201103L
+    /**
+     * \brief Move constructor that takes over the state of the other image set.
+     *
+     * The other image set is left empty, as if it was default constructed.
+     */
+    ImageSet(ImageSet&& other) noexcept;
+
+    /**
+     * \brief Move assignment that takes over the state of the other image set.
+     *
+     * Unlike a copy, this does not modify the reference count of owned pixel
+     * data. The previous data of this set is released, and the other image
+     * set is left empty, as if it was default constructed.
+     */
+    ImageSet& operator= (ImageSet&& other) noexcept;
+
+    /**
+     * \brief Shared handle to an image set.
+     *
+     * Copying an ImageSet allocates memory for the set's metadata. A handle
+     * can instead be copied at the cost of a single atomic increment, which
+     * makes it the preferred type for passing image sets between threads or
+     * keeping them in queues:
+     *
+     * \code
+     * ImageSet::Handle handle = std::make_shared<ImageSet>(std::move(imageSet));
+     * \endcode
+     */
+    typedef std::shared_ptr<ImageSet> Handle;
+#endif
+
+    /**
+     * \brief Exchanges the state of this image set with the other one.
+     */
+    void swap(ImageSet& other);
+
     /**
      * \brief Sets a new width for both images.
      */
@@ -137,6 +208,34 @@ public:
      */
     void setPixelData(int imageNumber, unsigned char* pixelData);
 
+#if VISIONTRANSFER_CPLUSPLUS_VERSION >= 201103L
+    /**
+     * \brief Sets a function that is called once the current pixel data is
+     * no longer referenced.
+     *
+     * \param callback Function that is called when the last copy of this
+     *        image set is destroyed, or when its data is replaced through
+     *        assignment or copyTo().
+     *
+     * This allows wrapping memory that is not owned by the library, such as
+     * DMA or shared memory buffers, and returning it to its owner once all
+     * copies have been released:
+     *
+     * \code
+     * imageSet.setPixelData(0, buffer);
+     * imageSet.setReleaseCallback([buffer, &bufferQueue]() {
+     *     bufferQueue.push(buffer);
+     * });
+     * \endcode
+     *
+     * The callback should be set after the pixel data. It may be invoked by
+     * any thread that releases the last copy, and must not throw exceptions.
+     * If the image set already owns its data, then this data is released
+     * after the callback has been invoked.
+     */
+    void setReleaseCallback(const std::function<void()>& callback);
+#endif
+
     /**
      * \brief Sets the pointer to the disparity-to-depth mapping matrix q.
      *
@@ -300,6 +399,17 @@ public:
      */
     void writePgmFile(int imageNumber, const char* fileName) const;
 
+    /**
+     * \brief Writes all images of the set to PGM or PPM files.
+     *
+     * \param fileNames Array with one file name for each image of the set
+     *        (0 ... getNumberOfImages()-1).
+     *
+     * The files are written concurrently, which is faster than writing
+     * each image with writePgmFile() when storing to fast disks.
+     */
+    void writePgmFiles(const char* const* fileNames) const;
+
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
     /**
      * \brief Returns true if this is a left camera image and disparity
@@ -321,9 +431,22 @@ public:
 
     /**
      * \brief Makes a deep copy of this image set.
+     *
+     * The pixel data and Q-matrix are copied to newly allocated memory,
+     * which is owned by \c dest. Use FramePool::copy() for avoiding the
+     * allocation when copying frames continuously.
      */
     void copyTo(ImageSet& dest);
 
+    /**
+     * \brief Makes a deep copy of this image set into buffers of the given
+     * frame pool.
+     *
+     * This is equivalent to pool.copy(*this, dest). Once the pool has warmed
+     * up, no memory is allocated for the copy.
+     */
+    void copyTo(ImageSet& dest, FramePool& pool);
+
     /**
      * \brief Returns the number of bytes that are required to store one
      * image pixel.
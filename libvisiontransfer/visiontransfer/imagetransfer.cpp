@@ -15,6 +15,8 @@
 #include <cstdio>
 #include <iostream>
 #include <cstring>
+#include <algorithm>
+#include <chrono>
 #include <memory>
 #include <string>
 #include <vector>
@@ -45,6 +47,10 @@ public:
     void setRawValidBytes(const std::vector<int>& validBytes);
     void setTransferImageSet(const ImageSet& imageSet);
     TransferStatus transferData();
+    bool waitForSocket(bool writable, bool readable, int timeoutMillisec);
+    void interruptWait();
+    static bool waitForSockets(Pimpl* const* transfers, int numTransfers,
+        bool writable, bool readable, bool* ready, int timeoutMillisec);
     bool receiveImageSet(ImageSet& imageSet);
     bool receivePartialImageSet(ImageSet& imageSet, int& validRows, bool& complete);
     int getNumDroppedFrames() const;
@@ -57,6 +63,7 @@ public:
     void setAutoReconnect(int secondsBetweenRetries);
 
     std::string statusReport();
+    void exchangeReceiveBuffers(internal::ReceiveBuffers& buffers);
 
 private:
     // Configuration parameters
@@ -72,6 +79,7 @@ private:
     // Transfer related members
     SOCKET clientSocket;
     SOCKET tcpServerSocket;
+    SOCKET wakeupSocket;
     sockaddr_in remoteAddress;
     addrinfo* addressInfo;
 
@@ -147,6 +155,24 @@ ImageTransfer::TransferStatus ImageTransfer::transferData() {
     return pimpl->transferData();
 }
 
+bool ImageTransfer::waitForSocket(bool writable, bool readable, int timeoutMillisec) {
+    return pimpl->waitForSocket(writable, readable, timeoutMillisec);
+}
+
+void ImageTransfer::interruptWait() {
+    pimpl->interruptWait();
+}
+
+bool ImageTransfer::waitForAnySocket(ImageTransfer* const* transfers, int numTransfers,
+        bool* readable, int timeoutMillisec) {
+    std::vector<Pimpl*> pimpls(numTransfers);
+    for(int i=0; i<numTransfers; i++) {
+        pimpls[i] = transfers[i]->pimpl;
+    }
+    return Pimpl::waitForSockets(pimpls.empty() ? nullptr : &pimpls[0], numTransfers,
+        false, true, readable, timeoutMillisec);
+}
+
 bool ImageTransfer::receiveImageSet(ImageSet& imageSet) {
     return pimpl->receiveImageSet(imageSet);
 }
@@ -192,7 +218,7 @@ ImageTransfer::Pimpl::Pimpl(const char* address, const char* service,
         : protType(protType), isServer(server), bufferSize(bufferSize),
         maxUdpPacketSize(maxUdpPacketSize),
         clientSocket(INVALID_SOCKET), tcpServerSocket(INVALID_SOCKET),
-        tcpReconnectSecondsBetweenRetries(autoReconnectDelay),
+        wakeupSocket(INVALID_SOCKET), tcpReconnectSecondsBetweenRetries(autoReconnectDelay),
         knownConnectedState(false), gotAnyData(false),
         currentMsgLen(0), currentMsgOffset(0), currentMsg(nullptr) {
 
@@ -204,13 +230,32 @@ ImageTransfer::Pimpl::Pimpl(const char* address, const char* service,
 
     memset(&remoteAddress, 0, sizeof(remoteAddress));
 
+    // Without a wakeup socket, waitForSocket() cannot be interrupted
+    // and just waits for the timeout
+    wakeupSocket = Networking::createWakeupSocket();
+
     // If address is null we use the any address
     if(address == nullptr || string(address) == "") {
         address = "0.0.0.0";
     }
 
     addressInfo = Networking::resolveAddress(address, service);
-    establishConnection();
+    try {
+        establishConnection();
+    } catch(...) {
+        // The destructor is not called if construction fails
+        if(clientSocket != INVALID_SOCKET) {
+            close(clientSocket);
+        }
+        if(tcpServerSocket != INVALID_SOCKET) {
+            close(tcpServerSocket);
+        }
+        if(wakeupSocket != INVALID_SOCKET) {
+            close(wakeupSocket);
+        }
+        freeaddrinfo(addressInfo);
+        throw;
+    }
 }
 
 void ImageTransfer::Pimpl::establishConnection() {
@@ -244,6 +289,9 @@ ImageTransfer::Pimpl::~Pimpl() {
     if(tcpServerSocket != INVALID_SOCKET) {
         Networking::closeSocket(tcpServerSocket);
     }
+    if(wakeupSocket != INVALID_SOCKET) {
+        close(wakeupSocket);
+    }
     if(addressInfo != nullptr) {
         freeaddrinfo(addressInfo);
     }
@@ -820,6 +868,109 @@ bool ImageTransfer::Pimpl::selectSocket(bool read, bool wait) {
     return true;
 }
 
+bool ImageTransfer::Pimpl::waitForSocket(bool writable, bool readable, int timeoutMillisec) {
+    Pimpl* self = this;
+    bool ready = false;
+    waitForSockets(&self, 1, writable, readable, &ready, timeoutMillisec);
+    return ready;
+}
+
+bool ImageTransfer::Pimpl::waitForSockets(Pimpl* const* transfers, int numTransfers,
+        bool writable, bool readable, bool* ready, int timeoutMillisec) {
+    std::vector<SOCKET> sockets(numTransfers);
+    for(int i=0; i<numTransfers; i++) {
+        unique_lock<recursive_mutex> lock(transfers[i]->sendMutex); // Either mutex will do
+        sockets[i] = (readable || writable) ? transfers[i]->clientSocket : INVALID_SOCKET;
+        ready[i] = false;
+    }
+
+    bool anyReady = false;
+#ifdef _WIN32
+    fd_set readFds, writeFds;
+    FD_ZERO(&readFds);
+    FD_ZERO(&writeFds);
+    SOCKET maxSocket = 0;
+    int numSockets = 0;
+    for(int i=0; i<numTransfers; i++) {
+        if(sockets[i] != INVALID_SOCKET) {
+            if(readable) {
+                FD_SET(sockets[i], &readFds);
+            }
+            if(writable) {
+                FD_SET(sockets[i], &writeFds);
+            }
+            maxSocket = std::max(maxSocket, sockets[i]);
+            numSockets++;
+        }
+        if(transfers[i]->wakeupSocket != INVALID_SOCKET) {
+            FD_SET(transfers[i]->wakeupSocket, &readFds);
+            maxSocket = std::max(maxSocket, transfers[i]->wakeupSocket);
+            numSockets++;
+        }
+    }
+
+    struct timeval tv;
+    tv.tv_sec = timeoutMillisec / 1000;
+    tv.tv_usec = (timeoutMillisec % 1000) * 1000;
+    if(numSockets == 0) {
+        // Windows does not allow select() without any sockets
+        std::this_thread::sleep_for(std::chrono::milliseconds(timeoutMillisec));
+        return false;
+    }
+    if(select(((int)maxSocket)+1, &readFds, &writeFds, nullptr, &tv) > 0) {
+        for(int i=0; i<numTransfers; i++) {
+            ready[i] = sockets[i] != INVALID_SOCKET && ((readable && FD_ISSET(sockets[i], &readFds))
+                || (writable && FD_ISSET(sockets[i], &writeFds)));
+            anyReady = anyReady || ready[i];
+        }
+    }
+#else
+    std::vector<pollfd> pfds;
+    pfds.reserve(2*numTransfers);
+    std::vector<int> sockIndex(numTransfers, -1);
+    for(int i=0; i<numTransfers; i++) {
+        pollfd pfd;
+        if(sockets[i] != INVALID_SOCKET) {
+            sockIndex[i] = static_cast<int>(pfds.size());
+            pfd.fd = sockets[i];
+            pfd.events = (readable ? POLLIN : 0) | (writable ? POLLOUT : 0);
+            pfd.revents = 0;
+            pfds.push_back(pfd);
+        }
+        if(transfers[i]->wakeupSocket != INVALID_SOCKET) {
+            pfd.fd = transfers[i]->wakeupSocket;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+            pfds.push_back(pfd);
+        }
+    }
+    if(poll(pfds.empty() ? nullptr : &pfds[0], pfds.size(), timeoutMillisec) > 0) {
+        for(int i=0; i<numTransfers; i++) {
+            ready[i] = (sockIndex[i] >= 0 && pfds[sockIndex[i]].revents != 0);
+            anyReady = anyReady || ready[i];
+        }
+    }
+#endif
+
+    // Consume all pending wakeup messages
+    for(int i=0; i<numTransfers; i++) {
+        if(transfers[i]->wakeupSocket != INVALID_SOCKET) {
+            char buffer[16];
+            while(recv(transfers[i]->wakeupSocket, buffer, sizeof(buffer), 0) > 0) {
+            }
+        }
+    }
+
+    return anyReady;
+}
+
+void ImageTransfer::Pimpl::interruptWait() {
+    if(wakeupSocket != INVALID_SOCKET) {
+        char msg = 0;
+        send(wakeupSocket, &msg, 1, 0);
+    }
+}
+
 std::string ImageTransfer::statusReport() {
     return pimpl->statusReport();
 }
@@ -827,6 +978,15 @@ std::string ImageTransfer::Pimpl::statusReport() {
     return protocol->statusReport();
 }
 
+void ImageTransfer::exchangeReceiveBuffers(internal::ReceiveBuffers& buffers) {
+    pimpl->exchangeReceiveBuffers(buffers);
+}
+
+void ImageTransfer::Pimpl::exchangeReceiveBuffers(internal::ReceiveBuffers& buffers) {
+    unique_lock<recursive_mutex> lock(receiveMutex);
+    protocol->exchangeReceiveBuffers(buffers);
+}
+
 void ImageTransfer::Pimpl::setConnectionStateChangeCallback(std::function<void(visiontransfer::ConnectionState)> callback) {
     connectionStateChangeCallback = callback;
 }
@@ -151,6 +151,31 @@ public:
      */
     TransferStatus transferData();
 
+    /**
+     * \brief Waits until the network socket is ready for sending or has
+     * received data.
+     *
+     * \param writable Wait until data can be sent without blocking.
+     * \param readable Wait until received data is available.
+     * \param timeoutMillisec Maximum waiting time in milliseconds.
+     * \return True if the socket is ready, or false if the timeout expired
+     *         or the wait has been interrupted.
+     *
+     * This method allows for calling transferData() only when progress can
+     * be made, rather than in fixed intervals. The wait ends early if
+     * interruptWait() is called from another thread, or if there is no
+     * connected socket and only the timeout can end the wait.
+     */
+    bool waitForSocket(bool writable, bool readable, int timeoutMillisec);
+
+    /**
+     * \brief Ends a wait of waitForSocket() in another thread.
+     *
+     * If no thread is currently waiting, the next call of waitForSocket()
+     * returns immediately.
+     */
+    void interruptWait();
+
     /**
      * \brief Waits for and receives a new image set.
      *
@@ -236,6 +261,31 @@ public:
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
     /// Prints status information to the console
     std::string statusReport();
+
+    /**
+     * \brief Exchanges the buffers holding the last received image set
+     * with the given buffers.
+     *
+     * Please see ImageProtocol::exchangeReceiveBuffers() for details.
+     */
+    void exchangeReceiveBuffers(internal::ReceiveBuffers& buffers);
+
+    /**
+     * \brief Waits until any of the given transfer objects has received
+     * data.
+     *
+     * \param transfers Transfer objects whose sockets shall be monitored.
+     * \param numTransfers Number of transfer objects.
+     * \param readable Array with one entry per transfer object, which
+     *        is set to true if its socket has received data.
+     * \param timeoutMillisec Maximum waiting time in milliseconds.
+     * \return True if at least one socket has received data.
+     *
+     * The wait ends early if interruptWait() is called for any of the
+     * transfer objects.
+     */
+    static bool waitForAnySocket(ImageTransfer* const* transfers, int numTransfers,
+        bool* readable, int timeoutMillisec);
 #endif
 
 #if VISIONTRANSFER_CPLUSPLUS_VERSION >= 201103L
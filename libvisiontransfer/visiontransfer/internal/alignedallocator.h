@@ -93,6 +93,11 @@ public :
     void destroy(pointer p) {
         p->~T();
     }
+
+    // Comparison. The allocator is stateless, hence memory allocated by one
+    // instance can be freed by any other, e.g. after swapping vectors.
+    inline bool operator==(AlignedAllocator const&) const { return true; }
+    inline bool operator!=(AlignedAllocator const&) const { return false; }
 };
 
 }} // namespace
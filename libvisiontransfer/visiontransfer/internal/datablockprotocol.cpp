@@ -994,6 +994,18 @@ void DataBlockProtocol::resizeReceiveBuffer() {
     }
 }
 
+void DataBlockProtocol::swapBlockReceiveBuffer(int block,
+        std::vector<unsigned char, AlignedAllocator<unsigned char> >& buffer) {
+    if(block < 0 || block >= MAX_DATA_BLOCKS) {
+        throw ProtocolException("Tried to swap receive buffer beyond data block range");
+    }
+
+    blockReceiveBuffers[block].swap(buffer);
+    if(block < numReceptionBlocks && static_cast<int>(blockReceiveBuffers[block].size()) < blockReceiveSize[block]) {
+        blockReceiveBuffers[block].resize(blockReceiveSize[block]);
+    }
+}
+
 // static
 void DataBlockProtocol::getDisconnectionMessage(const unsigned char* &buf, int &sz) {
     // A single disconnection message in the correct control message UDP wire format.
@@ -286,6 +286,15 @@ public:
         }
         return true;
     }
+    /**
+     * \brief Exchanges the receive buffer of a data block with the given
+     * buffer.
+     *
+     * This allows for taking over the received data without copying it.
+     * The new buffer is enlarged if needed for the current reception.
+     */
+    void swapBlockReceiveBuffer(int block, std::vector<unsigned char, AlignedAllocator<unsigned char> >& buffer);
+
     bool anyPayloadReceived() {
         for (int i=0; i<numReceptionBlocks; ++i) {
             if (blockReceiveOffsets[i] > 0) return true;
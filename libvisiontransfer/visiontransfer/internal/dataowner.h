@@ -0,0 +1,67 @@
+/*******************************************************************************
+ * Copyright (c) 2024 Allied Vision Technologies GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *******************************************************************************/
+
+
+#ifndef VISIONTRANSFER_DATAOWNER_H
+#define VISIONTRANSFER_DATAOWNER_H
+
+#include <atomic>
+
+namespace visiontransfer {
+namespace internal {
+
+/**
+ * \brief Reference counted owner of the pixel data and Q-matrix of an
+ * image set.
+ *
+ * All copies of an owning ImageSet reference the same owner. An owner
+ * starts out unreferenced; release() is called once the last reference has
+ * been removed again, and is responsible for freeing the data. The owner
+ * may be reused afterwards, e.g. by a frame pool.
+ */
+class DataOwner {
+public:
+    DataOwner(): refCount(0) {}
+
+    void addReference() {
+        // A new reference is always derived from an existing one or from
+        // the creator of the data, hence no ordering is required
+        refCount.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void removeReference() {
+        // The last owner must observe all writes of the other owners before
+        // the data is released
+        if(refCount.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            release();
+        }
+    }
+
+protected:
+    virtual ~DataOwner() {}
+
+    // Called when the last reference has been removed
+    virtual void release() = 0;
+
+private:
+    std::atomic<int> refCount;
+
+    // This class cannot be copied
+    DataOwner(const DataOwner& other);
+    DataOwner& operator=(const DataOwner&);
+};
+
+}} // namespace
+
+#endif
@@ -0,0 +1,73 @@
+/*******************************************************************************
+ * Copyright (c) 2024 Allied Vision Technologies GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *******************************************************************************/
+
+
+#include "visiontransfer/internal/heightgrid.h"
+#include <limits>
+#include <algorithm>
+
+namespace visiontransfer {
+namespace internal {
+
+HeightGrid::HeightGrid(): statistic(STAT_MAX) {
+}
+
+void HeightGrid::reset(int numCells, Statistic statistic) {
+    this->statistic = statistic;
+
+    float initialValue = 0;
+    if(statistic == STAT_MAX) {
+        initialValue = -std::numeric_limits<float>::infinity();
+    } else if(statistic == STAT_MIN) {
+        initialValue = std::numeric_limits<float>::infinity();
+    }
+
+    values.assign(numCells, initialValue);
+    counts.assign(numCells, 0);
+}
+
+void HeightGrid::merge(const HeightGrid& other, int firstCell, int endCell) {
+    for(int i = firstCell; i < endCell; i++) {
+        if(other.counts[i] == 0) {
+            continue;
+        }
+
+        if(statistic == STAT_MAX) {
+            values[i] = std::max(values[i], other.values[i]);
+        } else if(statistic == STAT_MIN) {
+            values[i] = std::min(values[i], other.values[i]);
+        } else {
+            values[i] += other.values[i];
+        }
+        counts[i] += other.counts[i];
+    }
+}
+
+void HeightGrid::getHeights(float* heights, unsigned int* pointCounts, int firstCell, int endCell) const {
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    for(int i = firstCell; i < endCell; i++) {
+        if(counts[i] == 0) {
+            heights[i] = nan;
+        } else if(statistic == STAT_MEAN) {
+            heights[i] = values[i] / counts[i];
+        } else {
+            heights[i] = values[i];
+        }
+        if(pointCounts != nullptr) {
+            pointCounts[i] = counts[i];
+        }
+    }
+}
+
+}} // namespace
@@ -0,0 +1,103 @@
+/*******************************************************************************
+ * Copyright (c) 2024 Allied Vision Technologies GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *******************************************************************************/
+
+
+#ifndef VISIONTRANSFER_HEIGHTGRID_H
+#define VISIONTRANSFER_HEIGHTGRID_H
+
+#include <vector>
+
+namespace visiontransfer {
+namespace internal {
+
+/**
+ * \brief Accumulates point heights in a dense, top-down 2D grid.
+ *
+ * For each cell, the number of points and either the maximum, minimum or
+ * sum of their heights is recorded. Cell indices are computed by the caller,
+ * such that this can be done vectorized for entire rows.
+ */
+class HeightGrid {
+public:
+    /// Statistic that is accumulated for each cell
+    enum Statistic {
+        STAT_MAX,
+        STAT_MIN,
+        STAT_MEAN
+    };
+
+    HeightGrid();
+
+    /// Removes all points and sets a new grid size and statistic
+    void reset(int numCells, Statistic statistic);
+
+    /**
+     * \brief Adds the heights of one row of points.
+     *
+     * \param cells Cell index of each point, or a negative value if the
+     *        point should be skipped.
+     * \param heights Height of each point.
+     * \param count Number of points.
+     */
+    void addPoints(const int* cells, const float* heights, int count) {
+        switch(statistic) {
+            case STAT_MAX:
+                for(int i = 0; i < count; i++) {
+                    if(cells[i] >= 0) {
+                        float& value = values[cells[i]];
+                        value = heights[i] > value ? heights[i] : value;
+                        counts[cells[i]]++;
+                    }
+                }
+                break;
+            case STAT_MIN:
+                for(int i = 0; i < count; i++) {
+                    if(cells[i] >= 0) {
+                        float& value = values[cells[i]];
+                        value = heights[i] < value ? heights[i] : value;
+                        counts[cells[i]]++;
+                    }
+                }
+                break;
+            default:
+                for(int i = 0; i < count; i++) {
+                    if(cells[i] >= 0) {
+                        values[cells[i]] += heights[i];
+                        counts[cells[i]]++;
+                    }
+                }
+        }
+    }
+
+    /// Adds the cells [firstCell, endCell) of another grid with the same size and statistic
+    void merge(const HeightGrid& other, int firstCell, int endCell);
+
+    /**
+     * \brief Writes the resulting heights and point counts of the cells
+     * [firstCell, endCell).
+     *
+     * Cells without points receive a NaN height. The counts are omitted if
+     * NULL is passed.
+     */
+    void getHeights(float* heights, unsigned int* pointCounts, int firstCell, int endCell) const;
+
+private:
+    Statistic statistic;
+    std::vector<float> values;
+    std::vector<unsigned int> counts;
+};
+
+}} // namespace
+
+#endif
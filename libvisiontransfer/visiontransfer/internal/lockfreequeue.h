@@ -0,0 +1,101 @@
+/*******************************************************************************
+ * Copyright (c) 2024 Allied Vision Technologies GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *******************************************************************************/
+
+
+#ifndef VISIONTRANSFER_LOCKFREEQUEUE_H
+#define VISIONTRANSFER_LOCKFREEQUEUE_H
+
+#include <atomic>
+#include <memory>
+
+namespace visiontransfer {
+namespace internal {
+
+/**
+ * \brief Bounded lock-free queue for small, trivially copyable values
+ * such as buffer indices.
+ *
+ * Values may only be pushed by a single thread, but may be popped by any
+ * number of threads. The latter allows the producer to discard the oldest
+ * entry of a full queue while a consumer is popping concurrently.
+ */
+template<typename T>
+class LockFreeQueue {
+public:
+    explicit LockFreeQueue(int capacity = 0)
+        : entries(nullptr), queueCapacity(0), writeIndex(0), readIndex(0) {
+        reset(capacity);
+    }
+
+    /// Discards all entries and changes the capacity. Not thread-safe.
+    void reset(int capacity) {
+        entries.reset(capacity > 0 ? new std::atomic<T>[capacity] : nullptr);
+        queueCapacity = capacity;
+        writeIndex.store(0, std::memory_order_relaxed);
+        readIndex.store(0, std::memory_order_relaxed);
+    }
+
+    int capacity() const {
+        return queueCapacity;
+    }
+
+    int size() const {
+        unsigned int r = readIndex.load(std::memory_order_acquire);
+        return static_cast<int>(writeIndex.load(std::memory_order_acquire) - r);
+    }
+
+    /// Appends a value from the producer thread. Returns false if the queue is full.
+    bool push(T value) {
+        unsigned int w = writeIndex.load(std::memory_order_relaxed);
+        if(w - readIndex.load(std::memory_order_acquire) >= static_cast<unsigned int>(queueCapacity)) {
+            return false;
+        }
+        entries[w % queueCapacity].store(value, std::memory_order_relaxed);
+        writeIndex.store(w + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Removes the oldest value. Returns false if the queue is empty.
+    bool pop(T& value) {
+        unsigned int r = readIndex.load(std::memory_order_relaxed);
+        while(r != writeIndex.load(std::memory_order_acquire)) {
+            // The entry can only be overwritten once the read index has been
+            // advanced, in which case the exchange below fails
+            T entry = entries[r % queueCapacity].load(std::memory_order_relaxed);
+            if(readIndex.compare_exchange_weak(r, r + 1, std::memory_order_acq_rel,
+                    std::memory_order_relaxed)) {
+                value = entry;
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    std::unique_ptr<std::atomic<T>[]> entries;
+    int queueCapacity;
+
+    // Indices increase monotonically and wrap around. Both are kept on
+    // separate cache lines to avoid false sharing between the threads.
+    alignas(64) std::atomic<unsigned int> writeIndex;
+    alignas(64) std::atomic<unsigned int> readIndex;
+
+    // This class cannot be copied
+    LockFreeQueue(const LockFreeQueue& other);
+    LockFreeQueue& operator=(const LockFreeQueue&);
+};
+
+}} // namespace
+
+#endif
@@ -99,6 +99,7 @@ SOCKET Networking::connectTcpSocket(const addrinfo* address) {
 
     if(connect(sock, address->ai_addr, static_cast<int>(address->ai_addrlen)) < 0) {
         TransferException ex("Error connection to destination address: " + getLastErrorString());
+        close(sock);
         throw ex;
     }
 
@@ -164,6 +165,33 @@ void Networking::bindSocket(SOCKET socket, const addrinfo* addressInfo) {
     }
 }
 
+SOCKET Networking::createWakeupSocket() {
+    // A UDP socket that is connected to itself on the loopback interface.
+    // Sending a datagram makes it readable, which interrupts a select() or
+    // poll() on all platforms.
+    SOCKET sock = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if(sock == INVALID_SOCKET) {
+        return INVALID_SOCKET;
+    }
+
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+    socklen_t addressLength = sizeof(address);
+
+    if(::bind(sock, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0
+            || getsockname(sock, reinterpret_cast<sockaddr*>(&address), &addressLength) < 0
+            || connect(sock, reinterpret_cast<sockaddr*>(&address), addressLength) < 0) {
+        close(sock);
+        return INVALID_SOCKET;
+    }
+
+    setSocketBlocking(sock, false);
+    return sock;
+}
+
 SOCKET Networking::acceptConnection(SOCKET socket, sockaddr_in& remoteAddress) {
     socklen_t clientAddressLength = sizeof(sockaddr_in);
 
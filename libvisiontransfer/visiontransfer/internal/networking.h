@@ -122,6 +122,7 @@ public:
     static void enableReuseAddress(SOCKET socket, bool reuse);
     static void bindSocket(SOCKET socket, const addrinfo* addressInfo);
     static SOCKET acceptConnection(SOCKET socket, sockaddr_in& remoteAddress);
+    static SOCKET createWakeupSocket();
     static error_int_type getErrno();
     static std::string getErrorString(error_int_type error);
     static std::string getLastErrorString();
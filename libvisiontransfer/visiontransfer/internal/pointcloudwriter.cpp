@@ -0,0 +1,366 @@
+/*******************************************************************************
+ * Copyright (c) 2024 Allied Vision Technologies GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *******************************************************************************/
+
+#include "visiontransfer/internal/pointcloudwriter.h"
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+#include <stdexcept>
+#include <algorithm>
+
+using namespace std;
+
+namespace visiontransfer {
+namespace internal {
+
+PointCloudWriter::PointCloudWriter(ThreadPool& threadPool): threadPool(threadPool) {
+}
+
+template <typename Formatter>
+void PointCloudWriter::writeBands(std::ofstream& strm, int numItems, int maxItemSize,
+        const Formatter& formatItem) {
+    int numBands = threadPool.getNumThreads();
+    bandBuffers.resize(numBands);
+    for(int band = 0; band < numBands; band++) {
+        bandBuffers[band].resize(size_t(ITEMS_PER_BAND) * maxItemSize);
+    }
+    std::vector<size_t> bandSizes(numBands, 0);
+
+    for(int chunkStart = 0; chunkStart < numItems; chunkStart += numBands*ITEMS_PER_BAND) {
+        int chunkItems = std::min(numBands*ITEMS_PER_BAND, numItems - chunkStart);
+        std::fill(bandSizes.begin(), bandSizes.end(), 0);
+
+        threadPool.parallelFor(chunkItems, [&](int band, int start, int end) {
+            char* bufferStart = &bandBuffers[band][0];
+            char* out = bufferStart;
+            for(int i = chunkStart + start; i < chunkStart + end; i++) {
+                out = formatItem(i, out);
+            }
+            bandSizes[band] = out - bufferStart;
+        });
+
+        for(int band = 0; band < numBands; band++) {
+            if(bandSizes[band] > 0) {
+                strm.write(&bandBuffers[band][0], bandSizes[band]);
+            }
+        }
+    }
+}
+
+void PointCloudWriter::write(const char* file, FileFormat format, bool binary,
+        const float* points, const int* pixelIndices, int numPoints,
+        int cloudWidth, int cloudHeight, const unsigned char* image,
+        ImageSet::ImageFormat imageFormat, int imageWidth, int imageRowStride) {
+
+    bool color = image != nullptr && format != FILE_XYZ;
+
+    ofstream strm(file, ios::out | ios::binary);
+    if(!strm) {
+        throw std::runtime_error(std::string("Unable to open file: ") + file);
+    }
+    writeHeader(strm, format, binary, color, numPoints, cloudWidth, cloudHeight);
+
+    // Upper bound for the size of a formatted point
+    int maxPointSize;
+    if(binary) {
+        maxPointSize = 3*sizeof(float) + (color ? sizeof(unsigned int) : 0);
+    } else {
+        maxPointSize = 3*16 + (color ? 3*4 : 0) + 1;
+    }
+
+    writeBands(strm, numPoints, maxPointSize, [&](int i, char* out) {
+        int pixel = pixelIndices != nullptr ? pixelIndices[i] : i;
+        const float* point = &points[4*size_t(pixel)];
+        unsigned char rgb[3] = {0, 0, 0};
+        if(color) {
+            getColor(image, imageFormat, imageWidth, imageRowStride, pixel, rgb);
+        }
+
+        if(binary) {
+            memcpy(out, point, 3*sizeof(float));
+            out += 3*sizeof(float);
+            if(color && format == FILE_PCD) {
+                // PCL packs the color into a single 32-bit field
+                unsigned int packed = (static_cast<unsigned int>(rgb[0]) << 16)
+                    | (static_cast<unsigned int>(rgb[1]) << 8) | rgb[2];
+                memcpy(out, &packed, sizeof(packed));
+                out += sizeof(packed);
+            } else if(color) {
+                memcpy(out, rgb, 3);
+                out += 3;
+            }
+        } else {
+            if(std::isfinite(point[2])) {
+                out = formatFloat(out, point[0]);
+                *(out++) = ' ';
+                out = formatFloat(out, point[1]);
+                *(out++) = ' ';
+                out = formatFloat(out, point[2]);
+            } else {
+                const char* invalid = format == FILE_PLY ? "NaN NaN NaN" : "nan nan nan";
+                memcpy(out, invalid, 11);
+                out += 11;
+            }
+
+            if(color && format == FILE_PCD) {
+                *(out++) = ' ';
+                out = formatInt(out, (static_cast<unsigned int>(rgb[0]) << 16)
+                    | (static_cast<unsigned int>(rgb[1]) << 8) | rgb[2]);
+            } else if(color) {
+                for(int c = 0; c < 3; c++) {
+                    *(out++) = ' ';
+                    out = formatInt(out, rgb[c]);
+                }
+            }
+            *(out++) = '\n';
+        }
+        return out;
+    });
+
+    if(!strm) {
+        throw std::runtime_error(std::string("Error writing file: ") + file);
+    }
+}
+
+void PointCloudWriter::writeMesh(const char* file, bool binary, const float* vertices,
+        const unsigned char* colors, int numVertices, const int* triangles, int numTriangles) {
+
+    bool color = colors != nullptr;
+
+    ofstream strm(file, ios::out | ios::binary);
+    if(!strm) {
+        throw std::runtime_error(std::string("Unable to open file: ") + file);
+    }
+
+    std::string header = "ply\n";
+    header += binary ? "format binary_little_endian 1.0\n" : "format ascii 1.0\n";
+    char line[128];
+    snprintf(line, sizeof(line), "element vertex %d\n", numVertices);
+    header += line;
+    header += "property float x\nproperty float y\nproperty float z\n";
+    if(color) {
+        header += "property uchar red\nproperty uchar green\nproperty uchar blue\n";
+    }
+    snprintf(line, sizeof(line), "element face %d\n", numTriangles);
+    header += line;
+    header += "property list uchar int vertex_indices\nend_header\n";
+    strm.write(header.c_str(), header.size());
+
+    // Upper bound for the size of a formatted vertex and face
+    int maxVertexSize = binary ? 3*sizeof(float) + (color ? 3 : 0) : 3*16 + (color ? 3*4 : 0) + 1;
+    int maxFaceSize = binary ? 1 + 3*sizeof(int) : 2 + 3*11 + 1;
+
+    writeBands(strm, numVertices, maxVertexSize, [&](int i, char* out) {
+        if(binary) {
+            memcpy(out, &vertices[3*i], 3*sizeof(float));
+            out += 3*sizeof(float);
+            if(color) {
+                memcpy(out, &colors[3*i], 3);
+                out += 3;
+            }
+        } else {
+            for(int c = 0; c < 3; c++) {
+                if(c > 0) {
+                    *(out++) = ' ';
+                }
+                out = formatFloat(out, vertices[3*i + c]);
+            }
+            if(color) {
+                for(int c = 0; c < 3; c++) {
+                    *(out++) = ' ';
+                    out = formatInt(out, colors[3*i + c]);
+                }
+            }
+            *(out++) = '\n';
+        }
+        return out;
+    });
+
+    writeBands(strm, numTriangles, maxFaceSize, [&](int i, char* out) {
+        if(binary) {
+            *(out++) = 3;
+            memcpy(out, &triangles[3*i], 3*sizeof(int));
+            out += 3*sizeof(int);
+        } else {
+            *(out++) = '3';
+            for(int c = 0; c < 3; c++) {
+                *(out++) = ' ';
+                out = formatInt(out, static_cast<unsigned int>(triangles[3*i + c]));
+            }
+            *(out++) = '\n';
+        }
+        return out;
+    });
+
+    if(!strm) {
+        throw std::runtime_error(std::string("Error writing file: ") + file);
+    }
+}
+
+void PointCloudWriter::writeHeader(std::ofstream& strm, FileFormat format, bool binary, bool color,
+        int numPoints, int cloudWidth, int cloudHeight) {
+    std::string header;
+    char line[128];
+
+    switch(format) {
+        case FILE_PLY:
+            header = "ply\n";
+            header += binary ? "format binary_little_endian 1.0\n" : "format ascii 1.0\n";
+            snprintf(line, sizeof(line), "element vertex %d\n", numPoints);
+            header += line;
+            header += "property float x\nproperty float y\nproperty float z\n";
+            if(color) {
+                header += "property uchar red\nproperty uchar green\nproperty uchar blue\n";
+            }
+            header += "end_header\n";
+            break;
+        case FILE_PCD:
+            header = "# .PCD v0.7 - Point Cloud Data file format\nVERSION 0.7\n";
+            header += color ? "FIELDS x y z rgb\nSIZE 4 4 4 4\nTYPE F F F U\nCOUNT 1 1 1 1\n"
+                : "FIELDS x y z\nSIZE 4 4 4\nTYPE F F F\nCOUNT 1 1 1\n";
+            snprintf(line, sizeof(line), "WIDTH %d\nHEIGHT %d\nVIEWPOINT 0 0 0 1 0 0 0\nPOINTS %d\n",
+                cloudWidth, cloudHeight, numPoints);
+            header += line;
+            header += binary ? "DATA binary\n" : "DATA ascii\n";
+            break;
+        case FILE_XYZ:
+            // No header
+            break;
+        default:
+            throw std::runtime_error("Invalid point cloud file format!");
+    }
+
+    strm.write(header.c_str(), header.size());
+}
+
+void PointCloudWriter::getColor(const unsigned char* image, ImageSet::ImageFormat imageFormat,
+        int imageWidth, int imageRowStride, int pixelIndex, unsigned char* rgb) {
+    int y = pixelIndex / imageWidth;
+    int x = pixelIndex % imageWidth;
+
+    switch(imageFormat) {
+        case ImageSet::FORMAT_8_BIT_RGB: {
+            const unsigned char* col = &image[y*imageRowStride + 3*x];
+            rgb[0] = col[0];
+            rgb[1] = col[1];
+            rgb[2] = col[2];
+            break;
+        }
+        case ImageSet::FORMAT_8_BIT_MONO:
+            rgb[0] = rgb[1] = rgb[2] = image[y*imageRowStride + x];
+            break;
+        case ImageSet::FORMAT_12_BIT_MONO: {
+            const unsigned short* col = reinterpret_cast<const unsigned short*>(&image[y*imageRowStride + 2*x]);
+            rgb[0] = rgb[1] = rgb[2] = static_cast<unsigned char>(*col >> 4);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+char* PointCloudWriter::formatInt(char* dst, unsigned int value) {
+    char digits[10];
+    int numDigits = 0;
+    do {
+        digits[numDigits++] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while(value != 0);
+
+    while(numDigits > 0) {
+        *(dst++) = digits[--numDigits];
+    }
+    return dst;
+}
+
+char* PointCloudWriter::formatFloat(char* dst, float value) {
+    static const double powersOfTen[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10};
+
+    if(value == 0.0f) {
+        if(std::signbit(value)) {
+            *(dst++) = '-';
+        }
+        *(dst++) = '0';
+        return dst;
+    }
+
+    double absValue = std::fabs(static_cast<double>(value));
+    if(absValue < 1e-4 || absValue >= 1e6) {
+        // Rare case: exponential notation
+        int len = snprintf(dst, 16, "%g", value);
+        return dst + len;
+    }
+
+    // Decimal exponent of the value
+    double scaled = absValue * 1e4;
+    int exponent = -4;
+    while(exponent < 5 && scaled >= powersOfTen[exponent + 5]) {
+        exponent++;
+    }
+
+    // Round to six significant digits (half to even, like printf). Rounding
+    // may carry into the next decade.
+    long long digits = static_cast<long long>(std::nearbyint(absValue * powersOfTen[5 - exponent]));
+    if(digits >= 1000000) {
+        exponent++;
+        if(exponent <= 5) {
+            digits = static_cast<long long>(std::nearbyint(absValue * powersOfTen[5 - exponent]));
+        }
+    }
+
+    if(exponent < -4 || exponent >= 6) {
+        // Rare case: exponential notation
+        int len = snprintf(dst, 16, "%g", value);
+        return dst + len;
+    }
+
+    if(value < 0) {
+        *(dst++) = '-';
+    }
+
+    // Split into integer and fractional digits
+    char buffer[6];
+    int len = 0;
+    for(int i = 0; i < 6; i++) {
+        buffer[len++] = static_cast<char>('0' + digits % 10);
+        digits /= 10;
+    }
+
+    if(exponent < 0) {
+        *(dst++) = '0';
+    } else {
+        for(int i = 0; i <= exponent; i++) {
+            *(dst++) = buffer[--len];
+        }
+    }
+
+    // Remove trailing zeros of the fractional part
+    int firstNonZero = 0;
+    while(firstNonZero < len && buffer[firstNonZero] == '0') {
+        firstNonZero++;
+    }
+    if(firstNonZero < len) {
+        *(dst++) = '.';
+        for(int i = 0; i < -exponent - 1; i++) {
+            *(dst++) = '0';
+        }
+        while(len > firstNonZero) {
+            *(dst++) = buffer[--len];
+        }
+    }
+
+    return dst;
+}
+
+}} // namespace
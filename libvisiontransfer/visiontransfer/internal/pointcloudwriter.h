@@ -0,0 +1,109 @@
+/*******************************************************************************
+ * Copyright (c) 2024 Allied Vision Technologies GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *******************************************************************************/
+
+#ifndef VISIONTRANSFER_POINTCLOUDWRITER_H
+#define VISIONTRANSFER_POINTCLOUDWRITER_H
+
+#include <vector>
+#include <fstream>
+#include "visiontransfer/imageset.h"
+#include "visiontransfer/internal/threadpool.h"
+
+namespace visiontransfer {
+namespace internal {
+
+/**
+ * \brief Writes point clouds to PLY, PCD or XYZ files, and triangle meshes
+ * to PLY files.
+ *
+ * Points are formatted concurrently into large memory buffers, one per
+ * thread of the given thread pool, which are then written to the file with
+ * a single write call per buffer. ASCII output uses a locale-independent
+ * float formatter that produces the same representation as printf's "%g".
+ */
+class PointCloudWriter {
+public:
+    enum FileFormat {
+        FILE_PLY,
+        FILE_PCD,
+        FILE_XYZ
+    };
+
+    explicit PointCloudWriter(ThreadPool& threadPool);
+
+    /**
+     * \brief Writes a point cloud to a file.
+     *
+     * \param file Name of the output file.
+     * \param format File format.
+     * \param binary Write binary instead of ASCII data. For FILE_XYZ, the
+     *        binary format is a headerless array of float triplets.
+     * \param points Point map with four floats (x, y, z and padding) per
+     *        pixel, as created by Reconstruct3D::createPointMap().
+     * \param pixelIndices Pixel index (y*imageWidth + x) of each point that
+     *        shall be written, or NULL if point i belongs to pixel i.
+     * \param numPoints Number of points.
+     * \param cloudWidth Width of an organized point cloud, or numPoints.
+     * \param cloudHeight Height of an organized point cloud, or 1.
+     * \param image Image for point colors, or NULL. Colors are not written to XYZ files.
+     * \param imageFormat Pixel format of the color image.
+     * \param imageWidth Width of the color image.
+     * \param imageRowStride Row stride of the color image in bytes.
+     */
+    void write(const char* file, FileFormat format, bool binary,
+        const float* points, const int* pixelIndices, int numPoints,
+        int cloudWidth, int cloudHeight, const unsigned char* image,
+        ImageSet::ImageFormat imageFormat, int imageWidth, int imageRowStride);
+
+    /**
+     * \brief Writes a triangle mesh to a PLY file.
+     *
+     * \param file Name of the output file.
+     * \param binary Write binary instead of ASCII data.
+     * \param vertices Array of numVertices x, y and z coordinates.
+     * \param colors Array of numVertices RGB values, or NULL.
+     * \param numVertices Number of vertices.
+     * \param triangles Array of numTriangles vertex index triplets.
+     * \param numTriangles Number of triangles.
+     */
+    void writeMesh(const char* file, bool binary, const float* vertices,
+        const unsigned char* colors, int numVertices, const int* triangles, int numTriangles);
+
+    /// Formats a float value like printf("%g") and returns the end of the output
+    static char* formatFloat(char* dst, float value);
+
+private:
+    // Number of points or faces that each thread formats before the buffers are written
+    static const int ITEMS_PER_BAND = 32768;
+
+    ThreadPool& threadPool;
+    std::vector<std::vector<char> > bandBuffers;
+
+    // Formats items concurrently with formatItem(index, dst), which returns the
+    // end of its output, and writes the results in order
+    template <typename Formatter>
+    void writeBands(std::ofstream& strm, int numItems, int maxItemSize, const Formatter& formatItem);
+
+    void writeHeader(std::ofstream& strm, FileFormat format, bool binary, bool color,
+        int numPoints, int cloudWidth, int cloudHeight);
+
+    static char* formatInt(char* dst, unsigned int value);
+
+    static void getColor(const unsigned char* image, ImageSet::ImageFormat imageFormat,
+        int imageWidth, int imageRowStride, int pixelIndex, unsigned char* rgb);
+};
+
+}} // namespace
+
+#endif
@@ -0,0 +1,77 @@
+/*******************************************************************************
+ * Copyright (c) 2024 Allied Vision Technologies GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *******************************************************************************/
+
+
+#ifndef VISIONTRANSFER_RECEIVEBUFFERS_H
+#define VISIONTRANSFER_RECEIVEBUFFERS_H
+
+#include <vector>
+#include <atomic>
+#include "visiontransfer/imageset.h"
+#include "visiontransfer/internal/alignedallocator.h"
+#include "visiontransfer/internal/datablockprotocol.h"
+#include "visiontransfer/internal/dataowner.h"
+
+namespace visiontransfer {
+namespace internal {
+
+/**
+ * \brief Buffers that hold the pixel data of a received image set.
+ *
+ * Pixel data that does not require decoding remains in the buffer of the
+ * data block in which it has been received. All other images are decoded
+ * into a separate buffer. The buffers can be exchanged with those of
+ * ImageProtocol, which allows for taking over a received image set without
+ * copying its pixel data.
+ */
+struct ReceiveBuffers {
+    std::vector<unsigned char, AlignedAllocator<unsigned char> > blockData[DataBlockProtocol::MAX_DATA_BLOCKS];
+    std::vector<unsigned char, AlignedAllocator<unsigned char> > decodedData[ImageSet::MAX_SUPPORTED_IMAGES];
+};
+
+/**
+ * \brief Receive buffers together with the image set that they contain.
+ *
+ * ImageProtocol receives directly into the buffers of a slot, which are
+ * then lent to the user as the data owner of the image set. A slot becomes
+ * free again once the last copy of the image set has been released. Only
+ * the receiving thread turns free slots into busy ones.
+ */
+class ReceiveSlot: public DataOwner {
+public:
+    enum State {
+        SLOT_FREE,
+        SLOT_BUSY, // Being filled or queued
+        SLOT_LENT,
+        SLOT_ORPHANED // Lent while the transfer object was destroyed
+    };
+
+    ReceiveSlot(): state(SLOT_FREE) {}
+    ImageSet imageSet;
+    ReceiveBuffers buffers;
+    std::atomic<int> state;
+
+protected:
+    virtual void release() override {
+        // The receiving thread may reuse this slot right after the state
+        // change, which has to be the last access
+        if(state.exchange(SLOT_FREE, std::memory_order_acq_rel) == SLOT_ORPHANED) {
+            delete this;
+        }
+    }
+};
+
+}} // namespace
+
+#endif
@@ -0,0 +1,173 @@
+/*******************************************************************************
+ * Copyright (c) 2024 Allied Vision Technologies GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *******************************************************************************/
+
+#include "visiontransfer/internal/threadpool.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace std;
+
+namespace visiontransfer {
+namespace internal {
+
+ThreadPool::ThreadPool()
+    : currentFunc(nullptr), currentNumItems(0), generation(0), pendingWorkers(0),
+    terminate(false) {
+}
+
+ThreadPool::~ThreadPool() {
+    stopWorkers();
+}
+
+void ThreadPool::setNumThreads(int numThreads, int firstCpu) {
+    if(numThreads <= 0) {
+        numThreads = static_cast<int>(thread::hardware_concurrency());
+        if(numThreads <= 0) {
+            numThreads = 1;
+        }
+    }
+
+    stopWorkers();
+
+    terminate = false;
+    for(int i = 1; i < numThreads; i++) {
+        workers.push_back(thread(bind(&ThreadPool::workerLoop, this, i, generation)));
+        if(firstCpu >= 0) {
+            pinToCpu(workers.back(), firstCpu + i - 1);
+        }
+    }
+}
+
+void ThreadPool::stopWorkers() {
+    {
+        unique_lock<mutex> lock(poolMutex);
+        terminate = true;
+    }
+    startCond.notify_all();
+
+    for(unsigned int i = 0; i < workers.size(); i++) {
+        if(workers[i].joinable()) {
+            workers[i].join();
+        }
+    }
+    workers.clear();
+}
+
+void ThreadPool::parallelFor(int numItems, const BandFunction& func) {
+    if(workers.size() == 0 || numItems < 2) {
+        // Nothing to distribute
+        func(0, 0, numItems);
+        return;
+    }
+
+    {
+        unique_lock<mutex> lock(poolMutex);
+        currentFunc = &func;
+        currentNumItems = numItems;
+        pendingWorkers = static_cast<int>(workers.size());
+        workerException = nullptr;
+        generation++;
+    }
+    startCond.notify_all();
+
+    // The calling thread processes the first band
+    exception_ptr callerException;
+    try {
+        runBand(0, getNumThreads());
+    } catch(...) {
+        callerException = current_exception();
+    }
+
+    unique_lock<mutex> lock(poolMutex);
+    while(pendingWorkers > 0) {
+        doneCond.wait(lock);
+    }
+    currentFunc = nullptr;
+
+    if(callerException) {
+        rethrow_exception(callerException);
+    } else if(workerException) {
+        exception_ptr ex = workerException;
+        workerException = nullptr;
+        rethrow_exception(ex);
+    }
+}
+
+void ThreadPool::runBand(int band, int numBands) {
+    int start = static_cast<int>(static_cast<long long>(currentNumItems) * band / numBands);
+    int end = static_cast<int>(static_cast<long long>(currentNumItems) * (band + 1) / numBands);
+    if(end > start) {
+        (*currentFunc)(band, start, end);
+    }
+}
+
+void ThreadPool::workerLoop(int band, unsigned int lastGeneration) {
+    while(true) {
+        int numBands = 0;
+        {
+            unique_lock<mutex> lock(poolMutex);
+            while(!terminate && generation == lastGeneration) {
+                startCond.wait(lock);
+            }
+            if(terminate) {
+                return;
+            }
+            lastGeneration = generation;
+            numBands = getNumThreads();
+        }
+
+        try {
+            runBand(band, numBands);
+        } catch(...) {
+            unique_lock<mutex> lock(poolMutex);
+            if(!workerException) {
+                workerException = current_exception();
+            }
+        }
+
+        {
+            unique_lock<mutex> lock(poolMutex);
+            if(--pendingWorkers == 0) {
+                doneCond.notify_one();
+            }
+        }
+    }
+}
+
+void ThreadPool::pinToCpu(std::thread& worker, int cpu) {
+    int numCpus = static_cast<int>(thread::hardware_concurrency());
+    if(numCpus <= 0) {
+        return;
+    }
+    cpu %= numCpus;
+
+#ifdef _WIN32
+    SetThreadAffinityMask(worker.native_handle(), DWORD_PTR(1) << cpu);
+#elif defined(__linux__)
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    CPU_SET(cpu, &cpuSet);
+    pthread_setaffinity_np(worker.native_handle(), sizeof(cpu_set_t), &cpuSet);
+#else
+    // Thread affinity is not supported on this platform
+    (void) worker;
+#endif
+}
+
+}} // namespace
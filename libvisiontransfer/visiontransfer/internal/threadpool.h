@@ -0,0 +1,90 @@
+/*******************************************************************************
+ * Copyright (c) 2024 Allied Vision Technologies GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *******************************************************************************/
+
+#ifndef VISIONTRANSFER_THREADPOOL_H
+#define VISIONTRANSFER_THREADPOOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+
+namespace visiontransfer {
+namespace internal {
+
+/**
+ * \brief A persistent pool of worker threads for splitting image processing
+ * tasks into bands of consecutive rows.
+ *
+ * The calling thread always processes the first band itself, such that a
+ * pool with one thread does not create any worker threads at all. Worker
+ * threads are created once and are reused for all subsequent calls of
+ * parallelFor().
+ */
+class ThreadPool {
+public:
+    /// Signature of a band function: band index, first item, end item (exclusive)
+    typedef std::function<void(int, int, int)> BandFunction;
+
+    ThreadPool();
+    ~ThreadPool();
+
+    /**
+     * \brief Sets the number of threads that process a task, including the
+     * calling thread.
+     *
+     * \param numThreads Number of threads. A value of 0 selects the number of
+     *        available hardware threads.
+     * \param firstCpu If >= 0, worker thread i is pinned to CPU core
+     *        (firstCpu + i) modulo the number of available cores. The calling
+     *        thread is never pinned.
+     */
+    void setNumThreads(int numThreads, int firstCpu = -1);
+
+    /// Returns the number of threads, including the calling thread
+    int getNumThreads() const {return static_cast<int>(workers.size()) + 1;}
+
+    /**
+     * \brief Splits the items [0, numItems) into getNumThreads() bands and
+     * processes them concurrently.
+     *
+     * The call blocks until all bands have been processed. An exception
+     * that is thrown in any band is rethrown in the calling thread.
+     */
+    void parallelFor(int numItems, const BandFunction& func);
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex poolMutex;
+    std::condition_variable startCond;
+    std::condition_variable doneCond;
+
+    const BandFunction* currentFunc;
+    int currentNumItems;
+    unsigned int generation;
+    int pendingWorkers;
+    bool terminate;
+    std::exception_ptr workerException;
+
+    void stopWorkers();
+    void workerLoop(int band, unsigned int lastGeneration);
+    void runBand(int band, int numBands);
+    static void pinToCpu(std::thread& worker, int cpu);
+};
+
+}} // namespace
+
+#endif
@@ -0,0 +1,90 @@
+/*******************************************************************************
+ * Copyright (c) 2024 Allied Vision Technologies GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *******************************************************************************/
+
+#include "visiontransfer/internal/voxelgrid.h"
+#include <cstring>
+
+namespace visiontransfer {
+namespace internal {
+
+VoxelGrid::VoxelGrid(): tableMask(0), numVoxels(0), invLeafSize(1.0f) {
+}
+
+void VoxelGrid::reset(float leafSize, int expectedVoxels) {
+    invLeafSize = 1.0f / leafSize;
+
+    size_t size = 1024;
+    while(size < 2*size_t(expectedVoxels)) {
+        size *= 2;
+    }
+
+    if(table.size() != size) {
+        table.resize(size);
+    }
+    memset(&table[0], 0, table.size() * sizeof(Voxel));
+    tableMask = size - 1;
+    numVoxels = 0;
+}
+
+void VoxelGrid::grow() {
+    std::vector<Voxel> oldTable(2*table.size());
+    oldTable.swap(table);
+    memset(&table[0], 0, table.size() * sizeof(Voxel));
+    tableMask = table.size() - 1;
+    numVoxels = 0;
+
+    for(size_t i = 0; i < oldTable.size(); i++) {
+        if(oldTable[i].count != 0) {
+            Voxel& voxel = findVoxel(oldTable[i].key);
+            voxel = oldTable[i];
+        }
+    }
+}
+
+void VoxelGrid::merge(const VoxelGrid& other) {
+    for(size_t i = 0; i < other.table.size(); i++) {
+        const Voxel& src = other.table[i];
+        if(src.count == 0) {
+            continue;
+        }
+
+        Voxel& dst = findVoxel(src.key);
+        dst.count += src.count;
+        for(int c = 0; c < 3; c++) {
+            dst.sum[c] += src.sum[c];
+            dst.colorSum[c] += src.colorSum[c];
+        }
+    }
+}
+
+void VoxelGrid::getAveragedPoints(float* points, unsigned char* colors) const {
+    for(size_t i = 0; i < table.size(); i++) {
+        const Voxel& voxel = table[i];
+        if(voxel.count == 0) {
+            continue;
+        }
+
+        float invCount = 1.0f / voxel.count;
+        for(int c = 0; c < 3; c++) {
+            *(points++) = voxel.sum[c] * invCount;
+        }
+        if(colors != nullptr) {
+            for(int c = 0; c < 3; c++) {
+                *(colors++) = static_cast<unsigned char>((voxel.colorSum[c] + voxel.count/2) / voxel.count);
+            }
+        }
+    }
+}
+
+}} // namespace
@@ -0,0 +1,138 @@
+/*******************************************************************************
+ * Copyright (c) 2024 Allied Vision Technologies GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *******************************************************************************/
+
+#ifndef VISIONTRANSFER_VOXELGRID_H
+#define VISIONTRANSFER_VOXELGRID_H
+
+#include <vector>
+#include <cmath>
+
+namespace visiontransfer {
+namespace internal {
+
+/**
+ * \brief Accumulates 3D points in a sparse voxel grid.
+ *
+ * Occupied voxels are stored in a hash table with open addressing and
+ * linear probing. For each voxel, the sum of all point coordinates and
+ * colors is accumulated, such that the averaged points can be obtained
+ * after all points have been added.
+ */
+class VoxelGrid {
+public:
+    VoxelGrid();
+
+    /**
+     * \brief Removes all voxels and sets a new leaf size.
+     *
+     * \param leafSize Edge length of one voxel.
+     * \param expectedVoxels Expected number of occupied voxels, which is used
+     *        for dimensioning the hash table.
+     */
+    void reset(float leafSize, int expectedVoxels);
+
+    /// Adds one point with an optional RGB color
+    void addPoint(float x, float y, float z, const unsigned char* rgb) {
+        float fx = std::floor(x * invLeafSize);
+        float fy = std::floor(y * invLeafSize);
+        float fz = std::floor(z * invLeafSize);
+        if(!(std::fabs(fx) < KEY_RANGE && std::fabs(fy) < KEY_RANGE && std::fabs(fz) < KEY_RANGE)) {
+            // Outside of the representable grid, or not finite
+            return;
+        }
+
+        unsigned long long key = packKey(static_cast<int>(fx), static_cast<int>(fy), static_cast<int>(fz));
+        Voxel& voxel = findVoxel(key);
+        voxel.count++;
+        voxel.sum[0] += x;
+        voxel.sum[1] += y;
+        voxel.sum[2] += z;
+        if(rgb != nullptr) {
+            voxel.colorSum[0] += rgb[0];
+            voxel.colorSum[1] += rgb[1];
+            voxel.colorSum[2] += rgb[2];
+        }
+    }
+
+    /// Adds all voxels of another grid with the same leaf size
+    void merge(const VoxelGrid& other);
+
+    /// Returns the number of occupied voxels
+    int getNumVoxels() const {return numVoxels;}
+
+    /**
+     * \brief Writes the averaged point and, optionally, averaged color of
+     * each occupied voxel.
+     *
+     * \param points Destination for 3*getNumVoxels() coordinates.
+     * \param colors Destination for 3*getNumVoxels() color values, or NULL.
+     */
+    void getAveragedPoints(float* points, unsigned char* colors) const;
+
+private:
+    // Voxel indices are limited to +/- 2^20 per axis
+    static const int KEY_BITS = 21;
+    static const int KEY_RANGE = 1 << (KEY_BITS - 1);
+
+    struct Voxel {
+        unsigned long long key;
+        unsigned int count;
+        float sum[3];
+        unsigned int colorSum[3];
+    };
+
+    std::vector<Voxel> table;
+    unsigned long long tableMask;
+    int numVoxels;
+    float invLeafSize;
+
+    static unsigned long long packKey(int x, int y, int z) {
+        const unsigned long long mask = (1ULL << KEY_BITS) - 1;
+        return ((static_cast<unsigned long long>(x + KEY_RANGE) & mask) << (2*KEY_BITS))
+            | ((static_cast<unsigned long long>(y + KEY_RANGE) & mask) << KEY_BITS)
+            | (static_cast<unsigned long long>(z + KEY_RANGE) & mask);
+    }
+
+    static unsigned long long hashKey(unsigned long long key) {
+        // Multiplicative hashing, folding the well-mixed upper bits into the lower ones
+        key *= 0x9E3779B97F4A7C15ULL;
+        return key ^ (key >> 29);
+    }
+
+    Voxel& findVoxel(unsigned long long key) {
+        unsigned long long pos = hashKey(key) & tableMask;
+        while(true) {
+            Voxel& voxel = table[pos];
+            if(voxel.count == 0) {
+                if(2*(numVoxels + 1) > static_cast<int>(table.size())) {
+                    // Keep the load factor below 0.5
+                    grow();
+                    return findVoxel(key);
+                }
+                voxel.key = key;
+                numVoxels++;
+                return voxel;
+            } else if(voxel.key == key) {
+                return voxel;
+            }
+            pos = (pos + 1) & tableMask;
+        }
+    }
+
+    void grow();
+};
+
+}} // namespace
+
+#endif
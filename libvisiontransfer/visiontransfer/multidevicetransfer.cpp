@@ -0,0 +1,627 @@
+/*******************************************************************************
+ * Copyright (c) 2024 Allied Vision Technologies GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *******************************************************************************/
+
+
+#include <functional>
+#include <stdexcept>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+#include "visiontransfer/multidevicetransfer.h"
+#include "visiontransfer/imagetransfer.h"
+#include "visiontransfer/exceptions.h"
+#include "visiontransfer/internal/receivebuffers.h"
+
+using namespace std;
+using namespace visiontransfer;
+using namespace visiontransfer::internal;
+
+namespace visiontransfer {
+
+/*************** Pimpl class containing all private members ***********/
+
+class MultiDeviceTransfer::Pimpl {
+public:
+    Pimpl(int bufferSize, int maxUdpPacketSize, int autoReconnectDelay);
+    ~Pimpl();
+
+    // Redeclaration of public members
+    int addDevice(const DeviceInfo& device);
+    int addDevice(const char* address, const char* service, ImageProtocol::ProtocolType protType);
+    int getNumDevices() const {return static_cast<int>(devices.size());}
+    void setSyncSource(SyncSource source) {syncSource = source;}
+    SyncSource getSyncSource() const {return static_cast<SyncSource>(syncSource.load());}
+    void setSyncTolerance(int microsec);
+    int getSyncTolerance() const {return syncTolerance;}
+    void setBundleQueueDepth(int depth);
+    int getBundleQueueDepth();
+    bool collectBundle(std::vector<ImageSet>& bundle, double timeout);
+    int getNumDroppedFrames(int device) const;
+    int getSkew(int device) const;
+    int getMaxSkew(int device) const;
+    bool isConnected(int device) const;
+
+private:
+    // Interval in which idle UDP connections are serviced
+    static constexpr int IO_THREAD_IDLE_WAIT_MS = 100;
+    // Maximum number of unmatched image sets that are kept per device
+    static constexpr int MAX_PENDING_FRAMES = 16;
+
+    // State of a TCP reconnection, which is shared between the I/O thread
+    // and a detached reconnection thread
+    struct Reconnection {
+        std::mutex mutex;
+        std::condition_variable cond;
+        bool terminate;
+        std::unique_ptr<ImageTransfer> transfer;
+
+        std::string address;
+        std::string service;
+        int bufferSize;
+        int maxUdpPacketSize;
+        int delay;
+    };
+
+    struct Device {
+        Device(ImageTransfer* transfer, const char* address, const char* service,
+            ImageProtocol::ProtocolType protType)
+            : transfer(transfer), address(address), service(service), protType(protType),
+            droppedFrames(0), skew(0), maxSkew(0) {}
+
+        // Replaced by the I/O thread after a reconnection. Accesses from
+        // other threads have to lock transferMutex.
+        std::unique_ptr<ImageTransfer> transfer;
+        mutable std::mutex transferMutex;
+
+        std::string address;
+        std::string service;
+        ImageProtocol::ProtocolType protType;
+
+        // Pending reconnection of a closed TCP connection. Only accessed by
+        // the I/O thread and the destructor.
+        std::shared_ptr<Reconnection> reconnection;
+
+        // Image set that is currently being received. Only accessed by the
+        // I/O thread.
+        ImageSet receivedSet;
+
+        // Received image sets that have not yet been matched, in the order
+        // of reception. Only accessed by the I/O thread.
+        std::deque<ReceiveSlot*> pendingSlots;
+
+        std::atomic<int> droppedFrames;
+        std::atomic<int> skew;
+        std::atomic<int> maxSkew;
+    };
+
+    int bufferSize;
+    int maxUdpPacketSize;
+    int autoReconnectDelay;
+
+    std::vector<std::unique_ptr<Device> > devices;
+    std::vector<ImageTransfer*> transfers;
+
+    std::atomic<int> syncSource;
+    std::atomic<int> syncTolerance;
+
+    // A single thread receives from all devices and matches the image sets
+    std::thread ioThread;
+    bool ioThreadCreated;
+    std::atomic<bool> terminate;
+
+    // Matched bundles waiting for collection
+    std::mutex bundleMutex;
+    std::condition_variable bundleCond;
+    std::deque<std::vector<ReceiveSlot*> > bundleQueue;
+    int bundleQueueDepth;
+    std::exception_ptr ioException;
+
+    // All allocated slots. Only accessed by the I/O thread and the destructor.
+    std::vector<ReceiveSlot*> receiveSlots;
+
+    void checkDeviceIndex(int device) const;
+    void createIoThread();
+    void ioLoop();
+    void receiveFromDevice(Device& device);
+    void handleClosedConnection(int index);
+    void finishReconnection(int index);
+    static void reconnectLoop(std::shared_ptr<Reconnection> reconnection);
+    void matchBundles();
+    void queueBundle(const std::vector<ReceiveSlot*>& bundle);
+    void dropSlot(Device& device, ReceiveSlot* slot);
+    ReceiveSlot* findFreeReceiveSlot();
+    long long getSyncTime(const ImageSet& imageSet, SyncSource source) const;
+};
+
+/******************** Stubs for all public members ********************/
+
+MultiDeviceTransfer::MultiDeviceTransfer(int bufferSize, int maxUdpPacketSize, int autoReconnectDelay)
+    : pimpl(new Pimpl(bufferSize, maxUdpPacketSize, autoReconnectDelay)) {
+}
+
+MultiDeviceTransfer::~MultiDeviceTransfer() {
+    delete pimpl;
+}
+
+int MultiDeviceTransfer::addDevice(const DeviceInfo& device) {
+    return pimpl->addDevice(device);
+}
+
+int MultiDeviceTransfer::addDevice(const char* address, const char* service,
+        ImageProtocol::ProtocolType protType) {
+    return pimpl->addDevice(address, service, protType);
+}
+
+int MultiDeviceTransfer::getNumDevices() const {
+    return pimpl->getNumDevices();
+}
+
+void MultiDeviceTransfer::setSyncSource(SyncSource source) {
+    pimpl->setSyncSource(source);
+}
+
+MultiDeviceTransfer::SyncSource MultiDeviceTransfer::getSyncSource() const {
+    return pimpl->getSyncSource();
+}
+
+void MultiDeviceTransfer::setSyncTolerance(int microsec) {
+    pimpl->setSyncTolerance(microsec);
+}
+
+int MultiDeviceTransfer::getSyncTolerance() const {
+    return pimpl->getSyncTolerance();
+}
+
+void MultiDeviceTransfer::setBundleQueueDepth(int depth) {
+    pimpl->setBundleQueueDepth(depth);
+}
+
+int MultiDeviceTransfer::getBundleQueueDepth() const {
+    return pimpl->getBundleQueueDepth();
+}
+
+bool MultiDeviceTransfer::collectBundle(std::vector<ImageSet>& bundle, double timeout) {
+    return pimpl->collectBundle(bundle, timeout);
+}
+
+int MultiDeviceTransfer::getNumDroppedFrames(int device) const {
+    return pimpl->getNumDroppedFrames(device);
+}
+
+int MultiDeviceTransfer::getSkew(int device) const {
+    return pimpl->getSkew(device);
+}
+
+int MultiDeviceTransfer::getMaxSkew(int device) const {
+    return pimpl->getMaxSkew(device);
+}
+
+bool MultiDeviceTransfer::isConnected(int device) const {
+    return pimpl->isConnected(device);
+}
+
+/******************** Implementation in pimpl class *******************/
+
+MultiDeviceTransfer::Pimpl::Pimpl(int bufferSize, int maxUdpPacketSize, int autoReconnectDelay)
+    : bufferSize(bufferSize), maxUdpPacketSize(maxUdpPacketSize),
+    autoReconnectDelay(autoReconnectDelay), syncSource(SYNC_TIMESTAMP),
+    syncTolerance(5000), ioThreadCreated(false), terminate(false),
+    bundleQueueDepth(1) {
+}
+
+MultiDeviceTransfer::Pimpl::~Pimpl() {
+    terminate = true;
+    if(!devices.empty()) {
+        unique_lock<mutex> lock(devices[0]->transferMutex);
+        devices[0]->transfer->interruptWait();
+    }
+    {
+        unique_lock<mutex> lock(bundleMutex);
+        bundleCond.notify_all();
+    }
+
+    if(ioThreadCreated && ioThread.joinable()) {
+        ioThread.join();
+    }
+
+    // Reconnection threads might still be blocked in connecting, hence they
+    // are not joined but only told to discard their result
+    for(unsigned int i=0; i<devices.size(); i++) {
+        if(devices[i]->reconnection) {
+            unique_lock<mutex> lock(devices[i]->reconnection->mutex);
+            devices[i]->reconnection->terminate = true;
+            devices[i]->reconnection->cond.notify_all();
+        }
+    }
+
+    // Slots that are still lent are deleted once they are released
+    for(unsigned int i=0; i<receiveSlots.size(); i++) {
+        if(receiveSlots[i]->state.exchange(ReceiveSlot::SLOT_ORPHANED,
+                std::memory_order_acq_rel) != ReceiveSlot::SLOT_LENT) {
+            delete receiveSlots[i];
+        }
+    }
+}
+
+int MultiDeviceTransfer::Pimpl::addDevice(const DeviceInfo& device) {
+    if(ioThreadCreated) {
+        throw std::runtime_error("Devices cannot be added after reception has started!");
+    }
+
+    // Reconnections are handled by the I/O thread, such that a closed
+    // connection does not block the reception from the other devices
+    ImageTransfer* transfer = new ImageTransfer(device, bufferSize, maxUdpPacketSize, 0);
+    devices.push_back(std::unique_ptr<Device>(new Device(transfer, device.getIpAddress().c_str(),
+        "7681", static_cast<ImageProtocol::ProtocolType>(device.getNetworkProtocol()))));
+    transfers.push_back(transfer);
+    return static_cast<int>(devices.size()) - 1;
+}
+
+int MultiDeviceTransfer::Pimpl::addDevice(const char* address, const char* service,
+        ImageProtocol::ProtocolType protType) {
+    if(ioThreadCreated) {
+        throw std::runtime_error("Devices cannot be added after reception has started!");
+    }
+
+    ImageTransfer* transfer = new ImageTransfer(address, service, protType, false,
+        bufferSize, maxUdpPacketSize, 0);
+    devices.push_back(std::unique_ptr<Device>(new Device(transfer,
+        address == nullptr ? "" : address, service, protType)));
+    transfers.push_back(transfer);
+    return static_cast<int>(devices.size()) - 1;
+}
+
+void MultiDeviceTransfer::Pimpl::setSyncTolerance(int microsec) {
+    if(microsec < 0) {
+        throw std::runtime_error("Sync tolerance must not be negative!");
+    }
+    syncTolerance = microsec;
+}
+
+void MultiDeviceTransfer::Pimpl::setBundleQueueDepth(int depth) {
+    if(depth < 1) {
+        throw std::runtime_error("Bundle queue depth must be at least 1!");
+    }
+    unique_lock<mutex> lock(bundleMutex);
+    bundleQueueDepth = depth;
+}
+
+int MultiDeviceTransfer::Pimpl::getBundleQueueDepth() {
+    unique_lock<mutex> lock(bundleMutex);
+    return bundleQueueDepth;
+}
+
+void MultiDeviceTransfer::Pimpl::checkDeviceIndex(int device) const {
+    if(device < 0 || device >= static_cast<int>(devices.size())) {
+        throw std::runtime_error("Invalid device index!");
+    }
+}
+
+int MultiDeviceTransfer::Pimpl::getNumDroppedFrames(int device) const {
+    checkDeviceIndex(device);
+    unique_lock<mutex> lock(devices[device]->transferMutex);
+    return devices[device]->transfer->getNumDroppedFrames() + devices[device]->droppedFrames;
+}
+
+int MultiDeviceTransfer::Pimpl::getSkew(int device) const {
+    checkDeviceIndex(device);
+    return devices[device]->skew;
+}
+
+int MultiDeviceTransfer::Pimpl::getMaxSkew(int device) const {
+    checkDeviceIndex(device);
+    return devices[device]->maxSkew;
+}
+
+bool MultiDeviceTransfer::Pimpl::isConnected(int device) const {
+    checkDeviceIndex(device);
+    unique_lock<mutex> lock(devices[device]->transferMutex);
+    return devices[device]->transfer->isConnected();
+}
+
+void MultiDeviceTransfer::Pimpl::createIoThread() {
+    if(devices.empty()) {
+        throw std::runtime_error("No devices have been added!");
+    }
+
+    // Lazy initialization of the I/O thread
+    ioThreadCreated = true;
+    ioThread = thread(bind(&MultiDeviceTransfer::Pimpl::ioLoop, this));
+}
+
+bool MultiDeviceTransfer::Pimpl::collectBundle(std::vector<ImageSet>& bundle, double timeout) {
+    if(!ioThreadCreated) {
+        createIoThread();
+    }
+
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now()
+        + std::chrono::microseconds(static_cast<long long>(std::max(0.0, timeout)*1e6));
+
+    std::vector<ReceiveSlot*> slots;
+    {
+        unique_lock<mutex> lock(bundleMutex);
+        while(bundleQueue.empty() && !ioException && !terminate) {
+            if(timeout < 0) {
+                bundleCond.wait(lock);
+            } else if(timeout == 0 || bundleCond.wait_until(lock, deadline) == std::cv_status::timeout) {
+                break;
+            }
+        }
+
+        // Test for errors
+        if(ioException) {
+            std::rethrow_exception(ioException);
+        }
+        if(bundleQueue.empty()) {
+            return false;
+        }
+
+        slots = bundleQueue.front();
+        bundleQueue.pop_front();
+    }
+
+    // Lend the slots to the caller. This also releases the image sets that
+    // have previously been collected into the same vector.
+    bundle.resize(slots.size());
+    for(unsigned int i=0; i<slots.size(); i++) {
+        slots[i]->state.store(ReceiveSlot::SLOT_LENT, std::memory_order_relaxed);
+        bundle[i] = slots[i]->imageSet;
+        bundle[i].setDataOwner(slots[i]);
+    }
+
+    return true;
+}
+
+void MultiDeviceTransfer::Pimpl::ioLoop() {
+    std::unique_ptr<bool[]> readable(new bool[transfers.size()]);
+    std::chrono::steady_clock::time_point lastService = std::chrono::steady_clock::now();
+
+    try {
+        while(!terminate) {
+            ImageTransfer::waitForAnySocket(&transfers[0], static_cast<int>(transfers.size()),
+                readable.get(), IO_THREAD_IDLE_WAIT_MS);
+
+            // UDP connections require regular heartbeat messages, which
+            // are otherwise only sent while receiving
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            bool service = now - lastService >= std::chrono::milliseconds(IO_THREAD_IDLE_WAIT_MS);
+            if(service) {
+                lastService = now;
+            }
+
+            for(unsigned int i=0; i<devices.size() && !terminate; i++) {
+                Device& device = *devices[i];
+                if(device.reconnection) {
+                    finishReconnection(i);
+                } else if(readable[i]) {
+                    receiveFromDevice(device);
+                } else if(service && device.protType == ImageProtocol::PROTOCOL_UDP) {
+                    device.transfer->transferData();
+                }
+
+                if(!device.reconnection && device.protType == ImageProtocol::PROTOCOL_TCP
+                        && !device.transfer->isConnected()) {
+                    handleClosedConnection(i);
+                }
+            }
+        }
+    } catch(...) {
+        // Store the exception for later
+        unique_lock<mutex> lock(bundleMutex);
+        ioException = std::current_exception();
+        bundleCond.notify_all();
+    }
+}
+
+void MultiDeviceTransfer::Pimpl::receiveFromDevice(Device& device) {
+    // Data is available, hence this does not block
+    int validRows = 0;
+    bool complete = false;
+    if(!device.transfer->receivePartialImageSet(device.receivedSet, validRows, complete) || !complete) {
+        return;
+    }
+
+    // Take over the pixel data by exchanging buffers with the protocol
+    ReceiveSlot* slot = findFreeReceiveSlot();
+    device.transfer->exchangeReceiveBuffers(slot->buffers);
+    slot->imageSet = device.receivedSet;
+    device.pendingSlots.push_back(slot);
+
+    if(static_cast<int>(device.pendingSlots.size()) > MAX_PENDING_FRAMES) {
+        // Other devices are not delivering
+        dropSlot(device, device.pendingSlots.front());
+        device.pendingSlots.pop_front();
+    }
+
+    matchBundles();
+}
+
+void MultiDeviceTransfer::Pimpl::handleClosedConnection(int index) {
+    if(autoReconnectDelay <= 0) {
+        throw TransferException("Connection to device " + std::to_string(index) + " has been closed!");
+    }
+
+    // The partially received image set is lost
+    Device& device = *devices[index];
+    device.receivedSet = ImageSet();
+
+    // Connecting may block, hence this is done by a separate thread
+    device.reconnection.reset(new Reconnection);
+    device.reconnection->terminate = false;
+    device.reconnection->address = device.address;
+    device.reconnection->service = device.service;
+    device.reconnection->bufferSize = bufferSize;
+    device.reconnection->maxUdpPacketSize = maxUdpPacketSize;
+    device.reconnection->delay = autoReconnectDelay;
+    thread(&MultiDeviceTransfer::Pimpl::reconnectLoop, device.reconnection).detach();
+}
+
+void MultiDeviceTransfer::Pimpl::finishReconnection(int index) {
+    Device& device = *devices[index];
+    std::unique_ptr<ImageTransfer> newTransfer;
+    {
+        unique_lock<mutex> lock(device.reconnection->mutex);
+        if(!device.reconnection->transfer) {
+            // Still reconnecting
+            return;
+        }
+        newTransfer = std::move(device.reconnection->transfer);
+    }
+    device.reconnection.reset();
+
+    // Frames dropped by the closed connection remain counted
+    unique_lock<mutex> lock(device.transferMutex);
+    device.droppedFrames += device.transfer->getNumDroppedFrames();
+    device.transfer.swap(newTransfer);
+    transfers[index] = device.transfer.get();
+}
+
+void MultiDeviceTransfer::Pimpl::reconnectLoop(std::shared_ptr<Reconnection> reconnection) {
+    unique_lock<mutex> lock(reconnection->mutex);
+    while(!reconnection->terminate) {
+        lock.unlock();
+        std::unique_ptr<ImageTransfer> transfer;
+        try {
+            transfer.reset(new ImageTransfer(reconnection->address.c_str(),
+                reconnection->service.c_str(), ImageProtocol::PROTOCOL_TCP, false,
+                reconnection->bufferSize, reconnection->maxUdpPacketSize, 0));
+        } catch(...) {
+            // The device is not reachable yet. We keep trying.
+        }
+        lock.lock();
+
+        if(transfer) {
+            if(!reconnection->terminate) {
+                reconnection->transfer = std::move(transfer);
+            }
+            return;
+        }
+
+        reconnection->cond.wait_for(lock, std::chrono::seconds(reconnection->delay));
+    }
+}
+
+void MultiDeviceTransfer::Pimpl::matchBundles() {
+    SyncSource source = getSyncSource();
+    long long tolerance = syncTolerance;
+
+    while(true) {
+        // The image set of the bundle that was captured last determines
+        // the time of the bundle
+        long long bundleTime = 0;
+        for(unsigned int i=0; i<devices.size(); i++) {
+            if(devices[i]->pendingSlots.empty()) {
+                return;
+            }
+            long long time = getSyncTime(devices[i]->pendingSlots.front()->imageSet, source);
+            if(i == 0 || time > bundleTime) {
+                bundleTime = time;
+            }
+        }
+
+        // Older image sets will never be matched
+        bool dropped = false;
+        for(unsigned int i=0; i<devices.size(); i++) {
+            Device& device = *devices[i];
+            while(!device.pendingSlots.empty() && getSyncTime(
+                    device.pendingSlots.front()->imageSet, source) < bundleTime - tolerance) {
+                dropSlot(device, device.pendingSlots.front());
+                device.pendingSlots.pop_front();
+                dropped = true;
+            }
+        }
+        if(dropped) {
+            // The next image sets might have been captured after the
+            // bundle time, which hence has to be determined again
+            continue;
+        }
+
+        // All remaining image sets lie within the tolerance
+        std::vector<ReceiveSlot*> bundle(devices.size());
+        long long referenceTime = getSyncTime(devices[0]->pendingSlots.front()->imageSet, source);
+        for(unsigned int i=0; i<devices.size(); i++) {
+            Device& device = *devices[i];
+            bundle[i] = device.pendingSlots.front();
+            device.pendingSlots.pop_front();
+
+            int skew = static_cast<int>(getSyncTime(bundle[i]->imageSet, source) - referenceTime);
+            device.skew = skew;
+            if(std::abs(skew) > device.maxSkew) {
+                device.maxSkew = std::abs(skew);
+            }
+        }
+
+        queueBundle(bundle);
+    }
+}
+
+void MultiDeviceTransfer::Pimpl::queueBundle(const std::vector<ReceiveSlot*>& bundle) {
+    unique_lock<mutex> lock(bundleMutex);
+    while(static_cast<int>(bundleQueue.size()) >= bundleQueueDepth) {
+        // The oldest bundle is dropped in favor of the new one
+        std::vector<ReceiveSlot*>& dropped = bundleQueue.front();
+        for(unsigned int i=0; i<dropped.size(); i++) {
+            dropSlot(*devices[i], dropped[i]);
+        }
+        bundleQueue.pop_front();
+    }
+
+    bundleQueue.push_back(bundle);
+    bundleCond.notify_one();
+}
+
+void MultiDeviceTransfer::Pimpl::dropSlot(Device& device, ReceiveSlot* slot) {
+    device.droppedFrames++;
+    slot->imageSet = ImageSet();
+    slot->state.store(ReceiveSlot::SLOT_FREE, std::memory_order_release);
+}
+
+ReceiveSlot* MultiDeviceTransfer::Pimpl::findFreeReceiveSlot() {
+    for(unsigned int i=0; i<receiveSlots.size(); i++) {
+        // Only this thread turns free slots into busy ones
+        if(receiveSlots[i]->state.load(std::memory_order_acquire) == ReceiveSlot::SLOT_FREE) {
+            receiveSlots[i]->state.store(ReceiveSlot::SLOT_BUSY, std::memory_order_relaxed);
+            return receiveSlots[i];
+        }
+    }
+
+    // All slots are pending, queued or still held by the caller
+    ReceiveSlot* slot = new ReceiveSlot;
+    slot->state.store(ReceiveSlot::SLOT_BUSY, std::memory_order_relaxed);
+    receiveSlots.push_back(slot);
+    return slot;
+}
+
+long long MultiDeviceTransfer::Pimpl::getSyncTime(const ImageSet& imageSet, SyncSource source) const {
+    int seconds = 0, microsec = 0;
+    if(source == SYNC_PULSE) {
+        imageSet.getLastSyncPulse(seconds, microsec);
+    } else {
+        imageSet.getTimestamp(seconds, microsec);
+    }
+    return seconds * 1000000LL + microsec;
+}
+
+constexpr int MultiDeviceTransfer::Pimpl::IO_THREAD_IDLE_WAIT_MS;
+constexpr int MultiDeviceTransfer::Pimpl::MAX_PENDING_FRAMES;
+
+} // namespace
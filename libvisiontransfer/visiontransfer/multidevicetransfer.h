@@ -0,0 +1,219 @@
+/*******************************************************************************
+ * Copyright (c) 2024 Allied Vision Technologies GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *******************************************************************************/
+
+
+#ifndef VISIONTRANSFER_MULTIDEVICETRANSFER_H
+#define VISIONTRANSFER_MULTIDEVICETRANSFER_H
+
+#include <vector>
+#include "visiontransfer/common.h"
+#include "visiontransfer/imageset.h"
+#include "visiontransfer/imageprotocol.h"
+#include "visiontransfer/deviceinfo.h"
+
+namespace visiontransfer {
+
+/**
+ * \brief Receives image sets from multiple devices and combines them into
+ * synchronized bundles.
+ *
+ * All devices are serviced by a single background thread, which waits for
+ * network data on all connections at once. This scales better than using
+ * one AsyncTransfer object per device, each of which requires its own
+ * threads.
+ *
+ * Received image sets are matched by their capture timestamps or by the
+ * time of the last synchronization pulse (see SyncSource). A bundle
+ * contains exactly one image set per device, and the times of all image
+ * sets in a bundle differ by no more than the sync tolerance. This requires
+ * the clocks of all devices to be synchronized, e.g. through PTP.
+ *
+ * Image sets for which no matching image sets from all other devices are
+ * received, e.g. because a frame has been lost on the network, are dropped
+ * and reported through getNumDroppedFrames(). The time differences between
+ * the devices are reported through getSkew().
+ *
+ * \code
+ * MultiDeviceTransfer transfer;
+ * transfer.addDevice("192.168.10.10");
+ * transfer.addDevice("192.168.10.11");
+ *
+ * std::vector<ImageSet> bundle;
+ * while(transfer.collectBundle(bundle)) {
+ *     // bundle[i] has been received from device i
+ * }
+ * \endcode
+ */
+class VT_EXPORT MultiDeviceTransfer {
+public:
+    /// Time that is used for matching the image sets of different devices
+    enum SyncSource {
+        /// The capture timestamp of each image set
+        SYNC_TIMESTAMP,
+
+        /// The time of the last synchronization pulse before each capture
+        SYNC_PULSE
+    };
+
+    /**
+     * \brief Creates a new transfer object without any devices.
+     *
+     * \param bufferSize Buffer size for sending / receiving network data.
+     * \param maxUdpPacketSize Maximum allowed size of a UDP packet when sending data.
+     * \param autoReconnectDelay Seconds between attempts to reconnect to a
+     *        TCP device whose connection has been closed, see
+     *        ImageTransfer::setAutoReconnect(). Reconnection happens in the
+     *        background, while the other devices continue to be received.
+     *        If set to 0, a closed TCP connection causes collectBundle()
+     *        to throw an exception.
+     *
+     * The parameters apply to all devices that are added later on.
+     */
+    MultiDeviceTransfer(int bufferSize = 16*1048576, int maxUdpPacketSize = 1472,
+        int autoReconnectDelay = 1);
+
+    ~MultiDeviceTransfer();
+
+    /**
+     * \brief Connects to a new device.
+     *
+     * \param device Information on the device to connect to.
+     * \return The index of the device within collected bundles.
+     *
+     * All devices must be added before the first call of collectBundle().
+     */
+    int addDevice(const DeviceInfo& device);
+
+    /**
+     * \brief Connects to a new device at the given address.
+     *
+     * \param address Address of the device.
+     * \param service The port number that should be used as string or
+     *        as textual service name.
+     * \param protType Specifies whether the UDP or TCP transport protocol
+     *        shall be used.
+     * \return The index of the device within collected bundles.
+     *
+     * All devices must be added before the first call of collectBundle().
+     */
+    int addDevice(const char* address, const char* service = "7681",
+        ImageProtocol::ProtocolType protType = ImageProtocol::PROTOCOL_UDP);
+
+    /// Returns the number of devices that have been added
+    int getNumDevices() const;
+
+    /**
+     * \brief Selects the time that is used for matching the image sets of
+     * different devices.
+     *
+     * The default is SYNC_TIMESTAMP. SYNC_PULSE is intended for devices that
+     * are triggered by a common external trigger signal, and requires
+     * devices that transmit the time of the last synchronization pulse.
+     */
+    void setSyncSource(SyncSource source);
+
+    /// Returns the time that is used for matching the image sets
+    SyncSource getSyncSource() const;
+
+    /**
+     * \brief Sets the maximum time difference between the image sets of
+     * one bundle.
+     *
+     * \param microsec Tolerance in microseconds. The default is 5000.
+     *
+     * The tolerance should be less than half the frame period, as otherwise
+     * image sets of consecutive frames might be matched.
+     */
+    void setSyncTolerance(int microsec);
+
+    /// Returns the maximum time difference between the image sets of one bundle
+    int getSyncTolerance() const;
+
+    /**
+     * \brief Sets the number of bundles that can be queued for collection.
+     *
+     * \param depth Maximum number of bundles that have not yet been
+     *        collected. The default is 1.
+     *
+     * If the queue is full, the oldest bundle is dropped in favor of a new
+     * one. Its image sets are counted as dropped frames for each device.
+     */
+    void setBundleQueueDepth(int depth);
+
+    /// Returns the number of bundles that can be queued for collection
+    int getBundleQueueDepth() const;
+
+    /**
+     * \brief Collects the next synchronized bundle of image sets.
+     *
+     * \param bundle Receives one image set per device, in the order in which
+     *        the devices have been added.
+     * \param timeout The maximum time in seconds for which to wait if no
+     *        bundle is available yet. A value < 0 waits indefinitely.
+     * \return True if a bundle has been received before the timeout.
+     *
+     * No bundles are received while a TCP device is reconnecting, which
+     * can be detected through isConnected(). Errors on any connection,
+     * including a closed TCP connection if auto-reconnection is disabled,
+     * are thrown as exceptions.
+     *
+     * Reception starts with the first call of this method. Like with
+     * AsyncTransfer::collectReceivedImageSet(), the image sets own their
+     * receive buffers, which are only reused once the image sets and all of
+     * their copies have been destroyed or overwritten.
+     */
+    bool collectBundle(std::vector<ImageSet>& bundle, double timeout = -1);
+
+    /**
+     * \brief Returns the number of frames of the given device that have
+     * been dropped.
+     *
+     * This includes frames that have been lost on the network, frames for
+     * which no matching frames of the other devices have been received, and
+     * frames of bundles that have not been collected in time.
+     */
+    int getNumDroppedFrames(int device) const;
+
+    /**
+     * \brief Returns the time difference in microseconds between the given
+     * device and the first device in the most recent bundle.
+     */
+    int getSkew(int device) const;
+
+    /**
+     * \brief Returns the largest absolute time difference in microseconds
+     * between the given device and the first device in any bundle so far.
+     */
+    int getMaxSkew(int device) const;
+
+    /**
+     * \brief Returns true if a connection to the given device is established.
+     *
+     * This is false while a closed TCP connection is being reconnected.
+     */
+    bool isConnected(int device) const;
+
+private:
+    // We follow the pimpl idiom
+    class Pimpl;
+    Pimpl* pimpl;
+
+    // This class cannot be copied
+    MultiDeviceTransfer(const MultiDeviceTransfer& other);
+    MultiDeviceTransfer& operator=(const MultiDeviceTransfer&);
+};
+
+} // namespace
+
+#endif
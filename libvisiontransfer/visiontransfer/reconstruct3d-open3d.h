@@ -25,80 +25,67 @@ namespace visiontransfer {
  */
 
 inline std::shared_ptr<open3d::geometry::PointCloud> Reconstruct3D::createOpen3DCloud(
-        const ImageSet& imageSet, ColorSource colSource, unsigned short minDisparity, unsigned short maxDisparity) {
+        const ImageSet& imageSet, ColorSource colSource, unsigned short minDisparity, unsigned short maxDisparity,
+        bool estimateNormals, std::shared_ptr<open3d::geometry::PointCloud> cloud) {
 
     int numPoints = imageSet.getWidth() * imageSet.getHeight();
-    std::shared_ptr<open3d::geometry::PointCloud> ret(new open3d::geometry::PointCloud());
+    std::shared_ptr<open3d::geometry::PointCloud> ret = cloud;
+    if(!ret) {
+        ret.reset(new open3d::geometry::PointCloud());
+    }
 
-    // Convert the 3D point cloud
+    // Points and colors are written directly into the vectors of the point
+    // cloud, whose elements each consist of three consecutive doubles
     ret->points_.resize(numPoints);
 
-    float* points = createPointMap(imageSet, minDisparity, maxDisparity);
-    float* end = &points[4*numPoints];
-    Eigen::Vector3d* dest = &ret->points_[0];
-
-    while(points != end) {
-        float x = *(points++);
-        float y = *(points++);
-        float z = *(points++);
-        points++;
-
-        *dest = Eigen::Vector3d(x, y, z);
-        dest++;
-    }
-
     ImageSet::ImageType colImg = getColorImage(imageSet, colSource);
-
-    // Convert the color information if enabled
+    double* colors = NULL;
     if(colSource != COLOR_NONE && imageSet.hasImageType(colImg)) {
         ret->colors_.resize(numPoints);
-        unsigned char* pixel = imageSet.getPixelData(colImg);
-        Eigen::Vector3d* color = &ret->colors_[0];
-        Eigen::Vector3d* colorEnd = &ret->colors_[numPoints];
-
-        switch(imageSet.getPixelFormat(colImg)) {
-            case ImageSet::FORMAT_8_BIT_MONO:
-                while(color != colorEnd) {
-                    double col = double(*(pixel++))/0xFF;
-                    *(color++) = Eigen::Vector3d(col, col, col);
-                }
-                break;
-            case ImageSet::FORMAT_12_BIT_MONO:
-                while(color != colorEnd) {
-                    double col = double(*reinterpret_cast<unsigned short*>(pixel))/0xFFF;
-                    pixel+=2;
-                    *(color++) = Eigen::Vector3d(col, col, col);
-                }
-                break;
-            case ImageSet::FORMAT_8_BIT_RGB:
-                while(color != colorEnd) {
-                    double r = double(*(pixel++))/0xFF;
-                    double g = double(*(pixel++))/0xFF;
-                    double b = double(*(pixel++))/0xFF;
-                    *(color++) = Eigen::Vector3d(r, g, b);
-                }
-                break;
-            default: throw std::runtime_error("Illegal pixel format");
+        colors = reinterpret_cast<double*>(ret->colors_.data());
+    } else {
+        ret->colors_.clear();
+    }
+
+    createDoubleCloud(imageSet, minDisparity, maxDisparity,
+        reinterpret_cast<double*>(ret->points_.data()), colors, colSource);
+
+    // Convert the normals if requested
+    if(estimateNormals) {
+        ret->normals_.resize(numPoints);
+        float* normals = createNormalMap(imageSet, minDisparity, maxDisparity);
+        for(int i = 0; i < numPoints; i++) {
+            ret->normals_[i] = Eigen::Vector3d(normals[3*i], normals[3*i + 1], normals[3*i + 2]);
         }
+    } else {
+        ret->normals_.clear();
     }
 
     return ret;
 }
 
 inline std::shared_ptr<open3d::geometry::RGBDImage> Reconstruct3D::createOpen3DImageRGBD(const ImageSet& imageSet,
-    ColorSource colSource, unsigned short minDisparity) {
+    ColorSource colSource, unsigned short minDisparity, ZMapFormat depthFormat) {
+
+    if(depthFormat == ZMAP_HALF_FLOAT) {
+        throw std::runtime_error("Open3D does not support half-precision depth images");
+    }
 
     std::shared_ptr<open3d::geometry::RGBDImage> ret(new open3d::geometry::RGBDImage);
 
-    // Convert depth map
+    // Create the depth map directly in the image data
     ret->depth_.width_ = imageSet.getWidth();
     ret->depth_.height_ = imageSet.getHeight();
     ret->depth_.num_of_channels_ = 1;
-    ret->depth_.bytes_per_channel_ = sizeof(float);
+    ret->depth_.bytes_per_channel_ = getBytesPerPixel(depthFormat);
     ret->depth_.data_.resize(ret->depth_.width_*ret->depth_.height_*ret->depth_.bytes_per_channel_);
 
-    float* zMap = createZMap(imageSet, minDisparity);
-    memcpy(&ret->depth_.data_[0], zMap, ret->depth_.data_.size());
+    if(depthFormat == ZMAP_FLOAT) {
+        createZMap(imageSet, minDisparity, 0xFFF, reinterpret_cast<float*>(&ret->depth_.data_[0]), 0);
+    } else {
+        createZMap(imageSet, depthFormat, 0, minDisparity > 0 ? minDisparity : 1, 0xFFF,
+            &ret->depth_.data_[0], 0);
+    }
 
     // Convert color
     ret->color_.width_ = imageSet.getWidth();
@@ -108,35 +95,65 @@ inline std::shared_ptr<open3d::geometry::RGBDImage> Reconstruct3D::createOpen3DI
     ret->color_.data_.resize(ret->color_.width_ * ret->color_.height_ *
         ret->color_.num_of_channels_ * ret->color_.bytes_per_channel_);
 
-    ImageSet::ImageType colImg = getColorImage(imageSet, colSource);
+    createRgbImage(imageSet, colSource, &ret->color_.data_[0]);
+
+    return ret;
+}
+
+inline std::shared_ptr<open3d::geometry::PointCloud> Reconstruct3D::createOpen3DVoxelGridCloud(
+        const ImageSet& imageSet, float leafSize, ColorSource colSource, const float* boundingBox,
+        unsigned short minDisparity) {
 
-    unsigned char* srcPixel = imageSet.getPixelData(colImg);
-    unsigned char* dstPixel = &ret->color_.data_[0];
-    unsigned char* dstEnd = &ret->color_.data_[ret->color_.data_.size()];
-
-    switch(imageSet.getPixelFormat(colImg)) {
-        case ImageSet::FORMAT_8_BIT_MONO:
-            while(dstPixel != dstEnd) {
-                *(dstPixel++) = *srcPixel;
-                *(dstPixel++) = *srcPixel;
-                *(dstPixel++) = *(srcPixel++);
-            }
-            break;
-        case ImageSet::FORMAT_12_BIT_MONO:
-            while(dstPixel != dstEnd) {
-                unsigned short pixel16Bit = *reinterpret_cast<unsigned short*>(srcPixel);
-                unsigned char pixel8Bit = pixel16Bit / 0xF;
-                srcPixel += 2;
-
-                *(dstPixel++) = pixel8Bit;
-                *(dstPixel++) = pixel8Bit;
-                *(dstPixel++) = pixel8Bit;
-            }
-            break;
-        case ImageSet::FORMAT_8_BIT_RGB:
-            memcpy(&ret->color_.data_[0], srcPixel, ret->color_.data_.size());
-            break;
-        default: throw std::runtime_error("Illegal pixel format");
+    int numPoints = 0;
+    const unsigned char* colors = NULL;
+    float* points = createVoxelGridCloud(imageSet, leafSize, numPoints,
+        colSource != COLOR_NONE ? &colors : NULL, colSource, boundingBox, minDisparity);
+
+    std::shared_ptr<open3d::geometry::PointCloud> ret(new open3d::geometry::PointCloud());
+    ret->points_.resize(numPoints);
+    for(int i = 0; i < numPoints; i++) {
+        ret->points_[i] = Eigen::Vector3d(points[3*i], points[3*i + 1], points[3*i + 2]);
+    }
+
+    if(colors != NULL) {
+        ret->colors_.resize(numPoints);
+        for(int i = 0; i < numPoints; i++) {
+            ret->colors_[i] = Eigen::Vector3d(double(colors[3*i])/0xFF,
+                double(colors[3*i + 1])/0xFF, double(colors[3*i + 2])/0xFF);
+        }
+    }
+
+    return ret;
+}
+
+inline std::shared_ptr<open3d::geometry::TriangleMesh> Reconstruct3D::createOpen3DMesh(
+        const ImageSet& imageSet, ColorSource colSource, int decimation,
+        float discontinuityThreshold, unsigned short minDisparity) {
+
+    int numVertices = 0, numTriangles = 0;
+    const int* triangles = NULL;
+    const unsigned char* colors = NULL;
+    float* vertices = createMesh(imageSet, numVertices, &triangles, numTriangles,
+        colSource != COLOR_NONE ? &colors : NULL, colSource, decimation,
+        discontinuityThreshold, minDisparity);
+
+    std::shared_ptr<open3d::geometry::TriangleMesh> ret(new open3d::geometry::TriangleMesh());
+    ret->vertices_.resize(numVertices);
+    for(int i = 0; i < numVertices; i++) {
+        ret->vertices_[i] = Eigen::Vector3d(vertices[3*i], vertices[3*i + 1], vertices[3*i + 2]);
+    }
+
+    ret->triangles_.resize(numTriangles);
+    for(int i = 0; i < numTriangles; i++) {
+        ret->triangles_[i] = Eigen::Vector3i(triangles[3*i], triangles[3*i + 1], triangles[3*i + 2]);
+    }
+
+    if(colors != NULL) {
+        ret->vertex_colors_.resize(numVertices);
+        for(int i = 0; i < numVertices; i++) {
+            ret->vertex_colors_[i] = Eigen::Vector3d(double(colors[3*i])/0xFF,
+                double(colors[3*i + 1])/0xFF, double(colors[3*i + 2])/0xFF);
+        }
     }
 
     return ret;
@@ -25,12 +25,18 @@ namespace visiontransfer {
  */
 
 template <typename T>
-typename pcl::PointCloud<T>::Ptr Reconstruct3D::initPointCloud(const ImageSet& imageSet, const char* frameId) {
+typename pcl::PointCloud<T>::Ptr Reconstruct3D::initPointCloud(const ImageSet& imageSet, const char* frameId,
+        typename pcl::PointCloud<T>::Ptr cloud) {
     int sec, microsec;
     imageSet.getTimestamp(sec, microsec);
 
-    typename pcl::PointCloud<T>::Ptr ret(
-        new pcl::PointCloud<T>(imageSet.getWidth(), imageSet.getHeight()));
+    typename pcl::PointCloud<T>::Ptr ret = cloud;
+    if(!ret) {
+        ret.reset(new pcl::PointCloud<T>(imageSet.getWidth(), imageSet.getHeight()));
+    } else {
+        // Reuse the existing storage
+        ret->points.resize(static_cast<size_t>(imageSet.getWidth()) * imageSet.getHeight());
+    }
 
     ret->header.frame_id = frameId;
     ret->header.seq = imageSet.getSequenceNumber();
@@ -42,82 +48,137 @@ typename pcl::PointCloud<T>::Ptr Reconstruct3D::initPointCloud(const ImageSet& i
 }
 
 inline pcl::PointCloud<pcl::PointXYZ>::Ptr Reconstruct3D::createXYZCloud(const ImageSet& imageSet,
-        const char* frameId, unsigned short minDisparity) {
-    float* pointMap = createPointMap(imageSet, minDisparity);
-    pcl::PointCloud<pcl::PointXYZ>::Ptr ret = initPointCloud<pcl::PointXYZ>(imageSet, frameId);
-    memcpy(&ret->points[0].x, pointMap, ret->width*ret->height*sizeof(float)*4);
+        const char* frameId, unsigned short minDisparity, pcl::PointCloud<pcl::PointXYZ>::Ptr cloud) {
+    pcl::PointCloud<pcl::PointXYZ>::Ptr ret = initPointCloud<pcl::PointXYZ>(imageSet, frameId, cloud);
+    createInterleavedCloud(imageSet, minDisparity, 0xFFF, reinterpret_cast<unsigned char*>(ret->points.data()),
+        sizeof(pcl::PointXYZ), CHANNEL_NONE, 0, COLOR_NONE);
     return ret;
 }
 
 inline pcl::PointCloud<pcl::PointXYZI>::Ptr Reconstruct3D::createXYZICloud(const ImageSet& imageSet,
-        const char* frameId, unsigned short minDisparity) {
-    float* pointMap = createPointMap(imageSet, minDisparity);
-    pcl::PointCloud<pcl::PointXYZI>::Ptr ret = initPointCloud<pcl::PointXYZI>(imageSet, frameId);
-
-    ImageSet::ImageType colImg = ImageSet::IMAGE_LEFT;
-
-    pcl::PointXYZI* dstPtr = &ret->points[0];
-    if(imageSet.getPixelFormat(colImg) == ImageSet::FORMAT_8_BIT_MONO) {
-        for(int y = 0; y < imageSet.getHeight(); y++) {
-            unsigned char* rowPtr = imageSet.getPixelData(colImg) + y*imageSet.getRowStride(colImg);
-            unsigned char* endPtr = rowPtr + imageSet.getWidth();
-            for(; rowPtr < endPtr; rowPtr++) {
-                dstPtr->intensity = static_cast<float>(*rowPtr)/255.0F;
-                dstPtr->x = *pointMap++;
-                dstPtr->y = *pointMap++;
-                dstPtr->z = *pointMap++;
-
-                pointMap++;
-                dstPtr++;
-            }
-        }
-    } else if(imageSet.getPixelFormat(colImg) == ImageSet::FORMAT_12_BIT_MONO) {
-        for(int y = 0; y < imageSet.getHeight(); y++) {
-            unsigned short* rowPtr = reinterpret_cast<unsigned short*>(imageSet.getPixelData(colImg) + y*imageSet.getRowStride(colImg));
-            unsigned short* endPtr = rowPtr + imageSet.getWidth();
-            for(; rowPtr < endPtr; rowPtr++) {
-                dstPtr->intensity = static_cast<float>(*rowPtr)/4095.0F;
-                dstPtr->x = *pointMap++;
-                dstPtr->y = *pointMap++;
-                dstPtr->z = *pointMap++;
-
-                pointMap++;
-                dstPtr++;
-            }
-        }
-    } else {
+        const char* frameId, unsigned short minDisparity, pcl::PointCloud<pcl::PointXYZI>::Ptr cloud) {
+    ImageSet::ImageFormat format = imageSet.getPixelFormat(ImageSet::IMAGE_LEFT);
+    if(format != ImageSet::FORMAT_8_BIT_MONO && format != ImageSet::FORMAT_12_BIT_MONO) {
         throw std::runtime_error("Left image does not have a valid greyscale format");
     }
 
+    pcl::PointCloud<pcl::PointXYZI>::Ptr ret = initPointCloud<pcl::PointXYZI>(imageSet, frameId, cloud);
+    // The cloud may be empty, so the field offset is taken from a local point
+    unsigned char* dst = reinterpret_cast<unsigned char*>(ret->points.data());
+    pcl::PointXYZI layout;
+    int intensityOffset = static_cast<int>(reinterpret_cast<unsigned char*>(&layout.intensity)
+        - reinterpret_cast<unsigned char*>(&layout));
+
+    createInterleavedCloud(imageSet, minDisparity, 0xFFF, dst, sizeof(pcl::PointXYZI),
+        CHANNEL_INTENSITY, intensityOffset, COLOR_LEFT);
     return ret;
 }
 
 inline pcl::PointCloud<pcl::PointXYZRGB>::Ptr Reconstruct3D::createXYZRGBCloud(const ImageSet& imageSet,
-        const char* frameId, unsigned short minDisparity) {
-    float* pointMap = createPointMap(imageSet, minDisparity);
-    pcl::PointCloud<pcl::PointXYZRGB>::Ptr ret = initPointCloud<pcl::PointXYZRGB>(imageSet, frameId);
-
+        const char* frameId, unsigned short minDisparity, pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud) {
     ImageSet::ImageType colImg = getColorImage(imageSet, COLOR_AUTO);
-
-    pcl::PointXYZRGB* dstPtr = &ret->points[0];
     if(imageSet.getPixelFormat(colImg) != ImageSet::FORMAT_8_BIT_RGB) {
         throw std::runtime_error("Left image is not an RGB image");
     }
 
-    for(int y = 0; y < imageSet.getHeight(); y++) {
-        unsigned char* rowPtr = imageSet.getPixelData(colImg) + y*imageSet.getRowStride(colImg);
-        unsigned char* endPtr = rowPtr + 3*imageSet.getWidth();
-        for(; rowPtr < endPtr;rowPtr +=3) {
-            dstPtr->r = rowPtr[0];
-            dstPtr->g = rowPtr[1];
-            dstPtr->b = rowPtr[2];
-            dstPtr->x = *pointMap++;
-            dstPtr->y = *pointMap++;
-            dstPtr->z = *pointMap++;
-
-            pointMap++;
-            dstPtr++;
-        }
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr ret = initPointCloud<pcl::PointXYZRGB>(imageSet, frameId, cloud);
+
+    // PCL stores the color as one 32-bit word with the bytes b, g, r, a. The
+    // cloud may be empty, so the field offset is taken from a local point.
+    unsigned char* dst = reinterpret_cast<unsigned char*>(ret->points.data());
+    pcl::PointXYZRGB layout;
+    int colorOffset = static_cast<int>(&layout.b - reinterpret_cast<unsigned char*>(&layout));
+
+    createInterleavedCloud(imageSet, minDisparity, 0xFFF, dst, sizeof(pcl::PointXYZRGB),
+        CHANNEL_BGRA, colorOffset, COLOR_AUTO);
+    return ret;
+}
+
+inline pcl::PointCloud<pcl::PointXYZ>::Ptr Reconstruct3D::createCompactXYZCloud(const ImageSet& imageSet,
+        const char* frameId, unsigned short minDisparity, float maxZ) {
+    int numPoints = 0;
+    float* points = createCompactPointCloud(imageSet, numPoints, minDisparity, 0xFFF, maxZ);
+
+    pcl::PointCloud<pcl::PointXYZ>::Ptr ret = initPointCloud<pcl::PointXYZ>(imageSet, frameId);
+    ret->points.resize(numPoints);
+    ret->width = numPoints;
+    ret->height = 1;
+
+    for(int i = 0; i < numPoints; i++) {
+        ret->points[i].x = points[3*i];
+        ret->points[i].y = points[3*i + 1];
+        ret->points[i].z = points[3*i + 2];
+    }
+
+    return ret;
+}
+
+inline pcl::PointCloud<pcl::PointXYZ>::Ptr Reconstruct3D::createVoxelGridXYZCloud(const ImageSet& imageSet,
+        const char* frameId, float leafSize, const float* boundingBox, unsigned short minDisparity) {
+    int numPoints = 0;
+    float* points = createVoxelGridCloud(imageSet, leafSize, numPoints, NULL, COLOR_NONE,
+        boundingBox, minDisparity);
+
+    pcl::PointCloud<pcl::PointXYZ>::Ptr ret = initPointCloud<pcl::PointXYZ>(imageSet, frameId);
+    ret->points.resize(numPoints);
+    ret->width = numPoints;
+    ret->height = 1;
+
+    for(int i = 0; i < numPoints; i++) {
+        ret->points[i].x = points[3*i];
+        ret->points[i].y = points[3*i + 1];
+        ret->points[i].z = points[3*i + 2];
+    }
+
+    return ret;
+}
+
+inline pcl::PointCloud<pcl::PointXYZRGB>::Ptr Reconstruct3D::createVoxelGridXYZRGBCloud(const ImageSet& imageSet,
+        const char* frameId, float leafSize, const float* boundingBox, unsigned short minDisparity) {
+    int numPoints = 0;
+    const unsigned char* colors = NULL;
+    float* points = createVoxelGridCloud(imageSet, leafSize, numPoints, &colors, COLOR_AUTO,
+        boundingBox, minDisparity);
+    if(colors == NULL) {
+        throw std::runtime_error("Image set does not contain a color image");
+    }
+
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr ret = initPointCloud<pcl::PointXYZRGB>(imageSet, frameId);
+    ret->points.resize(numPoints);
+    ret->width = numPoints;
+    ret->height = 1;
+
+    for(int i = 0; i < numPoints; i++) {
+        ret->points[i].x = points[3*i];
+        ret->points[i].y = points[3*i + 1];
+        ret->points[i].z = points[3*i + 2];
+        ret->points[i].r = colors[3*i];
+        ret->points[i].g = colors[3*i + 1];
+        ret->points[i].b = colors[3*i + 2];
+    }
+
+    return ret;
+}
+
+inline pcl::PointCloud<pcl::PointNormal>::Ptr Reconstruct3D::createXYZNormalCloud(const ImageSet& imageSet,
+        const char* frameId, unsigned short minDisparity, float discontinuityThreshold) {
+    float* normals = createNormalMap(imageSet, minDisparity, 0xFFF,
+        discontinuityThreshold);
+    float* points = createPointMap(imageSet, minDisparity);
+
+    pcl::PointCloud<pcl::PointNormal>::Ptr ret = initPointCloud<pcl::PointNormal>(imageSet, frameId);
+    ret->is_dense = false; // Invalid normals are NaN
+    int numPoints = imageSet.getWidth() * imageSet.getHeight();
+
+    for(int i = 0; i < numPoints; i++) {
+        pcl::PointNormal& point = ret->points[i];
+        point.x = points[4*i];
+        point.y = points[4*i + 1];
+        point.z = points[4*i + 2];
+        point.normal_x = normals[3*i];
+        point.normal_y = normals[3*i + 1];
+        point.normal_z = normals[3*i + 2];
+        point.curvature = 0;
     }
 
     return ret;
@@ -14,6 +14,10 @@
 
 #include "reconstruct3d.h"
 #include "visiontransfer/internal/alignedallocator.h"
+#include "visiontransfer/internal/threadpool.h"
+#include "visiontransfer/internal/pointcloudwriter.h"
+#include "visiontransfer/internal/voxelgrid.h"
+#include "visiontransfer/internal/heightgrid.h"
 #include <vector>
 #include <cstring>
 #include <algorithm>
@@ -30,6 +34,9 @@
 #elif __aarch64__
 #include <arm_neon.h>
 #endif
+#if defined(__F16C__) && !defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 #include <iostream>
 
@@ -45,14 +52,62 @@ class Reconstruct3D::Pimpl {
 public:
     Pimpl();
 
+    // If given, bandFinished is called by each band after its rows have been reconstructed
     float* createPointMap(const unsigned short* dispMap, int width, int height,
         int rowStride, const float* q, unsigned short minDisparity, int subpixelFactor,
-        unsigned short maxDisparity);
+        unsigned short maxDisparity, const ThreadPool::BandFunction* bandFinished = nullptr);
+
+    float* createPointMap(const ImageSet& imageSet, unsigned short minDisparity, unsigned short maxDisparity = 0xFFF,
+        const ThreadPool::BandFunction* bandFinished = nullptr);
 
-    float* createPointMap(const ImageSet& imageSet, unsigned short minDisparity, unsigned short maxDisparity = 0xFFF);
+    unsigned char* createPointMap(const ImageSet& imageSet, PointMapLayout layout,
+        unsigned short minDisparity, unsigned short maxDisparity);
+
+    void createPointMap(const ImageSet& imageSet, PointMapLayout layout,
+        unsigned short minDisparity, unsigned short maxDisparity,
+        unsigned char* dst, int dstRowStride);
 
     float* createZMap(const ImageSet& imageSet, unsigned short minDisparity, unsigned short maxDisparity);
 
+    void createZMap(const ImageSet& imageSet, unsigned short minDisparity,
+        unsigned short maxDisparity, float* dst, int dstRowStride);
+
+    unsigned char* createZMap(const ImageSet& imageSet, ZMapFormat format, float invalidValue,
+        unsigned short minDisparity, unsigned short maxDisparity);
+
+    void createZMap(const ImageSet& imageSet, ZMapFormat format, float invalidValue,
+        unsigned short minDisparity, unsigned short maxDisparity, bool clampToMinDisparity,
+        unsigned char* dst, int dstRowStride);
+
+    float* createCompactPointCloud(const ImageSet& imageSet, int& numPoints,
+        unsigned short minDisparity, unsigned short maxDisparity, float maxZ,
+        const int** pixelIndices);
+
+    float* createVoxelGridCloud(const ImageSet& imageSet, float leafSize, int& numPoints,
+        const unsigned char** colors, ColorSource colSource, const float* boundingBox,
+        unsigned short minDisparity, unsigned short maxDisparity);
+
+    float* createNormalMap(const ImageSet& imageSet, unsigned short minDisparity,
+        unsigned short maxDisparity, float discontinuityThreshold);
+
+    float* createHeightMap(const ImageSet& imageSet, float cellSize, const float* extent,
+        int& columns, int& rows, HeightMapMode mode, const unsigned int** pointCounts,
+        unsigned short minDisparity, unsigned short maxDisparity);
+
+    float* createMesh(const ImageSet& imageSet, int& numVertices, const int** triangles,
+        int& numTriangles, const unsigned char** colors, ColorSource colSource,
+        int decimation, float discontinuityThreshold, unsigned short minDisparity,
+        unsigned short maxDisparity);
+
+    void createInterleavedCloud(const ImageSet& imageSet, unsigned short minDisparity,
+        unsigned short maxDisparity, unsigned char* dst, int pointSize, PointChannel channel,
+        int channelOffset, ColorSource colSource);
+
+    void createDoubleCloud(const ImageSet& imageSet, unsigned short minDisparity,
+        unsigned short maxDisparity, double* points, double* colors, ColorSource colSource);
+
+    void createRgbImage(const ImageSet& imageSet, ColorSource colSource, unsigned char* dst);
+
     void projectSinglePoint(int imageX, int imageY, unsigned short disparity, const float* q,
         float& pointX, float& pointY, float& pointZ, int subpixelFactor);
 
@@ -64,24 +119,245 @@ public:
    void writePlyFile(const char* file, const ImageSet& imageSet,
         double maxZ, bool binary, ColorSource colSource, unsigned short maxDisparity);
 
+    void writePointCloudFile(const char* file, PointCloudWriter::FileFormat format,
+        const ImageSet& imageSet, double maxZ, bool binary, ColorSource colSource,
+        unsigned short maxDisparity);
+
+    void writeMeshPlyFile(const char* file, const ImageSet& imageSet, bool binary,
+        ColorSource colSource, int decimation, float discontinuityThreshold,
+        unsigned short maxDisparity);
+
+    void setNumThreads(int numThreads, int firstCpu);
+
+    int getNumThreads() const;
+
+    void setTransformation(const float* transformation);
+
+    void setCropBox(const float* boundingBox, const float* boxTransformation);
+
+    void setCalibration(const float* q, int width, int height, int subpixelFactor);
+
 private:
+    // Crop box, given by an affine transformation from the output frame
+    // into the box frame and the extents of the box in that frame
+    struct CropBox {
+        float matrix[12];
+        float minCorner[3];
+        float maxCorner[3];
+
+        bool contains(float x, float y, float z) const {
+            float bx = matrix[0]*x + matrix[1]*y + matrix[2]*z + matrix[3];
+            float by = matrix[4]*x + matrix[5]*y + matrix[6]*z + matrix[7];
+            float bz = matrix[8]*x + matrix[9]*y + matrix[10]*z + matrix[11];
+            return bx >= minCorner[0] && bx <= maxCorner[0] && by >= minCorner[1]
+                && by <= maxCorner[1] && bz >= minCorner[2] && bz <= maxCorner[2];
+        }
+    };
+
+    // Terms of the disparity-to-depth mapping that only depend on the pixel
+    // position. They are recomputed if Q, the image size or the subpixel
+    // factor change.
+    struct ProjectionCache {
+        bool valid;
+        float q[16];
+        int width;
+        int height;
+        int subpixelFactor;
+        int planeStride;
+
+        // q[4*i]*x for each column x, as four planes and interleaved per column
+        std::vector<float, AlignedAllocator<float> > columnPlanes;
+        std::vector<float, AlignedAllocator<float> > columnVectors;
+
+        // q[4*i + 1]*y + q[4*i + 3] for each row y, interleaved per row
+        std::vector<float, AlignedAllocator<float> > rowVectors;
+
+        ProjectionCache(): valid(false), width(0), height(0), subpixelFactor(0), planeStride(0) {}
+
+        const float* getColumnPlane(int i) const {
+            return &columnPlanes[i*planeStride];
+        }
+    };
+
+    // Transformation from the camera frame into the output frame
+    bool hasTransformation;
+    float transformation[16];
+
+    bool hasCropBox;
+    CropBox cropBox;
+
+    // Cached projection terms for the output frame, and for the camera frame
+    // as used for normal estimation
+    ProjectionCache projectionCache;
+    ProjectionCache cameraProjectionCache;
+
     std::vector<float, AlignedAllocator<float> > pointMap;
+    std::vector<int, AlignedAllocator<int> > pixelIndexMap;
+
+    // Per-band grids and output colors for voxel grid downsampling
+    std::vector<VoxelGrid> voxelGrids;
+    std::vector<unsigned char> voxelColors;
+    std::vector<unsigned char> colorRowBuffers;
+
+    // Per-band grids and resulting cells for height maps
+    std::vector<HeightGrid> heightGrids;
+    std::vector<float> heightMap;
+    std::vector<unsigned int> heightCounts;
+
+    // Depth for each disparity value, for depth maps in float and 16-bit formats
+    std::vector<float, AlignedAllocator<float> > depthLut;
+    std::vector<unsigned short> depthLut16;
+
+    // Padded point planes and resulting normals for normal estimation
+    std::vector<float, AlignedAllocator<float> > normalPoints;
+    std::vector<float, AlignedAllocator<float> > normalMap;
+
+    // Grid points, triangle masks of the grid squares and vertex indices, as
+    // well as the resulting vertices, triangles and colors for meshes
+    std::vector<float, AlignedAllocator<float> > meshGrid;
+    std::vector<unsigned char> meshGridColors;
+    std::vector<unsigned char> meshQuads;
+    std::vector<int> meshVertexIndices;
+    std::vector<float> meshVertices;
+    std::vector<int> meshTriangles;
+    std::vector<unsigned char> meshColors;
+
+    // Persistent worker threads for processing bands of rows
+    ThreadPool threadPool;
+
+    // Buffered writer for point cloud files
+    PointCloudWriter pointCloudWriter;
+
+    // Scratch memory for the coordinates of individual rows, one set per band
+    std::vector<float, AlignedAllocator<float> > rowBuffers;
+    int rowBufferStride;
+    int rowBuffersPerBand;
+
+    void allocateRowBuffers(int width, int buffersPerBand);
+
+    float* getRowBuffer(int band, int index) {
+        return &rowBuffers[(band*rowBuffersPerBand + index) * rowBufferStride];
+    }
 
-    float* createPointMapFallback(const unsigned short* dispMap, int width, int height,
-        int rowStride, const float* q, unsigned short minDisparity, int subpixelFactor,
-        unsigned short maxDisparity);
+    static void checkDisparityMap(const ImageSet& imageSet);
 
-    float* createPointMapSSE2(const unsigned short* dispMap, int width, int height,
-        int rowStride, const float* q, unsigned short minDisparity, int subpixelFactor,
-        unsigned short maxDisparity);
+    static void checkAffineMatrix(const float* matrix);
 
-    float* createPointMapAVX2(const unsigned short* dispMap, int width, int height,
-        int rowStride, const float* q, unsigned short minDisparity, int subpixelFactor,
-        unsigned short maxDisparity);
+    const float* getProjectionMatrix(const float* q, float* combined) const;
+
+    const ProjectionCache& getProjectionCache(ProjectionCache& cache, const float* q,
+        int width, int height, int subpixelFactor);
+
+    const CropBox* getCropBox() const {
+        return hasCropBox ? &cropBox : nullptr;
+    }
+
+    const CropBox* getCameraCropBox(CropBox& cameraCropBox) const;
+
+    void evaluateRow(const unsigned short* dispRow, int width, int y,
+        const ProjectionCache& projection, unsigned short minDisparity, unsigned short maxDisparity,
+        float* xRow, float* yRow, float* zRow, const CropBox* crop);
+
+    void createPointMapRows(const unsigned short* dispMap, int width,
+        int rowStride, const ProjectionCache& projection, unsigned short minDisparity,
+        unsigned short maxDisparity, PointMapLayout layout, unsigned char* dst,
+        int dstRowStride, int dstPlaneStride, int band, int startRow, int stopRow);
+
+    static void storeRowXYZW(const float* xRow, const float* yRow, const float* zRow,
+        int width, float* dst);
+
+    static void storeRowXYZ(const float* xRow, const float* yRow, const float* zRow,
+        int width, float* dst);
+
+    static void storeRowHalfFloat(const float* xRow, const float* yRow, const float* zRow,
+        int width, unsigned short* dst);
+
+    static void storeRowInt16(const float* xRow, const float* yRow, const float* zRow,
+        int width, short* dst);
+
+    static unsigned short floatToHalf(float value);
+
+    static void convertRowToRgb(const unsigned char* src, ImageSet::ImageFormat format,
+        int width, unsigned char* dst);
+
+    static void convertRowToIntensity(const unsigned char* src, ImageSet::ImageFormat format,
+        int width, float* dst);
+
+    static void convertRowToBgra(const unsigned char* src, ImageSet::ImageFormat format,
+        int width, unsigned int* dst);
+
+    static void convertRowToDoubleColors(const unsigned char* src, ImageSet::ImageFormat format,
+        int width, double* dst);
+
+    static void storeRowInterleaved(const float* xRow, const float* yRow, const float* zRow,
+        const float* channelRow, int width, int pointSize, int channelOffset, unsigned char* dst);
+
+    static void storeRowXYZDouble(const float* xRow, const float* yRow, const float* zRow,
+        int width, double* dst);
+
+    static int compactRow(const unsigned short* dispRow, const float* xRow,
+        const float* yRow, const float* zRow, int width, int firstIndex,
+        unsigned short minDisparity, unsigned short maxDisparity, float zMin, float zLimit,
+        float* dstPoints, int* dstIndices);
+
+    static int selectVoxelRow(const unsigned short* dispRow, const float* xRow,
+        const float* yRow, const float* zRow, int width, unsigned short minDisparity,
+        unsigned short maxDisparity, const float* bounds, int* columns);
+
+    static void computeCellRow(const unsigned short* dispRow, const float* xRow,
+        const float* yRow, const float* zRow, int width, unsigned short minDisparity,
+        unsigned short maxDisparity, const float* extent, float invCellSize, int columns,
+        int rows, int* cells);
+
+    static void sampleGridRow(const unsigned short* dispRow, const float* xRow,
+        const float* yRow, const float* zRow, int gridWidth, int step,
+        unsigned short minDisparity, unsigned short maxDisparity,
+        float* gridX, float* gridY, float* gridZ);
+
+    static int computeQuadRow(const float* topRow, const float* bottomRow, int numQuads,
+        float threshold, unsigned char* quads);
+
+    static void computeNormalRow(const float* const* planes, int stride, int width,
+        float threshold, float* nxRow, float* nyRow, float* nzRow);
+
+#if defined(__SSE2__) || defined(__AVX2__)
+    static void selectTangent(__m128 validPrev, __m128 validNext,
+        __m128 prevX, __m128 prevY, __m128 prevZ, __m128 centerX, __m128 centerY, __m128 centerZ,
+        __m128 nextX, __m128 nextY, __m128 nextZ, __m128 nanVector,
+        __m128& tx, __m128& ty, __m128& tz);
+#endif
 
-    float* createPointMapNEON(const unsigned short* dispMap, int width, int height,
+    void createPointMapFallback(const unsigned short* dispMap, int width,
+        int rowStride, const ProjectionCache& projection, unsigned short minDisparity,
+        unsigned short maxDisparity, int startRow, int stopRow);
+
+    void createPointMapSSE2(const unsigned short* dispMap, int width,
+        int rowStride, const ProjectionCache& projection, unsigned short minDisparity,
+        unsigned short maxDisparity, int startRow, int stopRow);
+
+    void createPointMapAVX2(const unsigned short* dispMap, int width,
+        int rowStride, const ProjectionCache& projection, unsigned short minDisparity,
+        unsigned short maxDisparity, int startRow, int stopRow);
+
+    void createPointMapNEON(const unsigned short* dispMap, int width,
+        int rowStride, const ProjectionCache& projection, unsigned short minDisparity,
+        unsigned short maxDisparity, int startRow, int stopRow);
+
+    void createZMapGeneric(const unsigned short* dispMap, int width,
         int rowStride, const float* q, unsigned short minDisparity, int subpixelFactor,
-        unsigned short maxDisparity);
+        unsigned short maxDisparity, bool clampToMinDisparity, ZMapFormat format,
+        float invalidValue, unsigned char* dst, int dstRowStride, float* zRow,
+        int startRow, int stopRow);
+
+    void buildDepthLut(const float* q, int subpixelFactor, unsigned short minDisparity,
+        unsigned short maxDisparity, bool clampToMinDisparity, ZMapFormat format,
+        float invalidValue);
+
+    static unsigned short depthToMillimeters(float depth, float invalidValue);
+
+    template <typename T>
+    static void lookupDepthRow(const unsigned short* dispRow, int width,
+        unsigned short maxDisparity, const T* lut, T* dst);
 };
 
 /******************** Stubs for all public members ********************/
@@ -105,11 +381,118 @@ float* Reconstruct3D::createPointMap(const ImageSet& imageSet, unsigned short mi
     return pimpl->createPointMap(imageSet, minDisparity, maxDisparity);
 }
 
+unsigned char* Reconstruct3D::createPointMap(const ImageSet& imageSet, PointMapLayout layout,
+        unsigned short minDisparity, unsigned short maxDisparity) {
+    return pimpl->createPointMap(imageSet, layout, minDisparity, maxDisparity);
+}
+
+void Reconstruct3D::createPointMap(const ImageSet& imageSet, PointMapLayout layout,
+        unsigned short minDisparity, unsigned short maxDisparity,
+        unsigned char* dst, int dstRowStride) {
+    pimpl->createPointMap(imageSet, layout, minDisparity, maxDisparity, dst, dstRowStride);
+}
+
+int Reconstruct3D::getBytesPerPoint(PointMapLayout layout) {
+    switch(layout) {
+        case LAYOUT_XYZW_FLOAT: return 4*sizeof(float);
+        case LAYOUT_XYZ_FLOAT: return 3*sizeof(float);
+        case LAYOUT_PLANAR_FLOAT: return 3*sizeof(float);
+        case LAYOUT_XYZ_HALF_FLOAT: return 3*sizeof(unsigned short);
+        case LAYOUT_XYZ_INT16_MM: return 3*sizeof(short);
+        default: throw std::runtime_error("Invalid point map layout!");
+    }
+}
+
 float* Reconstruct3D::createZMap(const ImageSet& imageSet, unsigned short minDisparity,
     unsigned short maxDisparity) {
     return pimpl->createZMap(imageSet, minDisparity, maxDisparity);
 }
 
+void Reconstruct3D::createZMap(const ImageSet& imageSet, unsigned short minDisparity,
+        unsigned short maxDisparity, float* dst, int dstRowStride) {
+    pimpl->createZMap(imageSet, minDisparity, maxDisparity, dst, dstRowStride);
+}
+
+unsigned char* Reconstruct3D::createZMap(const ImageSet& imageSet, ZMapFormat format,
+        float invalidValue, unsigned short minDisparity, unsigned short maxDisparity) {
+    return pimpl->createZMap(imageSet, format, invalidValue, minDisparity, maxDisparity);
+}
+
+void Reconstruct3D::createZMap(const ImageSet& imageSet, ZMapFormat format, float invalidValue,
+        unsigned short minDisparity, unsigned short maxDisparity, unsigned char* dst,
+        int dstRowStride) {
+    pimpl->createZMap(imageSet, format, invalidValue, minDisparity, maxDisparity, false,
+        dst, dstRowStride);
+}
+
+int Reconstruct3D::getBytesPerPixel(ZMapFormat format) {
+    switch(format) {
+        case ZMAP_FLOAT: return sizeof(float);
+        case ZMAP_UINT16_MM: return sizeof(unsigned short);
+        case ZMAP_HALF_FLOAT: return sizeof(unsigned short);
+        default: throw std::runtime_error("Invalid depth map format!");
+    }
+}
+
+float* Reconstruct3D::createCompactPointCloud(const ImageSet& imageSet, int& numPoints,
+        unsigned short minDisparity, unsigned short maxDisparity, float maxZ,
+        const int** pixelIndices) {
+    return pimpl->createCompactPointCloud(imageSet, numPoints, minDisparity, maxDisparity,
+        maxZ, pixelIndices);
+}
+
+float* Reconstruct3D::createVoxelGridCloud(const ImageSet& imageSet, float leafSize,
+        int& numPoints, const unsigned char** colors, ColorSource colSource,
+        const float* boundingBox, unsigned short minDisparity, unsigned short maxDisparity) {
+    return pimpl->createVoxelGridCloud(imageSet, leafSize, numPoints, colors, colSource,
+        boundingBox, minDisparity, maxDisparity);
+}
+
+float* Reconstruct3D::createNormalMap(const ImageSet& imageSet, unsigned short minDisparity,
+        unsigned short maxDisparity, float discontinuityThreshold) {
+    return pimpl->createNormalMap(imageSet, minDisparity, maxDisparity, discontinuityThreshold);
+}
+
+float* Reconstruct3D::createHeightMap(const ImageSet& imageSet, float cellSize,
+        const float* extent, int& columns, int& rows, HeightMapMode mode,
+        const unsigned int** pointCounts, unsigned short minDisparity, unsigned short maxDisparity) {
+    return pimpl->createHeightMap(imageSet, cellSize, extent, columns, rows, mode,
+        pointCounts, minDisparity, maxDisparity);
+}
+
+float* Reconstruct3D::createMesh(const ImageSet& imageSet, int& numVertices,
+        const int** triangles, int& numTriangles, const unsigned char** colors,
+        ColorSource colSource, int decimation, float discontinuityThreshold,
+        unsigned short minDisparity, unsigned short maxDisparity) {
+    return pimpl->createMesh(imageSet, numVertices, triangles, numTriangles, colors,
+        colSource, decimation, discontinuityThreshold, minDisparity, maxDisparity);
+}
+
+void Reconstruct3D::setCalibration(const float* q, int width, int height, int subpixelFactor) {
+    pimpl->setCalibration(q, width, height, subpixelFactor);
+}
+
+void Reconstruct3D::setCalibration(const ImageSet& imageSet) {
+    pimpl->setCalibration(imageSet.getQMatrix(), imageSet.getWidth(), imageSet.getHeight(),
+        imageSet.getSubpixelFactor());
+}
+
+void Reconstruct3D::createInterleavedCloud(const ImageSet& imageSet, unsigned short minDisparity,
+        unsigned short maxDisparity, unsigned char* dst, int pointSize, PointChannel channel,
+        int channelOffset, ColorSource colSource) {
+    pimpl->createInterleavedCloud(imageSet, minDisparity, maxDisparity, dst, pointSize,
+        channel, channelOffset, colSource);
+}
+
+void Reconstruct3D::createDoubleCloud(const ImageSet& imageSet, unsigned short minDisparity,
+        unsigned short maxDisparity, double* points, double* colors, ColorSource colSource) {
+    pimpl->createDoubleCloud(imageSet, minDisparity, maxDisparity, points, colors, colSource);
+}
+
+void Reconstruct3D::createRgbImage(const ImageSet& imageSet, ColorSource colSource, unsigned char* dst) {
+    pimpl->createRgbImage(imageSet, colSource, dst);
+}
+
 void Reconstruct3D::projectSinglePoint(int imageX, int imageY, unsigned short disparity,
         const float* q, float& pointX, float& pointY, float& pointZ, int subpixelFactor) {
     pimpl->projectSinglePoint(imageX, imageY, disparity, q, pointX, pointY, pointZ,
@@ -129,164 +512,2288 @@ void Reconstruct3D::writePlyFile(const char* file, const ImageSet& imageSet,
     pimpl->writePlyFile(file, imageSet, maxZ, binary, colSource, maxDisparity);
 }
 
+void Reconstruct3D::writePcdFile(const char* file, const ImageSet& imageSet,
+        double maxZ, bool binary, ColorSource colSource, unsigned short maxDisparity) {
+    pimpl->writePointCloudFile(file, PointCloudWriter::FILE_PCD, imageSet, maxZ, binary,
+        colSource, maxDisparity);
+}
+
+void Reconstruct3D::writeXyzFile(const char* file, const ImageSet& imageSet,
+        double maxZ, bool binary, unsigned short maxDisparity) {
+    pimpl->writePointCloudFile(file, PointCloudWriter::FILE_XYZ, imageSet, maxZ, binary,
+        COLOR_NONE, maxDisparity);
+}
+
+void Reconstruct3D::writeMeshPlyFile(const char* file, const ImageSet& imageSet,
+        bool binary, ColorSource colSource, int decimation, float discontinuityThreshold,
+        unsigned short maxDisparity) {
+    pimpl->writeMeshPlyFile(file, imageSet, binary, colSource, decimation,
+        discontinuityThreshold, maxDisparity);
+}
+
+void Reconstruct3D::setNumThreads(int numThreads, int firstCpu) {
+    pimpl->setNumThreads(numThreads, firstCpu);
+}
+
+void Reconstruct3D::setTransformation(const float* transformation) {
+    pimpl->setTransformation(transformation);
+}
+
+void Reconstruct3D::setCropBox(const float* boundingBox, const float* boxTransformation) {
+    pimpl->setCropBox(boundingBox, boxTransformation);
+}
+
+int Reconstruct3D::getNumThreads() const {
+    return pimpl->getNumThreads();
+}
+
 /******************** Implementation in pimpl class *******************/
 
-Reconstruct3D::Pimpl::Pimpl() {
+Reconstruct3D::Pimpl::Pimpl(): hasTransformation(false), hasCropBox(false),
+        pointCloudWriter(threadPool), rowBufferStride(0), rowBuffersPerBand(0) {
+}
+
+void Reconstruct3D::Pimpl::setNumThreads(int numThreads, int firstCpu) {
+    threadPool.setNumThreads(numThreads, firstCpu);
+}
+
+int Reconstruct3D::Pimpl::getNumThreads() const {
+    return threadPool.getNumThreads();
+}
+
+void Reconstruct3D::Pimpl::checkAffineMatrix(const float* matrix) {
+    if(matrix[12] != 0 || matrix[13] != 0 || matrix[14] != 0 || matrix[15] != 1) {
+        throw std::runtime_error("Transformation must be an affine 4x4 matrix!");
+    }
+}
+
+void Reconstruct3D::Pimpl::setTransformation(const float* transformation) {
+    if(transformation == nullptr) {
+        hasTransformation = false;
+        return;
+    }
+
+    checkAffineMatrix(transformation);
+    memcpy(this->transformation, transformation, sizeof(this->transformation));
+    hasTransformation = true;
+}
+
+void Reconstruct3D::Pimpl::setCropBox(const float* boundingBox, const float* boxTransformation) {
+    if(boundingBox == nullptr) {
+        hasCropBox = false;
+        return;
+    }
+
+    static const float identity[12] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0};
+    if(boxTransformation != nullptr) {
+        checkAffineMatrix(boxTransformation);
+        memcpy(cropBox.matrix, boxTransformation, sizeof(cropBox.matrix));
+    } else {
+        memcpy(cropBox.matrix, identity, sizeof(cropBox.matrix));
+    }
+    for(int i = 0; i < 3; i++) {
+        cropBox.minCorner[i] = boundingBox[i];
+        cropBox.maxCorner[i] = boundingBox[i + 3];
+    }
+    hasCropBox = true;
+}
+
+const float* Reconstruct3D::Pimpl::getProjectionMatrix(const float* q, float* combined) const {
+    if(!hasTransformation) {
+        return q;
+    }
+
+    // Fold the transformation into the disparity-to-depth mapping
+    for(int row = 0; row < 4; row++) {
+        for(int col = 0; col < 4; col++) {
+            double sum = 0;
+            for(int i = 0; i < 4; i++) {
+                sum += double(transformation[4*row + i]) * q[4*i + col];
+            }
+            combined[4*row + col] = static_cast<float>(sum);
+        }
+    }
+    return combined;
+}
+
+const Reconstruct3D::Pimpl::ProjectionCache& Reconstruct3D::Pimpl::getProjectionCache(
+        ProjectionCache& cache, const float* q, int width, int height, int subpixelFactor) {
+    if(cache.valid && cache.width == width && cache.height == height
+            && cache.subpixelFactor == subpixelFactor && memcmp(cache.q, q, sizeof(cache.q)) == 0) {
+        return cache;
+    }
+
+    memcpy(cache.q, q, sizeof(cache.q));
+    cache.width = width;
+    cache.height = height;
+    cache.subpixelFactor = subpixelFactor;
+
+    // Pad the planes to a multiple of 8 floats for keeping each plane aligned
+    cache.planeStride = (width + 7) & ~7;
+    cache.columnPlanes.resize(4*cache.planeStride);
+    cache.columnVectors.resize(4*size_t(width));
+    for(int x = 0; x < width; x++) {
+        float xf = static_cast<float>(x);
+        for(int i = 0; i < 4; i++) {
+            cache.columnPlanes[i*cache.planeStride + x] = q[4*i]*xf;
+            cache.columnVectors[4*x + i] = q[4*i]*xf;
+        }
+    }
+
+    cache.rowVectors.resize(4*size_t(height));
+    for(int y = 0; y < height; y++) {
+        float yf = static_cast<float>(y);
+        for(int i = 0; i < 4; i++) {
+            cache.rowVectors[4*y + i] = q[4*i + 1]*yf + q[4*i + 3];
+        }
+    }
+
+    cache.valid = true;
+    return cache;
+}
+
+void Reconstruct3D::Pimpl::setCalibration(const float* q, int width, int height, int subpixelFactor) {
+    if(width <= 0 || height <= 0 || subpixelFactor <= 0) {
+        throw std::runtime_error("Invalid calibration parameters!");
+    }
+
+    float combinedQ[16];
+    getProjectionCache(projectionCache, getProjectionMatrix(q, combinedQ), width, height, subpixelFactor);
+    getProjectionCache(cameraProjectionCache, q, width, height, subpixelFactor);
+}
+
+float* Reconstruct3D::Pimpl::createPointMap(const unsigned short* dispMap, int width,
+        int height, int rowStride, const float* q, unsigned short minDisparity,
+        int subpixelFactor, unsigned short maxDisparity, const ThreadPool::BandFunction* bandFinished) {
+
+    // Allocate the buffer
+    if(pointMap.size() < static_cast<unsigned int>(4*width*height)) {
+        pointMap.resize(4*width*height);
+    }
+
+    float combinedQ[16];
+    q = getProjectionMatrix(q, combinedQ);
+    const ProjectionCache& projection = getProjectionCache(projectionCache, q, width,
+        height, subpixelFactor);
+
+    if(hasCropBox) {
+        // Cropping is only implemented by the generic row kernel
+        unsigned char* dst = reinterpret_cast<unsigned char*>(&pointMap[0]);
+        allocateRowBuffers(width, 3);
+        threadPool.parallelFor(height, [&](int band, int startRow, int stopRow) {
+            createPointMapRows(dispMap, width, rowStride, projection, minDisparity,
+                maxDisparity, LAYOUT_XYZW_FLOAT, dst, 16*width, 0, band,
+                startRow, stopRow);
+            if(bandFinished != nullptr) {
+                (*bandFinished)(band, startRow, stopRow);
+            }
+        });
+        return &pointMap[0];
+    }
+
+    // +inf mapping of invalid points only works for fallback implementation
+    // in case of angled cameras.
+    bool angledCameraFallback = (q[15] != 0.0 && minDisparity == 0);
+    (void)angledCameraFallback; // Suppresses unused variable warning
+
+    // Select the implementation for processing one band of rows
+    void (Reconstruct3D::Pimpl::*bandFunc)(const unsigned short*, int, int, const ProjectionCache&,
+        unsigned short, unsigned short, int, int);
+
+#   ifdef __AVX2__
+        if(!angledCameraFallback && maxDisparity <= 0x1000 && width % 16 == 0 && (uintptr_t)dispMap % 32 == 0) {
+            bandFunc = &Reconstruct3D::Pimpl::createPointMapAVX2;
+        } else
+#   endif
+#   ifdef __SSE2__
+        if(!angledCameraFallback && maxDisparity <= 0x1000 && width % 8 == 0 && (uintptr_t)dispMap % 16 == 0) {
+            bandFunc = &Reconstruct3D::Pimpl::createPointMapSSE2;
+        } else
+#   endif
+#   ifdef __aarch64__
+        if(!angledCameraFallback && maxDisparity <= 0x1000 && width % 8 == 0) {
+            bandFunc = &Reconstruct3D::Pimpl::createPointMapNEON;
+        } else
+#   endif
+        {
+            bandFunc = &Reconstruct3D::Pimpl::createPointMapFallback;
+        }
+
+    threadPool.parallelFor(height, [&](int band, int startRow, int stopRow) {
+        (this->*bandFunc)(dispMap, width, rowStride, projection, minDisparity,
+            maxDisparity, startRow, stopRow);
+        if(bandFinished != nullptr) {
+            (*bandFinished)(band, startRow, stopRow);
+        }
+    });
+
+    return &pointMap[0];
+}
+
+void Reconstruct3D::Pimpl::checkDisparityMap(const ImageSet& imageSet) {
+    if(!imageSet.hasImageType(ImageSet::IMAGE_DISPARITY)) {
+        throw std::runtime_error("ImageSet does not contain a disparity map!");
+    }
+
+    if(imageSet.getPixelFormat(ImageSet::IMAGE_DISPARITY) != ImageSet::FORMAT_12_BIT_MONO) {
+        throw std::runtime_error("Disparity map must have 12-bit pixel format!");
+    }
+}
+
+float* Reconstruct3D::Pimpl::createPointMap(const ImageSet& imageSet, unsigned short minDisparity, unsigned short maxDisparity,
+        const ThreadPool::BandFunction* bandFinished) {
+    checkDisparityMap(imageSet);
+
+    return createPointMap(reinterpret_cast<unsigned short*>(imageSet.getPixelData(ImageSet::IMAGE_DISPARITY)), imageSet.getWidth(),
+        imageSet.getHeight(), imageSet.getRowStride(ImageSet::IMAGE_DISPARITY), imageSet.getQMatrix(), minDisparity,
+        imageSet.getSubpixelFactor(), maxDisparity, bandFinished);
+}
+
+void Reconstruct3D::Pimpl::createPointMapFallback(const unsigned short* dispMap, int width,
+        int rowStride, const ProjectionCache& projection, unsigned short minDisparity,
+        unsigned short maxDisparity, int startRow, int stopRow) {
+    const float* q = projection.q;
+    int subpixelFactor = projection.subpixelFactor;
+    // Code without SSE or AVX optimization
+    float* outputPtr = &pointMap[4*width*startRow];
+    int stride = rowStride / 2;
+
+    double dInvalid;
+    if(minDisparity == 0) {
+        // Manually force invalid points to +inf, so that this works even
+        // for for angled cameras
+        dInvalid = std::numeric_limits<double>::infinity();
+    } else {
+        // Set invalid disparity to minimum disparity
+        dInvalid = double(minDisparity) / double(subpixelFactor);
+    }
+
+    for(int y = startRow; y < stopRow; y++) {
+        double qx = q[1]*y + q[3];
+        double qy = q[5]*y + q[7];
+        double qz = q[9]*y + q[11];
+        double qw = q[13]*y + q[15];
+
+        const unsigned short* dispRow = &dispMap[y*stride];
+        for(int x = 0; x < width; x++) {
+            unsigned short intDisp = std::max(minDisparity, dispRow[x]);
+            double d;
+
+            if(intDisp >= maxDisparity) {
+                d = dInvalid;
+            } else {
+                d = double(intDisp) / double(subpixelFactor);
+            }
+
+            double w = qw + q[14]*d;
+
+            *outputPtr = static_cast<float>((qx + q[2]*d)/w); // x
+            outputPtr++;
+
+            *outputPtr = static_cast<float>((qy + q[6]*d)/w); // y
+            outputPtr++;
+
+            *outputPtr = static_cast<float>((qz + q[10]*d)/w); // z
+            outputPtr+=2; // Consider padding
+
+            qx += q[0];
+            qy += q[4];
+            qz += q[8];
+            qw += q[12];
+        }
+    }
+}
+
+float* Reconstruct3D::Pimpl::createZMap(const ImageSet& imageSet, unsigned short minDisparity,
+        unsigned short maxDisparity) {
+    // Allocate the buffer
+    if(pointMap.size() < static_cast<unsigned int>(imageSet.getWidth()*imageSet.getHeight())) {
+        pointMap.resize(imageSet.getWidth()*imageSet.getHeight());
+    }
+
+    createZMap(imageSet, minDisparity, maxDisparity, &pointMap[0], 0);
+    return &pointMap[0];
+}
+
+void Reconstruct3D::Pimpl::createZMap(const ImageSet& imageSet, unsigned short minDisparity,
+        unsigned short maxDisparity, float* dst, int dstRowStride) {
+    // Invalid disparities are set to the minimum disparity, or to NaN if it is 0,
+    // as it has always been the case for this method
+    createZMap(imageSet, ZMAP_FLOAT, std::numeric_limits<float>::quiet_NaN(), minDisparity,
+        maxDisparity, true, reinterpret_cast<unsigned char*>(dst), dstRowStride);
+}
+
+unsigned char* Reconstruct3D::Pimpl::createZMap(const ImageSet& imageSet, ZMapFormat format,
+        float invalidValue, unsigned short minDisparity, unsigned short maxDisparity) {
+    // Allocate the buffer
+    size_t numBytes = size_t(imageSet.getWidth())*imageSet.getHeight()*Reconstruct3D::getBytesPerPixel(format);
+    size_t numFloats = (numBytes + sizeof(float) - 1) / sizeof(float);
+    if(pointMap.size() < numFloats) {
+        pointMap.resize(numFloats);
+    }
+
+    unsigned char* dst = reinterpret_cast<unsigned char*>(&pointMap[0]);
+    createZMap(imageSet, format, invalidValue, minDisparity, maxDisparity, false, dst, 0);
+    return dst;
+}
+
+void Reconstruct3D::Pimpl::createZMap(const ImageSet& imageSet, ZMapFormat format,
+        float invalidValue, unsigned short minDisparity, unsigned short maxDisparity,
+        bool clampToMinDisparity, unsigned char* dst, int dstRowStride) {
+    checkDisparityMap(imageSet);
+
+    int width = imageSet.getWidth();
+    int minRowStride = width * Reconstruct3D::getBytesPerPixel(format);
+    if(dstRowStride == 0) {
+        dstRowStride = minRowStride;
+    } else if(dstRowStride < minRowStride) {
+        throw std::runtime_error("Destination row stride is too small!");
+    }
+
+    int rowStride = imageSet.getRowStride(ImageSet::IMAGE_DISPARITY);
+    const unsigned short* dispMap = reinterpret_cast<const unsigned short*>(imageSet.getPixelData(ImageSet::IMAGE_DISPARITY));
+    int subpixelFactor = imageSet.getSubpixelFactor();
+    const float* q = imageSet.getQMatrix();
+
+    if(q[8] != 0 || q[9] != 0 || q[12] != 0 || q[13] != 0) {
+        // The depth also depends on the image position
+        allocateRowBuffers(width, 1);
+        threadPool.parallelFor(imageSet.getHeight(), [&](int band, int startRow, int stopRow) {
+            createZMapGeneric(dispMap, width, rowStride, q, minDisparity, subpixelFactor,
+                maxDisparity, clampToMinDisparity, format, invalidValue, dst, dstRowStride,
+                getRowBuffer(band, 0), startRow, stopRow);
+        });
+        return;
+    }
+
+    // The depth only depends on the disparity and can be looked up
+    buildDepthLut(q, subpixelFactor, minDisparity, maxDisparity, clampToMinDisparity,
+        format, invalidValue);
+
+    threadPool.parallelFor(imageSet.getHeight(), [&](int, int startRow, int stopRow) {
+        for(int y = startRow; y < stopRow; y++) {
+            const unsigned short* dispRow = reinterpret_cast<const unsigned short*>(
+                &reinterpret_cast<const unsigned char*>(dispMap)[y*rowStride]);
+            unsigned char* dstRow = &dst[size_t(y)*dstRowStride];
+            if(format == ZMAP_FLOAT) {
+                lookupDepthRow(dispRow, width, maxDisparity, &depthLut[0], reinterpret_cast<float*>(dstRow));
+            } else {
+                lookupDepthRow(dispRow, width, maxDisparity, &depthLut16[0], reinterpret_cast<unsigned short*>(dstRow));
+            }
+        }
+    });
+}
+
+void Reconstruct3D::Pimpl::buildDepthLut(const float* q, int subpixelFactor,
+        unsigned short minDisparity, unsigned short maxDisparity, bool clampToMinDisparity,
+        ZMapFormat format, float invalidValue) {
+    // One entry per disparity below the maximum, plus one entry for all invalid
+    // disparities and one entry of padding for 32-bit gathers
+    int numEntries = int(maxDisparity) + 2;
+    if(format == ZMAP_FLOAT) {
+        depthLut.resize(numEntries);
+    } else {
+        depthLut16.resize(numEntries);
+    }
+
+    double invalidDepth;
+    if(clampToMinDisparity && minDisparity > 0) {
+        invalidDepth = (q[11] + q[10]*minDisparity/double(subpixelFactor))
+            / (q[15] + q[14]*minDisparity/double(subpixelFactor));
+    } else {
+        invalidDepth = std::numeric_limits<double>::quiet_NaN();
+    }
+
+    for(int i = 0; i < numEntries; i++) {
+        bool valid;
+        double depth;
+        if(i >= minDisparity && i < maxDisparity) {
+            double d = double(i) / double(subpixelFactor);
+            depth = (q[11] + q[10]*d) / (q[15] + q[14]*d);
+            valid = true;
+        } else {
+            depth = invalidDepth;
+            valid = !std::isnan(invalidDepth);
+        }
+
+        switch(format) {
+            case ZMAP_FLOAT:
+                depthLut[i] = valid ? static_cast<float>(depth) : invalidValue;
+                break;
+            case ZMAP_UINT16_MM:
+                depthLut16[i] = depthToMillimeters(valid ? static_cast<float>(depth)
+                    : std::numeric_limits<float>::quiet_NaN(), invalidValue);
+                break;
+            case ZMAP_HALF_FLOAT:
+                depthLut16[i] = floatToHalf(valid ? static_cast<float>(depth) : invalidValue);
+                break;
+            default:
+                throw std::runtime_error("Invalid depth map format!");
+        }
+    }
+}
+
+unsigned short Reconstruct3D::Pimpl::depthToMillimeters(float depth, float invalidValue) {
+    float mm = depth * 1000.0f;
+    if(!(mm >= 0 && mm <= 65535.0f)) {
+        // Invalid or out of range
+        if(!(invalidValue >= 0)) {
+            return 0;
+        }
+        mm = std::min(invalidValue, 65535.0f);
+    }
+    return static_cast<unsigned short>(mm + 0.5f);
+}
+
+template <typename T>
+void Reconstruct3D::Pimpl::lookupDepthRow(const unsigned short* dispRow, int width,
+        unsigned short maxDisparity, const T* lut, T* dst) {
+    int x = 0;
+#ifdef __AVX2__
+    const __m128i maxDispVector = _mm_set1_epi16(static_cast<short>(maxDisparity));
+    for(; x + 8 <= width; x += 8) {
+        __m128i disparities = _mm_min_epu16(_mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(&dispRow[x])), maxDispVector);
+        __m256i indices = _mm256_cvtepu16_epi32(disparities);
+
+        if(sizeof(T) == sizeof(float)) {
+            __m256 depth = _mm256_i32gather_ps(reinterpret_cast<const float*>(lut), indices, 4);
+            _mm256_storeu_ps(reinterpret_cast<float*>(&dst[x]), depth);
+        } else {
+            // Gather 32 bits per entry and keep the lower 16 bits
+            __m256i depth = _mm256_i32gather_epi32(reinterpret_cast<const int*>(lut), indices, 2);
+            depth = _mm256_and_si256(depth, _mm256_set1_epi32(0xFFFF));
+            depth = _mm256_permute4x64_epi64(_mm256_packus_epi32(depth, depth), 0xD8);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&dst[x]), _mm256_castsi256_si128(depth));
+        }
+    }
+#endif
+
+    for(; x < width; x++) {
+        dst[x] = lut[std::min(dispRow[x], maxDisparity)];
+    }
+}
+
+void Reconstruct3D::Pimpl::createZMapGeneric(const unsigned short* dispMap, int width,
+        int rowStride, const float* q, unsigned short minDisparity,
+        int subpixelFactor, unsigned short maxDisparity, bool clampToMinDisparity,
+        ZMapFormat format, float invalidValue, unsigned char* dst, int dstRowStride,
+        float* zRow, int startRow, int stopRow) {
+    int stride = rowStride / 2;
+    bool clamp = clampToMinDisparity && minDisparity > 0;
+    double dMin = double(minDisparity) / double(subpixelFactor);
+    float invalidDepth = format == ZMAP_UINT16_MM ? std::numeric_limits<float>::quiet_NaN() : invalidValue;
+
+    for(int y = startRow; y < stopRow; y++) {
+        double qz = q[9]*y + q[11];
+        double qw = q[13]*y + q[15];
+
+        const unsigned short* dispRow = &dispMap[y*stride];
+        for(int x = 0; x < width; x++) {
+            double d;
+            if(dispRow[x] >= minDisparity && dispRow[x] < maxDisparity) {
+                d = double(dispRow[x]) / double(subpixelFactor);
+            } else if(clamp) {
+                d = dMin;
+            } else {
+                zRow[x] = invalidDepth;
+                qz += q[8];
+                qw += q[12];
+                continue;
+            }
+
+            zRow[x] = static_cast<float>((qz + q[10]*d)/(qw + q[14]*d));
+            qz += q[8];
+            qw += q[12];
+        }
+
+        unsigned char* dstRow = &dst[size_t(y)*dstRowStride];
+        switch(format) {
+            case ZMAP_FLOAT:
+                memcpy(dstRow, zRow, width*sizeof(float));
+                break;
+            case ZMAP_UINT16_MM:
+                for(int x = 0; x < width; x++) {
+                    reinterpret_cast<unsigned short*>(dstRow)[x] = depthToMillimeters(zRow[x], invalidValue);
+                }
+                break;
+            case ZMAP_HALF_FLOAT:
+                for(int x = 0; x < width; x++) {
+                    reinterpret_cast<unsigned short*>(dstRow)[x] = floatToHalf(zRow[x]);
+                }
+                break;
+            default:
+                throw std::runtime_error("Invalid depth map format!");
+        }
+    }
+}
+
+unsigned char* Reconstruct3D::Pimpl::createPointMap(const ImageSet& imageSet, PointMapLayout layout,
+        unsigned short minDisparity, unsigned short maxDisparity) {
+    if(layout == LAYOUT_XYZW_FLOAT) {
+        return reinterpret_cast<unsigned char*>(createPointMap(imageSet, minDisparity, maxDisparity));
+    }
+
+    checkDisparityMap(imageSet);
+
+    // Allocate the buffer
+    size_t numBytes = size_t(imageSet.getWidth())*imageSet.getHeight()*Reconstruct3D::getBytesPerPoint(layout);
+    size_t numFloats = (numBytes + sizeof(float) - 1) / sizeof(float);
+    if(pointMap.size() < numFloats) {
+        pointMap.resize(numFloats);
+    }
+
+    unsigned char* dst = reinterpret_cast<unsigned char*>(&pointMap[0]);
+    createPointMap(imageSet, layout, minDisparity, maxDisparity, dst, 0);
+    return dst;
+}
+
+void Reconstruct3D::Pimpl::createPointMap(const ImageSet& imageSet, PointMapLayout layout,
+        unsigned short minDisparity, unsigned short maxDisparity,
+        unsigned char* dst, int dstRowStride) {
+    checkDisparityMap(imageSet);
+
+    int width = imageSet.getWidth();
+    int height = imageSet.getHeight();
+    int minRowStride = width * (layout == LAYOUT_PLANAR_FLOAT ? static_cast<int>(sizeof(float))
+        : Reconstruct3D::getBytesPerPoint(layout));
+
+    if(dstRowStride == 0) {
+        dstRowStride = minRowStride;
+    } else if(dstRowStride < minRowStride) {
+        throw std::runtime_error("Destination row stride is too small!");
+    }
+    int dstPlaneStride = layout == LAYOUT_PLANAR_FLOAT ? height * dstRowStride : 0;
+
+    int rowStride = imageSet.getRowStride(ImageSet::IMAGE_DISPARITY);
+    const unsigned short* dispMap = reinterpret_cast<const unsigned short*>(imageSet.getPixelData(ImageSet::IMAGE_DISPARITY));
+    int subpixelFactor = imageSet.getSubpixelFactor();
+    float combinedQ[16];
+    const float* q = getProjectionMatrix(imageSet.getQMatrix(), combinedQ);
+    const ProjectionCache& projection = getProjectionCache(projectionCache, q, width,
+        imageSet.getHeight(), subpixelFactor);
+
+    allocateRowBuffers(width, 3);
+    threadPool.parallelFor(height, [&](int band, int startRow, int stopRow) {
+        createPointMapRows(dispMap, width, rowStride, projection, minDisparity,
+            maxDisparity, layout, dst, dstRowStride, dstPlaneStride, band, startRow, stopRow);
+    });
+}
+
+void Reconstruct3D::Pimpl::allocateRowBuffers(int width, int buffersPerBand) {
+    // Pad rows to a multiple of 8 floats for keeping each row aligned
+    rowBufferStride = (width + 7) & ~7;
+    rowBuffersPerBand = buffersPerBand;
+
+    size_t size = size_t(threadPool.getNumThreads()) * buffersPerBand * rowBufferStride;
+    if(rowBuffers.size() < size) {
+        rowBuffers.resize(size);
+    }
+}
+
+void Reconstruct3D::Pimpl::createPointMapRows(const unsigned short* dispMap, int width,
+        int rowStride, const ProjectionCache& projection, unsigned short minDisparity,
+        unsigned short maxDisparity, PointMapLayout layout, unsigned char* dst,
+        int dstRowStride, int dstPlaneStride, int band, int startRow, int stopRow) {
+    for(int y = startRow; y < stopRow; y++) {
+        const unsigned short* dispRow = reinterpret_cast<const unsigned short*>(
+            &reinterpret_cast<const unsigned char*>(dispMap)[y*rowStride]);
+        unsigned char* dstRow = &dst[size_t(y)*dstRowStride];
+
+        if(layout == LAYOUT_PLANAR_FLOAT) {
+            // Coordinates can be written to the output planes directly
+            evaluateRow(dispRow, width, y, projection, minDisparity, maxDisparity,
+                reinterpret_cast<float*>(dstRow),
+                reinterpret_cast<float*>(dstRow + dstPlaneStride),
+                reinterpret_cast<float*>(dstRow + 2*size_t(dstPlaneStride)), getCropBox());
+            continue;
+        }
+
+        float* xRow = getRowBuffer(band, 0);
+        float* yRow = getRowBuffer(band, 1);
+        float* zRow = getRowBuffer(band, 2);
+        evaluateRow(dispRow, width, y, projection, minDisparity, maxDisparity,
+            xRow, yRow, zRow, getCropBox());
+
+        switch(layout) {
+            case LAYOUT_XYZW_FLOAT:
+                storeRowXYZW(xRow, yRow, zRow, width, reinterpret_cast<float*>(dstRow));
+                break;
+            case LAYOUT_XYZ_FLOAT:
+                storeRowXYZ(xRow, yRow, zRow, width, reinterpret_cast<float*>(dstRow));
+                break;
+            case LAYOUT_XYZ_HALF_FLOAT:
+                storeRowHalfFloat(xRow, yRow, zRow, width, reinterpret_cast<unsigned short*>(dstRow));
+                break;
+            case LAYOUT_XYZ_INT16_MM:
+                storeRowInt16(xRow, yRow, zRow, width, reinterpret_cast<short*>(dstRow));
+                break;
+            default:
+                throw std::runtime_error("Invalid point map layout!");
+        }
+    }
+}
+
+#if defined(__SSE2__) || defined(__AVX2__)
+// Returns a mask of the points that are located within the crop box
+static inline __m128 isInsideCropBox(const __m128* crop, __m128 px, __m128 py, __m128 pz) {
+    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for(int i = 0; i < 3; i++) {
+        __m128 b = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(crop[4*i], px),
+            _mm_mul_ps(crop[4*i + 1], py)), _mm_mul_ps(crop[4*i + 2], pz)), crop[4*i + 3]);
+        inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmpge_ps(b, crop[12 + i]), _mm_cmple_ps(b, crop[15 + i])));
+    }
+    return inside;
+}
+#endif
+
+void Reconstruct3D::Pimpl::evaluateRow(const unsigned short* dispRow, int width, int y,
+        const ProjectionCache& projection, unsigned short minDisparity, unsigned short maxDisparity,
+        float* xRow, float* yRow, float* zRow, const CropBox* crop) {
+    // Terms of the matrix product that are constant for the entire row
+    // or column are taken from the cache
+    const float* q = projection.q;
+    const float rowX = projection.rowVectors[4*y];
+    const float rowY = projection.rowVectors[4*y + 1];
+    const float rowZ = projection.rowVectors[4*y + 2];
+    const float rowW = projection.rowVectors[4*y + 3];
+    const float* colX = projection.getColumnPlane(0);
+    const float* colY = projection.getColumnPlane(1);
+    const float* colZ = projection.getColumnPlane(2);
+    const float* colW = projection.getColumnPlane(3);
+    const float scale = 1.0f / float(projection.subpixelFactor);
+    const float inf = std::numeric_limits<float>::infinity();
+
+    int x = 0;
+#if defined(__SSE2__) || defined(__AVX2__)
+    const __m128 q2 = _mm_set1_ps(q[2]), q6 = _mm_set1_ps(q[6]);
+    const __m128 q10 = _mm_set1_ps(q[10]), q14 = _mm_set1_ps(q[14]);
+    const __m128 rowXVector = _mm_set1_ps(rowX), rowYVector = _mm_set1_ps(rowY);
+    const __m128 rowZVector = _mm_set1_ps(rowZ), rowWVector = _mm_set1_ps(rowW);
+    const __m128 scaleVector = _mm_set1_ps(scale);
+    const __m128 oneVector = _mm_set1_ps(1.0f);
+    const __m128 infVector = _mm_set1_ps(inf);
+
+    // SSE2 only offers signed 16-bit comparisons
+    const __m128i signVector = _mm_set1_epi16(static_cast<short>(0x8000));
+    const __m128i maxDispVector = _mm_xor_si128(_mm_set1_epi16(static_cast<short>(maxDisparity)), signVector);
+    const __m128i minDispVector = _mm_set1_epi16(static_cast<short>(minDisparity));
+    const __m128i zeroVector = _mm_setzero_si128();
+
+    // Crop box transformation and extents
+    __m128 cropVectors[18];
+    if(crop != nullptr) {
+        for(int i = 0; i < 12; i++) {
+            cropVectors[i] = _mm_set1_ps(crop->matrix[i]);
+        }
+        for(int i = 0; i < 3; i++) {
+            cropVectors[12 + i] = _mm_set1_ps(crop->minCorner[i]);
+            cropVectors[15 + i] = _mm_set1_ps(crop->maxCorner[i]);
+        }
+    }
+
+    for(; x + 8 <= width; x += 8) {
+        __m128i disparities = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&dispRow[x]));
+
+        // Set invalid disparities to 0 and clamp to minimum disparity
+        __m128i validMask = _mm_cmplt_epi16(_mm_xor_si128(disparities, signVector), maxDispVector);
+        disparities = _mm_and_si128(validMask, disparities);
+        disparities = _mm_add_epi16(_mm_subs_epu16(disparities, minDispVector), minDispVector);
+        __m128i infMask16 = _mm_cmpeq_epi16(disparities, zeroVector);
+
+        for(int half = 0; half < 2; half++) {
+            __m128i disp32, infMask32;
+            if(half == 0) {
+                disp32 = _mm_unpacklo_epi16(disparities, zeroVector);
+                infMask32 = _mm_unpacklo_epi16(infMask16, infMask16);
+            } else {
+                disp32 = _mm_unpackhi_epi16(disparities, zeroVector);
+                infMask32 = _mm_unpackhi_epi16(infMask16, infMask16);
+            }
+            __m128 d = _mm_mul_ps(_mm_cvtepi32_ps(disp32), scaleVector);
+            __m128 infMask = _mm_castsi128_ps(infMask32);
+            int col = x + 4*half;
+
+            __m128 w = _mm_add_ps(_mm_add_ps(_mm_load_ps(&colW[col]), rowWVector), _mm_mul_ps(q14, d));
+            __m128 invW = _mm_div_ps(oneVector, w);
+
+            __m128 px = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_load_ps(&colX[col]), rowXVector), _mm_mul_ps(q2, d)), invW);
+            __m128 py = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_load_ps(&colY[col]), rowYVector), _mm_mul_ps(q6, d)), invW);
+            __m128 pz = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_load_ps(&colZ[col]), rowZVector), _mm_mul_ps(q10, d)), invW);
+
+            if(crop != nullptr) {
+                infMask = _mm_or_ps(infMask, _mm_xor_ps(isInsideCropBox(cropVectors, px, py, pz),
+                    _mm_castsi128_ps(_mm_set1_epi32(-1))));
+            }
+
+            // Points with a disparity of 0 or outside the crop box are at infinity
+            px = _mm_or_ps(_mm_andnot_ps(infMask, px), _mm_and_ps(infMask, infVector));
+            py = _mm_or_ps(_mm_andnot_ps(infMask, py), _mm_and_ps(infMask, infVector));
+            pz = _mm_or_ps(_mm_andnot_ps(infMask, pz), _mm_and_ps(infMask, infVector));
+
+            _mm_storeu_ps(&xRow[x + 4*half], px);
+            _mm_storeu_ps(&yRow[x + 4*half], py);
+            _mm_storeu_ps(&zRow[x + 4*half], pz);
+        }
+    }
+#endif
+
+    // Remaining pixels or code without SSE optimization
+    for(; x < width; x++) {
+        unsigned short intDisp = dispRow[x];
+        if(intDisp >= maxDisparity) {
+            intDisp = 0;
+        }
+        intDisp = std::max(minDisparity, intDisp);
+
+        if(intDisp == 0) {
+            xRow[x] = yRow[x] = zRow[x] = inf;
+            continue;
+        }
+
+        float d = intDisp * scale;
+        float invW = 1.0f / ((colW[x] + rowW) + q[14]*d);
+        xRow[x] = ((colX[x] + rowX) + q[2]*d) * invW;
+        yRow[x] = ((colY[x] + rowY) + q[6]*d) * invW;
+        zRow[x] = ((colZ[x] + rowZ) + q[10]*d) * invW;
+
+        if(crop != nullptr && !crop->contains(xRow[x], yRow[x], zRow[x])) {
+            xRow[x] = yRow[x] = zRow[x] = inf;
+        }
+    }
+}
+
+#if defined(__SSE2__) || defined(__AVX2__)
+// Interleaves the coordinates of four points to x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3
+static inline void interleaveXYZ(__m128 px, __m128 py, __m128 pz, __m128& v0, __m128& v1, __m128& v2) {
+    __m128 t0 = _mm_unpacklo_ps(px, py);
+    __m128 t1 = _mm_unpackhi_ps(px, py);
+    __m128 a = _mm_shuffle_ps(pz, px, _MM_SHUFFLE(1,1,0,0));
+    __m128 b = _mm_shuffle_ps(py, pz, _MM_SHUFFLE(1,1,1,1));
+    __m128 c = _mm_shuffle_ps(t1, pz, _MM_SHUFFLE(3,2,3,2));
+    v0 = _mm_shuffle_ps(t0, a, _MM_SHUFFLE(2,0,1,0));
+    v1 = _mm_shuffle_ps(b, t1, _MM_SHUFFLE(1,0,2,0));
+    v2 = _mm_shuffle_ps(c, c, _MM_SHUFFLE(3,1,0,2));
+}
+#endif
+
+void Reconstruct3D::Pimpl::storeRowXYZW(const float* xRow, const float* yRow, const float* zRow,
+        int width, float* dst) {
+    int x = 0;
+#if defined(__SSE2__) || defined(__AVX2__)
+    const __m128 oneVector = _mm_set1_ps(1.0f);
+    for(; x + 4 <= width; x += 4) {
+        __m128 px = _mm_loadu_ps(&xRow[x]);
+        __m128 py = _mm_loadu_ps(&yRow[x]);
+        __m128 pz = _mm_loadu_ps(&zRow[x]);
+        __m128 pw = oneVector;
+        _MM_TRANSPOSE4_PS(px, py, pz, pw);
+        _mm_storeu_ps(&dst[4*x], px);
+        _mm_storeu_ps(&dst[4*x + 4], py);
+        _mm_storeu_ps(&dst[4*x + 8], pz);
+        _mm_storeu_ps(&dst[4*x + 12], pw);
+    }
+#endif
+    for(; x < width; x++) {
+        dst[4*x] = xRow[x];
+        dst[4*x + 1] = yRow[x];
+        dst[4*x + 2] = zRow[x];
+        dst[4*x + 3] = 1.0f;
+    }
+}
+
+void Reconstruct3D::Pimpl::storeRowXYZ(const float* xRow, const float* yRow, const float* zRow,
+        int width, float* dst) {
+    int x = 0;
+#if defined(__SSE2__) || defined(__AVX2__)
+    for(; x + 4 <= width; x += 4) {
+        __m128 v0, v1, v2;
+        interleaveXYZ(_mm_loadu_ps(&xRow[x]), _mm_loadu_ps(&yRow[x]), _mm_loadu_ps(&zRow[x]), v0, v1, v2);
+        _mm_storeu_ps(&dst[3*x], v0);
+        _mm_storeu_ps(&dst[3*x + 4], v1);
+        _mm_storeu_ps(&dst[3*x + 8], v2);
+    }
+#endif
+    for(; x < width; x++) {
+        dst[3*x] = xRow[x];
+        dst[3*x + 1] = yRow[x];
+        dst[3*x + 2] = zRow[x];
+    }
+}
+
+void Reconstruct3D::Pimpl::storeRowHalfFloat(const float* xRow, const float* yRow, const float* zRow,
+        int width, unsigned short* dst) {
+    int x = 0;
+#ifdef __F16C__
+    for(; x + 4 <= width; x += 4) {
+        __m128 v0, v1, v2;
+        interleaveXYZ(_mm_loadu_ps(&xRow[x]), _mm_loadu_ps(&yRow[x]), _mm_loadu_ps(&zRow[x]), v0, v1, v2);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(&dst[3*x]), _mm_cvtps_ph(v0, _MM_FROUND_TO_NEAREST_INT));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(&dst[3*x + 4]), _mm_cvtps_ph(v1, _MM_FROUND_TO_NEAREST_INT));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(&dst[3*x + 8]), _mm_cvtps_ph(v2, _MM_FROUND_TO_NEAREST_INT));
+    }
+#endif
+    for(; x < width; x++) {
+        dst[3*x] = floatToHalf(xRow[x]);
+        dst[3*x + 1] = floatToHalf(yRow[x]);
+        dst[3*x + 2] = floatToHalf(zRow[x]);
+    }
+}
+
+void Reconstruct3D::Pimpl::storeRowInt16(const float* xRow, const float* yRow, const float* zRow,
+        int width, short* dst) {
+    int x = 0;
+#if defined(__SSE2__) || defined(__AVX2__)
+    const __m128 scaleVector = _mm_set1_ps(1000.0f);
+    const __m128 limitVector = _mm_set1_ps(32767.0f);
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+
+    for(; x + 4 <= width; x += 4) {
+        __m128 px = _mm_mul_ps(_mm_loadu_ps(&xRow[x]), scaleVector);
+        __m128 py = _mm_mul_ps(_mm_loadu_ps(&yRow[x]), scaleVector);
+        __m128 pz = _mm_mul_ps(_mm_loadu_ps(&zRow[x]), scaleVector);
+
+        // Points outside the value range (including inf and NaN) are set to 0
+        __m128 validMask = _mm_and_ps(
+            _mm_and_ps(_mm_cmple_ps(_mm_and_ps(px, absMask), limitVector),
+                _mm_cmple_ps(_mm_and_ps(py, absMask), limitVector)),
+            _mm_cmple_ps(_mm_and_ps(pz, absMask), limitVector));
+        px = _mm_and_ps(px, validMask);
+        py = _mm_and_ps(py, validMask);
+        pz = _mm_and_ps(pz, validMask);
+
+        __m128 v0, v1, v2;
+        interleaveXYZ(px, py, pz, v0, v1, v2);
+        __m128i packed01 = _mm_packs_epi32(_mm_cvtps_epi32(v0), _mm_cvtps_epi32(v1));
+        __m128i packed2 = _mm_packs_epi32(_mm_cvtps_epi32(v2), _mm_cvtps_epi32(v2));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&dst[3*x]), packed01);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(&dst[3*x + 8]), packed2);
+    }
+#endif
+    for(; x < width; x++) {
+        float px = xRow[x]*1000.0f, py = yRow[x]*1000.0f, pz = zRow[x]*1000.0f;
+        if(std::fabs(px) <= 32767.0f && std::fabs(py) <= 32767.0f && std::fabs(pz) <= 32767.0f) {
+            dst[3*x] = static_cast<short>(lrintf(px));
+            dst[3*x + 1] = static_cast<short>(lrintf(py));
+            dst[3*x + 2] = static_cast<short>(lrintf(pz));
+        } else {
+            dst[3*x] = dst[3*x + 1] = dst[3*x + 2] = 0;
+        }
+    }
+}
+
+unsigned short Reconstruct3D::Pimpl::floatToHalf(float value) {
+    // Conversion with round-to-nearest-even, equivalent to the F16C instructions
+    unsigned int bits;
+    memcpy(&bits, &value, sizeof(bits));
+    unsigned short sign = static_cast<unsigned short>((bits >> 16) & 0x8000);
+    unsigned int absBits = bits & 0x7FFFFFFF;
+
+    if(absBits >= 0x7F800000) {
+        // Infinity or NaN
+        return sign | 0x7C00 | (absBits > 0x7F800000 ? 0x200 : 0);
+    } else if(absBits >= 0x477FF000) {
+        // Overflow
+        return sign | 0x7C00;
+    } else if(absBits < 0x33000000) {
+        // Underflow
+        return sign;
+    } else if(absBits < 0x38800000) {
+        // Subnormal half float
+        unsigned int shift = 126 - (absBits >> 23);
+        unsigned int mantissa = (absBits & 0x7FFFFF) | 0x800000;
+        unsigned int result = mantissa >> shift;
+        unsigned int remainder = mantissa & ((1u << shift) - 1);
+        unsigned int halfway = 1u << (shift - 1);
+        if(remainder > halfway || (remainder == halfway && (result & 1))) {
+            result++;
+        }
+        return sign | static_cast<unsigned short>(result);
+    } else {
+        // Normal half float: adjust the exponent bias and round the mantissa
+        unsigned int result = (absBits - 0x38000000) >> 13;
+        unsigned int remainder = absBits & 0x1FFF;
+        if(remainder > 0x1000 || (remainder == 0x1000 && (result & 1))) {
+            result++;
+        }
+        return sign | static_cast<unsigned short>(result);
+    }
+}
+
+float* Reconstruct3D::Pimpl::createCompactPointCloud(const ImageSet& imageSet, int& numPoints,
+        unsigned short minDisparity, unsigned short maxDisparity, float maxZ,
+        const int** pixelIndices) {
+    checkDisparityMap(imageSet);
+
+    int width = imageSet.getWidth();
+    int height = imageSet.getHeight();
+
+    // Allocate the buffers for the worst case of all points being valid
+    if(pointMap.size() < size_t(3)*width*height) {
+        pointMap.resize(size_t(3)*width*height);
+    }
+    if(pixelIndexMap.size() < size_t(width)*height) {
+        pixelIndexMap.resize(size_t(width)*height);
+    }
+
+    int rowStride = imageSet.getRowStride(ImageSet::IMAGE_DISPARITY);
+    const unsigned short* dispMap = reinterpret_cast<const unsigned short*>(imageSet.getPixelData(ImageSet::IMAGE_DISPARITY));
+    int subpixelFactor = imageSet.getSubpixelFactor();
+    float combinedQ[16];
+    const float* q = getProjectionMatrix(imageSet.getQMatrix(), combinedQ);
+    const ProjectionCache& projection = getProjectionCache(projectionCache, q, width,
+        imageSet.getHeight(), subpixelFactor);
+
+    // A disparity of 0 is always invalid
+    minDisparity = std::max(minDisparity, static_cast<unsigned short>(1));
+    float zLimit = maxZ > 0 ? maxZ : (std::numeric_limits<float>::max)();
+
+    // Points in the camera frame are always in front of the camera
+    float zMin = hasTransformation ? -(std::numeric_limits<float>::max)() : 0.0f;
+
+    // Each band compacts its points to the beginning of its own section
+    // of the output buffers
+    int numBands = threadPool.getNumThreads();
+    std::vector<int> bandStarts(numBands, 0);
+    std::vector<int> bandCounts(numBands, 0);
+
+    allocateRowBuffers(width, 3);
+    threadPool.parallelFor(height, [&](int band, int startRow, int stopRow) {
+        float* xRow = getRowBuffer(band, 0);
+        float* yRow = getRowBuffer(band, 1);
+        float* zRow = getRowBuffer(band, 2);
+
+        int count = 0;
+        for(int y = startRow; y < stopRow; y++) {
+            const unsigned short* dispRow = reinterpret_cast<const unsigned short*>(
+                &reinterpret_cast<const unsigned char*>(dispMap)[y*rowStride]);
+            evaluateRow(dispRow, width, y, projection, 0, maxDisparity, xRow, yRow, zRow,
+                getCropBox());
+
+            int offset = startRow*width + count;
+            count += compactRow(dispRow, xRow, yRow, zRow, width, y*width, minDisparity,
+                maxDisparity, zMin, zLimit, &pointMap[3*size_t(offset)], &pixelIndexMap[offset]);
+        }
+
+        bandStarts[band] = startRow*width;
+        bandCounts[band] = count;
+    });
+
+    // Close the gaps between bands
+    numPoints = 0;
+    for(int band = 0; band < numBands; band++) {
+        if(bandCounts[band] > 0 && bandStarts[band] != numPoints) {
+            memmove(&pointMap[3*size_t(numPoints)], &pointMap[3*size_t(bandStarts[band])],
+                3*sizeof(float)*bandCounts[band]);
+            memmove(&pixelIndexMap[numPoints], &pixelIndexMap[bandStarts[band]],
+                sizeof(int)*bandCounts[band]);
+        }
+        numPoints += bandCounts[band];
+    }
+
+    if(pixelIndices != nullptr) {
+        *pixelIndices = &pixelIndexMap[0];
+    }
+    return &pointMap[0];
+}
+
+int Reconstruct3D::Pimpl::compactRow(const unsigned short* dispRow, const float* xRow,
+        const float* yRow, const float* zRow, int width, int firstIndex,
+        unsigned short minDisparity, unsigned short maxDisparity, float zMin, float zLimit,
+        float* dstPoints, int* dstIndices) {
+    // Invalid points are written as well, but the output position only
+    // advances for valid points. This avoids unpredictable branches.
+    float* outPoint = dstPoints;
+    int* outIndex = dstIndices;
+
+    int x = 0;
+#if defined(__SSE2__) || defined(__AVX2__)
+    const __m128i minDispVector = _mm_set1_epi32(minDisparity);
+    const __m128i maxDispVector = _mm_set1_epi32(maxDisparity);
+    const __m128i zeroVector = _mm_setzero_si128();
+    const __m128i offsetVector = _mm_setr_epi32(0, 1, 2, 3);
+    const __m128 zMinVector = _mm_set1_ps(zMin);
+    const __m128 zLimitVector = _mm_set1_ps(zLimit);
+
+    for(; x + 4 <= width; x += 4) {
+        __m128i disparities = _mm_unpacklo_epi16(
+            _mm_loadl_epi64(reinterpret_cast<const __m128i*>(&dispRow[x])), zeroVector);
+        __m128i dispValid = _mm_andnot_si128(_mm_cmplt_epi32(disparities, minDispVector),
+            _mm_cmplt_epi32(disparities, maxDispVector));
+
+        // Comparisons with NaN or inf fail
+        __m128 pz = _mm_loadu_ps(&zRow[x]);
+        __m128 zValid = _mm_and_ps(_mm_cmpgt_ps(pz, zMinVector), _mm_cmple_ps(pz, zLimitVector));
+
+        int mask = _mm_movemask_ps(_mm_and_ps(_mm_castsi128_ps(dispValid), zValid));
+        if(mask == 0xF) {
+            __m128 v0, v1, v2;
+            interleaveXYZ(_mm_loadu_ps(&xRow[x]), _mm_loadu_ps(&yRow[x]), pz, v0, v1, v2);
+            _mm_storeu_ps(outPoint, v0);
+            _mm_storeu_ps(outPoint + 4, v1);
+            _mm_storeu_ps(outPoint + 8, v2);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(outIndex),
+                _mm_add_epi32(_mm_set1_epi32(firstIndex + x), offsetVector));
+            outPoint += 12;
+            outIndex += 4;
+        } else if(mask != 0) {
+            for(int i = 0; i < 4; i++) {
+                int valid = (mask >> i) & 1;
+                outPoint[0] = xRow[x + i];
+                outPoint[1] = yRow[x + i];
+                outPoint[2] = zRow[x + i];
+                *outIndex = firstIndex + x + i;
+                outPoint += 3*valid;
+                outIndex += valid;
+            }
+        }
+    }
+#endif
+
+    for(; x < width; x++) {
+        int valid = dispRow[x] >= minDisparity && dispRow[x] < maxDisparity
+            && zRow[x] > zMin && zRow[x] <= zLimit;
+        outPoint[0] = xRow[x];
+        outPoint[1] = yRow[x];
+        outPoint[2] = zRow[x];
+        *outIndex = firstIndex + x;
+        outPoint += 3*valid;
+        outIndex += valid;
+    }
+
+    return static_cast<int>(outIndex - dstIndices);
+}
+
+float* Reconstruct3D::Pimpl::createVoxelGridCloud(const ImageSet& imageSet, float leafSize,
+        int& numPoints, const unsigned char** colors, ColorSource colSource,
+        const float* boundingBox, unsigned short minDisparity, unsigned short maxDisparity) {
+    checkDisparityMap(imageSet);
+    if(!(leafSize > 0)) {
+        throw std::runtime_error("Voxel leaf size must be positive!");
+    }
+
+    int width = imageSet.getWidth();
+    int height = imageSet.getHeight();
+    int rowStride = imageSet.getRowStride(ImageSet::IMAGE_DISPARITY);
+    const unsigned short* dispMap = reinterpret_cast<const unsigned short*>(imageSet.getPixelData(ImageSet::IMAGE_DISPARITY));
+    int subpixelFactor = imageSet.getSubpixelFactor();
+    float combinedQ[16];
+    const float* q = getProjectionMatrix(imageSet.getQMatrix(), combinedQ);
+    const ProjectionCache& projection = getProjectionCache(projectionCache, q, width,
+        imageSet.getHeight(), subpixelFactor);
+
+    // Find color image, if requested
+    const unsigned char* image = nullptr;
+    ImageSet::ImageFormat imageFormat = ImageSet::FORMAT_8_BIT_MONO;
+    int imageRowStride = 0;
+    if(colors != nullptr && colSource != COLOR_NONE) {
+        ImageSet::ImageType colImg = getColorImage(imageSet, colSource);
+        if(imageSet.hasImageType(colImg)) {
+            image = imageSet.getPixelData(colImg);
+            imageFormat = imageSet.getPixelFormat(colImg);
+            imageRowStride = imageSet.getRowStride(colImg);
+        }
+    }
+
+    // Min x, y, z and max x, y, z, with the minimum z being exclusive
+    float bounds[6];
+    if(boundingBox != nullptr) {
+        std::copy(boundingBox, boundingBox + 6, bounds);
+    } else {
+        bounds[0] = bounds[1] = -(std::numeric_limits<float>::max)();
+        bounds[2] = hasTransformation ? bounds[0] : 0;
+        bounds[3] = bounds[4] = bounds[5] = (std::numeric_limits<float>::max)();
+    }
+
+    // A disparity of 0 is always invalid
+    minDisparity = std::max(minDisparity, static_cast<unsigned short>(1));
+
+    int numBands = threadPool.getNumThreads();
+    if(static_cast<int>(voxelGrids.size()) < numBands) {
+        voxelGrids.resize(numBands);
+    }
+    if(image != nullptr && colorRowBuffers.size() < size_t(3)*width*numBands) {
+        colorRowBuffers.resize(size_t(3)*width*numBands);
+    }
+
+    // Each band accumulates its points in its own grid
+    std::vector<char> bandActive(numBands, 0);
+    allocateRowBuffers(width, 4);
+    threadPool.parallelFor(height, [&](int band, int startRow, int stopRow) {
+        VoxelGrid& grid = voxelGrids[band];
+        grid.reset(leafSize, (stopRow - startRow) * width / 16);
+        bandActive[band] = 1;
+
+        float* xRow = getRowBuffer(band, 0);
+        float* yRow = getRowBuffer(band, 1);
+        float* zRow = getRowBuffer(band, 2);
+        int* columns = reinterpret_cast<int*>(getRowBuffer(band, 3));
+        unsigned char* rgbRow = image != nullptr ? &colorRowBuffers[size_t(3)*width*band] : nullptr;
+
+        for(int y = startRow; y < stopRow; y++) {
+            const unsigned short* dispRow = reinterpret_cast<const unsigned short*>(
+                &reinterpret_cast<const unsigned char*>(dispMap)[y*rowStride]);
+            evaluateRow(dispRow, width, y, projection, 0, maxDisparity, xRow, yRow, zRow,
+                getCropBox());
+            if(rgbRow != nullptr) {
+                convertRowToRgb(&image[y*imageRowStride], imageFormat, width, rgbRow);
+            }
+
+            // Only the points inside the bounds are accumulated
+            int numValid = selectVoxelRow(dispRow, xRow, yRow, zRow, width, minDisparity,
+                maxDisparity, bounds, columns);
+            for(int i = 0; i < numValid; i++) {
+                int x = columns[i];
+                grid.addPoint(xRow[x], yRow[x], zRow[x], rgbRow != nullptr ? &rgbRow[3*x] : nullptr);
+            }
+        }
+    });
+
+    // Merge the grids of all bands
+    VoxelGrid& grid = voxelGrids[0];
+    if(!bandActive[0]) {
+        grid.reset(leafSize, 0);
+    }
+    for(int band = 1; band < numBands; band++) {
+        if(bandActive[band]) {
+            grid.merge(voxelGrids[band]);
+        }
+    }
+
+    numPoints = grid.getNumVoxels();
+    if(pointMap.size() < size_t(3)*numPoints) {
+        pointMap.resize(size_t(3)*numPoints);
+    }
+    unsigned char* colorPtr = nullptr;
+    if(image != nullptr) {
+        if(voxelColors.size() < size_t(3)*numPoints) {
+            voxelColors.resize(size_t(3)*numPoints);
+        }
+        colorPtr = voxelColors.size() > 0 ? &voxelColors[0] : nullptr;
+    }
+    grid.getAveragedPoints(pointMap.size() > 0 ? &pointMap[0] : nullptr, colorPtr);
+
+    if(colors != nullptr) {
+        *colors = colorPtr;
+    }
+    return pointMap.size() > 0 ? &pointMap[0] : nullptr;
+}
+
+int Reconstruct3D::Pimpl::selectVoxelRow(const unsigned short* dispRow, const float* xRow,
+        const float* yRow, const float* zRow, int width, unsigned short minDisparity,
+        unsigned short maxDisparity, const float* bounds, int* columns) {
+    // The column of each point is written, but the output position only
+    // advances for valid points
+    int numValid = 0;
+    int x = 0;
+#if defined(__SSE2__) || defined(__AVX2__)
+    const __m128i minDispVector = _mm_set1_epi32(minDisparity);
+    const __m128i maxDispVector = _mm_set1_epi32(maxDisparity);
+    const __m128i zeroVector = _mm_setzero_si128();
+    const __m128 minXVector = _mm_set1_ps(bounds[0]);
+    const __m128 minYVector = _mm_set1_ps(bounds[1]);
+    const __m128 minZVector = _mm_set1_ps(bounds[2]);
+    const __m128 maxXVector = _mm_set1_ps(bounds[3]);
+    const __m128 maxYVector = _mm_set1_ps(bounds[4]);
+    const __m128 maxZVector = _mm_set1_ps(bounds[5]);
+
+    for(; x + 4 <= width; x += 4) {
+        __m128i disparities = _mm_unpacklo_epi16(
+            _mm_loadl_epi64(reinterpret_cast<const __m128i*>(&dispRow[x])), zeroVector);
+        __m128i dispValid = _mm_andnot_si128(_mm_cmplt_epi32(disparities, minDispVector),
+            _mm_cmplt_epi32(disparities, maxDispVector));
+
+        // Comparisons with NaN or inf fail
+        __m128 px = _mm_loadu_ps(&xRow[x]);
+        __m128 py = _mm_loadu_ps(&yRow[x]);
+        __m128 pz = _mm_loadu_ps(&zRow[x]);
+        __m128 valid = _mm_and_ps(_mm_cmpgt_ps(pz, minZVector), _mm_cmple_ps(pz, maxZVector));
+        valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(px, minXVector), _mm_cmple_ps(px, maxXVector)));
+        valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(py, minYVector), _mm_cmple_ps(py, maxYVector)));
+
+        int mask = _mm_movemask_ps(_mm_and_ps(_mm_castsi128_ps(dispValid), valid));
+        if(mask == 0xF) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&columns[numValid]),
+                _mm_add_epi32(_mm_set1_epi32(x), _mm_setr_epi32(0, 1, 2, 3)));
+            numValid += 4;
+        } else if(mask != 0) {
+            for(int i = 0; i < 4; i++) {
+                columns[numValid] = x + i;
+                numValid += (mask >> i) & 1;
+            }
+        }
+    }
+#endif
+
+    for(; x < width; x++) {
+        columns[numValid] = x;
+        numValid += dispRow[x] >= minDisparity && dispRow[x] < maxDisparity
+            && zRow[x] > bounds[2] && zRow[x] <= bounds[5]
+            && xRow[x] >= bounds[0] && xRow[x] <= bounds[3]
+            && yRow[x] >= bounds[1] && yRow[x] <= bounds[4];
+    }
+
+    return numValid;
+}
+
+void Reconstruct3D::Pimpl::computeCellRow(const unsigned short* dispRow, const float* xRow,
+        const float* yRow, const float* zRow, int width, unsigned short minDisparity,
+        unsigned short maxDisparity, const float* extent, float invCellSize, int columns,
+        int rows, int* cells) {
+    int x = 0;
+#if defined(__SSE2__) || defined(__AVX2__)
+    const __m128i minDispVector = _mm_set1_epi32(minDisparity);
+    const __m128i maxDispVector = _mm_set1_epi32(maxDisparity);
+    const __m128i zeroVector = _mm_setzero_si128();
+    const __m128i invalidVector = _mm_set1_epi32(-1);
+    const __m128 minXVector = _mm_set1_ps(extent[0]);
+    const __m128 minYVector = _mm_set1_ps(extent[1]);
+    const __m128 minZVector = _mm_set1_ps(extent[2]);
+    const __m128 maxXVector = _mm_set1_ps(extent[3]);
+    const __m128 maxYVector = _mm_set1_ps(extent[4]);
+    const __m128 maxZVector = _mm_set1_ps(extent[5]);
+    const __m128 invCellVector = _mm_set1_ps(invCellSize);
+    const __m128 zeroFloatVector = _mm_setzero_ps();
+    const __m128 columnsVector = _mm_set1_ps(static_cast<float>(columns));
+    const __m128 rowsVector = _mm_set1_ps(static_cast<float>(rows));
+
+    for(; x + 4 <= width; x += 4) {
+        __m128i disparities = _mm_unpacklo_epi16(
+            _mm_loadl_epi64(reinterpret_cast<const __m128i*>(&dispRow[x])), zeroVector);
+        __m128i dispValid = _mm_andnot_si128(_mm_cmplt_epi32(disparities, minDispVector),
+            _mm_cmplt_epi32(disparities, maxDispVector));
+
+        // Comparisons with NaN or inf fail
+        __m128 px = _mm_loadu_ps(&xRow[x]);
+        __m128 py = _mm_loadu_ps(&yRow[x]);
+        __m128 pz = _mm_loadu_ps(&zRow[x]);
+        __m128 cellX = _mm_mul_ps(_mm_sub_ps(px, minXVector), invCellVector);
+        __m128 cellY = _mm_mul_ps(_mm_sub_ps(py, minYVector), invCellVector);
+        __m128 valid = _mm_and_ps(_mm_cmpge_ps(pz, minZVector), _mm_cmple_ps(pz, maxZVector));
+
+        // The last cell may reach beyond the extent, which is hence also tested
+        valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmple_ps(px, maxXVector), _mm_cmple_ps(py, maxYVector)));
+        valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(cellX, zeroFloatVector), _mm_cmplt_ps(cellX, columnsVector)));
+        valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(cellY, zeroFloatVector), _mm_cmplt_ps(cellY, rowsVector)));
+        __m128i validMask = _mm_and_si128(_mm_castps_si128(valid), dispValid);
+
+        // The cell index is exact in float as long as the grid has at most 2^24 cells
+        __m128 truncX = _mm_cvtepi32_ps(_mm_cvttps_epi32(cellX));
+        __m128 truncY = _mm_cvtepi32_ps(_mm_cvttps_epi32(cellY));
+        __m128i index = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(truncY, columnsVector), truncX));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&cells[x]), _mm_or_si128(
+            _mm_and_si128(validMask, index), _mm_andnot_si128(validMask, invalidVector)));
+    }
+#endif
+
+    for(; x < width; x++) {
+        float cellX = (xRow[x] - extent[0]) * invCellSize;
+        float cellY = (yRow[x] - extent[1]) * invCellSize;
+        bool valid = dispRow[x] >= minDisparity && dispRow[x] < maxDisparity
+            && zRow[x] >= extent[2] && zRow[x] <= extent[5]
+            && xRow[x] <= extent[3] && yRow[x] <= extent[4]
+            && cellX >= 0 && cellX < columns && cellY >= 0 && cellY < rows;
+        cells[x] = valid ? static_cast<int>(cellY) * columns + static_cast<int>(cellX) : -1;
+    }
+}
+
+float* Reconstruct3D::Pimpl::createHeightMap(const ImageSet& imageSet, float cellSize,
+        const float* extent, int& columns, int& rows, HeightMapMode mode,
+        const unsigned int** pointCounts, unsigned short minDisparity, unsigned short maxDisparity) {
+    checkDisparityMap(imageSet);
+    if(!(cellSize > 0)) {
+        throw std::runtime_error("Height map cell size must be positive!");
+    }
+    if(extent == nullptr || !(extent[3] > extent[0] && extent[4] > extent[1] && extent[5] >= extent[2])) {
+        throw std::runtime_error("Invalid height map extent!");
+    }
+
+    double gridColumns = std::ceil((double(extent[3]) - extent[0]) / cellSize);
+    double gridRows = std::ceil((double(extent[4]) - extent[1]) / cellSize);
+    if(gridColumns * gridRows > double(1 << 24)) {
+        throw std::runtime_error("Height map exceeds the maximum number of cells!");
+    }
+    columns = static_cast<int>(gridColumns);
+    rows = static_cast<int>(gridRows);
+    int numCells = columns * rows;
+
+    int width = imageSet.getWidth();
+    int rowStride = imageSet.getRowStride(ImageSet::IMAGE_DISPARITY);
+    const unsigned short* dispMap = reinterpret_cast<const unsigned short*>(imageSet.getPixelData(ImageSet::IMAGE_DISPARITY));
+    int subpixelFactor = imageSet.getSubpixelFactor();
+    float combinedQ[16];
+    const float* q = getProjectionMatrix(imageSet.getQMatrix(), combinedQ);
+    const ProjectionCache& projection = getProjectionCache(projectionCache, q, width,
+        imageSet.getHeight(), subpixelFactor);
+    float invCellSize = 1.0f / cellSize;
+
+    HeightGrid::Statistic statistic = mode == HEIGHT_MIN ? HeightGrid::STAT_MIN
+        : (mode == HEIGHT_MEAN ? HeightGrid::STAT_MEAN : HeightGrid::STAT_MAX);
+
+    // A disparity of 0 is always invalid
+    minDisparity = std::max(minDisparity, static_cast<unsigned short>(1));
+
+    int numBands = threadPool.getNumThreads();
+    if(static_cast<int>(heightGrids.size()) < numBands) {
+        heightGrids.resize(numBands);
+    }
+
+    // Each band accumulates its points in its own grid
+    std::vector<char> bandActive(numBands, 0);
+    allocateRowBuffers(width, 4);
+    threadPool.parallelFor(imageSet.getHeight(), [&](int band, int startRow, int stopRow) {
+        HeightGrid& grid = heightGrids[band];
+        grid.reset(numCells, statistic);
+        bandActive[band] = 1;
+
+        float* xRow = getRowBuffer(band, 0);
+        float* yRow = getRowBuffer(band, 1);
+        float* zRow = getRowBuffer(band, 2);
+        int* cellRow = reinterpret_cast<int*>(getRowBuffer(band, 3));
+
+        for(int y = startRow; y < stopRow; y++) {
+            const unsigned short* dispRow = reinterpret_cast<const unsigned short*>(
+                &reinterpret_cast<const unsigned char*>(dispMap)[y*rowStride]);
+            evaluateRow(dispRow, width, y, projection, 0, maxDisparity, xRow, yRow, zRow,
+                getCropBox());
+            computeCellRow(dispRow, xRow, yRow, zRow, width, minDisparity, maxDisparity,
+                extent, invCellSize, columns, rows, cellRow);
+            grid.addPoints(cellRow, zRow, width);
+        }
+    });
+
+    if(!bandActive[0]) {
+        heightGrids[0].reset(numCells, statistic);
+    }
+
+    // Merge the grids of all bands and compute the final heights, split by cells
+    heightMap.resize(numCells);
+    heightCounts.resize(numCells);
+    threadPool.parallelFor(numCells, [&](int, int firstCell, int endCell) {
+        for(int band = 1; band < numBands; band++) {
+            if(bandActive[band]) {
+                heightGrids[0].merge(heightGrids[band], firstCell, endCell);
+            }
+        }
+        heightGrids[0].getHeights(&heightMap[0], &heightCounts[0], firstCell, endCell);
+    });
+
+    if(pointCounts != nullptr) {
+        *pointCounts = &heightCounts[0];
+    }
+    return &heightMap[0];
+}
+
+void Reconstruct3D::Pimpl::createInterleavedCloud(const ImageSet& imageSet, unsigned short minDisparity,
+        unsigned short maxDisparity, unsigned char* dst, int pointSize, PointChannel channel,
+        int channelOffset, ColorSource colSource) {
+    checkDisparityMap(imageSet);
+
+    const unsigned char* image = nullptr;
+    ImageSet::ImageFormat imageFormat = ImageSet::FORMAT_8_BIT_MONO;
+    int imageRowStride = 0;
+    if(channel != CHANNEL_NONE) {
+        ImageSet::ImageType colImg = getColorImage(imageSet, colSource);
+        if(!imageSet.hasImageType(colImg)) {
+            throw std::runtime_error("Image set does not contain the requested color image");
+        }
+        image = imageSet.getPixelData(colImg);
+        imageFormat = imageSet.getPixelFormat(colImg);
+        imageRowStride = imageSet.getRowStride(colImg);
+    }
+
+    int width = imageSet.getWidth();
+    int rowStride = imageSet.getRowStride(ImageSet::IMAGE_DISPARITY);
+    const unsigned short* dispMap = reinterpret_cast<const unsigned short*>(imageSet.getPixelData(ImageSet::IMAGE_DISPARITY));
+    int subpixelFactor = imageSet.getSubpixelFactor();
+    float combinedQ[16];
+    const float* q = getProjectionMatrix(imageSet.getQMatrix(), combinedQ);
+    const ProjectionCache& projection = getProjectionCache(projectionCache, q, width,
+        imageSet.getHeight(), subpixelFactor);
+
+    allocateRowBuffers(width, 4);
+    threadPool.parallelFor(imageSet.getHeight(), [&](int band, int startRow, int stopRow) {
+        float* xRow = getRowBuffer(band, 0);
+        float* yRow = getRowBuffer(band, 1);
+        float* zRow = getRowBuffer(band, 2);
+        float* channelRow = getRowBuffer(band, 3);
+
+        for(int y = startRow; y < stopRow; y++) {
+            const unsigned short* dispRow = reinterpret_cast<const unsigned short*>(
+                &reinterpret_cast<const unsigned char*>(dispMap)[y*rowStride]);
+            evaluateRow(dispRow, width, y, projection, minDisparity, maxDisparity,
+                xRow, yRow, zRow, getCropBox());
+
+            if(channel == CHANNEL_INTENSITY) {
+                convertRowToIntensity(&image[y*imageRowStride], imageFormat, width, channelRow);
+            } else if(channel == CHANNEL_BGRA) {
+                convertRowToBgra(&image[y*imageRowStride], imageFormat, width,
+                    reinterpret_cast<unsigned int*>(channelRow));
+            }
+
+            storeRowInterleaved(xRow, yRow, zRow, channel != CHANNEL_NONE ? channelRow : nullptr,
+                width, pointSize, channelOffset, &dst[size_t(y)*width*pointSize]);
+        }
+    });
+}
+
+void Reconstruct3D::Pimpl::createDoubleCloud(const ImageSet& imageSet, unsigned short minDisparity,
+        unsigned short maxDisparity, double* points, double* colors, ColorSource colSource) {
+    checkDisparityMap(imageSet);
+
+    const unsigned char* image = nullptr;
+    ImageSet::ImageFormat imageFormat = ImageSet::FORMAT_8_BIT_MONO;
+    int imageRowStride = 0;
+    if(colors != nullptr) {
+        ImageSet::ImageType colImg = getColorImage(imageSet, colSource);
+        if(!imageSet.hasImageType(colImg)) {
+            throw std::runtime_error("Image set does not contain the requested color image");
+        }
+        image = imageSet.getPixelData(colImg);
+        imageFormat = imageSet.getPixelFormat(colImg);
+        imageRowStride = imageSet.getRowStride(colImg);
+    }
+
+    int width = imageSet.getWidth();
+    int rowStride = imageSet.getRowStride(ImageSet::IMAGE_DISPARITY);
+    const unsigned short* dispMap = reinterpret_cast<const unsigned short*>(imageSet.getPixelData(ImageSet::IMAGE_DISPARITY));
+    int subpixelFactor = imageSet.getSubpixelFactor();
+    float combinedQ[16];
+    const float* q = getProjectionMatrix(imageSet.getQMatrix(), combinedQ);
+    const ProjectionCache& projection = getProjectionCache(projectionCache, q, width,
+        imageSet.getHeight(), subpixelFactor);
+
+    allocateRowBuffers(width, 3);
+    threadPool.parallelFor(imageSet.getHeight(), [&](int band, int startRow, int stopRow) {
+        float* xRow = getRowBuffer(band, 0);
+        float* yRow = getRowBuffer(band, 1);
+        float* zRow = getRowBuffer(band, 2);
+
+        for(int y = startRow; y < stopRow; y++) {
+            const unsigned short* dispRow = reinterpret_cast<const unsigned short*>(
+                &reinterpret_cast<const unsigned char*>(dispMap)[y*rowStride]);
+            evaluateRow(dispRow, width, y, projection, minDisparity, maxDisparity,
+                xRow, yRow, zRow, getCropBox());
+            storeRowXYZDouble(xRow, yRow, zRow, width, &points[3*size_t(y)*width]);
+
+            if(colors != nullptr) {
+                convertRowToDoubleColors(&image[y*imageRowStride], imageFormat, width,
+                    &colors[3*size_t(y)*width]);
+            }
+        }
+    });
+}
+
+void Reconstruct3D::Pimpl::createRgbImage(const ImageSet& imageSet, ColorSource colSource,
+        unsigned char* dst) {
+    ImageSet::ImageType colImg = getColorImage(imageSet, colSource);
+    if(!imageSet.hasImageType(colImg)) {
+        throw std::runtime_error("Image set does not contain the requested color image");
+    }
+
+    const unsigned char* image = imageSet.getPixelData(colImg);
+    ImageSet::ImageFormat imageFormat = imageSet.getPixelFormat(colImg);
+    int imageRowStride = imageSet.getRowStride(colImg);
+    int width = imageSet.getWidth();
+
+    threadPool.parallelFor(imageSet.getHeight(), [&](int, int startRow, int stopRow) {
+        for(int y = startRow; y < stopRow; y++) {
+            convertRowToRgb(&image[y*imageRowStride], imageFormat, width, &dst[3*size_t(y)*width]);
+        }
+    });
+}
+
+void Reconstruct3D::Pimpl::storeRowInterleaved(const float* xRow, const float* yRow, const float* zRow,
+        const float* channelRow, int width, int pointSize, int channelOffset, unsigned char* dst) {
+    int x = 0;
+#if defined(__SSE2__) || defined(__AVX2__)
+    const __m128 oneVector = _mm_set1_ps(1.0f);
+    for(; x + 4 <= width; x += 4) {
+        __m128 px = _mm_loadu_ps(&xRow[x]);
+        __m128 py = _mm_loadu_ps(&yRow[x]);
+        __m128 pz = _mm_loadu_ps(&zRow[x]);
+        __m128 pw = oneVector;
+        _MM_TRANSPOSE4_PS(px, py, pz, pw);
+
+        unsigned char* point = &dst[size_t(x)*pointSize];
+        _mm_storeu_ps(reinterpret_cast<float*>(point), px);
+        _mm_storeu_ps(reinterpret_cast<float*>(point + pointSize), py);
+        _mm_storeu_ps(reinterpret_cast<float*>(point + 2*pointSize), pz);
+        _mm_storeu_ps(reinterpret_cast<float*>(point + 3*pointSize), pw);
+
+        if(channelRow != nullptr) {
+            for(int i = 0; i < 4; i++) {
+                memcpy(point + i*pointSize + channelOffset, &channelRow[x + i], sizeof(float));
+            }
+        }
+    }
+#endif
+
+    for(; x < width; x++) {
+        float* point = reinterpret_cast<float*>(&dst[size_t(x)*pointSize]);
+        point[0] = xRow[x];
+        point[1] = yRow[x];
+        point[2] = zRow[x];
+        point[3] = 1.0f;
+        if(channelRow != nullptr) {
+            memcpy(&dst[size_t(x)*pointSize + channelOffset], &channelRow[x], sizeof(float));
+        }
+    }
 }
 
-float* Reconstruct3D::Pimpl::createPointMap(const unsigned short* dispMap, int width,
-        int height, int rowStride, const float* q, unsigned short minDisparity,
-        int subpixelFactor, unsigned short maxDisparity) {
+void Reconstruct3D::Pimpl::storeRowXYZDouble(const float* xRow, const float* yRow, const float* zRow,
+        int width, double* dst) {
+    int x = 0;
+#if defined(__SSE2__) || defined(__AVX2__)
+    for(; x + 2 <= width; x += 2) {
+        __m128d px = _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(&xRow[x]))));
+        __m128d py = _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(&yRow[x]))));
+        __m128d pz = _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(&zRow[x]))));
+
+        // x0 y0 | z0 x1 | y1 z1
+        _mm_storeu_pd(&dst[3*x], _mm_unpacklo_pd(px, py));
+        _mm_storeu_pd(&dst[3*x + 2], _mm_shuffle_pd(pz, px, 2));
+        _mm_storeu_pd(&dst[3*x + 4], _mm_unpackhi_pd(py, pz));
+    }
+#endif
+    for(; x < width; x++) {
+        dst[3*x] = xRow[x];
+        dst[3*x + 1] = yRow[x];
+        dst[3*x + 2] = zRow[x];
+    }
+}
 
-    // Allocate the buffer
-    if(pointMap.size() < static_cast<unsigned int>(4*width*height)) {
-        pointMap.resize(4*width*height);
+void Reconstruct3D::Pimpl::convertRowToIntensity(const unsigned char* src, ImageSet::ImageFormat format,
+        int width, float* dst) {
+    int x = 0;
+    switch(format) {
+        case ImageSet::FORMAT_8_BIT_MONO: {
+#if defined(__SSE2__) || defined(__AVX2__)
+            const __m128 divisor = _mm_set1_ps(255.0f);
+            const __m128i zero = _mm_setzero_si128();
+            for(; x + 16 <= width; x += 16) {
+                __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src[x]));
+                __m128i lo = _mm_unpacklo_epi8(pixels, zero), hi = _mm_unpackhi_epi8(pixels, zero);
+                _mm_storeu_ps(&dst[x], _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), divisor));
+                _mm_storeu_ps(&dst[x + 4], _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), divisor));
+                _mm_storeu_ps(&dst[x + 8], _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), divisor));
+                _mm_storeu_ps(&dst[x + 12], _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), divisor));
+            }
+#endif
+            for(; x < width; x++) {
+                dst[x] = static_cast<float>(src[x])/255.0f;
+            }
+            break;
+        }
+        case ImageSet::FORMAT_12_BIT_MONO: {
+            const unsigned short* src16 = reinterpret_cast<const unsigned short*>(src);
+#if defined(__SSE2__) || defined(__AVX2__)
+            const __m128 divisor = _mm_set1_ps(4095.0f);
+            const __m128i zero = _mm_setzero_si128();
+            for(; x + 8 <= width; x += 8) {
+                __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src16[x]));
+                _mm_storeu_ps(&dst[x], _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(pixels, zero)), divisor));
+                _mm_storeu_ps(&dst[x + 4], _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(pixels, zero)), divisor));
+            }
+#endif
+            for(; x < width; x++) {
+                dst[x] = static_cast<float>(src16[x])/4095.0f;
+            }
+            break;
+        }
+        default:
+            throw std::runtime_error("Intensity image does not have a valid greyscale format");
     }
+}
 
-    // +inf mapping of invalid points only works for fallback implementation
-    // in case of angled cameras.
-    bool angledCameraFallback = (q[15] != 0.0 && minDisparity == 0);
-    (void)angledCameraFallback; // Suppresses unused variable warning
+void Reconstruct3D::Pimpl::convertRowToBgra(const unsigned char* src, ImageSet::ImageFormat format,
+        int width, unsigned int* dst) {
+    int x = 0;
+#if defined(__SSE2__) || defined(__AVX2__)
+    const __m128i alpha = _mm_set1_epi8(static_cast<char>(0xFF));
+#endif
 
-#   ifdef __AVX2__
-        if(!angledCameraFallback && maxDisparity <= 0x1000 && width % 16 == 0 && (uintptr_t)dispMap % 32 == 0) {
-            return createPointMapAVX2(dispMap, width, height, rowStride, q,
-                minDisparity, subpixelFactor, maxDisparity);
-        } else
-#   endif
-#   ifdef __SSE2__
-        if(!angledCameraFallback && maxDisparity <= 0x1000 && width % 8 == 0 && (uintptr_t)dispMap % 16 == 0) {
-            return createPointMapSSE2(dispMap, width, height, rowStride, q,
-                minDisparity, subpixelFactor, maxDisparity);
-        } else
-#   endif
-#   ifdef __aarch64__
-        if(!angledCameraFallback && maxDisparity <= 0x1000 && width % 8 == 0) {
-            return createPointMapNEON(dispMap, width, height, rowStride, q,
-                minDisparity, subpixelFactor, maxDisparity);
-        } else
-#   endif
-        {
-            return createPointMapFallback(dispMap, width, height, rowStride, q,
-                minDisparity, subpixelFactor, maxDisparity);
+    switch(format) {
+        case ImageSet::FORMAT_8_BIT_MONO:
+        case ImageSet::FORMAT_12_BIT_MONO: {
+            const unsigned short* src16 = reinterpret_cast<const unsigned short*>(src);
+#if defined(__SSE2__) || defined(__AVX2__)
+            for(; x + 16 <= width; x += 16) {
+                __m128i gray;
+                if(format == ImageSet::FORMAT_8_BIT_MONO) {
+                    gray = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src[x]));
+                } else {
+                    gray = _mm_packus_epi16(
+                        _mm_srli_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&src16[x])), 4),
+                        _mm_srli_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&src16[x + 8])), 4));
+                }
+
+                // Expand each value v to the bytes v v v 0xFF
+                __m128i grayGray = _mm_unpacklo_epi8(gray, gray);
+                __m128i grayAlpha = _mm_unpacklo_epi8(gray, alpha);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(&dst[x]), _mm_unpacklo_epi16(grayGray, grayAlpha));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(&dst[x + 4]), _mm_unpackhi_epi16(grayGray, grayAlpha));
+                grayGray = _mm_unpackhi_epi8(gray, gray);
+                grayAlpha = _mm_unpackhi_epi8(gray, alpha);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(&dst[x + 8]), _mm_unpacklo_epi16(grayGray, grayAlpha));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(&dst[x + 12]), _mm_unpackhi_epi16(grayGray, grayAlpha));
+            }
+#endif
+            for(; x < width; x++) {
+                unsigned int gray = format == ImageSet::FORMAT_8_BIT_MONO ? src[x]
+                    : std::min(src16[x] >> 4, 0xFF);
+                dst[x] = gray | (gray << 8) | (gray << 16) | 0xFF000000u;
+            }
+            break;
+        }
+        case ImageSet::FORMAT_8_BIT_RGB: {
+#ifdef __SSSE3__
+            // Reorders four RGB pixels to BGR and leaves zero bytes for alpha
+            const __m128i shuffle = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+            for(; x + 6 <= width; x += 4) {
+                __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src[3*x]));
+                __m128i bgra = _mm_or_si128(_mm_shuffle_epi8(pixels, shuffle),
+                    _mm_set1_epi32(static_cast<int>(0xFF000000u)));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(&dst[x]), bgra);
+            }
+#endif
+            for(; x < width; x++) {
+                dst[x] = src[3*x + 2] | (src[3*x + 1] << 8) | (src[3*x] << 16) | 0xFF000000u;
+            }
+            break;
         }
+        default:
+            throw std::runtime_error("Illegal pixel format");
+    }
 }
 
-float* Reconstruct3D::Pimpl::createPointMap(const ImageSet& imageSet, unsigned short minDisparity, unsigned short maxDisparity) {
-    if(!imageSet.hasImageType(ImageSet::IMAGE_DISPARITY)) {
-        throw std::runtime_error("ImageSet does not contain a disparity map!");
+void Reconstruct3D::Pimpl::convertRowToDoubleColors(const unsigned char* src, ImageSet::ImageFormat format,
+        int width, double* dst) {
+    int x = 0;
+    switch(format) {
+        case ImageSet::FORMAT_8_BIT_MONO:
+        case ImageSet::FORMAT_12_BIT_MONO: {
+            const unsigned short* src16 = reinterpret_cast<const unsigned short*>(src);
+            double maxValue = format == ImageSet::FORMAT_8_BIT_MONO ? 0xFF : 0xFFF;
+#if defined(__SSE2__) || defined(__AVX2__)
+            const __m128d divisor = _mm_set1_pd(maxValue);
+            for(; x + 2 <= width; x += 2) {
+                int v0 = format == ImageSet::FORMAT_8_BIT_MONO ? src[x] : src16[x];
+                int v1 = format == ImageSet::FORMAT_8_BIT_MONO ? src[x + 1] : src16[x + 1];
+                __m128d col = _mm_div_pd(_mm_cvtepi32_pd(_mm_setr_epi32(v0, v1, 0, 0)), divisor);
+
+                // c0 c0 | c0 c1 | c1 c1
+                _mm_storeu_pd(&dst[3*x], _mm_unpacklo_pd(col, col));
+                _mm_storeu_pd(&dst[3*x + 2], col);
+                _mm_storeu_pd(&dst[3*x + 4], _mm_unpackhi_pd(col, col));
+            }
+#endif
+            for(; x < width; x++) {
+                double col = double(format == ImageSet::FORMAT_8_BIT_MONO ? src[x] : src16[x]) / maxValue;
+                dst[3*x] = dst[3*x + 1] = dst[3*x + 2] = col;
+            }
+            break;
+        }
+        case ImageSet::FORMAT_8_BIT_RGB: {
+            // The channels are already interleaved, and only need to be scaled
+#if defined(__SSE2__) || defined(__AVX2__)
+            const __m128d divisor = _mm_set1_pd(0xFF);
+            const __m128i zero = _mm_setzero_si128();
+            for(; x + 4 <= 3*width; x += 4) {
+                int bytes;
+                memcpy(&bytes, &src[x], sizeof(bytes));
+                __m128i values = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero), zero);
+                _mm_storeu_pd(&dst[x], _mm_div_pd(_mm_cvtepi32_pd(values), divisor));
+                _mm_storeu_pd(&dst[x + 2], _mm_div_pd(_mm_cvtepi32_pd(_mm_srli_si128(values, 8)), divisor));
+            }
+#endif
+            for(; x < 3*width; x++) {
+                dst[x] = double(src[x]) / 0xFF;
+            }
+            break;
+        }
+        default:
+            throw std::runtime_error("Illegal pixel format");
     }
+}
 
-    if(imageSet.getPixelFormat(ImageSet::IMAGE_DISPARITY) != ImageSet::FORMAT_12_BIT_MONO) {
-        throw std::runtime_error("Disparity map must have 12-bit pixel format!");
+void Reconstruct3D::Pimpl::convertRowToRgb(const unsigned char* src, ImageSet::ImageFormat format,
+        int width, unsigned char* dst) {
+    int x = 0;
+    switch(format) {
+        case ImageSet::FORMAT_8_BIT_RGB:
+            memcpy(dst, src, 3*width);
+            break;
+        case ImageSet::FORMAT_8_BIT_MONO:
+        case ImageSet::FORMAT_12_BIT_MONO: {
+            const unsigned short* src16 = reinterpret_cast<const unsigned short*>(src);
+#ifdef __SSSE3__
+            // Triplicates each of 16 gray values into 48 bytes of RGB
+            const __m128i shuffle0 = _mm_setr_epi8(0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5);
+            const __m128i shuffle1 = _mm_setr_epi8(5, 5, 6, 6, 6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10);
+            const __m128i shuffle2 = _mm_setr_epi8(10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 14, 14, 14, 15, 15, 15);
+            for(; x + 16 <= width; x += 16) {
+                __m128i gray;
+                if(format == ImageSet::FORMAT_8_BIT_MONO) {
+                    gray = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src[x]));
+                } else {
+                    gray = _mm_packus_epi16(
+                        _mm_srli_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&src16[x])), 4),
+                        _mm_srli_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&src16[x + 8])), 4));
+                }
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(&dst[3*x]), _mm_shuffle_epi8(gray, shuffle0));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(&dst[3*x + 16]), _mm_shuffle_epi8(gray, shuffle1));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(&dst[3*x + 32]), _mm_shuffle_epi8(gray, shuffle2));
+            }
+#endif
+            for(; x < width; x++) {
+                unsigned char gray = format == ImageSet::FORMAT_8_BIT_MONO ? src[x]
+                    : static_cast<unsigned char>(std::min(src16[x] >> 4, 0xFF));
+                dst[3*x] = dst[3*x + 1] = dst[3*x + 2] = gray;
+            }
+            break;
+        }
+        default:
+            throw std::runtime_error("Illegal pixel format");
     }
-
-    return createPointMap(reinterpret_cast<unsigned short*>(imageSet.getPixelData(ImageSet::IMAGE_DISPARITY)), imageSet.getWidth(),
-        imageSet.getHeight(), imageSet.getRowStride(ImageSet::IMAGE_DISPARITY), imageSet.getQMatrix(), minDisparity,
-        imageSet.getSubpixelFactor(), maxDisparity);
 }
 
-float* Reconstruct3D::Pimpl::createPointMapFallback(const unsigned short* dispMap, int width,
-        int height, int rowStride, const float* q, unsigned short minDisparity,
-        int subpixelFactor, unsigned short maxDisparity) {
-    // Code without SSE or AVX optimization
-    float* outputPtr = &pointMap[0];
-    int stride = rowStride / 2;
+float* Reconstruct3D::Pimpl::createNormalMap(const ImageSet& imageSet, unsigned short minDisparity,
+        unsigned short maxDisparity, float discontinuityThreshold) {
+    checkDisparityMap(imageSet);
 
-    double dInvalid;
-    if(minDisparity == 0) {
-        // Manually force invalid points to +inf, so that this works even
-        // for for angled cameras
-        dInvalid = std::numeric_limits<double>::infinity();
-    } else {
-        // Set invalid disparity to minimum disparity
-        dInvalid = double(minDisparity) / double(subpixelFactor);
+    int width = imageSet.getWidth();
+    int height = imageSet.getHeight();
+    int rowStride = imageSet.getRowStride(ImageSet::IMAGE_DISPARITY);
+    const unsigned short* dispMap = reinterpret_cast<const unsigned short*>(imageSet.getPixelData(ImageSet::IMAGE_DISPARITY));
+    int subpixelFactor = imageSet.getSubpixelFactor();
+    const ProjectionCache& projection = getProjectionCache(cameraProjectionCache,
+        imageSet.getQMatrix(), width, height, subpixelFactor);
+
+    // The points are stored in three planes with a border of one invalid
+    // pixel, such that no special handling is required at the image borders
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    int paddedWidth = width + 2;
+    size_t planeSize = size_t(paddedWidth) * (height + 2);
+    if(normalPoints.size() != 3*planeSize) {
+        normalPoints.resize(3*planeSize);
+    }
+    for(int c = 0; c < 3; c++) {
+        float* plane = &normalPoints[c*planeSize];
+        std::fill(plane, plane + paddedWidth, nan);
+        std::fill(plane + planeSize - paddedWidth, plane + planeSize, nan);
     }
 
-    for(int y = 0; y < height; y++) {
-        double qx = q[1]*y + q[3];
-        double qy = q[5]*y + q[7];
-        double qz = q[9]*y + q[11];
-        double qw = q[13]*y + q[15];
+    if(normalMap.size() < size_t(3)*width*height) {
+        normalMap.resize(size_t(3)*width*height);
+    }
 
-        const unsigned short* dispRow = &dispMap[y*stride];
-        for(int x = 0; x < width; x++) {
-            unsigned short intDisp = std::max(minDisparity, dispRow[x]);
-            double d;
+    // A disparity of 0 is always invalid
+    minDisparity = std::max(minDisparity, static_cast<unsigned short>(1));
+
+    // Normals are estimated in the camera frame, such that the depth can be
+    // used for detecting discontinuities. The crop box is hence transformed
+    // into the camera frame, and the normals into the output frame.
+    CropBox cameraCropBox;
+    const CropBox* crop = getCameraCropBox(cameraCropBox);
+
+    threadPool.parallelFor(height, [&](int, int startRow, int stopRow) {
+        for(int y = startRow; y < stopRow; y++) {
+            const unsigned short* dispRow = reinterpret_cast<const unsigned short*>(
+                &reinterpret_cast<const unsigned char*>(dispMap)[y*rowStride]);
+            size_t offset = size_t(y + 1)*paddedWidth;
+            float* xRow = &normalPoints[offset];
+            float* yRow = &normalPoints[planeSize + offset];
+            float* zRow = &normalPoints[2*planeSize + offset];
+
+            xRow[0] = yRow[0] = zRow[0] = nan;
+            xRow[width + 1] = yRow[width + 1] = zRow[width + 1] = nan;
+            evaluateRow(dispRow, width, y, projection, 0, maxDisparity,
+                xRow + 1, yRow + 1, zRow + 1, crop);
+
+            // Mark invalid points
+            for(int x = 0; x < width; x++) {
+                if(dispRow[x] < minDisparity || dispRow[x] >= maxDisparity
+                        || !(zRow[x + 1] > 0 && zRow[x + 1] < std::numeric_limits<float>::infinity())) {
+                    xRow[x + 1] = yRow[x + 1] = zRow[x + 1] = nan;
+                }
+            }
+        }
+    });
+
+    // Estimate the normals once all points are available
+    allocateRowBuffers(width, 3);
+    threadPool.parallelFor(height, [&](int band, int startRow, int stopRow) {
+        float* nxRow = getRowBuffer(band, 0);
+        float* nyRow = getRowBuffer(band, 1);
+        float* nzRow = getRowBuffer(band, 2);
+
+        for(int y = startRow; y < stopRow; y++) {
+            const float* planes[3];
+            for(int c = 0; c < 3; c++) {
+                planes[c] = &normalPoints[c*planeSize + size_t(y + 1)*paddedWidth + 1];
+            }
+            computeNormalRow(planes, paddedWidth, width, discontinuityThreshold, nxRow, nyRow, nzRow);
+
+            if(hasTransformation) {
+                const float* r = transformation;
+                for(int x = 0; x < width; x++) {
+                    float nx = nxRow[x], ny = nyRow[x], nz = nzRow[x];
+                    nxRow[x] = r[0]*nx + r[1]*ny + r[2]*nz;
+                    nyRow[x] = r[4]*nx + r[5]*ny + r[6]*nz;
+                    nzRow[x] = r[8]*nx + r[9]*ny + r[10]*nz;
+                }
+            }
+            storeRowXYZ(nxRow, nyRow, nzRow, width, &normalMap[size_t(3)*width*y]);
+        }
+    });
 
-            if(intDisp >= maxDisparity) {
-                d = dInvalid;
+    return &normalMap[0];
+}
+
+void Reconstruct3D::Pimpl::computeNormalRow(const float* const* planes, int stride, int width,
+        float threshold, float* nxRow, float* nyRow, float* nzRow) {
+    const float* px = planes[0];
+    const float* py = planes[1];
+    const float* pz = planes[2];
+
+    int x = 0;
+#if defined(__SSE2__) || defined(__AVX2__)
+    const __m128 thresholdVector = _mm_set1_ps(threshold);
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+    const __m128 nanVector = _mm_set1_ps(std::numeric_limits<float>::quiet_NaN());
+
+    for(; x + 4 <= width; x += 4) {
+        __m128 cx = _mm_loadu_ps(&px[x]), cy = _mm_loadu_ps(&py[x]), cz = _mm_loadu_ps(&pz[x]);
+        __m128 maxDiff = _mm_mul_ps(cz, thresholdVector);
+
+        // Tangent along the row
+        __m128 lx = _mm_loadu_ps(&px[x - 1]), ly = _mm_loadu_ps(&py[x - 1]), lz = _mm_loadu_ps(&pz[x - 1]);
+        __m128 rx = _mm_loadu_ps(&px[x + 1]), ry = _mm_loadu_ps(&py[x + 1]), rz = _mm_loadu_ps(&pz[x + 1]);
+        __m128 validL = _mm_cmple_ps(_mm_and_ps(_mm_sub_ps(lz, cz), absMask), maxDiff);
+        __m128 validR = _mm_cmple_ps(_mm_and_ps(_mm_sub_ps(rz, cz), absMask), maxDiff);
+        __m128 hx, hy, hz;
+        selectTangent(validL, validR, lx, ly, lz, cx, cy, cz, rx, ry, rz, nanVector, hx, hy, hz);
+
+        // Tangent along the column
+        __m128 ux = _mm_loadu_ps(&px[x - stride]), uy = _mm_loadu_ps(&py[x - stride]), uz = _mm_loadu_ps(&pz[x - stride]);
+        __m128 dx = _mm_loadu_ps(&px[x + stride]), dy = _mm_loadu_ps(&py[x + stride]), dz = _mm_loadu_ps(&pz[x + stride]);
+        __m128 validU = _mm_cmple_ps(_mm_and_ps(_mm_sub_ps(uz, cz), absMask), maxDiff);
+        __m128 validD = _mm_cmple_ps(_mm_and_ps(_mm_sub_ps(dz, cz), absMask), maxDiff);
+        __m128 vx, vy, vz;
+        selectTangent(validU, validD, ux, uy, uz, cx, cy, cz, dx, dy, dz, nanVector, vx, vy, vz);
+
+        // Cross product and normalization
+        __m128 nx = _mm_sub_ps(_mm_mul_ps(hy, vz), _mm_mul_ps(hz, vy));
+        __m128 ny = _mm_sub_ps(_mm_mul_ps(hz, vx), _mm_mul_ps(hx, vz));
+        __m128 nz = _mm_sub_ps(_mm_mul_ps(hx, vy), _mm_mul_ps(hy, vx));
+        __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz)));
+
+        // Orient the normal towards the camera
+        __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)), _mm_mul_ps(nz, cz));
+        __m128 flip = _mm_and_ps(_mm_cmpgt_ps(dot, _mm_setzero_ps()), signMask);
+        __m128 invLen = _mm_xor_ps(_mm_div_ps(_mm_set1_ps(1.0f), len), flip);
+
+        _mm_storeu_ps(&nxRow[x], _mm_mul_ps(nx, invLen));
+        _mm_storeu_ps(&nyRow[x], _mm_mul_ps(ny, invLen));
+        _mm_storeu_ps(&nzRow[x], _mm_mul_ps(nz, invLen));
+    }
+#endif
+
+    for(; x < width; x++) {
+        float maxDiff = pz[x] * threshold;
+        float h[3], v[3];
+        const int offsets[2][2] = {{-1, 1}, {-stride, stride}};
+        for(int dir = 0; dir < 2; dir++) {
+            float* t = dir == 0 ? h : v;
+            int prev = x + offsets[dir][0], next = x + offsets[dir][1];
+            bool validPrev = std::fabs(pz[prev] - pz[x]) <= maxDiff;
+            bool validNext = std::fabs(pz[next] - pz[x]) <= maxDiff;
+            int from = validPrev ? prev : x;
+            int to = validNext ? next : x;
+            if(from == to) {
+                t[0] = t[1] = t[2] = std::numeric_limits<float>::quiet_NaN();
             } else {
-                d = double(intDisp) / double(subpixelFactor);
+                t[0] = px[to] - px[from];
+                t[1] = py[to] - py[from];
+                t[2] = pz[to] - pz[from];
             }
+        }
 
-            double w = qw + q[14]*d;
-
-            *outputPtr = static_cast<float>((qx + q[2]*d)/w); // x
-            outputPtr++;
+        float nx = h[1]*v[2] - h[2]*v[1];
+        float ny = h[2]*v[0] - h[0]*v[2];
+        float nz = h[0]*v[1] - h[1]*v[0];
+        float invLen = 1.0f / std::sqrt(nx*nx + ny*ny + nz*nz);
+        if(nx*px[x] + ny*py[x] + nz*pz[x] > 0) {
+            invLen = -invLen;
+        }
+        nxRow[x] = nx * invLen;
+        nyRow[x] = ny * invLen;
+        nzRow[x] = nz * invLen;
+    }
+}
 
-            *outputPtr = static_cast<float>((qy + q[6]*d)/w); // y
-            outputPtr++;
+#if defined(__SSE2__) || defined(__AVX2__)
+void Reconstruct3D::Pimpl::selectTangent(__m128 validPrev, __m128 validNext,
+        __m128 prevX, __m128 prevY, __m128 prevZ, __m128 centerX, __m128 centerY, __m128 centerZ,
+        __m128 nextX, __m128 nextY, __m128 nextZ, __m128 nanVector,
+        __m128& tx, __m128& ty, __m128& tz) {
+    // Use the central difference if possible, and one-sided differences otherwise
+    __m128 fromX = _mm_or_ps(_mm_and_ps(validPrev, prevX), _mm_andnot_ps(validPrev, centerX));
+    __m128 fromY = _mm_or_ps(_mm_and_ps(validPrev, prevY), _mm_andnot_ps(validPrev, centerY));
+    __m128 fromZ = _mm_or_ps(_mm_and_ps(validPrev, prevZ), _mm_andnot_ps(validPrev, centerZ));
+    __m128 toX = _mm_or_ps(_mm_and_ps(validNext, nextX), _mm_andnot_ps(validNext, centerX));
+    __m128 toY = _mm_or_ps(_mm_and_ps(validNext, nextY), _mm_andnot_ps(validNext, centerY));
+    __m128 toZ = _mm_or_ps(_mm_and_ps(validNext, nextZ), _mm_andnot_ps(validNext, centerZ));
+
+    // No valid neighbour at all
+    __m128 invalid = _mm_castsi128_ps(_mm_cmpeq_epi32(
+        _mm_castps_si128(_mm_or_ps(validPrev, validNext)), _mm_setzero_si128()));
+
+    tx = _mm_or_ps(_mm_sub_ps(toX, fromX), _mm_and_ps(invalid, nanVector));
+    ty = _mm_or_ps(_mm_sub_ps(toY, fromY), _mm_and_ps(invalid, nanVector));
+    tz = _mm_or_ps(_mm_sub_ps(toZ, fromZ), _mm_and_ps(invalid, nanVector));
+}
+#endif
 
-            *outputPtr = static_cast<float>((qz + q[10]*d)/w); // z
-            outputPtr+=2; // Consider padding
+const Reconstruct3D::Pimpl::CropBox* Reconstruct3D::Pimpl::getCameraCropBox(CropBox& cameraCropBox) const {
+    if(!hasCropBox || !hasTransformation) {
+        return getCropBox();
+    }
 
-            qx += q[0];
-            qy += q[4];
-            qz += q[8];
-            qw += q[12];
+    // Concatenate the crop box matrix with the transformation into the output frame
+    cameraCropBox = cropBox;
+    for(int row = 0; row < 3; row++) {
+        for(int col = 0; col < 4; col++) {
+            double sum = col == 3 ? cropBox.matrix[4*row + 3] : 0.0;
+            for(int i = 0; i < 3; i++) {
+                sum += double(cropBox.matrix[4*row + i]) * transformation[4*i + col];
+            }
+            cameraCropBox.matrix[4*row + col] = static_cast<float>(sum);
         }
     }
-    return &pointMap[0];
+    return &cameraCropBox;
 }
 
-float* Reconstruct3D::Pimpl::createZMap(const ImageSet& imageSet, unsigned short minDisparity,
-        unsigned short maxDisparity) {
-    // Allocate the buffer
-    if(pointMap.size() < static_cast<unsigned int>(imageSet.getWidth()*imageSet.getHeight())) {
-        pointMap.resize(imageSet.getWidth()*imageSet.getHeight());
+float* Reconstruct3D::Pimpl::createMesh(const ImageSet& imageSet, int& numVertices,
+        const int** triangles, int& numTriangles, const unsigned char** colors,
+        ColorSource colSource, int decimation, float discontinuityThreshold,
+        unsigned short minDisparity, unsigned short maxDisparity) {
+    checkDisparityMap(imageSet);
+    if(decimation < 1) {
+        throw std::runtime_error("Mesh decimation must be positive!");
     }
 
-    float* outputPtr = &pointMap[0];
-    int stride = imageSet.getRowStride(ImageSet::IMAGE_DISPARITY) / 2;
+    int width = imageSet.getWidth();
+    int height = imageSet.getHeight();
+    int rowStride = imageSet.getRowStride(ImageSet::IMAGE_DISPARITY);
     const unsigned short* dispMap = reinterpret_cast<const unsigned short*>(imageSet.getPixelData(ImageSet::IMAGE_DISPARITY));
     int subpixelFactor = imageSet.getSubpixelFactor();
-    const float* q = imageSet.getQMatrix();
+    const ProjectionCache& projection = getProjectionCache(cameraProjectionCache,
+        imageSet.getQMatrix(), width, height, subpixelFactor);
+
+    // Find color image, if requested
+    const unsigned char* image = nullptr;
+    ImageSet::ImageFormat imageFormat = ImageSet::FORMAT_8_BIT_MONO;
+    int imageRowStride = 0;
+    if(colors != nullptr && colSource != COLOR_NONE) {
+        ImageSet::ImageType colImg = getColorImage(imageSet, colSource);
+        if(imageSet.hasImageType(colImg)) {
+            image = imageSet.getPixelData(colImg);
+            imageFormat = imageSet.getPixelFormat(colImg);
+            imageRowStride = imageSet.getRowStride(colImg);
+        }
+    }
 
-    double dInvalid;
-    if(minDisparity == 0) {
-        // Manually force invalid points to +inf, so that this works even
-        // for for angled cameras
-        dInvalid = std::numeric_limits<double>::infinity();
-    } else {
-        // Set invalid disparity to minimum disparity
-        dInvalid = double(minDisparity) / double(subpixelFactor);
+    // Vertices are taken from a grid of every n-th pixel. The triangle masks
+    // of the grid squares are stored with a border of empty squares, such
+    // that the squares around each grid point can be looked up without
+    // special handling at the borders.
+    int gridWidth = (width - 1) / decimation + 1;
+    int gridHeight = (height - 1) / decimation + 1;
+    size_t gridSize = size_t(gridWidth) * gridHeight;
+    int quadStride = gridWidth + 1;
+    if(meshGrid.size() < 3*gridSize) {
+        meshGrid.resize(3*gridSize);
+    }
+    if(meshVertexIndices.size() < gridSize) {
+        meshVertexIndices.resize(gridSize);
+    }
+    meshQuads.resize(size_t(quadStride) * (gridHeight + 1));
+    std::fill(meshQuads.begin(), meshQuads.begin() + quadStride, 0);
+    std::fill(meshQuads.end() - quadStride, meshQuads.end(), 0);
+
+    int numBands = threadPool.getNumThreads();
+    if(image != nullptr) {
+        if(colorRowBuffers.size() < size_t(3)*width*numBands) {
+            colorRowBuffers.resize(size_t(3)*width*numBands);
+        }
+        if(meshGridColors.size() < 3*gridSize) {
+            meshGridColors.resize(3*gridSize);
+        }
     }
 
-    for(int y = 0; y < imageSet.getHeight(); y++) {
-        double qz = q[9]*y + q[11];
-        double qw = q[13]*y + q[15];
+    // A disparity of 0 is always invalid
+    minDisparity = std::max(minDisparity, static_cast<unsigned short>(1));
+
+    // The mesh is built in the camera frame, such that the depth can be used
+    // for detecting discontinuities. The crop box is hence transformed into
+    // the camera frame, and the vertices into the output frame.
+    CropBox cameraCropBox;
+    const CropBox* crop = getCameraCropBox(cameraCropBox);
+    float* gridX = &meshGrid[0];
+    float* gridY = &meshGrid[gridSize];
+    float* gridZ = &meshGrid[2*gridSize];
+
+    allocateRowBuffers(width, 3);
+    threadPool.parallelFor(gridHeight, [&](int band, int startRow, int stopRow) {
+        float* xRow = getRowBuffer(band, 0);
+        float* yRow = getRowBuffer(band, 1);
+        float* zRow = getRowBuffer(band, 2);
+        unsigned char* rgbRow = image != nullptr ? &colorRowBuffers[size_t(3)*width*band] : nullptr;
+
+        for(int gy = startRow; gy < stopRow; gy++) {
+            int y = gy * decimation;
+            const unsigned short* dispRow = reinterpret_cast<const unsigned short*>(
+                &reinterpret_cast<const unsigned char*>(dispMap)[y*rowStride]);
+            size_t offset = size_t(gy) * gridWidth;
+            evaluateRow(dispRow, width, y, projection, 0, maxDisparity, xRow, yRow, zRow, crop);
+            sampleGridRow(dispRow, xRow, yRow, zRow, gridWidth, decimation, minDisparity,
+                maxDisparity, &gridX[offset], &gridY[offset], &gridZ[offset]);
+
+            if(rgbRow != nullptr) {
+                convertRowToRgb(&image[y*imageRowStride], imageFormat, width, rgbRow);
+                unsigned char* dst = &meshGridColors[3*offset];
+                for(int gx = 0; gx < gridWidth; gx++) {
+                    memcpy(&dst[3*gx], &rgbRow[3*gx*decimation], 3);
+                }
+            }
+        }
+    });
+
+    // Determine the valid triangles of each grid square
+    std::vector<int> bandTriangles(numBands, 0);
+    threadPool.parallelFor(gridHeight - 1, [&](int band, int startRow, int stopRow) {
+        for(int gy = startRow; gy < stopRow; gy++) {
+            unsigned char* quadRow = &meshQuads[size_t(gy + 1)*quadStride];
+            quadRow[0] = quadRow[gridWidth] = 0;
+            bandTriangles[band] += computeQuadRow(&gridZ[size_t(gy)*gridWidth],
+                &gridZ[size_t(gy + 1)*gridWidth], gridWidth - 1, discontinuityThreshold,
+                quadRow + 1);
+        }
+    });
+
+    // Number all grid points that belong to at least one triangle. Point (x, y) is
+    // the first corner of the first triangle in square (x, y), a corner of both
+    // triangles in squares (x - 1, y) and (x, y - 1), and the last corner of the
+    // second triangle in square (x - 1, y - 1).
+    std::vector<int> bandVertices(numBands, 0);
+    threadPool.parallelFor(gridHeight, [&](int band, int startRow, int stopRow) {
+        int count = 0;
+        for(int gy = startRow; gy < stopRow; gy++) {
+            const unsigned char* above = &meshQuads[size_t(gy)*quadStride];
+            const unsigned char* below = &meshQuads[size_t(gy + 1)*quadStride];
+            int* indices = &meshVertexIndices[size_t(gy)*gridWidth];
+            for(int gx = 0; gx < gridWidth; gx++) {
+                int used = ((below[gx + 1] & 1) | below[gx] | above[gx + 1] | (above[gx] & 2)) != 0;
+                indices[gx] = used ? count : -1;
+                count += used;
+            }
+        }
+        bandVertices[band] = count;
+    });
+
+    // Offsets of each band in the output arrays
+    std::vector<int> vertexOffsets(numBands, 0), triangleOffsets(numBands, 0);
+    numVertices = numTriangles = 0;
+    for(int band = 0; band < numBands; band++) {
+        vertexOffsets[band] = numVertices;
+        triangleOffsets[band] = numTriangles;
+        numVertices += bandVertices[band];
+        numTriangles += bandTriangles[band];
+    }
 
-        const unsigned short* dispRow = &dispMap[y*stride];
-        for(int x = 0; x < imageSet.getWidth(); x++) {
-            unsigned short intDisp = std::max(minDisparity, dispRow[x]);
-            double d;
+    if(meshVertices.size() < size_t(3)*numVertices) {
+        meshVertices.resize(size_t(3)*numVertices);
+    }
+    if(meshTriangles.size() < size_t(3)*numTriangles) {
+        meshTriangles.resize(size_t(3)*numTriangles);
+    }
+    if(image != nullptr && meshColors.size() < size_t(3)*numVertices) {
+        meshColors.resize(size_t(3)*numVertices);
+    }
 
-            if(intDisp >= maxDisparity) {
-                d = dInvalid;
-            } else {
-                d = double(intDisp) / double(subpixelFactor);
-            }
+    // Write the vertices and convert the vertex indices from band to mesh indices
+    threadPool.parallelFor(gridHeight, [&](int band, int startRow, int stopRow) {
+        int vertexOffset = vertexOffsets[band];
+        const float* r = transformation;
+        for(int gy = startRow; gy < stopRow; gy++) {
+            size_t offset = size_t(gy) * gridWidth;
+            int* indices = &meshVertexIndices[offset];
+            for(int gx = 0; gx < gridWidth; gx++) {
+                if(indices[gx] < 0) {
+                    continue;
+                }
 
-            double w = qw + q[14]*d;
+                int index = (indices[gx] += vertexOffset);
+                float x = gridX[offset + gx], y = gridY[offset + gx], z = gridZ[offset + gx];
+                float* dst = &meshVertices[size_t(3)*index];
+                if(hasTransformation) {
+                    dst[0] = r[0]*x + r[1]*y + r[2]*z + r[3];
+                    dst[1] = r[4]*x + r[5]*y + r[6]*z + r[7];
+                    dst[2] = r[8]*x + r[9]*y + r[10]*z + r[11];
+                } else {
+                    dst[0] = x;
+                    dst[1] = y;
+                    dst[2] = z;
+                }
+                if(image != nullptr) {
+                    memcpy(&meshColors[size_t(3)*index], &meshGridColors[3*(offset + gx)], 3);
+                }
+            }
+        }
+    });
+
+    // Emit the triangles, with the same bands as for counting them
+    threadPool.parallelFor(gridHeight - 1, [&](int band, int startRow, int stopRow) {
+        int* dst = numTriangles > 0 ? &meshTriangles[size_t(3)*triangleOffsets[band]] : nullptr;
+        for(int gy = startRow; gy < stopRow; gy++) {
+            const unsigned char* quadRow = &meshQuads[size_t(gy + 1)*quadStride + 1];
+            const int* top = &meshVertexIndices[size_t(gy)*gridWidth];
+            const int* bottom = &meshVertexIndices[size_t(gy + 1)*gridWidth];
+            for(int gx = 0; gx < gridWidth - 1; gx++) {
+                if(quadRow[gx] & 1) {
+                    dst[0] = top[gx];
+                    dst[1] = bottom[gx];
+                    dst[2] = top[gx + 1];
+                    dst += 3;
+                }
+                if(quadRow[gx] & 2) {
+                    dst[0] = top[gx + 1];
+                    dst[1] = bottom[gx];
+                    dst[2] = bottom[gx + 1];
+                    dst += 3;
+                }
+            }
+        }
+    });
 
-            *outputPtr = static_cast<float>((qz + q[10]*d)/w); // z
-            outputPtr++;
+    if(triangles != nullptr) {
+        *triangles = numTriangles > 0 ? &meshTriangles[0] : nullptr;
+    }
+    if(colors != nullptr) {
+        *colors = image != nullptr && numVertices > 0 ? &meshColors[0] : nullptr;
+    }
+    return numVertices > 0 ? &meshVertices[0] : nullptr;
+}
 
-            qz += q[8];
+void Reconstruct3D::Pimpl::sampleGridRow(const unsigned short* dispRow, const float* xRow,
+        const float* yRow, const float* zRow, int gridWidth, int step,
+        unsigned short minDisparity, unsigned short maxDisparity,
+        float* gridX, float* gridY, float* gridZ) {
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    int gx = 0;
+
+#if defined(__SSE2__) || defined(__AVX2__)
+    if(step == 1) {
+        const __m128i minDispVector = _mm_set1_epi32(minDisparity);
+        const __m128i maxDispVector = _mm_set1_epi32(maxDisparity);
+        const __m128i zeroVector = _mm_setzero_si128();
+        const __m128 infVector = _mm_set1_ps(std::numeric_limits<float>::infinity());
+        const __m128 nanVector = _mm_set1_ps(nan);
+
+        for(; gx + 4 <= gridWidth; gx += 4) {
+            __m128i disparities = _mm_unpacklo_epi16(
+                _mm_loadl_epi64(reinterpret_cast<const __m128i*>(&dispRow[gx])), zeroVector);
+            __m128 dispValid = _mm_castsi128_ps(_mm_andnot_si128(
+                _mm_cmplt_epi32(disparities, minDispVector), _mm_cmplt_epi32(disparities, maxDispVector)));
+
+            __m128 pz = _mm_loadu_ps(&zRow[gx]);
+            __m128 valid = _mm_and_ps(dispValid, _mm_and_ps(
+                _mm_cmpgt_ps(pz, _mm_setzero_ps()), _mm_cmplt_ps(pz, infVector)));
+
+            _mm_storeu_ps(&gridX[gx], _mm_loadu_ps(&xRow[gx]));
+            _mm_storeu_ps(&gridY[gx], _mm_loadu_ps(&yRow[gx]));
+            _mm_storeu_ps(&gridZ[gx], _mm_or_ps(_mm_and_ps(valid, pz), _mm_andnot_ps(valid, nanVector)));
         }
     }
-    return &pointMap[0];
+#endif
+
+    // Invalid points receive a NaN depth
+    for(; gx < gridWidth; gx++) {
+        int x = gx * step;
+        float z = zRow[x];
+        bool valid = dispRow[x] >= minDisparity && dispRow[x] < maxDisparity
+            && z > 0 && z < std::numeric_limits<float>::infinity();
+        gridX[gx] = xRow[x];
+        gridY[gx] = yRow[x];
+        gridZ[gx] = valid ? z : nan;
+    }
+}
+
+int Reconstruct3D::Pimpl::computeQuadRow(const float* topRow, const float* bottomRow,
+        int numQuads, float threshold, unsigned char* quads) {
+    // Square x has the corners a = (x, y), b = (x + 1, y), c = (x, y + 1) and
+    // d = (x + 1, y + 1), and is split into triangles (a, c, b) and (b, c, d).
+    // Bit 0 of the mask is set if the first triangle is valid, and bit 1 if
+    // the second triangle is valid.
+    int count = 0;
+    int x = 0;
+
+#if defined(__SSE2__) || defined(__AVX2__)
+    static const int bitCounts[16] = {0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4};
+    const __m128 thresholdVector = _mm_set1_ps(threshold);
+    const __m128i firstBit = _mm_set1_epi32(1);
+    const __m128i secondBit = _mm_set1_epi32(2);
+
+    for(; x + 4 <= numQuads; x += 4) {
+        __m128 za = _mm_loadu_ps(&topRow[x]);
+        __m128 zb = _mm_loadu_ps(&topRow[x + 1]);
+        __m128 zc = _mm_loadu_ps(&bottomRow[x]);
+        __m128 zd = _mm_loadu_ps(&bottomRow[x + 1]);
+
+        // Invalid corners have a NaN depth, which fails the ordered comparison
+        __m128 minBC = _mm_min_ps(zb, zc);
+        __m128 maxBC = _mm_max_ps(zb, zc);
+        __m128 validBC = _mm_cmpord_ps(zb, zc);
+
+        __m128 min1 = _mm_min_ps(za, minBC);
+        __m128 max1 = _mm_max_ps(za, maxBC);
+        __m128 valid1 = _mm_and_ps(_mm_and_ps(validBC, _mm_cmpord_ps(za, za)),
+            _mm_cmple_ps(_mm_sub_ps(max1, min1), _mm_mul_ps(min1, thresholdVector)));
+
+        __m128 min2 = _mm_min_ps(zd, minBC);
+        __m128 max2 = _mm_max_ps(zd, maxBC);
+        __m128 valid2 = _mm_and_ps(_mm_and_ps(validBC, _mm_cmpord_ps(zd, zd)),
+            _mm_cmple_ps(_mm_sub_ps(max2, min2), _mm_mul_ps(min2, thresholdVector)));
+
+        __m128i mask = _mm_or_si128(_mm_and_si128(_mm_castps_si128(valid1), firstBit),
+            _mm_and_si128(_mm_castps_si128(valid2), secondBit));
+        mask = _mm_packus_epi16(_mm_packs_epi32(mask, mask), mask);
+        int packed = _mm_cvtsi128_si32(mask);
+        memcpy(&quads[x], &packed, 4);
+
+        count += bitCounts[_mm_movemask_ps(valid1)] + bitCounts[_mm_movemask_ps(valid2)];
+    }
+#endif
+
+    for(; x < numQuads; x++) {
+        float za = topRow[x], zb = topRow[x + 1], zc = bottomRow[x], zd = bottomRow[x + 1];
+        bool validBC = zb == zb && zc == zc;
+        float minBC = std::min(zb, zc), maxBC = std::max(zb, zc);
+
+        float min1 = std::min(za, minBC), max1 = std::max(za, maxBC);
+        bool valid1 = validBC && za == za && max1 - min1 <= min1 * threshold;
+        float min2 = std::min(zd, minBC), max2 = std::max(zd, maxBC);
+        bool valid2 = validBC && zd == zd && max2 - min2 <= min2 * threshold;
+
+        quads[x] = static_cast<unsigned char>(valid1 | (valid2 << 1));
+        count += valid1 + valid2;
+    }
+
+    return count;
 }
 
 void Reconstruct3D::Pimpl::projectSinglePoint(int imageX, int imageY, unsigned short disparity,
@@ -294,31 +2801,44 @@ void Reconstruct3D::Pimpl::projectSinglePoint(int imageX, int imageY, unsigned s
 
     double d = disparity / double(subpixelFactor);
     double w = q[15] + q[14]*d;
-    pointX = static_cast<float>((imageX*q[0] + q[3])/w);
-    pointY = static_cast<float>((imageY*q[5] + q[7])/w);
-    pointZ = static_cast<float>(q[11]/w);
+    double x = (imageX*q[0] + q[3])/w;
+    double y = (imageY*q[5] + q[7])/w;
+    double z = q[11]/w;
+
+    if(hasTransformation) {
+        const float* t = transformation;
+        pointX = static_cast<float>(t[0]*x + t[1]*y + t[2]*z + t[3]);
+        pointY = static_cast<float>(t[4]*x + t[5]*y + t[6]*z + t[7]);
+        pointZ = static_cast<float>(t[8]*x + t[9]*y + t[10]*z + t[11]);
+    } else {
+        pointX = static_cast<float>(x);
+        pointY = static_cast<float>(y);
+        pointZ = static_cast<float>(z);
+    }
 }
 
 # ifdef __AVX2__
-float* Reconstruct3D::Pimpl::createPointMapAVX2(const unsigned short* dispMap, int width,
-        int height, int rowStride, const float* q, unsigned short minDisparity,
-        int subpixelFactor, unsigned short maxDisparity) {
+void Reconstruct3D::Pimpl::createPointMapAVX2(const unsigned short* dispMap, int width,
+        int rowStride, const ProjectionCache& projection, unsigned short minDisparity,
+        unsigned short maxDisparity, int startRow, int stopRow) {
 
-    // Create column vectors of q
-    const __m256 qCol0 = _mm256_setr_ps(q[0], q[4], q[8], q[12],   q[0], q[4], q[8], q[12]);
-    const __m256 qCol1 = _mm256_setr_ps(q[1], q[5], q[9], q[13],   q[1], q[5], q[9], q[13]);
+    // Only the disparity-dependent column of q is needed, as the other
+    // terms are taken from the cache
+    const float* q = projection.q;
     const __m256 qCol2 = _mm256_setr_ps(q[2], q[6], q[10], q[14],  q[2], q[6], q[10], q[14]);
-    const __m256 qCol3 = _mm256_setr_ps(q[3], q[7], q[11], q[15],  q[3], q[7], q[11], q[15]);
 
     // More constants that we need
     const __m256i minDispVector = _mm256_set1_epi16(minDisparity);
     const __m256i maxDispVector = _mm256_set1_epi16(maxDisparity);
-    const __m256 scaleVector = _mm256_set1_ps(1.0/double(subpixelFactor));
+    const __m256 scaleVector = _mm256_set1_ps(1.0/double(projection.subpixelFactor));
     const __m256i zeroVector = _mm256_set1_epi16(0);
+    const float* columnVectors = &projection.columnVectors[0];
 
-    float* outputPtr = &pointMap[0];
+    float* outputPtr = &pointMap[4*width*startRow];
 
-    for(int y = 0; y < height; y++) {
+    for(int y = startRow; y < stopRow; y++) {
+        const __m128 rowVector128 = _mm_load_ps(&projection.rowVectors[4*y]);
+        const __m256 rowVector = _mm256_insertf128_ps(_mm256_castps128_ps256(rowVector128), rowVector128, 1);
         const unsigned char* rowStart = &reinterpret_cast<const unsigned char*>(dispMap)[y*rowStride];
         const unsigned char* rowEnd = &reinterpret_cast<const unsigned char*>(dispMap)[y*rowStride + 2*width];
 
@@ -355,22 +2875,11 @@ float* Reconstruct3D::Pimpl::createPointMapAVX2(const unsigned short* dispMap, i
 
             // Iterate over disparities and perform matrix multiplication for each
             for(int i=0; i<16; i+=2) {
-                // Create two vectors
-                __m256 vec = _mm256_setr_ps(x, y, dispArray[i], 1.0,
-                    x+1, y, dispArray[i+1], 1.0);
-
-                // Multiply with matrix
-                __m256 u1 = _mm256_shuffle_ps(vec, vec, _MM_SHUFFLE(0,0,0,0));
-                __m256 u2 = _mm256_shuffle_ps(vec, vec, _MM_SHUFFLE(1,1,1,1));
-                __m256 u3 = _mm256_shuffle_ps(vec, vec, _MM_SHUFFLE(2,2,2,2));
-                __m256 u4 = _mm256_shuffle_ps(vec, vec, _MM_SHUFFLE(3,3,3,3));
-
-                __m256 prod1 = _mm256_mul_ps(u1, qCol0);
-                __m256 prod2 = _mm256_mul_ps(u2, qCol1);
-                __m256 prod3 = _mm256_mul_ps(u3, qCol2);
-                __m256 prod4 = _mm256_mul_ps(u4, qCol3);
-
-                __m256 multResult = _mm256_add_ps(_mm256_add_ps(prod1, prod2), _mm256_add_ps(prod3, prod4));
+                // Add the disparity-dependent terms of two points to the cached terms
+                __m256 u3 = _mm256_setr_ps(dispArray[i], dispArray[i], dispArray[i], dispArray[i],
+                    dispArray[i+1], dispArray[i+1], dispArray[i+1], dispArray[i+1]);
+                __m256 multResult = _mm256_add_ps(_mm256_add_ps(_mm256_load_ps(&columnVectors[4*x]), rowVector),
+                    _mm256_mul_ps(u3, qCol2));
 
                 // Divide by w to receive point coordinates
                 __m256 point = _mm256_div_ps(multResult,
@@ -384,31 +2893,30 @@ float* Reconstruct3D::Pimpl::createPointMapAVX2(const unsigned short* dispMap, i
             }
         }
     }
-
-    return &pointMap[0];
 }
 #endif
 
 #ifdef __SSE2__
-float* Reconstruct3D::Pimpl::createPointMapSSE2(const unsigned short* dispMap, int width,
-        int height, int rowStride, const float* q, unsigned short minDisparity,
-        int subpixelFactor, unsigned short maxDisparity) {
+void Reconstruct3D::Pimpl::createPointMapSSE2(const unsigned short* dispMap, int width,
+        int rowStride, const ProjectionCache& projection, unsigned short minDisparity,
+        unsigned short maxDisparity, int startRow, int stopRow) {
 
-    // Create column vectors of q
-    const __m128 qCol0 = _mm_setr_ps(q[0], q[4], q[8], q[12]);
-    const __m128 qCol1 = _mm_setr_ps(q[1], q[5], q[9], q[13]);
+    // Only the disparity-dependent column of q is needed, as the other
+    // terms are taken from the cache
+    const float* q = projection.q;
     const __m128 qCol2 = _mm_setr_ps(q[2], q[6], q[10], q[14]);
-    const __m128 qCol3 = _mm_setr_ps(q[3], q[7], q[11], q[15]);
 
     // More constants that we need
     const __m128i minDispVector = _mm_set1_epi16(minDisparity);
     const __m128i maxDispVector = _mm_set1_epi16(maxDisparity);
-    const __m128 scaleVector = _mm_set1_ps(1.0f/float(subpixelFactor));
+    const __m128 scaleVector = _mm_set1_ps(1.0f/float(projection.subpixelFactor));
     const __m128i zeroVector = _mm_set1_epi16(0);
+    const float* columnVectors = &projection.columnVectors[0];
 
-    float* outputPtr = &pointMap[0];
+    float* outputPtr = &pointMap[4*width*startRow];
 
-    for(int y = 0; y < height; y++) {
+    for(int y = startRow; y < stopRow; y++) {
+        const __m128 rowVector = _mm_load_ps(&projection.rowVectors[4*y]);
         const unsigned char* rowStart = &reinterpret_cast<const unsigned char*>(dispMap)[y*rowStride];
         const unsigned char* rowEnd = &reinterpret_cast<const unsigned char*>(dispMap)[y*rowStride + 2*width];
 
@@ -442,18 +2950,10 @@ float* Reconstruct3D::Pimpl::createPointMapSSE2(const unsigned short* dispMap, i
 
             // Iterate over disparities and perform matrix multiplication for each
             for(int i=0; i<8; i++) {
-                // Create vectors and perform matrix multiplication
-                __m128 u1 = _mm_set1_ps(static_cast<float>(x));
-                __m128 u2 = _mm_set1_ps(static_cast<float>(y));
+                // Add the disparity-dependent term to the cached terms
                 __m128 u3 = _mm_set1_ps(dispArray[i]);
-                __m128 u4 = _mm_set1_ps(1.0f);
-
-                __m128 prod1 = _mm_mul_ps(u1, qCol0);
-                __m128 prod2 = _mm_mul_ps(u2, qCol1);
-                __m128 prod3 = _mm_mul_ps(u3, qCol2);
-                __m128 prod4 = _mm_mul_ps(u4, qCol3);
-
-                __m128 multResult = _mm_add_ps(_mm_add_ps(prod1, prod2), _mm_add_ps(prod3, prod4));
+                __m128 multResult = _mm_add_ps(_mm_add_ps(_mm_load_ps(&columnVectors[4*x]), rowVector),
+                    _mm_mul_ps(u3, qCol2));
 
                 // Divide by w to receive point coordinates
                 __m128 point = _mm_div_ps(multResult,
@@ -467,30 +2967,29 @@ float* Reconstruct3D::Pimpl::createPointMapSSE2(const unsigned short* dispMap, i
             }
         }
     }
-
-    return &pointMap[0];
 }
 #endif
 
 #ifdef __aarch64__
-float* Reconstruct3D::Pimpl::createPointMapNEON(const unsigned short* dispMap, int width,
-        int height, int rowStride, const float* q, unsigned short minDisparity,
-        int subpixelFactor, unsigned short maxDisparity) {
+void Reconstruct3D::Pimpl::createPointMapNEON(const unsigned short* dispMap, int width,
+        int rowStride, const ProjectionCache& projection, unsigned short minDisparity,
+        unsigned short maxDisparity, int startRow, int stopRow) {
 
-    // Create column vectors of q
-    float32x4_t qCol0 = {q[0], q[4], q[8], q[12]};
-    float32x4_t qCol1 = {q[1], q[5], q[9], q[13]};
+    // Only the disparity-dependent column of q is needed, as the other
+    // terms are taken from the cache
+    const float* q = projection.q;
     float32x4_t qCol2 = {q[2], q[6], q[10], q[14]};
-    float32x4_t qCol3 = {q[3], q[7], q[11], q[15]};
 
     // More constants that we need
     uint16x8_t minDispVector = vdupq_n_u16(minDisparity);
     uint16x8_t maxDispVector = vdupq_n_u16(maxDisparity);
-    float32x4_t scaleVector = vdupq_n_f32(1.0f / static_cast<float>(subpixelFactor));
+    float32x4_t scaleVector = vdupq_n_f32(1.0f / static_cast<float>(projection.subpixelFactor));
+    const float* columnVectors = &projection.columnVectors[0];
 
-    float* outputPtr = &pointMap[0];
+    float* outputPtr = &pointMap[4*width*startRow];
 
-    for(int y = 0; y < height; y++) {
+    for(int y = startRow; y < stopRow; y++) {
+        float32x4_t rowVector = vld1q_f32(&projection.rowVectors[4*y]);
         const unsigned char* rowStart = &reinterpret_cast<const unsigned char*>(dispMap)[y*rowStride];
         const unsigned char* rowEnd = &reinterpret_cast<const unsigned char*>(dispMap)[y*rowStride + 2*width];
 
@@ -520,18 +3019,10 @@ float* Reconstruct3D::Pimpl::createPointMapNEON(const unsigned short* dispMap, i
 
             // Iterate over disparities and perform matrix multiplication for each
             for(int i=0; i<8; i++) {
-                // Create vectors and perform matrix multiplication
-                float32x4_t u1 = vdupq_n_f32(static_cast<float>(x));
-                float32x4_t u2 = vdupq_n_f32(static_cast<float>(y));
+                // Add the disparity-dependent term to the cached terms
                 float32x4_t u3 = vdupq_n_f32(dispArray[i]);
-                float32x4_t u4 = vdupq_n_f32(1.0f);
-
-                float32x4_t prod1 = vmulq_f32(u1, qCol0);
-                float32x4_t prod2 = vmulq_f32(u2, qCol1);
-                float32x4_t prod3 = vmulq_f32(u3, qCol2);
-                float32x4_t prod4 = vmulq_f32(u4, qCol3);
-
-                float32x4_t multResult = vaddq_f32(vaddq_f32(prod1, prod2), vaddq_f32(prod3, prod4));
+                float32x4_t multResult = vaddq_f32(vaddq_f32(vld1q_f32(&columnVectors[4*x]), rowVector),
+                    vmulq_f32(u3, qCol2));
 
                 // Divide by w to receive point coordinates
                 float32x4_t point = vdivq_f32(multResult, vdupq_laneq_f32(multResult, 3));
@@ -544,8 +3035,6 @@ float* Reconstruct3D::Pimpl::createPointMapNEON(const unsigned short* dispMap, i
             }
         }
     }
-
-    return &pointMap[0];
 }
 #endif
 
@@ -554,127 +3043,127 @@ void Reconstruct3D::Pimpl::writePlyFile(const char* file, const unsigned short*
         int imageRowStride, const float* q, double maxZ, bool binary, int subpixelFactor,
         unsigned short maxDisparity) {
 
-    float* pointMapTemp = createPointMap(dispMap, width, height, dispRowStride,
-        q, 0, subpixelFactor, maxDisparity);
-
-    // Count number of valid points
-    int pointsCount = 0;
-    if(maxZ >= 0) {
-        for(int i=0; i<width*height; i++) {
-            if(pointMapTemp[4*i+2] <= maxZ && pointMapTemp[4*i+2] > 0) {
-                pointsCount++;
-            }
-        }
-    } else {
-        pointsCount = width*height;
+    // Wrap the given data into an image set without copying
+    ImageSet imageSet;
+    imageSet.setWidth(width);
+    imageSet.setHeight(height);
+    imageSet.setNumberOfImages(image != nullptr ? 2 : 1);
+    imageSet.setIndexOf(ImageSet::IMAGE_DISPARITY, 0);
+    imageSet.setIndexOf(ImageSet::IMAGE_LEFT, image != nullptr ? 1 : -1);
+    imageSet.setIndexOf(ImageSet::IMAGE_RIGHT, -1);
+    imageSet.setIndexOf(ImageSet::IMAGE_COLOR, -1);
+    imageSet.setPixelFormat(0, ImageSet::FORMAT_12_BIT_MONO);
+    imageSet.setRowStride(0, dispRowStride);
+    imageSet.setPixelData(0, reinterpret_cast<unsigned char*>(const_cast<unsigned short*>(dispMap)));
+    if(image != nullptr) {
+        imageSet.setPixelFormat(1, format);
+        imageSet.setRowStride(1, imageRowStride);
+        imageSet.setPixelData(1, const_cast<unsigned char*>(image));
     }
+    imageSet.setQMatrix(q);
+    imageSet.setSubpixelFactor(subpixelFactor);
 
-    // Write file header
-    fstream strm(file,  binary ? (ios::out | ios::binary) : ios::out);
-    strm << "ply" << endl;
-
-    if(binary) {
-        strm << "format binary_little_endian 1.0" << endl;
-    } else {
-        strm << "format ascii 1.0" << endl;
-    }
-
-    strm << "element vertex " << pointsCount << endl
-         << "property float x" << endl
-         << "property float y" << endl
-         << "property float z" << endl;
-    if (image != nullptr) {
-        // include RGB information only if a camera image was provided
-        strm << "property uchar red" << endl
-             << "property uchar green" << endl
-             << "property uchar blue" << endl;
-    }
-    strm << "end_header" << endl;
-
-    // Write points
-    for(int i=0; i<width*height; i++) {
-        int y = i / width;
-        int x = i % width;
-
-        if((maxZ < 0 || pointMapTemp[4*i+2] <= maxZ) && pointMapTemp[4*i+2] > 0) {
-            if(binary) {
-                // Write binary format
-                strm.write(reinterpret_cast<char*>(&pointMapTemp[4*i]), sizeof(float)*3);
-                if (image == nullptr) {
-                    // disparity only, no image data
-                } else if(format == ImageSet::FORMAT_8_BIT_RGB) {
-                    const unsigned char* col = &image[y*imageRowStride + 3*x];
-                    strm.write(reinterpret_cast<const char*>(col), 3*sizeof(*col));
-                } else if(format == ImageSet::FORMAT_8_BIT_MONO) {
-                    const unsigned char* col = &image[y*imageRowStride + x];
-                    unsigned char writeData[3] = {*col, *col, *col};
-                    strm.write(reinterpret_cast<const char*>(writeData), sizeof(writeData));
-                } else if(format == ImageSet::FORMAT_12_BIT_MONO) {
-                    const unsigned short* col = reinterpret_cast<const unsigned short*>(&image[y*imageRowStride + 2*x]);
-                    unsigned char writeData[3] = {
-                        (unsigned char)(*col >> 4),
-                        (unsigned char)(*col >> 4),
-                        (unsigned char)(*col >> 4)
-                    };
-                    strm.write(reinterpret_cast<const char*>(writeData), sizeof(writeData));
-                }
-            } else {
-                // Write ASCII format
-                if(std::isfinite(pointMapTemp[4*i + 2])) {
-                    strm << pointMapTemp[4*i]
-                        << " " << pointMapTemp[4*i + 1]
-                        << " " << pointMapTemp[4*i + 2];
-                } else {
-                    strm << "NaN NaN NaN";
-                }
-
-                if (image == nullptr) {
-                    // disparity only, no image data
-                    strm << endl;
-                } else if(format == ImageSet::FORMAT_8_BIT_RGB) {
-                    const unsigned char* col = &image[y*imageRowStride + 3*x];
-                    strm << " " << static_cast<int>(col[0])
-                        << " " << static_cast<int>(col[1])
-                        << " " << static_cast<int>(col[2]) << endl;
-                } else if(format == ImageSet::FORMAT_8_BIT_MONO) {
-                    const unsigned char* col = &image[y*imageRowStride + x];
-                    strm << " " << static_cast<int>(*col)
-                        << " " << static_cast<int>(*col)
-                        << " " << static_cast<int>(*col) << endl;
-                } else if(format == ImageSet::FORMAT_12_BIT_MONO) {
-                    const unsigned short* col = reinterpret_cast<const unsigned short*>(&image[y*imageRowStride + 2*x]);
-                    strm << " " << static_cast<int>(*col >> 4)
-                        << " " << static_cast<int>(*col >> 4)
-                        << " " << static_cast<int>(*col >> 4) << endl;
-                }
-            }
-        }
-    }
+    writePointCloudFile(file, PointCloudWriter::FILE_PLY, imageSet, maxZ, binary,
+        COLOR_LEFT, maxDisparity);
 }
 
 void Reconstruct3D::Pimpl::writePlyFile(const char* file, const ImageSet& imageSet,
         double maxZ, bool binary, ColorSource colSource, unsigned short maxDisparity) {
+    // write Ply file, passing image data for point colors, if available
+    writePointCloudFile(file, PointCloudWriter::FILE_PLY, imageSet, maxZ, binary,
+        colSource, maxDisparity);
+}
 
-    ImageSet::ImageType colImg = getColorImage(imageSet, colSource);
+void Reconstruct3D::Pimpl::writeMeshPlyFile(const char* file, const ImageSet& imageSet,
+        bool binary, ColorSource colSource, int decimation, float discontinuityThreshold,
+        unsigned short maxDisparity) {
+    int numVertices = 0, numTriangles = 0;
+    const int* triangles = nullptr;
+    const unsigned char* colors = nullptr;
+    const float* vertices = createMesh(imageSet, numVertices, &triangles, numTriangles,
+        &colors, colSource, decimation, discontinuityThreshold, 1, maxDisparity);
+
+    pointCloudWriter.writeMesh(file, binary, vertices, colors, numVertices,
+        triangles, numTriangles);
+}
 
-    int indexDisp = imageSet.getIndexOf(ImageSet::IMAGE_DISPARITY);
-    int indexImg = imageSet.getIndexOf(colImg);
-    if(indexDisp == -1) {
+void Reconstruct3D::Pimpl::writePointCloudFile(const char* file, PointCloudWriter::FileFormat format,
+        const ImageSet& imageSet, double maxZ, bool binary, ColorSource colSource,
+        unsigned short maxDisparity) {
+
+    if(imageSet.getIndexOf(ImageSet::IMAGE_DISPARITY) == -1) {
         throw std::runtime_error("No disparity channel present, cannot create point map!");
     }
-    if(imageSet.getPixelFormat(ImageSet::IMAGE_DISPARITY) != ImageSet::FORMAT_12_BIT_MONO) {
-        throw std::runtime_error("Disparity map must have 12-bit pixel format!");
+    checkDisparityMap(imageSet);
+
+    int indexImg = -1;
+    if(colSource != COLOR_NONE) {
+        indexImg = imageSet.getIndexOf(getColorImage(imageSet, colSource));
     }
 
-    // write Ply file, passing image data for point colors, if available
-    writePlyFile(file, reinterpret_cast<unsigned short*>(imageSet.getPixelData(indexDisp)),
+    int width = imageSet.getWidth();
+    int height = imageSet.getHeight();
+
+    const int* pixelIndices = nullptr;
+    int numPoints = 0;
+    int cloudWidth = 0, cloudHeight = 0;
+    const float* points = nullptr;
+
+    // Export the coordinates of the regular point map, such that the files
+    // are identical to those written by previous versions
+    if(maxZ < 0) {
+        // Export all points as an organized point cloud
+        points = createPointMap(imageSet, 0, maxDisparity);
+        numPoints = width*height;
+        cloudWidth = width;
+        cloudHeight = height;
+    } else {
+        // Only export valid points within the depth limit. Points in the
+        // camera frame are always in front of the camera. Each band compacts
+        // the indices of its valid points right after reconstructing them.
+        float zMin = hasTransformation ? -(std::numeric_limits<float>::max)() : 0.0f;
+        if(pixelIndexMap.size() < size_t(width)*height) {
+            pixelIndexMap.resize(size_t(width)*height);
+        }
+
+        int numBands = threadPool.getNumThreads();
+        std::vector<int> bandStarts(numBands, 0);
+        std::vector<int> bandCounts(numBands, 0);
+        ThreadPool::BandFunction compactBand = [&](int band, int startRow, int stopRow) {
+            const float* bandPoints = &pointMap[0];
+            int* bandIndices = &pixelIndexMap[size_t(startRow)*width];
+            int count = 0;
+            for(int i = startRow*width; i < stopRow*width; i++) {
+                // Comparisons with NaN fail
+                float z = bandPoints[4*size_t(i) + 2];
+                if(z > zMin && z <= maxZ) {
+                    bandIndices[count++] = i;
+                }
+            }
+            bandStarts[band] = startRow*width;
+            bandCounts[band] = count;
+        };
+        points = createPointMap(imageSet, 0, maxDisparity, &compactBand);
+
+        // Close the gaps between bands
+        for(int band = 0; band < numBands; band++) {
+            if(bandCounts[band] > 0 && bandStarts[band] != numPoints) {
+                memmove(&pixelIndexMap[numPoints], &pixelIndexMap[bandStarts[band]],
+                    sizeof(int)*bandCounts[band]);
+            }
+            numPoints += bandCounts[band];
+        }
+
+        pixelIndices = pixelIndexMap.data();
+        cloudWidth = numPoints;
+        cloudHeight = 1;
+    }
+
+    pointCloudWriter.write(file, format, binary, points, pixelIndices, numPoints,
+        cloudWidth, cloudHeight,
         (indexImg == -1) ? nullptr : imageSet.getPixelData(indexImg),
-        imageSet.getWidth(), imageSet.getHeight(),
         (indexImg == -1) ? ImageSet::FORMAT_8_BIT_MONO : imageSet.getPixelFormat(indexImg),
-        imageSet.getRowStride(indexDisp),
-        (indexImg == -1) ? 0 : imageSet.getRowStride(indexImg),
-        imageSet.getQMatrix(),
-        maxZ, binary, imageSet.getSubpixelFactor(), maxDisparity);
+        width, (indexImg == -1) ? 0 : imageSet.getRowStride(indexImg));
 }
 
 } // namespace
@@ -15,6 +15,7 @@
 #ifndef VISIONTRANSFER_RECONSTRUCT3D_H
 #define VISIONTRANSFER_RECONSTRUCT3D_H
 
+#include <cstddef>
 #include <limits>
 #include <stdexcept>
 #include "visiontransfer/common.h"
@@ -49,6 +50,51 @@ public:
         COLOR_THIRD_COLOR
     };
 
+    /**
+     * \brief Memory layouts for point maps that are created with
+     * createPointMap(const ImageSet&, PointMapLayout, unsigned short, unsigned short).
+     */
+    enum PointMapLayout {
+        /// Four floats per point: x, y, z and one float of padding, whose
+        /// value is unspecified
+        LAYOUT_XYZW_FLOAT,
+        /// Three consecutive floats per point: x, y and z
+        LAYOUT_XYZ_FLOAT,
+        /// Three separate planes of width*height floats, containing all x,
+        /// then all y and then all z coordinates
+        LAYOUT_PLANAR_FLOAT,
+        /// Three consecutive IEEE 754 half-precision floats per point
+        LAYOUT_XYZ_HALF_FLOAT,
+        /// Three consecutive signed 16-bit integers per point, in millimeters
+        LAYOUT_XYZ_INT16_MM
+    };
+
+    /**
+     * \brief Pixel formats for depth maps that are created with
+     * createZMap(const ImageSet&, ZMapFormat, float, unsigned short, unsigned short).
+     */
+    enum ZMapFormat {
+        /// 32-bit float depth in meters
+        ZMAP_FLOAT,
+        /// 16-bit unsigned integer depth in millimeters
+        ZMAP_UINT16_MM,
+        /// IEEE 754 half-precision float depth in meters
+        ZMAP_HALF_FLOAT
+    };
+
+    /**
+     * \brief Statistics that can be computed for each cell of a height map
+     * with createHeightMap().
+     */
+    enum HeightMapMode {
+        /// Largest height of all points in the cell
+        HEIGHT_MAX,
+        /// Smallest height of all points in the cell
+        HEIGHT_MIN,
+        /// Average height of all points in the cell
+        HEIGHT_MEAN
+    };
+
     /**
      * \brief Constructs a new object for 3D reconstructing.
      */
@@ -111,6 +157,62 @@ public:
     float* createPointMap(const ImageSet& imageSet, unsigned short minDisparity = 0,
         unsigned short maxDisparity = 0xFFF);
 
+    /**
+     * \brief Reconstructs the 3D location of each pixel in the given
+     * disparity map and stores the result with the given memory layout.
+     *
+     * \param imageSet Image set containing the disparity map.
+     * \param layout Memory layout of the created point map.
+     * \param minDisparity The minimum disparity with N-bit subpixel resolution.
+     * \param maxDisparity The maximum value that occurs in the disparity map. Any value
+     *        greater or equal will be marked as invalid.
+     *
+     * The output map has a size of exactly width*height*getBytesPerPoint(layout)
+     * bytes. For the floating point layouts, points with a disparity of 0 or an invalid
+     * disparity receive coordinates of +inf if the minimum disparity is set to 0.
+     * For LAYOUT_XYZ_INT16_MM, such points and all points that exceed the value range
+     * of +/- 32.767 meters are set to (0, 0, 0).
+     *
+     * The returned point map is valid until the next call of createPointMap(), createZMap(), or
+     * writePlyFile().
+     */
+    unsigned char* createPointMap(const ImageSet& imageSet, PointMapLayout layout,
+        unsigned short minDisparity = 0, unsigned short maxDisparity = 0xFFF);
+
+    /**
+     * \brief Returns the number of bytes that are required to store one
+     * point with the given point map layout.
+     */
+    static int getBytesPerPoint(PointMapLayout layout);
+
+    /**
+     * \brief Reconstructs the 3D location of each pixel in the given
+     * disparity map and writes the result into a caller-provided buffer.
+     *
+     * \param imageSet Image set containing the disparity map.
+     * \param layout Memory layout of the created point map.
+     * \param minDisparity The minimum disparity with N-bit subpixel resolution.
+     * \param maxDisparity The maximum value that occurs in the disparity map. Any value
+     *        greater or equal will be marked as invalid.
+     * \param dst Destination buffer for the point map.
+     * \param dstRowStride Distance between two rows of the destination buffer in bytes,
+     *        or 0 for tightly packed rows of width*getBytesPerPoint(layout) bytes.
+     *
+     * This method behaves like
+     * createPointMap(const ImageSet&, PointMapLayout, unsigned short, unsigned short),
+     * but the point map is written to \c dst, which must hold at least
+     * height*dstRowStride bytes. For LAYOUT_PLANAR_FLOAT, the three coordinate planes
+     * follow each other with a distance of height*dstRowStride bytes. For
+     * LAYOUT_XYZW_FLOAT, the fourth component of each point is padding with
+     * an unspecified value, like for all other methods.
+     *
+     * Point maps that were previously returned by the other methods are not
+     * overwritten by this call.
+     */
+    void createPointMap(const ImageSet& imageSet, PointMapLayout layout,
+        unsigned short minDisparity, unsigned short maxDisparity,
+        unsigned char* dst, int dstRowStride);
+
     /**
      * \brief Converts the disparity in an image set to a depth map
      *
@@ -127,7 +229,7 @@ public:
      * for each image point.
      *
      * If the minimum disparity is set to 0, points with a disparity of 0 or an invalid
-     * disparity will receive a z coordinate of +inf. If a larger minimum disparity is given,
+     * disparity will receive a depth of NaN. If a larger minimum disparity is given,
      * points with a lower disparity will be at a fix depth that corresponds to this
      * disparity.
      *
@@ -137,6 +239,236 @@ public:
     float* createZMap(const ImageSet& imageSet, unsigned short minDisparity = 0,
         unsigned short maxDisparity = 0xFFF);
 
+    /**
+     * \brief Converts the disparity map of a given image set into a depth
+     * map and writes the result into a caller-provided buffer.
+     *
+     * \param imageSet Image set containing the disparity map.
+     * \param minDisparity The minimum disparity with N-bit subpixel resolution.
+     * \param maxDisparity The maximum value that occurs in the disparity map. Any value
+     *        greater or equal will be marked as invalid.
+     * \param dst Destination buffer for the depth map.
+     * \param dstRowStride Distance between two rows of the destination buffer in bytes,
+     *        or 0 for tightly packed rows of width float values.
+     *
+     * This method behaves like createZMap(const ImageSet&, unsigned short, unsigned short),
+     * but writes the depth map to \c dst instead of an internal buffer.
+     */
+    void createZMap(const ImageSet& imageSet, unsigned short minDisparity,
+        unsigned short maxDisparity, float* dst, int dstRowStride);
+
+    /**
+     * \brief Converts the disparity in an image set to a depth map with
+     * the given pixel format.
+     *
+     * \param imageSet Image set containing the disparity map.
+     * \param format Pixel format of the created depth map.
+     * \param invalidValue Value that is stored for invalid pixels, in the unit
+     *        of the pixel format. Typical values are 0 or NaN for ZMAP_FLOAT and
+     *        ZMAP_HALF_FLOAT, and 0 or 65535 for ZMAP_UINT16_MM.
+     * \param minDisparity Minimum disparity with N-bit subpixel resolution. Pixels
+     *        with a lower disparity are invalid.
+     * \param maxDisparity The maximum value that occurs in the disparity map. Pixels
+     *        with a greater or equal disparity are invalid.
+     *
+     * The output map has a size of exactly width*height*getBytesPerPixel(format)
+     * bytes. For ZMAP_UINT16_MM, pixels with a depth beyond 65.535 meters are
+     * invalid as well.
+     *
+     * Unlike createZMap(const ImageSet&, unsigned short, unsigned short), invalid
+     * pixels are not clamped to the depth of the minimum disparity. The returned
+     * map is valid until the next call of createZMap(), createPointMap() or
+     * writePlyFile().
+     */
+    unsigned char* createZMap(const ImageSet& imageSet, ZMapFormat format,
+        float invalidValue = 0, unsigned short minDisparity = 1,
+        unsigned short maxDisparity = 0xFFF);
+
+    /**
+     * \brief Converts the disparity in an image set to a depth map with the
+     * given pixel format and writes the result into a caller-provided buffer.
+     *
+     * \param dst Destination buffer for the depth map.
+     * \param dstRowStride Distance between two rows of the destination buffer in bytes,
+     *        or 0 for tightly packed rows.
+     *
+     * See createZMap(const ImageSet&, ZMapFormat, float, unsigned short, unsigned short)
+     * for a description of the remaining parameters.
+     */
+    void createZMap(const ImageSet& imageSet, ZMapFormat format, float invalidValue,
+        unsigned short minDisparity, unsigned short maxDisparity,
+        unsigned char* dst, int dstRowStride);
+
+    /**
+     * \brief Returns the number of bytes that are required to store one
+     * pixel of a depth map with the given format.
+     */
+    static int getBytesPerPixel(ZMapFormat format);
+
+    /**
+     * \brief Reconstructs the 3D location of all valid pixels and returns
+     * them as a compact, unorganized point cloud.
+     *
+     * \param imageSet Image set containing the disparity map.
+     * \param numPoints Receives the number of points in the returned cloud.
+     * \param minDisparity Minimum disparity with N-bit subpixel resolution. Pixels
+     *        with a lower disparity are omitted. A disparity of 0 is always omitted.
+     * \param maxDisparity The maximum value that occurs in the disparity map. Pixels
+     *        with a greater or equal disparity are omitted.
+     * \param maxZ Maximum z-coordinate. Points that are further away are omitted.
+     *        A value <= 0 disables this filter.
+     * \param pixelIndices If not NULL, receives a pointer to an array of numPoints
+     *        pixel indices (y*width + x), which identify the source pixel of each point.
+     *
+     * The returned array contains the x, y and z coordinates of numPoints points
+     * without any padding. Points with a non-finite or non-positive z-coordinate
+     * are omitted as well. If a transformation has been set with setTransformation(),
+     * only non-finite points are omitted.
+     *
+     * The returned point cloud and pixel indices are valid until the next call of
+     * createCompactPointCloud(), createPointMap(), createZMap(), or writePlyFile().
+     */
+    float* createCompactPointCloud(const ImageSet& imageSet, int& numPoints,
+        unsigned short minDisparity = 1, unsigned short maxDisparity = 0xFFF,
+        float maxZ = 0, const int** pixelIndices = NULL);
+
+    /**
+     * \brief Reconstructs the 3D location of all valid pixels and downsamples
+     * them with a voxel grid in a single pass.
+     *
+     * \param imageSet Image set containing the disparity map and, optionally,
+     *        a camera image for the point colors.
+     * \param leafSize Edge length of one voxel in the unit of the reconstructed
+     *        points (usually meters).
+     * \param numPoints Receives the number of points, i.e. the number of
+     *        occupied voxels.
+     * \param colors If not NULL, receives a pointer to an array of 3*numPoints
+     *        averaged RGB values, or NULL if the image set does not contain the
+     *        selected color channel.
+     * \param colSource Source channel of the color information.
+     * \param boundingBox Optional axis-aligned bounding box given as six values
+     *        (min x, min y, min z, max x, max y, max z). Points outside this box
+     *        are omitted. If NULL, only points with a positive z-coordinate are
+     *        included, unless a transformation has been set with setTransformation().
+     * \param minDisparity Minimum disparity with N-bit subpixel resolution. Pixels
+     *        with a lower disparity are omitted. A disparity of 0 is always omitted.
+     * \param maxDisparity The maximum value that occurs in the disparity map. Pixels
+     *        with a greater or equal disparity are omitted.
+     *
+     * Each occupied voxel is represented by the average position and color of all
+     * points that fall into it. The returned array contains the x, y and z coordinates
+     * of numPoints points without any padding. The point order is not defined.
+     *
+     * The returned points and colors are valid until the next call of
+     * createVoxelGridCloud(), createCompactPointCloud(), createPointMap(), createZMap(),
+     * or any of the point cloud file writers.
+     */
+    float* createVoxelGridCloud(const ImageSet& imageSet, float leafSize, int& numPoints,
+        const unsigned char** colors = NULL, ColorSource colSource = COLOR_AUTO,
+        const float* boundingBox = NULL, unsigned short minDisparity = 1,
+        unsigned short maxDisparity = 0xFFF);
+
+    /**
+     * \brief Estimates a surface normal for each pixel of the disparity map.
+     *
+     * \param imageSet Image set containing the disparity map.
+     * \param minDisparity Minimum disparity with N-bit subpixel resolution. Pixels
+     *        with a lower disparity are invalid. A disparity of 0 is always invalid.
+     * \param maxDisparity The maximum value that occurs in the disparity map. Pixels
+     *        with a greater or equal disparity are invalid.
+     * \param discontinuityThreshold Maximum depth difference between neighbouring
+     *        pixels, relative to the depth of the center pixel. Neighbours with a
+     *        larger difference are considered to lie on a different surface.
+     * \returns Pointer to an array of 3*width*height floats with the x, y and z
+     *        components of the unit normal vectors, in the same row-major order
+     *        as the disparity map.
+     *
+     * The normals are computed from the cross product of the horizontal and vertical
+     * tangents in the organized point grid. Central differences are used where
+     * both neighbours are valid, and one-sided differences otherwise. All normals
+     * are oriented towards the camera. Pixels that are invalid, or for which no
+     * tangent can be found in one of the two directions, receive a NaN normal.
+     *
+     * The returned array is valid until the next call of createNormalMap(). It
+     * does not invalidate the result of createPointMap().
+     */
+    float* createNormalMap(const ImageSet& imageSet, unsigned short minDisparity = 1,
+        unsigned short maxDisparity = 0xFFF, float discontinuityThreshold = 0.05f);
+
+    /**
+     * \brief Projects the given disparity map to a top-down 2.5D height map,
+     * without creating an intermediate point cloud.
+     *
+     * \param imageSet Image set containing the disparity map.
+     * \param cellSize Edge length of one grid cell in the unit of the reconstructed
+     *        points (usually meters).
+     * \param extent Extent of the grid given as six values (min x, min y, min z,
+     *        max x, max y, max z). Points outside this box are omitted.
+     * \param columns Receives the number of grid columns, which cover the x-axis.
+     * \param rows Receives the number of grid rows, which cover the y-axis.
+     * \param mode Statistic of the point heights that is computed for each cell.
+     * \param pointCounts If not NULL, receives a pointer to an array of
+     *        columns*rows point counts, which can serve as an occupancy grid.
+     * \param minDisparity Minimum disparity with N-bit subpixel resolution. Pixels
+     *        with a lower disparity are omitted. A disparity of 0 is always omitted.
+     * \param maxDisparity The maximum value that occurs in the disparity map. Pixels
+     *        with a greater or equal disparity are omitted.
+     * \returns Pointer to an array of columns*rows heights in row-major order.
+     *        Cell (c, r) covers the x-range starting at min x + c*cellSize and the
+     *        y-range starting at min y + r*cellSize. Cells without points are NaN.
+     *
+     * The grid lies in the x/y plane of the output coordinate system and the z
+     * coordinate is used as height. For a camera that is mounted on a vehicle,
+     * setTransformation() should hence be used for mapping the camera frame into
+     * a vehicle frame whose z-axis points upwards. The grid may not contain more
+     * than 2^24 cells.
+     *
+     * The returned heights and counts are valid until the next call of
+     * createHeightMap().
+     */
+    float* createHeightMap(const ImageSet& imageSet, float cellSize, const float* extent,
+        int& columns, int& rows, HeightMapMode mode = HEIGHT_MAX,
+        const unsigned int** pointCounts = NULL, unsigned short minDisparity = 1,
+        unsigned short maxDisparity = 0xFFF);
+
+    /**
+     * \brief Triangulates the disparity map to an indexed triangle mesh,
+     * without creating an intermediate point cloud.
+     *
+     * \param imageSet Image set containing the disparity map.
+     * \param numVertices Receives the number of mesh vertices.
+     * \param triangles If not NULL, receives a pointer to an array of
+     *        3*numTriangles vertex indices.
+     * \param numTriangles Receives the number of triangles.
+     * \param colors If not NULL, receives a pointer to an array of 3*numVertices
+     *        RGB values, or NULL if no color image is available.
+     * \param colSource Source channel of the color information.
+     * \param decimation Only every n-th pixel in each row and column is used as
+     *        mesh vertex. A value of 1 uses all pixels.
+     * \param discontinuityThreshold Maximum depth difference between the corners
+     *        of a triangle, relative to the smallest corner depth. Triangles with a
+     *        larger difference would span a depth discontinuity and are omitted.
+     * \param minDisparity Minimum disparity with N-bit subpixel resolution. Pixels
+     *        with a lower disparity are invalid. A disparity of 0 is always invalid.
+     * \param maxDisparity The maximum value that occurs in the disparity map. Pixels
+     *        with a greater or equal disparity are invalid.
+     * \returns Pointer to an array of 3*numVertices floats with the x, y and z
+     *        coordinates of the vertices.
+     *
+     * Each square of four neighbouring grid pixels is split into two triangles
+     * along the same diagonal. Triangles are only created if all of their corners
+     * are valid and inside the crop box. Vertices that belong to no triangle are
+     * omitted, and the vertices are ordered by their pixel position. All
+     * triangles are wound counter-clockwise when viewed from the camera.
+     *
+     * The returned vertices, triangles and colors are valid until the next call
+     * of createMesh() or writeMeshPlyFile().
+     */
+    float* createMesh(const ImageSet& imageSet, int& numVertices, const int** triangles,
+        int& numTriangles, const unsigned char** colors = NULL, ColorSource colSource = COLOR_AUTO,
+        int decimation = 1, float discontinuityThreshold = 0.05f,
+        unsigned short minDisparity = 1, unsigned short maxDisparity = 0xFFF);
+
     /**
      * \brief Reconstructs the 3D location of one individual point.
      *
@@ -206,7 +538,8 @@ public:
      *
      * \param file The name for the output file.
      * \param imageSet Image set containing camera image and disparity map.
-     * \param maxZ Maximum allowed z-coordinate.
+     * \param maxZ Maximum allowed z-coordinate. If a negative value is given, all
+     *        points are exported as an organized point cloud.
      * \param binary Specifies whether the ASCII or binary PLY-format should be used.
      * \param colSource Source channel of the color information
      * \param maxDisparity The maximum value that occurs in the disparity map. Any value
@@ -219,6 +552,151 @@ public:
         ColorSource colSource = COLOR_AUTO,
         unsigned short maxDisparity = 0xFFF);
 
+    /**
+     * \brief Projects the given disparity map to 3D points and exports the result to
+     * a PCD file, as used by the Point Cloud Library.
+     *
+     * \param file The name for the output file.
+     * \param imageSet Image set containing camera image and disparity map.
+     * \param maxZ Maximum allowed z-coordinate. If a negative value is given, all
+     *        points are exported as an organized point cloud.
+     * \param binary Specifies whether the ASCII or binary PCD-format should be used.
+     * \param colSource Source channel of the color information
+     * \param maxDisparity The maximum value that occurs in the disparity map. Any value
+     *        greater or equal will be marked as invalid.
+     */
+    void writePcdFile(const char* file, const ImageSet& imageSet,
+        double maxZ = (std::numeric_limits<double>::max)(),
+        bool binary = true,
+        ColorSource colSource = COLOR_AUTO,
+        unsigned short maxDisparity = 0xFFF);
+
+    /**
+     * \brief Projects the given disparity map to 3D points and exports the
+     * coordinates to an XYZ file.
+     *
+     * \param file The name for the output file.
+     * \param imageSet Image set containing the disparity map.
+     * \param maxZ Maximum allowed z-coordinate. If a negative value is given, all
+     *        points are exported.
+     * \param binary If true, the file contains raw little-endian float triplets
+     *        without a header. Otherwise, each line contains the ASCII
+     *        coordinates of one point.
+     * \param maxDisparity The maximum value that occurs in the disparity map. Any value
+     *        greater or equal will be marked as invalid.
+     */
+    void writeXyzFile(const char* file, const ImageSet& imageSet,
+        double maxZ = (std::numeric_limits<double>::max)(),
+        bool binary = false,
+        unsigned short maxDisparity = 0xFFF);
+
+    /**
+     * \brief Triangulates the given disparity map and exports the resulting
+     * mesh to a PLY file.
+     *
+     * \param file The name for the output file.
+     * \param imageSet Image set containing camera image and disparity map.
+     * \param binary Specifies whether the ASCII or binary PLY-format should be used.
+     * \param colSource Source channel of the vertex colors
+     * \param decimation Only every n-th pixel in each row and column is used as
+     *        mesh vertex.
+     * \param discontinuityThreshold Relative depth difference at which no
+     *        triangle is created.
+     * \param maxDisparity The maximum value that occurs in the disparity map. Any value
+     *        greater or equal will be marked as invalid.
+     *
+     * See createMesh() for details.
+     */
+    void writeMeshPlyFile(const char* file, const ImageSet& imageSet,
+        bool binary = true, ColorSource colSource = COLOR_AUTO, int decimation = 1,
+        float discontinuityThreshold = 0.05f, unsigned short maxDisparity = 0xFFF);
+
+    /**
+     * \brief Sets the number of threads that are used for 3D reconstruction.
+     *
+     * \param numThreads Number of threads, including the calling thread. A value
+     *        of 0 selects the number of available hardware threads. The default
+     *        is 1, which means that all processing happens in the calling thread.
+     * \param firstCpu Optional CPU affinity. If set to a value >= 0, the internal
+     *        worker threads are pinned to consecutive CPU cores, starting at
+     *        the given core number. The calling thread is never pinned.
+     *
+     * The disparity map is split into bands of consecutive rows, which are
+     * processed concurrently on a persistent internal thread pool. The threads
+     * are created once by this method and are reused for all subsequent calls
+     * of createPointMap(), createZMap() and the point cloud file writers.
+     */
+    void setNumThreads(int numThreads, int firstCpu = -1);
+
+    /**
+     * \brief Returns the number of threads that are used for 3D reconstruction.
+     */
+    int getNumThreads() const;
+
+    /**
+     * \brief Sets a transformation that is applied to all reconstructed points.
+     *
+     * \param transformation Affine transformation matrix of size 4x4, stored in
+     *        a row-wise alignment. This is usually the extrinsic calibration of
+     *        the camera with respect to a vehicle or world frame. Pass NULL to
+     *        reconstruct points in the camera frame again (default).
+     *
+     * The transformation is folded into the disparity-to-depth mapping matrix
+     * and hence comes at no additional cost. It applies to all methods that
+     * return 3D points, including the point cloud file writers and
+     * projectSinglePoint(). Normals returned by createNormalMap() are rotated
+     * accordingly. createZMap() is not affected, as depth always refers to the
+     * camera.
+     */
+    void setTransformation(const float* transformation);
+
+    /**
+     * \brief Restricts all reconstructed points to a crop box.
+     *
+     * \param boundingBox Extents of the box given as six values (min x, min y,
+     *        min z, max x, max y, max z), or NULL for disabling cropping (default).
+     * \param boxTransformation Optional affine 4x4 matrix in row-wise alignment,
+     *        which maps points from the output frame into the frame of the box.
+     *        This allows for oriented crop boxes. If NULL, the box is axis-aligned
+     *        in the output frame.
+     *
+     * The output frame is the camera frame, or the target frame of
+     * setTransformation() if a transformation has been set. The crop box is
+     * evaluated while the points are reconstructed. Points outside the box are
+     * handled like points with an invalid disparity: they are set to +inf in
+     * point maps, and they are omitted by createCompactPointCloud(),
+     * createVoxelGridCloud() and the point cloud file writers.
+     */
+    void setCropBox(const float* boundingBox, const float* boxTransformation = NULL);
+
+    /**
+     * \brief Prepares the reconstruction for the given camera calibration
+     * and image size.
+     *
+     * \param q Disparity-to-depth mapping matrix of size 4x4, stored in a
+     *        row-wise alignment.
+     * \param width Width of the disparity maps.
+     * \param height Height of the disparity maps.
+     * \param subpixelFactor Subpixel division factor of the disparity values.
+     *
+     * All terms of the reconstruction that only depend on the pixel position
+     * are computed once and cached. They are automatically recomputed whenever
+     * a frame with a different Q-matrix, image size or subpixel factor is
+     * processed, or after the transformation has changed. Calling this method,
+     * for example right after connecting to a device, is hence optional. It
+     * avoids the computation when processing the first frame.
+     */
+    void setCalibration(const float* q, int width, int height, int subpixelFactor = 16);
+
+    /**
+     * \brief Prepares the reconstruction for the calibration and image size
+     * of the given image set.
+     *
+     * See setCalibration(const float*, int, int, int) for details. Only the
+     * metadata of the image set is used.
+     */
+    void setCalibration(const ImageSet& imageSet);
+
 #ifdef PCL_MAJOR_VERSION
     /**
      * \brief Projects the given disparity map to a PCL point cloud without pixel intensities
@@ -234,17 +712,23 @@ public:
      * disparity will receive a z coordinate of +inf. If a larger minimum disparity is given,
      * points with a lower disparity will be at a fix depth that corresponds to this
      * disparity.
+     *
+     * If a point cloud is passed as \c cloud, it is resized if necessary and
+     * returned, such that its storage is reused across frames.
      */
     inline pcl::PointCloud<pcl::PointXYZ>::Ptr createXYZCloud(const ImageSet& imageSet,
-            const char* frameId, unsigned short minDisparity = 0);
+            const char* frameId, unsigned short minDisparity = 0,
+            pcl::PointCloud<pcl::PointXYZ>::Ptr cloud = pcl::PointCloud<pcl::PointXYZ>::Ptr());
 
     /**
      * \brief Projects the given disparity map to a PCL point cloud, including pixel intensities.
      *
-     * See createXYZCloud() for details.
+     * The intensities are taken from the left image, which must be a monochrome
+     * image. See createXYZCloud() for details.
      */
     inline pcl::PointCloud<pcl::PointXYZI>::Ptr createXYZICloud(const ImageSet& imageSet,
-            const char* frameId, unsigned short minDisparity = 0);
+            const char* frameId, unsigned short minDisparity = 0,
+            pcl::PointCloud<pcl::PointXYZI>::Ptr cloud = pcl::PointCloud<pcl::PointXYZI>::Ptr());
 
     /**
      * \brief Projects the given disparity map to a PCL point cloud, including pixel RGB data.
@@ -252,7 +736,64 @@ public:
      * See createXYZCloud() for details.
      */
     inline pcl::PointCloud<pcl::PointXYZRGB>::Ptr createXYZRGBCloud(const ImageSet& imageSet,
-        const char* frameId, unsigned short minDisparity = 0);
+        const char* frameId, unsigned short minDisparity = 0,
+        pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud = pcl::PointCloud<pcl::PointXYZRGB>::Ptr());
+
+    /**
+     * \brief Projects the given disparity map to an unorganized PCL point cloud
+     * that only contains valid points.
+     *
+     * \param imageSet Image set containing the disparity map.
+     * \param frameId Frame ID that will be assigned to the created point cloud.
+     * \param minDisparity The minimum disparity with N-bit subpixel resolution.
+     * \param maxZ Maximum z-coordinate, or a value <= 0 for no limit.
+     *
+     * See createCompactPointCloud() for details on the filtering of points.
+     */
+    inline pcl::PointCloud<pcl::PointXYZ>::Ptr createCompactXYZCloud(const ImageSet& imageSet,
+        const char* frameId, unsigned short minDisparity = 1, float maxZ = 0);
+
+    /**
+     * \brief Projects the given disparity map to a voxel-grid downsampled
+     * PCL point cloud.
+     *
+     * \param imageSet Image set containing the disparity map.
+     * \param frameId Frame ID that will be assigned to the created point cloud.
+     * \param leafSize Edge length of one voxel.
+     * \param boundingBox Optional bounding box (min x, min y, min z, max x, max y, max z).
+     * \param minDisparity The minimum disparity with N-bit subpixel resolution.
+     *
+     * See createVoxelGridCloud() for details.
+     */
+    inline pcl::PointCloud<pcl::PointXYZ>::Ptr createVoxelGridXYZCloud(const ImageSet& imageSet,
+        const char* frameId, float leafSize, const float* boundingBox = NULL,
+        unsigned short minDisparity = 1);
+
+    /**
+     * \brief Projects the given disparity map to a voxel-grid downsampled
+     * PCL point cloud, including averaged RGB data.
+     *
+     * See createVoxelGridXYZCloud() for details.
+     */
+    inline pcl::PointCloud<pcl::PointXYZRGB>::Ptr createVoxelGridXYZRGBCloud(const ImageSet& imageSet,
+        const char* frameId, float leafSize, const float* boundingBox = NULL,
+        unsigned short minDisparity = 1);
+
+    /**
+     * \brief Projects the given disparity map to an organized PCL point cloud
+     * with surface normals.
+     *
+     * \param imageSet Image set containing the disparity map.
+     * \param frameId Frame ID that will be assigned to the created point cloud.
+     * \param minDisparity The minimum disparity with N-bit subpixel resolution.
+     * \param discontinuityThreshold Relative depth difference at which neighbouring
+     *        pixels are no longer used for normal estimation.
+     *
+     * Points are computed as with createXYZCloud(), normals as with
+     * createNormalMap(). The curvature is not estimated and set to 0.
+     */
+    inline pcl::PointCloud<pcl::PointNormal>::Ptr createXYZNormalCloud(const ImageSet& imageSet,
+        const char* frameId, unsigned short minDisparity = 0, float discontinuityThreshold = 0.05f);
 #endif
 
 #ifdef OPEN3D_VERSION
@@ -264,6 +805,10 @@ public:
      * \param minDisparity The minimum disparity with N-bit subpixel resolution.
      * \param maxDisparity The maximum value that occurs in the disparity map. Any value
      *        greater or equal will be marked as invalid.
+     * \param estimateNormals If true, the normals of the point cloud are filled
+     *        with the results of createNormalMap().
+     * \param cloud Optional point cloud that is resized if necessary, filled and
+     *        returned, such that its storage is reused across frames.
      *
      * For this method to be available, the Open3d headers must be included before
      * the libvisiontransfer headers!
@@ -274,12 +819,16 @@ public:
      * disparity.
      */
     inline std::shared_ptr<open3d::geometry::PointCloud> createOpen3DCloud(const ImageSet& imageSet,
-        ColorSource colSource = COLOR_AUTO, unsigned short minDisparity = 0, unsigned short maxDisparity = 0xFFF);
+        ColorSource colSource = COLOR_AUTO, unsigned short minDisparity = 0, unsigned short maxDisparity = 0xFFF,
+        bool estimateNormals = false,
+        std::shared_ptr<open3d::geometry::PointCloud> cloud = std::shared_ptr<open3d::geometry::PointCloud>());
     /**
      * \brief Converts the given disparity map to a Open3D RGBDn image
      *
      * \param imageSet Image set containing the disparity map.
      * \param minDisparity The minimum disparity with N-bit subpixel resolution.
+     * \param depthFormat Pixel format of the depth image. Open3D supports
+     *        ZMAP_FLOAT (meters) and ZMAP_UINT16_MM (millimeters).
      *
      * For this method to be available, the Open3d headers must be included before
      * the libvisiontransfer headers!
@@ -287,10 +836,45 @@ public:
      * If the minimum disparity is set to 0, points with a disparity of 0 or an invalid
      * disparity will receive a z coordinate of +inf. If a larger minimum disparity is given,
      * points with a lower disparity will be at a fix depth that corresponds to this
-     * disparity.
+     * disparity. For ZMAP_UINT16_MM, all invalid pixels receive a depth of 0, which
+     * Open3D treats as missing.
      */
     inline std::shared_ptr<open3d::geometry::RGBDImage> createOpen3DImageRGBD(const ImageSet& imageSet,
-        ColorSource colSource = COLOR_AUTO, unsigned short minDisparity = 0);
+        ColorSource colSource = COLOR_AUTO, unsigned short minDisparity = 0,
+        ZMapFormat depthFormat = ZMAP_FLOAT);
+
+    /**
+     * \brief Projects the given disparity map to a voxel-grid downsampled
+     * Open3D point cloud.
+     *
+     * \param imageSet Image set containing the disparity map.
+     * \param leafSize Edge length of one voxel.
+     * \param colSource Source channel of the color information
+     * \param boundingBox Optional bounding box (min x, min y, min z, max x, max y, max z).
+     * \param minDisparity The minimum disparity with N-bit subpixel resolution.
+     *
+     * See createVoxelGridCloud() for details.
+     */
+    inline std::shared_ptr<open3d::geometry::PointCloud> createOpen3DVoxelGridCloud(const ImageSet& imageSet,
+        float leafSize, ColorSource colSource = COLOR_AUTO, const float* boundingBox = NULL,
+        unsigned short minDisparity = 1);
+
+    /**
+     * \brief Triangulates the given disparity map to an Open3D triangle mesh.
+     *
+     * \param imageSet Image set containing the disparity map.
+     * \param colSource Source channel of the vertex colors
+     * \param decimation Only every n-th pixel in each row and column is used as
+     *        mesh vertex.
+     * \param discontinuityThreshold Relative depth difference at which no
+     *        triangle is created.
+     * \param minDisparity The minimum disparity with N-bit subpixel resolution.
+     *
+     * See createMesh() for details.
+     */
+    inline std::shared_ptr<open3d::geometry::TriangleMesh> createOpen3DMesh(const ImageSet& imageSet,
+        ColorSource colSource = COLOR_AUTO, int decimation = 1,
+        float discontinuityThreshold = 0.05f, unsigned short minDisparity = 1);
 #endif
 
 private:
@@ -305,9 +889,37 @@ private:
 #ifdef PCL_MAJOR_VERSION
     // Initializes a PCL point cloud
     template <typename T>
-    typename pcl::PointCloud<T>::Ptr initPointCloud(const ImageSet& imageSet, const char* frameId);
+    typename pcl::PointCloud<T>::Ptr initPointCloud(const ImageSet& imageSet, const char* frameId,
+        typename pcl::PointCloud<T>::Ptr cloud = typename pcl::PointCloud<T>::Ptr());
 #endif
 
+    // Per-point channels that can be written by createInterleavedCloud()
+    enum PointChannel {
+        // No additional channel
+        CHANNEL_NONE,
+        // Float intensity in the range [0, 1], from a monochrome image
+        CHANNEL_INTENSITY,
+        // Four bytes in b, g, r, a order, with an alpha value of 255
+        CHANNEL_BGRA
+    };
+
+    // Reconstructs all points directly into an array of point structures of
+    // pointSize bytes, as used by PCL. Each structure starts with the x, y and
+    // z coordinates, followed by a float that is set to 1. The selected channel
+    // is written at byte offset channelOffset.
+    void createInterleavedCloud(const ImageSet& imageSet, unsigned short minDisparity,
+        unsigned short maxDisparity, unsigned char* dst, int pointSize, PointChannel channel,
+        int channelOffset, ColorSource colSource);
+
+    // Reconstructs all points as interleaved doubles, and optionally the colors
+    // as interleaved doubles in the range [0, 1], as used by Open3D
+    void createDoubleCloud(const ImageSet& imageSet, unsigned short minDisparity,
+        unsigned short maxDisparity, double* points, double* colors, ColorSource colSource);
+
+    // Converts the color image to width*height packed 8-bit RGB pixels, as
+    // used by Open3D. Monochrome images are expanded to gray.
+    void createRgbImage(const ImageSet& imageSet, ColorSource colSource, unsigned char* dst);
+
     // Inlined code, as it is needed by PCL and Open3D bindings
     static ImageSet::ImageType getColorImage(const ImageSet& imageSet, ColorSource colSource) {
         switch(colSource) {
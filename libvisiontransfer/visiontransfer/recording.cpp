@@ -0,0 +1,796 @@
+/*******************************************************************************
+ * Copyright (c) 2024 Allied Vision Technologies GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *******************************************************************************/
+
+
+#include "visiontransfer/recording.h"
+#include "visiontransfer/framepool.h"
+#include "visiontransfer/internal/bitconversions.h"
+#include "visiontransfer/internal/dataowner.h"
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <stdexcept>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <cstdint>
+
+#ifdef _WIN32
+#   ifndef NOMINMAX
+#       define NOMINMAX
+#   endif
+#   include <windows.h>
+#   include <malloc.h>
+#else
+#   include <sys/types.h>
+#   include <sys/stat.h>
+#   include <sys/mman.h>
+#   include <fcntl.h>
+#   include <unistd.h>
+#endif
+
+using namespace std;
+using namespace visiontransfer;
+using namespace visiontransfer::internal;
+
+namespace visiontransfer {
+
+namespace {
+
+// Alignment of frames and image payloads within the file
+const int PAYLOAD_ALIGNMENT = 64;
+// Alignment of write buffers, file offsets and lengths for direct I/O
+const int BLOCK_ALIGNMENT = 4096;
+
+const char FILE_MAGIC[8] = {'V', 'T', 'R', 'E', 'C', 'O', 'R', 'D'};
+const uint32_t FILE_VERSION = 1;
+const uint32_t FRAME_MAGIC = 0x4D415246; // "FRAM"
+
+enum PayloadEncoding {
+    ENCODING_RAW = 0,
+    ENCODING_12_BIT_PACKED = 1
+};
+
+// All fields are 32 or 64 bit wide, such that no padding is inserted
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    // Offset of the frame index, or 0 if the recording was not closed
+    uint64_t indexOffset;
+    uint32_t numFrames;
+    uint32_t reserved[9];
+};
+
+// Per-frame header, mirroring the image protocol's header data
+struct FrameHeader {
+    uint32_t magic;
+    uint32_t headerSize;
+    // Total size including header, payloads and padding
+    uint64_t frameSize;
+
+    int32_t width;
+    int32_t height;
+    int32_t numberOfImages;
+    int32_t formats[ImageSet::MAX_SUPPORTED_IMAGES];
+    int32_t encodings[ImageSet::MAX_SUPPORTED_IMAGES];
+    // Offsets relative to the start of the frame header
+    uint64_t payloadOffsets[ImageSet::MAX_SUPPORTED_IMAGES];
+
+    int32_t indexLeftImage;
+    int32_t indexRightImage;
+    int32_t indexDisparityImage;
+    int32_t indexColorImage;
+
+    uint32_t seqNum;
+    int32_t timeSec;
+    int32_t timeMicrosec;
+    int32_t minDisparity;
+    int32_t maxDisparity;
+    int32_t subpixelFactor;
+    int32_t hasQMatrix;
+    float q[16];
+
+    int32_t exposureTime;
+    int32_t lastSyncPulseSec;
+    int32_t lastSyncPulseMicrosec;
+    int32_t triggerPulseSequenceIndex[ImageSet::MAX_SUPPORTED_TRIGGER_CHANNELS];
+    int32_t reserved[3];
+};
+
+// Entry of the frame index at the end of the file
+struct IndexEntry {
+    uint64_t offset;
+    uint32_t seqNum;
+    int32_t timeSec;
+    int32_t timeMicrosec;
+    uint32_t reserved;
+};
+
+uint64_t alignSize(uint64_t size, uint64_t alignment) {
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+int getPayloadRowSize(const FrameHeader& header, int imageNumber) {
+    if(header.encodings[imageNumber] == ENCODING_12_BIT_PACKED) {
+        return header.width * 3 / 2;
+    } else {
+        return header.width * ImageSet::getBytesPerPixel(
+            static_cast<ImageSet::ImageFormat>(header.formats[imageNumber]));
+    }
+}
+
+// Owner of a recording's memory mapping, shared by the reader and all
+// image sets that reference the mapped data
+class MappedFile: public DataOwner {
+public:
+    unsigned char* data;
+    uint64_t size;
+
+    MappedFile(const char* fileName): data(NULL), size(0) {
+#ifdef _WIN32
+        fileHandle = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL,
+            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if(fileHandle == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error(std::string("Unable to open recording: ") + fileName);
+        }
+        LARGE_INTEGER fileSize;
+        GetFileSizeEx(fileHandle, &fileSize);
+        size = static_cast<uint64_t>(fileSize.QuadPart);
+        mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+        if(mappingHandle != NULL) {
+            data = static_cast<unsigned char*>(MapViewOfFile(mappingHandle, FILE_MAP_COPY, 0, 0, 0));
+        }
+        if(data == NULL) {
+            if(mappingHandle != NULL) {
+                CloseHandle(mappingHandle);
+            }
+            CloseHandle(fileHandle);
+            throw std::runtime_error(std::string("Unable to map recording: ") + fileName);
+        }
+#else
+        int fd = ::open(fileName, O_RDONLY);
+        if(fd < 0) {
+            throw std::runtime_error(std::string("Unable to open recording: ") + fileName);
+        }
+        struct stat fileStat;
+        if(fstat(fd, &fileStat) != 0 || fileStat.st_size == 0) {
+            ::close(fd);
+            throw std::runtime_error(std::string("Invalid recording file: ") + fileName);
+        }
+        size = static_cast<uint64_t>(fileStat.st_size);
+        // A private mapping allows modifying the pixel data of returned
+        // image sets, without altering the file
+        void* mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if(mapping == MAP_FAILED) {
+            throw std::runtime_error(std::string("Unable to map recording: ") + fileName);
+        }
+        data = static_cast<unsigned char*>(mapping);
+#endif
+    }
+
+protected:
+    virtual void release() {
+#ifdef _WIN32
+        UnmapViewOfFile(data);
+        CloseHandle(mappingHandle);
+        CloseHandle(fileHandle);
+#else
+        munmap(data, size);
+#endif
+        delete this;
+    }
+
+private:
+#ifdef _WIN32
+    HANDLE fileHandle;
+    HANDLE mappingHandle;
+#endif
+};
+
+}
+
+/*************** Pimpl classes containing all private members ***********/
+
+class RecordingWriter::Pimpl {
+public:
+    Pimpl(const char* fileName, bool packed12Bit, bool directIO, int bufferSize);
+    ~Pimpl();
+
+    void writeImageSet(const ImageSet& imageSet);
+    void close();
+    int getNumFrames() const;
+    long long getBytesWritten() const;
+
+private:
+#ifdef _WIN32
+    FILE* file;
+#else
+    int fd;
+#endif
+    bool packed12Bit;
+    bool directIO;
+    bool closed;
+
+    // Write buffer aligned for direct I/O
+    unsigned char* buffer;
+    int bufferSize;
+    int bufferFill;
+
+    // Number of bytes that have been written to the file
+    uint64_t fileOffset;
+
+    std::vector<IndexEntry> index;
+    std::vector<unsigned char> encodeBuffer;
+
+    void append(const void* data, uint64_t length);
+    void appendPadding(uint64_t alignment);
+    void flushBuffer(int length);
+    void writeAt(uint64_t offset, const void* data, uint64_t length);
+    void closeFile();
+};
+
+class RecordingReader::Pimpl {
+public:
+    Pimpl(const char* fileName);
+    ~Pimpl();
+
+    int getNumFrames() const;
+    const FrameHeader& getFrameHeader(int index) const;
+    const unsigned char* getFrameData(int index) const;
+    DataOwner* getMapping() const {return mapping;}
+    const unsigned char* getMappingEnd() const {return mapping->data + mapping->size;}
+    FramePool& getFramePool() {return framePool;}
+    int findSequenceNumber(unsigned int seqNum) const;
+    int findTimestamp(int seconds, int microsec) const;
+    void getTimestamp(int index, int& seconds, int& microsec) const;
+
+private:
+    MappedFile* mapping;
+    std::vector<IndexEntry> index;
+    // Frame indices sorted by sequence number and timestamp
+    std::vector<std::pair<unsigned int, int> > seqNumIndex;
+    std::vector<std::pair<long long, int> > timeIndex;
+    // Buffers for frames that need to be decoded
+    FramePool framePool;
+
+    void readIndex();
+    void scanFrames();
+};
+
+/******************** Stubs for all public members ********************/
+
+RecordingWriter::RecordingWriter(const char* fileName, bool packed12Bit, bool directIO,
+        int bufferSize)
+    : pimpl(new Pimpl(fileName, packed12Bit, directIO, bufferSize)) {
+}
+
+RecordingWriter::~RecordingWriter() {
+    delete pimpl;
+}
+
+void RecordingWriter::writeImageSet(const ImageSet& imageSet) {
+    pimpl->writeImageSet(imageSet);
+}
+
+void RecordingWriter::close() {
+    pimpl->close();
+}
+
+int RecordingWriter::getNumFrames() const {
+    return pimpl->getNumFrames();
+}
+
+long long RecordingWriter::getBytesWritten() const {
+    return pimpl->getBytesWritten();
+}
+
+RecordingReader::RecordingReader(const char* fileName)
+    : pimpl(new Pimpl(fileName)) {
+}
+
+RecordingReader::~RecordingReader() {
+    delete pimpl;
+}
+
+int RecordingReader::getNumFrames() const {
+    return pimpl->getNumFrames();
+}
+
+void RecordingReader::getImageSet(int index, ImageSet& imageSet) {
+    const FrameHeader& header = pimpl->getFrameHeader(index);
+    const unsigned char* frameData = pimpl->getFrameData(index);
+
+    imageSet.setNumberOfImages(header.numberOfImages);
+    imageSet.setWidth(header.width);
+    imageSet.setHeight(header.height);
+    imageSet.setIndexOf(ImageSet::IMAGE_LEFT, header.indexLeftImage);
+    imageSet.setIndexOf(ImageSet::IMAGE_RIGHT, header.indexRightImage);
+    imageSet.setIndexOf(ImageSet::IMAGE_DISPARITY, header.indexDisparityImage);
+    imageSet.setIndexOf(ImageSet::IMAGE_COLOR, header.indexColorImage);
+    imageSet.setSequenceNumber(header.seqNum);
+    imageSet.setTimestamp(header.timeSec, header.timeMicrosec);
+    imageSet.setDisparityRange(header.minDisparity, header.maxDisparity);
+    imageSet.setSubpixelFactor(header.subpixelFactor);
+    imageSet.setQMatrix(header.hasQMatrix ? header.q : NULL);
+    imageSet.setExposureTime(header.exposureTime);
+    imageSet.setLastSyncPulse(header.lastSyncPulseSec, header.lastSyncPulseMicrosec);
+    for(int i=0; i<ImageSet::MAX_SUPPORTED_TRIGGER_CHANNELS; i++) {
+        imageSet.setTriggerPulseSequenceIndex(i, header.triggerPulseSequenceIndex[i]);
+    }
+
+    bool needsDecoding = false;
+    for(int i=0; i<header.numberOfImages; i++) {
+        imageSet.setPixelFormat(i, static_cast<ImageSet::ImageFormat>(header.formats[i]));
+        imageSet.setRowStride(i, getPayloadRowSize(header, i));
+        imageSet.setPixelData(i, const_cast<unsigned char*>(&frameData[header.payloadOffsets[i]]));
+        if(header.encodings[i] != ENCODING_RAW) {
+            needsDecoding = true;
+        }
+    }
+
+    // Sending image data over UDP temporarily overwrites 4 bytes after the
+    // pixel data, which must not exceed the mapping
+    int lastImage = header.numberOfImages - 1;
+    if(lastImage >= 0 && pimpl->getMappingEnd() - (&frameData[header.payloadOffsets[lastImage]]
+            + static_cast<size_t>(getPayloadRowSize(header, lastImage)) * header.height) < 4) {
+        needsDecoding = true;
+    }
+
+    if(!needsDecoding) {
+        // Zero-copy access to the mapped file
+        imageSet.setDataOwner(pimpl->getMapping());
+    } else {
+        pimpl->getFramePool().allocate(imageSet, imageSet);
+        for(int i=0; i<header.numberOfImages; i++) {
+            const unsigned char* src = &frameData[header.payloadOffsets[i]];
+            int srcStride = getPayloadRowSize(header, i);
+            if(header.encodings[i] == ENCODING_12_BIT_PACKED) {
+                BitConversions::decode12BitPacked(0, header.height, src, imageSet.getPixelData(i),
+                    srcStride, imageSet.getRowStride(i), header.width);
+            } else {
+                memcpy(imageSet.getPixelData(i), src, static_cast<size_t>(srcStride) * header.height);
+            }
+        }
+    }
+}
+
+int RecordingReader::findSequenceNumber(unsigned int seqNum) const {
+    return pimpl->findSequenceNumber(seqNum);
+}
+
+int RecordingReader::findTimestamp(int seconds, int microsec) const {
+    return pimpl->findTimestamp(seconds, microsec);
+}
+
+void RecordingReader::getTimestamp(int index, int& seconds, int& microsec) const {
+    pimpl->getTimestamp(index, seconds, microsec);
+}
+
+/******************** Implementation in pimpl classes *******************/
+
+RecordingWriter::Pimpl::Pimpl(const char* fileName, bool packed12Bit, bool directIO, int bufferSize)
+        : packed12Bit(packed12Bit), directIO(false), closed(false), buffer(NULL),
+        bufferSize(static_cast<int>(alignSize(std::max(bufferSize, BLOCK_ALIGNMENT), BLOCK_ALIGNMENT))),
+        bufferFill(0), fileOffset(0) {
+
+#ifdef _WIN32
+    (void) directIO;
+    file = fopen(fileName, "wb");
+    if(file == NULL) {
+        throw std::runtime_error(std::string("Unable to create recording: ") + fileName);
+    }
+    // We perform our own buffering
+    setvbuf(file, NULL, _IONBF, 0);
+    buffer = static_cast<unsigned char*>(_aligned_malloc(this->bufferSize, BLOCK_ALIGNMENT));
+#else
+    fd = -1;
+#   ifdef O_DIRECT
+    if(directIO) {
+        // Not all file systems support direct I/O
+        fd = ::open(fileName, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+        this->directIO = (fd >= 0);
+    }
+#   else
+    (void) directIO;
+#   endif
+    if(fd < 0) {
+        fd = ::open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    if(fd < 0) {
+        throw std::runtime_error(std::string("Unable to create recording: ") + fileName);
+    }
+    void* alignedBuffer = NULL;
+    if(posix_memalign(&alignedBuffer, BLOCK_ALIGNMENT, this->bufferSize) == 0) {
+        buffer = static_cast<unsigned char*>(alignedBuffer);
+    }
+#endif
+
+    if(buffer == NULL) {
+        closeFile();
+        throw std::runtime_error("Unable to allocate recording buffer!");
+    }
+
+    FileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+    header.version = FILE_VERSION;
+    header.headerSize = sizeof(FileHeader);
+    append(&header, sizeof(header));
+    appendPadding(PAYLOAD_ALIGNMENT);
+}
+
+RecordingWriter::Pimpl::~Pimpl() {
+    try {
+        close();
+    } catch(...) {
+        // Errors can only be reported by calling close() explicitly
+        closeFile();
+    }
+
+#ifdef _WIN32
+    _aligned_free(buffer);
+#else
+    free(buffer);
+#endif
+}
+
+void RecordingWriter::Pimpl::writeImageSet(const ImageSet& imageSet) {
+    if(closed) {
+        throw std::runtime_error("Recording has already been closed!");
+    }
+
+    FrameHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = FRAME_MAGIC;
+    header.headerSize = sizeof(FrameHeader);
+    header.width = imageSet.getWidth();
+    header.height = imageSet.getHeight();
+    header.numberOfImages = imageSet.getNumberOfImages();
+
+    uint64_t frameSize = alignSize(sizeof(FrameHeader), PAYLOAD_ALIGNMENT);
+    for(int i=0; i<imageSet.getNumberOfImages(); i++) {
+        header.formats[i] = imageSet.getPixelFormat(i);
+        header.encodings[i] = (packed12Bit && imageSet.getPixelFormat(i) == ImageSet::FORMAT_12_BIT_MONO
+            && imageSet.getWidth() % 2 == 0) ? ENCODING_12_BIT_PACKED : ENCODING_RAW;
+        header.payloadOffsets[i] = frameSize;
+        frameSize += alignSize(static_cast<uint64_t>(getPayloadRowSize(header, i)) * header.height,
+            PAYLOAD_ALIGNMENT);
+    }
+    header.frameSize = frameSize;
+
+    header.indexLeftImage = imageSet.getIndexOf(ImageSet::IMAGE_LEFT);
+    header.indexRightImage = imageSet.getIndexOf(ImageSet::IMAGE_RIGHT);
+    header.indexDisparityImage = imageSet.getIndexOf(ImageSet::IMAGE_DISPARITY);
+    header.indexColorImage = imageSet.getIndexOf(ImageSet::IMAGE_COLOR);
+    header.seqNum = imageSet.getSequenceNumber();
+    imageSet.getTimestamp(header.timeSec, header.timeMicrosec);
+    imageSet.getDisparityRange(header.minDisparity, header.maxDisparity);
+    header.subpixelFactor = imageSet.getSubpixelFactor();
+    if(imageSet.getQMatrix() != NULL) {
+        header.hasQMatrix = 1;
+        memcpy(header.q, imageSet.getQMatrix(), sizeof(header.q));
+    }
+    header.exposureTime = imageSet.getExposureTime();
+    imageSet.getLastSyncPulse(header.lastSyncPulseSec, header.lastSyncPulseMicrosec);
+    for(int i=0; i<ImageSet::MAX_SUPPORTED_TRIGGER_CHANNELS; i++) {
+        header.triggerPulseSequenceIndex[i] = imageSet.getTriggerPulseSequenceIndex(i);
+    }
+
+    IndexEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.offset = fileOffset + bufferFill;
+    entry.seqNum = header.seqNum;
+    entry.timeSec = header.timeSec;
+    entry.timeMicrosec = header.timeMicrosec;
+    index.push_back(entry);
+
+    append(&header, sizeof(header));
+    appendPadding(PAYLOAD_ALIGNMENT);
+
+    for(int i=0; i<imageSet.getNumberOfImages(); i++) {
+        int rowSize = getPayloadRowSize(header, i);
+        if(header.encodings[i] == ENCODING_12_BIT_PACKED) {
+            encodeBuffer.resize(static_cast<size_t>(rowSize) * header.height);
+            BitConversions::encode12BitPacked(0, header.height, imageSet.getPixelData(i),
+                &encodeBuffer[0], imageSet.getRowStride(i), rowSize, header.width);
+            append(&encodeBuffer[0], encodeBuffer.size());
+        } else if(imageSet.getRowStride(i) == rowSize) {
+            append(imageSet.getPixelData(i), static_cast<uint64_t>(rowSize) * header.height);
+        } else {
+            for(int y=0; y<header.height; y++) {
+                append(&imageSet.getPixelData(i)[y*imageSet.getRowStride(i)], rowSize);
+            }
+        }
+        appendPadding(PAYLOAD_ALIGNMENT);
+    }
+}
+
+void RecordingWriter::Pimpl::append(const void* data, uint64_t length) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    while(length > 0) {
+        int chunk = static_cast<int>(std::min<uint64_t>(length, bufferSize - bufferFill));
+        memcpy(&buffer[bufferFill], bytes, chunk);
+        bufferFill += chunk;
+        bytes += chunk;
+        length -= chunk;
+
+        if(bufferFill == bufferSize) {
+            flushBuffer(bufferSize);
+        }
+    }
+}
+
+void RecordingWriter::Pimpl::appendPadding(uint64_t alignment) {
+    uint64_t offset = fileOffset + bufferFill;
+    int padding = static_cast<int>(alignSize(offset, alignment) - offset);
+    if(padding > 0) {
+        static const unsigned char zeros[PAYLOAD_ALIGNMENT] = {0};
+        append(zeros, padding);
+    }
+}
+
+void RecordingWriter::Pimpl::flushBuffer(int length) {
+#ifdef _WIN32
+    if(fwrite(buffer, 1, length, file) != static_cast<size_t>(length)) {
+        throw std::runtime_error("Error writing recording!");
+    }
+#else
+    int written = 0;
+    while(written < length) {
+        ssize_t ret = ::write(fd, &buffer[written], length - written);
+        if(ret <= 0) {
+            throw std::runtime_error("Error writing recording!");
+        }
+        written += static_cast<int>(ret);
+    }
+#endif
+
+    fileOffset += bufferFill;
+    bufferFill = 0;
+}
+
+void RecordingWriter::Pimpl::writeAt(uint64_t offset, const void* data, uint64_t length) {
+#ifdef _WIN32
+    if(_fseeki64(file, static_cast<__int64>(offset), SEEK_SET) != 0
+            || fwrite(data, 1, length, file) != length) {
+        throw std::runtime_error("Error writing recording!");
+    }
+#else
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    while(length > 0) {
+        ssize_t ret = pwrite(fd, bytes, length, static_cast<off_t>(offset));
+        if(ret <= 0) {
+            throw std::runtime_error("Error writing recording!");
+        }
+        bytes += ret;
+        offset += ret;
+        length -= ret;
+    }
+#endif
+}
+
+void RecordingWriter::Pimpl::close() {
+    if(closed) {
+        return;
+    }
+    closed = true;
+
+    uint64_t dataSize = fileOffset + bufferFill;
+    if(bufferFill > 0) {
+        if(directIO) {
+            // Direct I/O requires writing complete blocks. The file is
+            // truncated to its actual size afterwards.
+            int length = static_cast<int>(alignSize(bufferFill, BLOCK_ALIGNMENT));
+            memset(&buffer[bufferFill], 0, length - bufferFill);
+            flushBuffer(length);
+        } else {
+            flushBuffer(bufferFill);
+        }
+    }
+
+#if !defined(_WIN32) && defined(O_DIRECT)
+    if(directIO) {
+        // Index and header are not block aligned
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+        if(ftruncate(fd, static_cast<off_t>(dataSize)) != 0) {
+            closeFile();
+            throw std::runtime_error("Error writing recording!");
+        }
+    }
+#endif
+
+    try {
+        if(index.size() > 0) {
+            writeAt(dataSize, &index[0], index.size() * sizeof(IndexEntry));
+        }
+
+        FileHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+        header.version = FILE_VERSION;
+        header.headerSize = sizeof(FileHeader);
+        header.indexOffset = dataSize;
+        header.numFrames = static_cast<uint32_t>(index.size());
+        writeAt(0, &header, sizeof(header));
+    } catch(...) {
+        closeFile();
+        throw;
+    }
+
+    closeFile();
+}
+
+void RecordingWriter::Pimpl::closeFile() {
+#ifdef _WIN32
+    if(file != NULL) {
+        fclose(file);
+        file = NULL;
+    }
+#else
+    if(fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+#endif
+}
+
+int RecordingWriter::Pimpl::getNumFrames() const {
+    return static_cast<int>(index.size());
+}
+
+long long RecordingWriter::Pimpl::getBytesWritten() const {
+    return static_cast<long long>(fileOffset + bufferFill);
+}
+
+RecordingReader::Pimpl::Pimpl(const char* fileName)
+        : mapping(new MappedFile(fileName)) {
+    // The reader holds one reference to the mapping
+    mapping->addReference();
+
+    try {
+        const FileHeader* header = reinterpret_cast<const FileHeader*>(mapping->data);
+        if(mapping->size < sizeof(FileHeader) || memcmp(header->magic, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0) {
+            throw std::runtime_error(std::string("Invalid recording file: ") + fileName);
+        }
+        if(header->version != FILE_VERSION) {
+            throw std::runtime_error("Unsupported recording version!");
+        }
+
+        if(header->indexOffset != 0) {
+            readIndex();
+        } else {
+            // Recording has not been closed properly
+            scanFrames();
+        }
+    } catch(...) {
+        mapping->removeReference();
+        throw;
+    }
+
+    for(unsigned int i=0; i<index.size(); i++) {
+        seqNumIndex.push_back(std::make_pair(static_cast<unsigned int>(index[i].seqNum), static_cast<int>(i)));
+        timeIndex.push_back(std::make_pair(index[i].timeSec * 1000000LL + index[i].timeMicrosec, static_cast<int>(i)));
+    }
+    std::sort(seqNumIndex.begin(), seqNumIndex.end());
+    std::sort(timeIndex.begin(), timeIndex.end());
+}
+
+RecordingReader::Pimpl::~Pimpl() {
+    // Image sets that still reference the mapping keep it alive
+    mapping->removeReference();
+}
+
+void RecordingReader::Pimpl::readIndex() {
+    const FileHeader* header = reinterpret_cast<const FileHeader*>(mapping->data);
+    if(header->indexOffset + static_cast<uint64_t>(header->numFrames) * sizeof(IndexEntry) > mapping->size) {
+        throw std::runtime_error("Recording index is truncated!");
+    }
+
+    const IndexEntry* entries = reinterpret_cast<const IndexEntry*>(&mapping->data[header->indexOffset]);
+    index.assign(entries, entries + header->numFrames);
+    for(unsigned int i=0; i<index.size(); i++) {
+        if(index[i].offset + sizeof(FrameHeader) > header->indexOffset) {
+            throw std::runtime_error("Invalid recording index!");
+        }
+    }
+}
+
+void RecordingReader::Pimpl::scanFrames() {
+    uint64_t offset = alignSize(sizeof(FileHeader), PAYLOAD_ALIGNMENT);
+    while(offset + sizeof(FrameHeader) <= mapping->size) {
+        const FrameHeader* header = reinterpret_cast<const FrameHeader*>(&mapping->data[offset]);
+        if(header->magic != FRAME_MAGIC || header->frameSize == 0
+                || offset + header->frameSize > mapping->size) {
+            // End of the data or incompletely written frame
+            break;
+        }
+
+        IndexEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.offset = offset;
+        entry.seqNum = header->seqNum;
+        entry.timeSec = header->timeSec;
+        entry.timeMicrosec = header->timeMicrosec;
+        index.push_back(entry);
+
+        offset += header->frameSize;
+    }
+}
+
+int RecordingReader::Pimpl::getNumFrames() const {
+    return static_cast<int>(index.size());
+}
+
+const FrameHeader& RecordingReader::Pimpl::getFrameHeader(int frameIndex) const {
+    if(frameIndex < 0 || frameIndex >= static_cast<int>(index.size())) {
+        throw std::runtime_error("Illegal frame index!");
+    }
+
+    const FrameHeader& header = *reinterpret_cast<const FrameHeader*>(&mapping->data[index[frameIndex].offset]);
+    if(header.magic != FRAME_MAGIC || header.numberOfImages < 1
+            || header.numberOfImages > ImageSet::MAX_SUPPORTED_IMAGES
+            || index[frameIndex].offset + header.frameSize > mapping->size) {
+        throw std::runtime_error("Corrupted frame in recording!");
+    }
+    for(int i=0; i<header.numberOfImages; i++) {
+        if(header.payloadOffsets[i] + static_cast<uint64_t>(getPayloadRowSize(header, i)) * header.height
+                > header.frameSize) {
+            throw std::runtime_error("Corrupted frame in recording!");
+        }
+    }
+    return header;
+}
+
+const unsigned char* RecordingReader::Pimpl::getFrameData(int frameIndex) const {
+    return &mapping->data[index[frameIndex].offset];
+}
+
+int RecordingReader::Pimpl::findSequenceNumber(unsigned int seqNum) const {
+    std::vector<std::pair<unsigned int, int> >::const_iterator it = std::lower_bound(
+        seqNumIndex.begin(), seqNumIndex.end(), std::make_pair(seqNum, 0));
+    if(it == seqNumIndex.end() || it->first != seqNum) {
+        return -1;
+    } else {
+        return it->second;
+    }
+}
+
+int RecordingReader::Pimpl::findTimestamp(int seconds, int microsec) const {
+    long long time = seconds * 1000000LL + microsec;
+
+    // Find the last entry at or before the given time
+    std::vector<std::pair<long long, int> >::const_iterator it = std::upper_bound(
+        timeIndex.begin(), timeIndex.end(), std::make_pair(time, static_cast<int>(index.size())));
+    if(it == timeIndex.begin()) {
+        return -1;
+    }
+    --it;
+
+    // Return the first of multiple frames with equal timestamp
+    std::vector<std::pair<long long, int> >::const_iterator first = std::lower_bound(
+        timeIndex.begin(), timeIndex.end(), std::make_pair(it->first, 0));
+    return first->second;
+}
+
+void RecordingReader::Pimpl::getTimestamp(int frameIndex, int& seconds, int& microsec) const {
+    if(frameIndex < 0 || frameIndex >= static_cast<int>(index.size())) {
+        throw std::runtime_error("Illegal frame index!");
+    }
+    seconds = index[frameIndex].timeSec;
+    microsec = index[frameIndex].timeMicrosec;
+}
+
+} // namespace
@@ -0,0 +1,166 @@
+/*******************************************************************************
+ * Copyright (c) 2024 Allied Vision Technologies GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *******************************************************************************/
+
+
+#ifndef VISIONTRANSFER_RECORDING_H
+#define VISIONTRANSFER_RECORDING_H
+
+#include "visiontransfer/common.h"
+#include "visiontransfer/imageset.h"
+
+namespace visiontransfer {
+
+/**
+ * \brief Records a stream of image sets to a file.
+ *
+ * The recording format is a binary container that keeps all image set
+ * metadata, i.e. the Q-matrix, timestamps, exposure time, sync pulse and
+ * trigger indices. Frames are appended to the file, and an index for random
+ * access is written when the recording is closed. If a recording has not
+ * been closed properly, its frames can still be read by RecordingReader.
+ *
+ * Frames are collected in a large memory buffer, which is written to disk
+ * in big sequential blocks. 12-bit images are optionally stored in a packed
+ * format, requiring only 1.5 bytes per pixel.
+ *
+ * The recording format uses the byte order of the host, which is little
+ * endian on all supported platforms.
+ */
+class VT_EXPORT RecordingWriter {
+public:
+    /**
+     * \brief Creates a new recording file.
+     *
+     * \param fileName Name of the file that shall be created. An existing
+     *        file is overwritten.
+     * \param packed12Bit If true, 12-bit images are stored in packed format.
+     *        This requires an even image width.
+     * \param directIO If true, the page cache is bypassed on platforms where
+     *        this is supported (O_DIRECT on Linux). This avoids evicting
+     *        other data from the cache when recording for long durations.
+     * \param bufferSize Size of the write buffer in bytes. It is rounded up
+     *        to a multiple of 4096.
+     */
+    RecordingWriter(const char* fileName, bool packed12Bit = true, bool directIO = false,
+        int bufferSize = 8*1048576);
+
+    /**
+     * \brief Closes the recording, if close() has not been called yet.
+     */
+    ~RecordingWriter();
+
+    /**
+     * \brief Appends an image set to the recording.
+     *
+     * The pixel data is copied to the write buffer, which is written to disk
+     * once it is full. The image set can hence be reused immediately.
+     */
+    void writeImageSet(const ImageSet& imageSet);
+
+    /**
+     * \brief Writes all buffered data and the frame index, and closes the file.
+     */
+    void close();
+
+    /// Returns the number of image sets that have been recorded
+    int getNumFrames() const;
+
+    /// Returns the number of bytes that have been recorded so far, including buffered data
+    long long getBytesWritten() const;
+
+private:
+    // We follow the pimpl idiom
+    class Pimpl;
+    Pimpl* pimpl;
+
+    // This class cannot be copied
+    RecordingWriter(const RecordingWriter& other);
+    RecordingWriter& operator=(const RecordingWriter&);
+};
+
+/**
+ * \brief Reads image sets from a recording that has been created with
+ * RecordingWriter.
+ *
+ * The recording file is mapped into memory, and the returned image sets
+ * directly reference the mapped data if possible. Such image sets own a
+ * reference to the mapping, which is hence only released after the reader
+ * and all returned image sets have been destroyed. Image sets with packed
+ * 12-bit images are decoded into recycled buffers instead.
+ *
+ * Frames can be accessed by index, sequence number or timestamp.
+ */
+class VT_EXPORT RecordingReader {
+public:
+    /**
+     * \brief Opens an existing recording.
+     *
+     * \param fileName Name of the recording file.
+     */
+    RecordingReader(const char* fileName);
+
+    ~RecordingReader();
+
+    /// Returns the number of image sets in the recording
+    int getNumFrames() const;
+
+    /**
+     * \brief Provides one image set of the recording.
+     *
+     * \param index Index of the image set (0 ... getNumFrames()-1).
+     * \param imageSet Image set that receives the recorded data. Its
+     *        previous data is released.
+     */
+    void getImageSet(int index, ImageSet& imageSet);
+
+    /**
+     * \brief Returns the index of the first image set with the given
+     * sequence number, or -1 if there is no such image set.
+     */
+    int findSequenceNumber(unsigned int seqNum) const;
+
+    /**
+     * \brief Returns the index of the latest image set that has been captured
+     * at or before the given time, or -1 if there is no such image set.
+     *
+     * \param seconds The time stamp with a resolution of one second.
+     * \param microsec The fractional seconds part of the time stamp.
+     *
+     * If multiple image sets have the same timestamp, then the first of them
+     * is returned.
+     */
+    int findTimestamp(int seconds, int microsec) const;
+
+    /**
+     * \brief Returns the timestamp of an image set without accessing its data.
+     *
+     * \param index Index of the image set (0 ... getNumFrames()-1).
+     * \param seconds Receives the time stamp with a resolution of one second.
+     * \param microsec Receives the fractional seconds part of the time stamp.
+     */
+    void getTimestamp(int index, int& seconds, int& microsec) const;
+
+private:
+    // We follow the pimpl idiom
+    class Pimpl;
+    Pimpl* pimpl;
+
+    // This class cannot be copied
+    RecordingReader(const RecordingReader& other);
+    RecordingReader& operator=(const RecordingReader&);
+};
+
+} // namespace
+
+#endif
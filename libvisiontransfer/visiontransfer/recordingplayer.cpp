@@ -0,0 +1,395 @@
+/*******************************************************************************
+ * Copyright (c) 2024 Allied Vision Technologies GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *******************************************************************************/
+
+
+#include "visiontransfer/recordingplayer.h"
+#include "visiontransfer/recording.h"
+#include "visiontransfer/imagetransfer.h"
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <stdexcept>
+
+using namespace std;
+using namespace std::chrono;
+using namespace visiontransfer;
+
+namespace visiontransfer {
+
+namespace {
+
+// Interval for polling a TCP server for new clients, as the listening socket
+// cannot be waited for
+const int ACCEPT_INTERVAL_MS = 1;
+
+// Maximum time of blocking on the socket before checking for termination
+const int IDLE_WAIT_MS = 100;
+
+// Time of waiting for messages from the client while a transfer is stalled
+const int SHORT_WAIT_MS = 1;
+
+}
+
+/*************** Pimpl class containing all private members ***********/
+
+class RecordingPlayer::Pimpl {
+public:
+    Pimpl(const char* fileName, const char* address, const char* service,
+        ImageProtocol::ProtocolType protType, int bufferSize, int maxUdpPacketSize);
+    ~Pimpl();
+
+    void setPlaybackSpeed(double speed);
+    double getPlaybackSpeed() const {return speed;}
+    void setLooping(bool loop) {looping = loop;}
+    bool isLooping() const {return looping;}
+    void start();
+    void stop();
+    bool isPlaying() const;
+    int getNumFrames() const {return reader.getNumFrames();}
+    int getNumFramesSent() const {return framesSent;}
+    int getNumLateFrames() const {return lateFrames;}
+    double getFrameRate() const;
+    double getDataRate() const;
+
+private:
+    RecordingReader reader;
+    ImageTransfer imgTrans;
+    ImageProtocol::ProtocolType protType;
+
+    std::thread playThread;
+    std::atomic<bool> terminate;
+    std::atomic<bool> playing;
+    std::atomic<double> speed;
+    std::atomic<bool> looping;
+
+    mutable std::mutex exceptionMutex;
+    std::exception_ptr playException;
+
+    // Playback statistics. Times are in nanoseconds of the steady clock.
+    std::atomic<int> framesSent;
+    std::atomic<int> lateFrames;
+    std::atomic<long long> bytesSent;
+    std::atomic<long long> firstSendTime;
+    std::atomic<long long> lastSendTime;
+
+    void playLoop();
+    bool waitForClient();
+    void serviceUntil(steady_clock::time_point deadline);
+    bool sendImageSet(const ImageSet& imageSet);
+    static long long toMicroseconds(int seconds, int microsec);
+};
+
+/******************** Stubs for all public members ********************/
+
+RecordingPlayer::RecordingPlayer(const char* fileName, const char* address, const char* service,
+        ImageProtocol::ProtocolType protType, int bufferSize, int maxUdpPacketSize)
+    : pimpl(new Pimpl(fileName, address, service, protType, bufferSize, maxUdpPacketSize)) {
+}
+
+RecordingPlayer::~RecordingPlayer() {
+    delete pimpl;
+}
+
+void RecordingPlayer::setPlaybackSpeed(double speed) {
+    pimpl->setPlaybackSpeed(speed);
+}
+
+double RecordingPlayer::getPlaybackSpeed() const {
+    return pimpl->getPlaybackSpeed();
+}
+
+void RecordingPlayer::setLooping(bool loop) {
+    pimpl->setLooping(loop);
+}
+
+bool RecordingPlayer::isLooping() const {
+    return pimpl->isLooping();
+}
+
+void RecordingPlayer::start() {
+    pimpl->start();
+}
+
+void RecordingPlayer::stop() {
+    pimpl->stop();
+}
+
+bool RecordingPlayer::isPlaying() const {
+    return pimpl->isPlaying();
+}
+
+int RecordingPlayer::getNumFrames() const {
+    return pimpl->getNumFrames();
+}
+
+int RecordingPlayer::getNumFramesSent() const {
+    return pimpl->getNumFramesSent();
+}
+
+int RecordingPlayer::getNumLateFrames() const {
+    return pimpl->getNumLateFrames();
+}
+
+double RecordingPlayer::getFrameRate() const {
+    return pimpl->getFrameRate();
+}
+
+double RecordingPlayer::getDataRate() const {
+    return pimpl->getDataRate();
+}
+
+/******************** Implementation in pimpl class *******************/
+
+RecordingPlayer::Pimpl::Pimpl(const char* fileName, const char* address, const char* service,
+        ImageProtocol::ProtocolType protType, int bufferSize, int maxUdpPacketSize)
+    : reader(fileName), imgTrans(address, service, protType, true, bufferSize, maxUdpPacketSize),
+    protType(protType), terminate(false), playing(false), speed(1.0), looping(false),
+    framesSent(0), lateFrames(0), bytesSent(0), firstSendTime(0), lastSendTime(0) {
+}
+
+RecordingPlayer::Pimpl::~Pimpl() {
+    stop();
+}
+
+void RecordingPlayer::Pimpl::setPlaybackSpeed(double speed) {
+    if(speed < 0) {
+        throw std::runtime_error("Playback speed must not be negative!");
+    }
+    this->speed = speed;
+}
+
+void RecordingPlayer::Pimpl::start() {
+    stop();
+
+    framesSent = 0;
+    lateFrames = 0;
+    bytesSent = 0;
+    firstSendTime = 0;
+    lastSendTime = 0;
+    {
+        unique_lock<mutex> lock(exceptionMutex);
+        playException = nullptr;
+    }
+
+    terminate = false;
+    playing = true;
+    playThread = std::thread(std::bind(&RecordingPlayer::Pimpl::playLoop, this));
+}
+
+void RecordingPlayer::Pimpl::stop() {
+    terminate = true;
+    imgTrans.interruptWait();
+    if(playThread.joinable()) {
+        playThread.join();
+    }
+    playing = false;
+}
+
+bool RecordingPlayer::Pimpl::isPlaying() const {
+    unique_lock<mutex> lock(exceptionMutex);
+    if(playException) {
+        std::rethrow_exception(playException);
+    }
+    return playing;
+}
+
+double RecordingPlayer::Pimpl::getFrameRate() const {
+    double elapsed = (lastSendTime - firstSendTime) * 1e-9;
+    int frames = framesSent;
+    // The first frame marks the start of the measurement
+    return frames > 1 && elapsed > 0 ? (frames - 1) / elapsed : 0.0;
+}
+
+double RecordingPlayer::Pimpl::getDataRate() const {
+    double elapsed = (lastSendTime - firstSendTime) * 1e-9;
+    int frames = framesSent;
+    return frames > 1 && elapsed > 0 ? bytesSent * (frames - 1) / (frames * elapsed) : 0.0;
+}
+
+long long RecordingPlayer::Pimpl::toMicroseconds(int seconds, int microsec) {
+    return static_cast<long long>(seconds) * 1000000 + microsec;
+}
+
+void RecordingPlayer::Pimpl::serviceUntil(steady_clock::time_point deadline) {
+    // Keep the connection serviced while waiting, such that lost UDP packets
+    // of the previous frame can still be retransmitted
+    bool waitForControlMessages = protType == ImageProtocol::PROTOCOL_UDP;
+    while(!terminate) {
+        steady_clock::time_point now = steady_clock::now();
+        if(now >= deadline) {
+            break;
+        }
+        imgTrans.transferData();
+
+        long long remainingMs = duration_cast<milliseconds>(deadline - now).count();
+        if(remainingMs == 0) {
+            // The socket wait has a resolution of milliseconds
+            std::this_thread::sleep_for(deadline - now);
+        } else {
+            imgTrans.waitForSocket(false, waitForControlMessages,
+                static_cast<int>(std::min(remainingMs, static_cast<long long>(IDLE_WAIT_MS))));
+        }
+    }
+}
+
+bool RecordingPlayer::Pimpl::waitForClient() {
+    while(!terminate) {
+        if(protType == ImageProtocol::PROTOCOL_TCP) {
+            // A TCP server reports to be connected even before the first
+            // client has been accepted
+            if(imgTrans.tryAccept()) {
+                return true;
+            }
+            imgTrans.waitForSocket(false, false, ACCEPT_INTERVAL_MS);
+        } else {
+            // UDP clients connect by sending a control message
+            imgTrans.transferData();
+            if(imgTrans.isConnected()) {
+                return true;
+            }
+            imgTrans.waitForSocket(false, true, IDLE_WAIT_MS);
+        }
+    }
+    return false;
+}
+
+bool RecordingPlayer::Pimpl::sendImageSet(const ImageSet& imageSet) {
+    imgTrans.setTransferImageSet(imageSet);
+    bool stalled = false;
+    while(!terminate) {
+        ImageTransfer::TransferStatus status = imgTrans.transferData();
+        if(status == ImageTransfer::ALL_TRANSFERRED) {
+            return true;
+        } else if(status == ImageTransfer::WOULD_BLOCK) {
+            // Wait until the send buffers have drained
+            imgTrans.waitForSocket(true, false, IDLE_WAIT_MS);
+            stalled = false;
+        } else if(status == ImageTransfer::PARTIAL_TRANSFER) {
+            // Retry at once, but wait for messages from the client if this
+            // did not complete the transfer
+            if(stalled) {
+                imgTrans.waitForSocket(false, true, SHORT_WAIT_MS);
+            }
+            stalled = true;
+        } else {
+            return false;
+        }
+    }
+    return false;
+}
+
+void RecordingPlayer::Pimpl::playLoop() {
+    try {
+        ImageSet imageSet;
+        int numFrames = reader.getNumFrames();
+        int frame = 0;
+
+        // Reference point that maps recording timestamps to playback times.
+        // It is re-established whenever the timing cannot be continued.
+        bool haveReference = false;
+        steady_clock::time_point refTime;
+        long long refTimestamp = 0;
+        double refSpeed = 0;
+        long long prevTimestamp = 0;
+        bool clientConnected = false;
+
+        while(!terminate && numFrames > 0) {
+            if(frame >= numFrames) {
+                if(!looping) {
+                    break;
+                }
+                frame = 0;
+                haveReference = false;
+            }
+
+            if(!clientConnected || !imgTrans.isConnected()) {
+                if(!waitForClient()) {
+                    break;
+                }
+                clientConnected = true;
+                haveReference = false;
+            }
+
+            // Decode the frame before waiting, such that decoding does not
+            // delay the transmission
+            reader.getImageSet(frame, imageSet);
+            int sec = 0, usec = 0;
+            imageSet.getTimestamp(sec, usec);
+            long long timestamp = toMicroseconds(sec, usec);
+            double currentSpeed = speed;
+
+            if(currentSpeed > 0) {
+                if(!haveReference || currentSpeed != refSpeed || timestamp <= prevTimestamp) {
+                    // First frame, speed change or timestamps without progress
+                    haveReference = true;
+                    refTime = steady_clock::now();
+                    refTimestamp = timestamp;
+                    refSpeed = currentSpeed;
+                }
+
+                steady_clock::time_point due = refTime + duration_cast<steady_clock::duration>(
+                    duration<double, std::micro>((timestamp - refTimestamp) / currentSpeed));
+                serviceUntil(due);
+                if(steady_clock::now() - due > milliseconds(1)) {
+                    lateFrames++;
+                }
+            } else {
+                haveReference = false;
+            }
+            prevTimestamp = timestamp;
+
+            if(terminate) {
+                break;
+            }
+
+            long long sendStart = duration_cast<nanoseconds>(
+                steady_clock::now().time_since_epoch()).count();
+            if(!sendImageSet(imageSet)) {
+                // Client has disconnected. The frame is sent again once a new
+                // client connects.
+                clientConnected = false;
+                continue;
+            }
+
+            long long frameBytes = 0;
+            for(int i=0; i<imageSet.getNumberOfImages(); i++) {
+                frameBytes += static_cast<long long>(imageSet.getRowStride(i)) * imageSet.getHeight();
+            }
+            if(framesSent == 0) {
+                firstSendTime = sendStart;
+            }
+            bytesSent += frameBytes;
+            lastSendTime = duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+            framesSent++;
+            frame++;
+        }
+
+        playing = false;
+
+        // Keep servicing the connection until stopped, which allows for
+        // retransmissions and for clients to reconnect
+        while(!terminate) {
+            serviceUntil(steady_clock::now() + milliseconds(10));
+        }
+    } catch(...) {
+        unique_lock<mutex> lock(exceptionMutex);
+        playException = std::current_exception();
+        playing = false;
+    }
+}
+
+} // namespace
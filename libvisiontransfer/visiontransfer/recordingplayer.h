@@ -0,0 +1,146 @@
+/*******************************************************************************
+ * Copyright (c) 2024 Allied Vision Technologies GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *******************************************************************************/
+
+
+#ifndef VISIONTRANSFER_RECORDINGPLAYER_H
+#define VISIONTRANSFER_RECORDINGPLAYER_H
+
+#include <string>
+#include "visiontransfer/common.h"
+#include "visiontransfer/imageprotocol.h"
+
+namespace visiontransfer {
+
+/**
+ * \brief Plays back a recording as if it was streamed by a device.
+ *
+ * The player reads a recording that has been created with RecordingWriter
+ * and serves it through ImageTransfer in server mode. Clients connect to it
+ * just like to a real device, for instance with AsyncTransfer. This allows
+ * testing unmodified client code without cameras, and can serve as a
+ * benchmark source for the receiving side.
+ *
+ * Image sets are sent in a background thread, either with the original
+ * timing of the recording, with a speed-up factor, or as fast as possible.
+ * Playback only proceeds while a client is connected.
+ */
+class VT_EXPORT RecordingPlayer {
+public:
+    /**
+     * \brief Opens a recording and creates the server socket.
+     *
+     * \param fileName Name of the recording file.
+     * \param address Local interface address for the server, or NULL for
+     *        all interfaces.
+     * \param service The port number that should be used as string or
+     *        as textual service name.
+     * \param protType Specifies whether the UDP or TCP transport protocol
+     *        shall be used.
+     * \param bufferSize Buffer size for sending network data.
+     * \param maxUdpPacketSize Maximum allowed size of a UDP packet.
+     */
+    RecordingPlayer(const char* fileName, const char* address = NULL, const char* service = "7681",
+        ImageProtocol::ProtocolType protType = ImageProtocol::PROTOCOL_UDP,
+        int bufferSize = 16*1048576, int maxUdpPacketSize = 1472);
+
+    /**
+     * \brief Stops playback and closes the server socket.
+     */
+    ~RecordingPlayer();
+
+    /**
+     * \brief Sets the playback speed relative to the original timing.
+     *
+     * \param speed A value of 1 replays with the original inter-frame timing,
+     *        as determined by the image set timestamps. Values greater than
+     *        1 accelerate the playback. A value of 0 sends frames as fast as
+     *        possible.
+     *
+     * The speed can be changed during playback.
+     */
+    void setPlaybackSpeed(double speed);
+
+    /// Returns the playback speed relative to the original timing
+    double getPlaybackSpeed() const;
+
+    /**
+     * \brief Enables or disables restarting the playback at the end of the
+     * recording.
+     */
+    void setLooping(bool loop);
+
+    /// Returns true if playback is restarted at the end of the recording
+    bool isLooping() const;
+
+    /**
+     * \brief Starts playback from the first frame of the recording.
+     *
+     * If playback is already active, it is restarted.
+     */
+    void start();
+
+    /**
+     * \brief Stops playback.
+     */
+    void stop();
+
+    /**
+     * \brief Returns true while the playback has not yet reached the end of
+     * the recording and has not been stopped.
+     *
+     * Exceptions that occurred in the playback thread are rethrown by this
+     * method.
+     */
+    bool isPlaying() const;
+
+    /// Returns the number of frames of the recording
+    int getNumFrames() const;
+
+    /// Returns the number of image sets that have been sent since start()
+    int getNumFramesSent() const;
+
+    /**
+     * \brief Returns the number of image sets that were sent later than
+     * required by the playback speed, since start().
+     *
+     * A frame counts as late if it was sent more than one millisecond
+     * after its due time, i.e. if the network could not keep up.
+     */
+    int getNumLateFrames() const;
+
+    /**
+     * \brief Returns the average number of image sets per second that have
+     * been sent since start().
+     */
+    double getFrameRate() const;
+
+    /**
+     * \brief Returns the average amount of pixel data in bytes per second
+     * that has been sent since start().
+     */
+    double getDataRate() const;
+
+private:
+    // We follow the pimpl idiom
+    class Pimpl;
+    Pimpl* pimpl;
+
+    // This class cannot be copied
+    RecordingPlayer(const RecordingPlayer& other);
+    RecordingPlayer& operator=(const RecordingPlayer&);
+};
+
+} // namespace
+
+#endif
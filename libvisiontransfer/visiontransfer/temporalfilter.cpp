@@ -0,0 +1,573 @@
+/*******************************************************************************
+ * Copyright (c) 2024 Allied Vision Technologies GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *******************************************************************************/
+
+#include "visiontransfer/temporalfilter.h"
+#include "visiontransfer/internal/alignedallocator.h"
+#include "visiontransfer/internal/threadpool.h"
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+
+// SIMD Headers
+#ifdef __AVX2__
+#include <immintrin.h>
+#elif __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+using namespace visiontransfer;
+using namespace visiontransfer::internal;
+
+namespace visiontransfer {
+
+/*************** Pimpl class containing all private members ***********/
+
+class TemporalFilter::Pimpl {
+public:
+    Pimpl(FilterMode mode, int historyLength);
+
+    void setMode(FilterMode mode);
+    FilterMode getMode() const {return mode;}
+
+    void setHistoryLength(int historyLength);
+    int getHistoryLength() const {return historyLength;}
+
+    void setSmoothingFactor(float alpha);
+    float getSmoothingFactor() const {return smoothingFactor;}
+
+    void setMaxDifference(unsigned short maxDifference);
+    unsigned short getMaxDifference() const {return maxDifference;}
+
+    void setMinValidFrames(int minValidFrames);
+    int getMinValidFrames() const {return minValidFrames;}
+
+    void setNumThreads(int numThreads, int firstCpu);
+    int getNumThreads() const;
+
+    void reset();
+
+    void process(ImageSet& imageSet, unsigned short maxDisparity);
+
+private:
+    // Number of fractional bits of the filtered disparity estimates
+    static const int ESTIMATE_SHIFT = 3;
+
+    // Value of invalid disparities in the history of the median filter. It is
+    // larger than any valid disparity, such that invalid values are sorted last.
+    static const unsigned short INVALID_SAMPLE = 0x7FFF;
+
+    // Parameters of the row kernels, with disparities converted to the
+    // fixed-point format of the estimates
+    struct RowParameters {
+        unsigned short maxDisparity;
+        short maxDifference;
+        short historyLength;
+        short minValidFrames;
+        // Weights of the old estimate and the new disparity with 14 fractional bits
+        short weightOld;
+        short weightNew;
+    };
+
+    FilterMode mode;
+    int historyLength;
+    float smoothingFactor;
+    unsigned short maxDifference;
+    int minValidFrames;
+
+    // Size of the disparity maps for which the state has been initialized
+    int width;
+    int height;
+    int subpixelFactor;
+
+    // Estimate with ESTIMATE_SHIFT fractional bits and weight of each pixel for
+    // the exponential and confidence modes. Pixels without an estimate have a
+    // weight of 0.
+    std::vector<unsigned short, AlignedAllocator<unsigned short> > estimates;
+    std::vector<unsigned short, AlignedAllocator<unsigned short> > weights;
+
+    // Ring buffer of the last disparity maps for the median mode
+    std::vector<unsigned short, AlignedAllocator<unsigned short> > history;
+    int nextSlot;
+
+    // Persistent worker threads for processing bands of rows
+    ThreadPool threadPool;
+
+    void initState(int width, int height, int subpixelFactor);
+
+    static void filterRowExponential(unsigned short* dispRow, unsigned short* estimateRow,
+        unsigned short* weightRow, int width, const RowParameters& params);
+
+    static void filterRowConfidence(unsigned short* dispRow, unsigned short* estimateRow,
+        unsigned short* weightRow, int width, const RowParameters& params);
+
+    static void filterRowMedian(unsigned short* dispRow, unsigned short* const* historyRows,
+        int slot, int width, const RowParameters& params);
+};
+
+const unsigned short TemporalFilter::Pimpl::INVALID_SAMPLE;
+
+/******************** Stubs for all public members ********************/
+
+TemporalFilter::TemporalFilter(FilterMode mode, int historyLength)
+    :pimpl(new Pimpl(mode, historyLength)) {
+}
+
+TemporalFilter::~TemporalFilter() {
+    delete pimpl;
+}
+
+void TemporalFilter::setMode(FilterMode mode) {
+    pimpl->setMode(mode);
+}
+
+TemporalFilter::FilterMode TemporalFilter::getMode() const {
+    return pimpl->getMode();
+}
+
+void TemporalFilter::setHistoryLength(int historyLength) {
+    pimpl->setHistoryLength(historyLength);
+}
+
+int TemporalFilter::getHistoryLength() const {
+    return pimpl->getHistoryLength();
+}
+
+void TemporalFilter::setSmoothingFactor(float alpha) {
+    pimpl->setSmoothingFactor(alpha);
+}
+
+float TemporalFilter::getSmoothingFactor() const {
+    return pimpl->getSmoothingFactor();
+}
+
+void TemporalFilter::setMaxDifference(unsigned short maxDifference) {
+    pimpl->setMaxDifference(maxDifference);
+}
+
+unsigned short TemporalFilter::getMaxDifference() const {
+    return pimpl->getMaxDifference();
+}
+
+void TemporalFilter::setMinValidFrames(int minValidFrames) {
+    pimpl->setMinValidFrames(minValidFrames);
+}
+
+int TemporalFilter::getMinValidFrames() const {
+    return pimpl->getMinValidFrames();
+}
+
+void TemporalFilter::setNumThreads(int numThreads, int firstCpu) {
+    pimpl->setNumThreads(numThreads, firstCpu);
+}
+
+int TemporalFilter::getNumThreads() const {
+    return pimpl->getNumThreads();
+}
+
+void TemporalFilter::reset() {
+    pimpl->reset();
+}
+
+void TemporalFilter::process(ImageSet& imageSet, unsigned short maxDisparity) {
+    pimpl->process(imageSet, maxDisparity);
+}
+
+/******************** Implementation in pimpl class *******************/
+
+TemporalFilter::Pimpl::Pimpl(FilterMode mode, int historyLength)
+        : mode(FILTER_EXPONENTIAL), historyLength(1), smoothingFactor(0.25f), maxDifference(32),
+        minValidFrames(1), width(0), height(0), subpixelFactor(0), nextSlot(0) {
+    setMode(mode);
+    setHistoryLength(historyLength);
+}
+
+void TemporalFilter::Pimpl::setMode(FilterMode mode) {
+    if(mode != FILTER_EXPONENTIAL && mode != FILTER_MEDIAN && mode != FILTER_CONFIDENCE) {
+        throw std::runtime_error("Invalid temporal filter mode!");
+    }
+    this->mode = mode;
+    reset();
+}
+
+void TemporalFilter::Pimpl::setHistoryLength(int historyLength) {
+    if(historyLength < 1 || historyLength > MAX_HISTORY_LENGTH) {
+        throw std::runtime_error("Invalid temporal filter history length!");
+    }
+    this->historyLength = historyLength;
+    minValidFrames = std::min(minValidFrames, historyLength);
+    reset();
+}
+
+void TemporalFilter::Pimpl::setSmoothingFactor(float alpha) {
+    if(!(alpha > 0 && alpha <= 1)) {
+        throw std::runtime_error("Smoothing factor must be in the range (0, 1]!");
+    }
+    smoothingFactor = alpha;
+}
+
+void TemporalFilter::Pimpl::setMaxDifference(unsigned short maxDifference) {
+    this->maxDifference = maxDifference;
+}
+
+void TemporalFilter::Pimpl::setMinValidFrames(int minValidFrames) {
+    if(minValidFrames < 1 || minValidFrames > historyLength) {
+        throw std::runtime_error("Minimum number of valid frames must be between 1 and the history length!");
+    }
+    this->minValidFrames = minValidFrames;
+}
+
+void TemporalFilter::Pimpl::setNumThreads(int numThreads, int firstCpu) {
+    threadPool.setNumThreads(numThreads, firstCpu);
+}
+
+int TemporalFilter::Pimpl::getNumThreads() const {
+    return threadPool.getNumThreads();
+}
+
+void TemporalFilter::Pimpl::reset() {
+    // The state is initialized again with the next frame
+    width = height = subpixelFactor = 0;
+}
+
+void TemporalFilter::Pimpl::initState(int width, int height, int subpixelFactor) {
+    size_t size = size_t(width) * height;
+    if(mode == FILTER_MEDIAN) {
+        history.assign(size * historyLength, INVALID_SAMPLE);
+        estimates.clear();
+        weights.clear();
+    } else {
+        estimates.assign(size, 0);
+        weights.assign(size, 0);
+        history.clear();
+    }
+
+    nextSlot = 0;
+    this->width = width;
+    this->height = height;
+    this->subpixelFactor = subpixelFactor;
+}
+
+void TemporalFilter::Pimpl::process(ImageSet& imageSet, unsigned short maxDisparity) {
+    if(!imageSet.hasImageType(ImageSet::IMAGE_DISPARITY)) {
+        throw std::runtime_error("ImageSet does not contain a disparity map!");
+    }
+    if(imageSet.getPixelFormat(ImageSet::IMAGE_DISPARITY) != ImageSet::FORMAT_12_BIT_MONO) {
+        throw std::runtime_error("Disparity map must have 12-bit pixel format!");
+    }
+    if(maxDisparity < 1 || maxDisparity > 0x1000) {
+        throw std::runtime_error("Maximum disparity for temporal filtering must be between 1 and 0x1000!");
+    }
+
+    if(imageSet.getWidth() != width || imageSet.getHeight() != height
+            || imageSet.getSubpixelFactor() != subpixelFactor) {
+        initState(imageSet.getWidth(), imageSet.getHeight(), imageSet.getSubpixelFactor());
+    }
+
+    RowParameters params;
+    params.maxDisparity = maxDisparity;
+    params.maxDifference = static_cast<short>(std::min(int(maxDifference), 0xFFF) << ESTIMATE_SHIFT);
+    params.historyLength = static_cast<short>(historyLength);
+    params.minValidFrames = static_cast<short>(minValidFrames);
+    params.weightNew = static_cast<short>(std::lround(smoothingFactor * (1 << 14)));
+    params.weightOld = static_cast<short>((1 << 14) - params.weightNew);
+
+    unsigned char* dispMap = imageSet.getPixelData(ImageSet::IMAGE_DISPARITY);
+    int rowStride = imageSet.getRowStride(ImageSet::IMAGE_DISPARITY);
+    int slot = nextSlot;
+
+    threadPool.parallelFor(height, [&](int, int startRow, int stopRow) {
+        unsigned short* historyRows[MAX_HISTORY_LENGTH];
+        for(int y = startRow; y < stopRow; y++) {
+            unsigned short* dispRow = reinterpret_cast<unsigned short*>(&dispMap[y*rowStride]);
+            size_t offset = size_t(y) * width;
+            switch(mode) {
+                case FILTER_EXPONENTIAL:
+                    filterRowExponential(dispRow, &estimates[offset], &weights[offset], width, params);
+                    break;
+                case FILTER_CONFIDENCE:
+                    filterRowConfidence(dispRow, &estimates[offset], &weights[offset], width, params);
+                    break;
+                default:
+                    for(int i = 0; i < historyLength; i++) {
+                        historyRows[i] = &history[(size_t(i) * height + y) * width];
+                    }
+                    filterRowMedian(dispRow, historyRows, slot, width, params);
+                    break;
+            }
+        }
+    });
+
+    nextSlot = (nextSlot + 1) % historyLength;
+}
+
+#if defined(__SSE2__) || defined(__AVX2__)
+static inline __m128i selectBits(__m128i mask, __m128i a, __m128i b) {
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+// Returns a mask of the valid disparities, which are in the range [1, maxDisparity)
+static inline __m128i getValidDisparities(__m128i disparities, __m128i maxDispBiased) {
+    // Unsigned comparison through a signed comparison of biased values
+    const __m128i signBit = _mm_set1_epi16(static_cast<short>(0x8000));
+    return _mm_andnot_si128(_mm_cmpeq_epi16(disparities, _mm_setzero_si128()),
+        _mm_cmplt_epi16(_mm_xor_si128(disparities, signBit), maxDispBiased));
+}
+#endif
+
+void TemporalFilter::Pimpl::filterRowExponential(unsigned short* dispRow, unsigned short* estimateRow,
+        unsigned short* weightRow, int width, const RowParameters& params) {
+    int x = 0;
+
+#if defined(__SSE2__) || defined(__AVX2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i maxDispBiased = _mm_set1_epi16(static_cast<short>(params.maxDisparity ^ 0x8000));
+    const __m128i maxDiffVector = _mm_set1_epi16(params.maxDifference);
+    const __m128i historyVector = _mm_set1_epi16(params.historyLength);
+    const __m128i minValidVector = _mm_set1_epi16(params.minValidFrames);
+    const __m128i invalidVector = _mm_set1_epi16(static_cast<short>(params.maxDisparity));
+    const __m128i weightVector = _mm_set1_epi32((int(params.weightNew) << 16) | params.weightOld);
+    const __m128i roundVector = _mm_set1_epi32(1 << 13);
+    const __m128i roundEstimate = _mm_set1_epi16(1 << (ESTIMATE_SHIFT - 1));
+
+    for(; x + 8 <= width; x += 8) {
+        __m128i disp = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&dispRow[x]));
+        __m128i estimate = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&estimateRow[x]));
+        __m128i weight = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&weightRow[x]));
+
+        __m128i valid = getValidDisparities(disp, maxDispBiased);
+        __m128i scaled = _mm_slli_epi16(disp, ESTIMATE_SHIFT);
+        __m128i diff = _mm_sub_epi16(scaled, estimate);
+        __m128i absDiff = _mm_max_epi16(diff, _mm_sub_epi16(zero, diff));
+        __m128i consistent = _mm_andnot_si128(_mm_cmpeq_epi16(weight, zero),
+            _mm_andnot_si128(_mm_cmpgt_epi16(absDiff, maxDiffVector), valid));
+
+        // Weighted sum of both values in 32 bits
+        __m128i sumLow = _mm_madd_epi16(_mm_unpacklo_epi16(estimate, scaled), weightVector);
+        __m128i sumHigh = _mm_madd_epi16(_mm_unpackhi_epi16(estimate, scaled), weightVector);
+        __m128i blended = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(sumLow, roundVector), 14),
+            _mm_srai_epi32(_mm_add_epi32(sumHigh, roundVector), 14));
+
+        // Inconsistent measurements replace the estimate
+        __m128i newEstimate = selectBits(valid, selectBits(consistent, blended, scaled), estimate);
+        __m128i newWeight = selectBits(valid,
+            selectBits(consistent, _mm_min_epi16(_mm_add_epi16(weight, one), historyVector), one),
+            _mm_subs_epu16(weight, one));
+        newEstimate = _mm_andnot_si128(_mm_cmpeq_epi16(newWeight, zero), newEstimate);
+
+        __m128i output = selectBits(_mm_cmplt_epi16(newWeight, minValidVector), invalidVector,
+            _mm_srli_epi16(_mm_add_epi16(newEstimate, roundEstimate), ESTIMATE_SHIFT));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&estimateRow[x]), newEstimate);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&weightRow[x]), newWeight);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&dispRow[x]), output);
+    }
+#endif
+
+    for(; x < width; x++) {
+        int disp = dispRow[x];
+        int estimate = estimateRow[x];
+        int weight = weightRow[x];
+        int scaled = disp << ESTIMATE_SHIFT;
+
+        if(disp > 0 && disp < params.maxDisparity) {
+            if(weight > 0 && std::abs(scaled - estimate) <= params.maxDifference) {
+                estimate = (estimate*params.weightOld + scaled*params.weightNew + (1 << 13)) >> 14;
+                weight = std::min(weight + 1, int(params.historyLength));
+            } else {
+                estimate = scaled;
+                weight = 1;
+            }
+        } else if(weight > 0) {
+            weight--;
+        }
+        if(weight == 0) {
+            estimate = 0;
+        }
+
+        estimateRow[x] = static_cast<unsigned short>(estimate);
+        weightRow[x] = static_cast<unsigned short>(weight);
+        dispRow[x] = weight < params.minValidFrames ? params.maxDisparity
+            : static_cast<unsigned short>((estimate + (1 << (ESTIMATE_SHIFT - 1))) >> ESTIMATE_SHIFT);
+    }
+}
+
+void TemporalFilter::Pimpl::filterRowConfidence(unsigned short* dispRow, unsigned short* estimateRow,
+        unsigned short* weightRow, int width, const RowParameters& params) {
+    int x = 0;
+
+#if defined(__SSE2__) || defined(__AVX2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i two = _mm_set1_epi16(2);
+    const __m128i maxDispBiased = _mm_set1_epi16(static_cast<short>(params.maxDisparity ^ 0x8000));
+    const __m128i maxDiffVector = _mm_set1_epi16(params.maxDifference);
+    const __m128i historyVector = _mm_set1_epi16(params.historyLength);
+    const __m128i minValidVector = _mm_set1_epi16(params.minValidFrames);
+    const __m128i invalidVector = _mm_set1_epi16(static_cast<short>(params.maxDisparity));
+    const __m128i roundEstimate = _mm_set1_epi16(1 << (ESTIMATE_SHIFT - 1));
+
+    for(; x + 8 <= width; x += 8) {
+        __m128i disp = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&dispRow[x]));
+        __m128i estimate = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&estimateRow[x]));
+        __m128i weight = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&weightRow[x]));
+
+        __m128i valid = getValidDisparities(disp, maxDispBiased);
+        __m128i scaled = _mm_slli_epi16(disp, ESTIMATE_SHIFT);
+        __m128i diff = _mm_sub_epi16(scaled, estimate);
+        __m128i absDiff = _mm_max_epi16(diff, _mm_sub_epi16(zero, diff));
+        __m128i consistent = _mm_andnot_si128(_mm_cmpeq_epi16(weight, zero),
+            _mm_andnot_si128(_mm_cmpgt_epi16(absDiff, maxDiffVector), valid));
+
+        // (estimate*weight + scaled) / (weight + 1), with the products and the
+        // division computed in 32 bits
+        __m128i weightOne = _mm_unpacklo_epi16(weight, one);
+        __m128i sumLow = _mm_madd_epi16(_mm_unpacklo_epi16(estimate, scaled), weightOne);
+        weightOne = _mm_unpackhi_epi16(weight, one);
+        __m128i sumHigh = _mm_madd_epi16(_mm_unpackhi_epi16(estimate, scaled), weightOne);
+        __m128i divisor = _mm_add_epi16(weight, one);
+        __m128 quotientLow = _mm_div_ps(_mm_cvtepi32_ps(sumLow),
+            _mm_cvtepi32_ps(_mm_unpacklo_epi16(divisor, zero)));
+        __m128 quotientHigh = _mm_div_ps(_mm_cvtepi32_ps(sumHigh),
+            _mm_cvtepi32_ps(_mm_unpackhi_epi16(divisor, zero)));
+        __m128i fused = _mm_packs_epi32(_mm_cvtps_epi32(quotientLow), _mm_cvtps_epi32(quotientHigh));
+
+        // Inconsistent measurements reduce the weight, and only replace
+        // estimates with a weight of at most one
+        __m128i weak = _mm_cmplt_epi16(weight, two);
+        __m128i newEstimate = selectBits(valid,
+            selectBits(consistent, fused, selectBits(weak, scaled, estimate)), estimate);
+        __m128i newWeight = selectBits(valid,
+            selectBits(consistent, _mm_min_epi16(divisor, historyVector),
+                selectBits(weak, one, _mm_sub_epi16(weight, one))),
+            _mm_subs_epu16(weight, one));
+        newEstimate = _mm_andnot_si128(_mm_cmpeq_epi16(newWeight, zero), newEstimate);
+
+        __m128i output = selectBits(_mm_cmplt_epi16(newWeight, minValidVector), invalidVector,
+            _mm_srli_epi16(_mm_add_epi16(newEstimate, roundEstimate), ESTIMATE_SHIFT));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&estimateRow[x]), newEstimate);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&weightRow[x]), newWeight);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&dispRow[x]), output);
+    }
+#endif
+
+    for(; x < width; x++) {
+        int disp = dispRow[x];
+        int estimate = estimateRow[x];
+        int weight = weightRow[x];
+        int scaled = disp << ESTIMATE_SHIFT;
+
+        if(disp > 0 && disp < params.maxDisparity) {
+            if(weight > 0 && std::abs(scaled - estimate) <= params.maxDifference) {
+                float sum = static_cast<float>(estimate*weight + scaled);
+                estimate = static_cast<int>(std::nearbyint(sum / static_cast<float>(weight + 1)));
+                weight = std::min(weight + 1, int(params.historyLength));
+            } else if(weight <= 1) {
+                estimate = scaled;
+                weight = 1;
+            } else {
+                weight--;
+            }
+        } else if(weight > 0) {
+            weight--;
+        }
+        if(weight == 0) {
+            estimate = 0;
+        }
+
+        estimateRow[x] = static_cast<unsigned short>(estimate);
+        weightRow[x] = static_cast<unsigned short>(weight);
+        dispRow[x] = weight < params.minValidFrames ? params.maxDisparity
+            : static_cast<unsigned short>((estimate + (1 << (ESTIMATE_SHIFT - 1))) >> ESTIMATE_SHIFT);
+    }
+}
+
+void TemporalFilter::Pimpl::filterRowMedian(unsigned short* dispRow, unsigned short* const* historyRows,
+        int slot, int width, const RowParameters& params) {
+    int numFrames = params.historyLength;
+    unsigned short* newRow = historyRows[slot];
+    int x = 0;
+
+#if defined(__SSE2__) || defined(__AVX2__)
+    const __m128i maxDispBiased = _mm_set1_epi16(static_cast<short>(params.maxDisparity ^ 0x8000));
+    const __m128i invalidSample = _mm_set1_epi16(INVALID_SAMPLE);
+    const __m128i numFramesVector = _mm_set1_epi16(static_cast<short>(numFrames));
+    const __m128i minValidVector = _mm_set1_epi16(params.minValidFrames);
+    const __m128i invalidVector = _mm_set1_epi16(static_cast<short>(params.maxDisparity));
+    const __m128i one = _mm_set1_epi16(1);
+
+    for(; x + 8 <= width; x += 8) {
+        __m128i disp = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&dispRow[x]));
+        __m128i valid = getValidDisparities(disp, maxDispBiased);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&newRow[x]), selectBits(valid, disp, invalidSample));
+
+        // Sort the samples with an odd-even transposition network. Invalid
+        // samples are larger than all valid ones and end up at the back.
+        __m128i samples[MAX_HISTORY_LENGTH];
+        __m128i numValid = numFramesVector;
+        for(int i = 0; i < numFrames; i++) {
+            samples[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&historyRows[i][x]));
+            numValid = _mm_add_epi16(numValid, _mm_cmpeq_epi16(samples[i], invalidSample));
+        }
+        for(int round = 0; round < numFrames; round++) {
+            for(int i = round & 1; i + 1 < numFrames; i += 2) {
+                __m128i low = _mm_min_epi16(samples[i], samples[i + 1]);
+                samples[i + 1] = _mm_max_epi16(samples[i], samples[i + 1]);
+                samples[i] = low;
+            }
+        }
+
+        // Average of the two central valid samples
+        __m128i lowerIndex = _mm_srai_epi16(_mm_sub_epi16(numValid, one), 1);
+        __m128i upperIndex = _mm_srai_epi16(numValid, 1);
+        __m128i lower = _mm_setzero_si128(), upper = _mm_setzero_si128();
+        for(int i = 0; i < numFrames; i++) {
+            __m128i index = _mm_set1_epi16(static_cast<short>(i));
+            lower = _mm_or_si128(lower, _mm_and_si128(_mm_cmpeq_epi16(lowerIndex, index), samples[i]));
+            upper = _mm_or_si128(upper, _mm_and_si128(_mm_cmpeq_epi16(upperIndex, index), samples[i]));
+        }
+
+        __m128i output = selectBits(_mm_cmplt_epi16(numValid, minValidVector), invalidVector,
+            _mm_avg_epu16(lower, upper));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&dispRow[x]), output);
+    }
+#endif
+
+    for(; x < width; x++) {
+        unsigned short disp = dispRow[x];
+        newRow[x] = (disp > 0 && disp < params.maxDisparity) ? disp : INVALID_SAMPLE;
+
+        // Insertion sort of the valid samples
+        unsigned short samples[MAX_HISTORY_LENGTH];
+        int numValid = 0;
+        for(int i = 0; i < numFrames; i++) {
+            unsigned short sample = historyRows[i][x];
+            if(sample != INVALID_SAMPLE) {
+                int j = numValid++;
+                for(; j > 0 && samples[j - 1] > sample; j--) {
+                    samples[j] = samples[j - 1];
+                }
+                samples[j] = sample;
+            }
+        }
+
+        dispRow[x] = numValid < params.minValidFrames ? params.maxDisparity
+            : static_cast<unsigned short>((samples[(numValid - 1) / 2] + samples[numValid / 2] + 1) / 2);
+    }
+}
+
+} // namespace
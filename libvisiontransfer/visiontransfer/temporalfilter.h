@@ -0,0 +1,191 @@
+/*******************************************************************************
+ * Copyright (c) 2024 Allied Vision Technologies GmbH
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *******************************************************************************/
+
+#ifndef VISIONTRANSFER_TEMPORALFILTER_H
+#define VISIONTRANSFER_TEMPORALFILTER_H
+
+#include "visiontransfer/common.h"
+#include "visiontransfer/imageset.h"
+
+namespace visiontransfer {
+
+/**
+ * \brief Reduces the noise of disparity maps by filtering each pixel over
+ * consecutive frames.
+ *
+ * The filter is meant for static or slowly changing scenes. It is applied
+ * to received image sets before they are passed on for 3D reconstruction:
+ *
+ * \code
+ * ImageSet imageSet;
+ * if(imageTransfer.receiveImageSet(imageSet)) {
+ *     temporalFilter.process(imageSet);
+ *     float* pointMap = reconstruct3D.createPointMap(imageSet, 0);
+ * }
+ * \endcode
+ *
+ * Invalid pixels never contribute to the filtered disparity. A pixel that
+ * becomes invalid keeps its previous estimate for a limited number of
+ * frames, and a pixel whose disparity changes abruptly adopts the new
+ * disparity, such that moving objects do not leave trails. The filter state
+ * is reset automatically if the image size or subpixel factor changes.
+ */
+class VT_EXPORT TemporalFilter {
+public:
+    /**
+     * \brief Available methods for combining the disparity of consecutive frames.
+     */
+    enum FilterMode {
+        /// Exponential moving average with a fixed smoothing factor
+        FILTER_EXPONENTIAL,
+        /// Median of the valid disparities of the last N frames
+        FILTER_MEDIAN,
+        /// Running average that is weighted by the number of consistent observations
+        FILTER_CONFIDENCE
+    };
+
+    /// Maximum number of frames that can be considered by the filter
+    static const int MAX_HISTORY_LENGTH = 15;
+
+    /**
+     * \brief Creates a new temporal filter.
+     *
+     * \param mode Method for combining the disparity of consecutive frames.
+     * \param historyLength Number of frames that are considered for each
+     *        pixel. See setHistoryLength() for details.
+     */
+    TemporalFilter(FilterMode mode = FILTER_EXPONENTIAL, int historyLength = 5);
+
+    ~TemporalFilter();
+
+    /**
+     * \brief Selects the method for combining the disparity of consecutive
+     * frames. Changing the mode resets the filter.
+     */
+    void setMode(FilterMode mode);
+
+    /// Returns the method for combining the disparity of consecutive frames
+    FilterMode getMode() const;
+
+    /**
+     * \brief Sets the number of frames that are considered for each pixel.
+     *
+     * \param historyLength Number of frames between 1 and MAX_HISTORY_LENGTH.
+     *
+     * For FILTER_MEDIAN, this is the number of frames over which the median
+     * is computed. For FILTER_CONFIDENCE, this is the maximum weight of the
+     * current estimate, in number of frames. For both FILTER_EXPONENTIAL and
+     * FILTER_CONFIDENCE, a valid estimate is dropped after the pixel has
+     * been invalid for this number of consecutive frames. Changing the
+     * history length resets the filter.
+     */
+    void setHistoryLength(int historyLength);
+
+    /// Returns the number of frames that are considered for each pixel
+    int getHistoryLength() const;
+
+    /**
+     * \brief Sets the weight of a new frame for FILTER_EXPONENTIAL.
+     *
+     * \param alpha Weight between 0 (exclusive) and 1. Smaller values result
+     *        in stronger smoothing. The default is 0.25.
+     */
+    void setSmoothingFactor(float alpha);
+
+    /// Returns the weight of a new frame for FILTER_EXPONENTIAL
+    float getSmoothingFactor() const;
+
+    /**
+     * \brief Sets the maximum disparity difference between a new measurement
+     * and the current estimate that is still considered consistent.
+     *
+     * \param maxDifference Difference with N-bit subpixel resolution. The
+     *        default is 32, which is two pixels for a subpixel factor of 16.
+     *
+     * For FILTER_EXPONENTIAL, an inconsistent measurement replaces the current
+     * estimate. For FILTER_CONFIDENCE, it reduces the weight of the current
+     * estimate, which is only replaced once its weight drops to zero. The
+     * value has no effect for FILTER_MEDIAN.
+     */
+    void setMaxDifference(unsigned short maxDifference);
+
+    /// Returns the maximum disparity difference for consistent measurements
+    unsigned short getMaxDifference() const;
+
+    /**
+     * \brief Sets the number of valid measurements that are required before a
+     * filtered pixel becomes valid.
+     *
+     * \param minValidFrames Number of frames between 1 and the history length.
+     *
+     * For FILTER_MEDIAN, this is the number of valid disparities among the
+     * last N frames. For the other modes, it is the weight of the current
+     * estimate, which grows by one for each consistent measurement. The
+     * default is 1.
+     */
+    void setMinValidFrames(int minValidFrames);
+
+    /// Returns the number of valid measurements required for a valid pixel
+    int getMinValidFrames() const;
+
+    /**
+     * \brief Sets the number of threads that are used for filtering.
+     *
+     * \param numThreads Number of threads, including the calling thread. A value
+     *        of 0 selects the number of available hardware threads.
+     * \param firstCpu Optional CPU affinity of the internal worker threads.
+     *
+     * See Reconstruct3D::setNumThreads() for details.
+     */
+    void setNumThreads(int numThreads, int firstCpu = -1);
+
+    /// Returns the number of threads that are used for filtering
+    int getNumThreads() const;
+
+    /**
+     * \brief Discards the accumulated state, such that the next frame is
+     * processed as if it was the first one.
+     */
+    void reset();
+
+    /**
+     * \brief Filters the disparity map of the given image set.
+     *
+     * \param imageSet Image set containing the disparity map, which is
+     *        overwritten with the filtered disparity map.
+     * \param maxDisparity The maximum value that occurs in the disparity map.
+     *        Pixels with a greater or equal disparity, as well as pixels with a
+     *        disparity of 0, are invalid. Filtered pixels that are invalid
+     *        receive this value. It may not exceed 0x1000.
+     *
+     * The disparity map is modified in place. For image sets that have been
+     * received through ImageTransfer or AsyncTransfer, this is the receive
+     * buffer of the image set. Use ImageSet::copyTo() first if the unfiltered
+     * disparity map is still needed.
+     */
+    void process(ImageSet& imageSet, unsigned short maxDisparity = 0xFFF);
+
+private:
+    // We follow the pimpl idiom
+    class Pimpl;
+    Pimpl* pimpl;
+
+    // This class cannot be copied
+    TemporalFilter(const TemporalFilter& other);
+    TemporalFilter& operator=(const TemporalFilter&);
+};
+
+} // namespace
+
+#endif
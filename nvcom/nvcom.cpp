@@ -276,17 +276,15 @@ bool NVCom::transmitFrame() {
         long long microSecs = duration_cast<microseconds>(time.time_since_epoch()).count();
         pair.setTimestamp(microSecs / 1000000, microSecs % 1000000);
 
-        // Clone image data such that we can delete the original
-        const int extraBufferSpace = 16;
-        unsigned char* leftPixel = new unsigned char[stereoSendFrame->first.step[0] * stereoSendFrame->first.rows + extraBufferSpace];
-        unsigned char* rightPixel = new unsigned char[stereoSendFrame->second.step[0] * stereoSendFrame->second.rows + extraBufferSpace];
-        memcpy(leftPixel, stereoSendFrame->first.data, stereoSendFrame->first.step[0] * stereoSendFrame->first.rows);
-        memcpy(rightPixel, stereoSendFrame->second.data, stereoSendFrame->second.step[0] * stereoSendFrame->second.rows);
+        pair.setPixelData(0, stereoSendFrame->first.data);
+        pair.setPixelData(1, stereoSendFrame->second.data);
 
-        pair.setPixelData(0, leftPixel);
-        pair.setPixelData(1, rightPixel);
+        // Clone image data such that we can release the original. The
+        // pooled copy is returned once it has been sent.
+        ImageSet pooledPair;
+        sendFramePool.copy(pair, pooledPair);
 
-        asyncTrans->sendImageSetAsync(pair, true);
+        asyncTrans->sendImageSetAsync(pooledPair);
     }
 
     return true;
@@ -26,6 +26,7 @@
 
 #include <visiontransfer/asynctransfer.h>
 #include <visiontransfer/reconstruct3d.h>
+#include <visiontransfer/framepool.h>
 #include "ratelimit.h"
 #include "imagereader.h"
 #include "colorcoder.h"
@@ -123,6 +124,7 @@ private:
     std::unique_ptr<ColorCoder> redBlueCoder;
     std::unique_ptr<ColorCoder> rainbowCoder;
     visiontransfer::Reconstruct3D recon3d;
+    visiontransfer::FramePool sendFramePool;
 
     cv::Size2i lastFrameSize;
     int lastImageCount;